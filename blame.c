@@ -9,6 +9,12 @@
 #include "blame.h"
 #include "alloc.h"
 #include "commit-slab.h"
+#include "bloom.h"
+#include "commit-graph.h"
+#include "oidmap.h"
+#include "list.h"
+#include "lockfile.h"
+#include "dir.h"
 
 define_commit_slab(blame_suspects, struct blame_origin *);
 static struct blame_suspects blame_suspects;
@@ -27,13 +33,15 @@ static void set_blame_suspects(struct commit *commit, struct blame_origin *origi
 	*blame_suspects_at(&blame_suspects, commit) = origin;
 }
 
+static void drop_origin_blob(struct blame_origin *o);
+
 void blame_origin_decref(struct blame_origin *o)
 {
 	if (o && --o->refcnt <= 0) {
 		struct blame_origin *p, *l = NULL;
 		if (o->previous)
 			blame_origin_decref(o->previous);
-		free(o->file.ptr);
+		drop_origin_blob(o);
 		/* Should be present exactly once in commit chain */
 		for (p = get_blame_suspects(o->commit); p; l = p, p = p->next) {
 			if (p == o) {
@@ -1009,22 +1017,119 @@ static void drop_origin_fingerprints(struct blame_origin *o)
  * Given an origin, prepare mmfile_t structure to be used by the
  * diff machinery
  */
-static void fill_origin_blob(struct diff_options *opt,
+struct blame_blob_cache_entry {
+	struct oidmap_entry entry;
+	struct list_head lru;
+	char *buf;
+	unsigned long size;
+};
+
+struct blame_blob_cache {
+	struct oidmap map;
+	/* most recently used first */
+	struct list_head lru;
+	size_t total, limit;
+};
+
+struct blame_blob_cache *blame_blob_cache_new(size_t limit)
+{
+	struct blame_blob_cache *cache = xcalloc(1, sizeof(*cache));
+
+	oidmap_init(&cache->map, 0);
+	INIT_LIST_HEAD(&cache->lru);
+	cache->limit = limit;
+	return cache;
+}
+
+static void blob_cache_evict(struct blame_blob_cache *cache,
+			     struct blame_blob_cache_entry *e)
+{
+	oidmap_remove(&cache->map, &e->entry.oid);
+	list_del(&e->lru);
+	cache->total -= e->size;
+	free(e->buf);
+	free(e);
+}
+
+void blame_blob_cache_free(struct blame_blob_cache *cache)
+{
+	struct list_head *pos, *tmp;
+
+	if (!cache)
+		return;
+	list_for_each_safe(pos, tmp, &cache->lru)
+		blob_cache_evict(cache, list_entry(pos,
+						   struct blame_blob_cache_entry,
+						   lru));
+	oidmap_free(&cache->map, 0);
+	free(cache);
+}
+
+/*
+ * Return a copy of the contents of the blob "oid" if it is cached,
+ * or NULL.
+ */
+static char *blob_cache_get(struct blame_blob_cache *cache,
+			    const struct object_id *oid,
+			    unsigned long *size)
+{
+	struct blame_blob_cache_entry *e = oidmap_get(&cache->map, oid);
+
+	if (!e)
+		return NULL;
+	list_del(&e->lru);
+	list_add(&e->lru, &cache->lru);
+	*size = e->size;
+	return xmemdupz(e->buf, e->size);
+}
+
+static void blob_cache_put(struct blame_blob_cache *cache,
+			   const struct object_id *oid,
+			   const char *buf, unsigned long size)
+{
+	struct blame_blob_cache_entry *e;
+
+	if (size > cache->limit / 4 || oidmap_get(&cache->map, oid))
+		return;
+	while (cache->total + size > cache->limit &&
+	       !list_empty(&cache->lru))
+		blob_cache_evict(cache, list_entry(cache->lru.prev,
+						   struct blame_blob_cache_entry,
+						   lru));
+	e = xcalloc(1, sizeof(*e));
+	oidcpy(&e->entry.oid, oid);
+	e->buf = xmemdupz(buf, size);
+	e->size = size;
+	oidmap_put(&cache->map, e);
+	list_add(&e->lru, &cache->lru);
+	cache->total += size;
+}
+
+static void fill_origin_blob(struct blame_scoreboard *sb,
 			     struct blame_origin *o, mmfile_t *file,
-			     int *num_read_blob, int fill_fingerprints)
+			     int fill_fingerprints)
 {
+	struct diff_options *opt = &sb->revs->diffopt;
+
 	if (!o->file.ptr) {
 		enum object_type type;
 		unsigned long file_size;
 
-		(*num_read_blob)++;
 		if (opt->flags.allow_textconv &&
 		    textconv_object(opt->repo, o->path, o->mode,
 				    &o->blob_oid, 1, &file->ptr, &file_size))
-			;
-		else
+			sb->num_read_blob++;
+		else if (!sb->blob_cache ||
+			 !(file->ptr = blob_cache_get(sb->blob_cache,
+						      &o->blob_oid,
+						      &file_size))) {
+			sb->num_read_blob++;
 			file->ptr = read_object_file(&o->blob_oid, &type,
 						     &file_size);
+			if (file->ptr && sb->blob_cache)
+				blob_cache_put(sb->blob_cache, &o->blob_oid,
+					       file->ptr, file_size);
+		}
 		file->size = file_size;
 
 		if (!file->ptr)
@@ -1243,11 +1348,41 @@ static int fill_blob_sha1_and_mode(struct repository *r,
 	return -1;
 }
 
+/*
+ * Return 0 if the changed-path filter of origin's commit proves that
+ * origin->path is the same as in the commit's first parent, and 1
+ * otherwise.
+ */
+static int maybe_changed_path(struct blame_scoreboard *sb,
+			      struct blame_origin *origin)
+{
+	struct bloom_filter *filter;
+	struct bloom_key key;
+	int result;
+
+	if (!sb->bloom_filter_settings)
+		return 1;
+
+	if (origin->commit->generation == GENERATION_NUMBER_INFINITY)
+		return 1;
+
+	filter = get_bloom_filter(sb->repo, origin->commit, 0);
+	if (!filter)
+		return 1;
+
+	fill_bloom_key(origin->path, strlen(origin->path), &key,
+		       sb->bloom_filter_settings);
+	result = bloom_filter_contains(filter, &key, sb->bloom_filter_settings);
+	clear_bloom_key(&key);
+
+	return !!result;
+}
+
 /*
  * We have an origin -- check if the same path exists in the
  * parent and return an origin structure to represent it.
  */
-static struct blame_origin *find_origin(struct repository *r,
+static struct blame_origin *find_origin(struct blame_scoreboard *sb,
 					struct commit *parent,
 					struct blame_origin *origin)
 {
@@ -1269,7 +1404,7 @@ static struct blame_origin *find_origin(struct repository *r,
 	 * and origin first.  Most of the time they are the
 	 * same and diff-tree is fairly efficient about this.
 	 */
-	repo_diff_setup(r, &diff_opts);
+	repo_diff_setup(sb->repo, &diff_opts);
 	diff_opts.flags.recursive = 1;
 	diff_opts.detect_rename = 0;
 	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
@@ -1283,10 +1418,24 @@ static struct blame_origin *find_origin(struct repository *r,
 
 	if (is_null_oid(&origin->commit->object.oid))
 		do_diff_cache(get_commit_tree_oid(parent), &diff_opts);
-	else
-		diff_tree_oid(get_commit_tree_oid(parent),
-			      get_commit_tree_oid(origin->commit),
-			      "", &diff_opts);
+	else {
+		int compute_diff = 1;
+
+		/*
+		 * The changed-path filter describes the diff against
+		 * the first parent; for it, an unchanged path needs no
+		 * tree diff at all.
+		 */
+		if (origin->commit->parents &&
+		    oideq(&parent->object.oid,
+			  &origin->commit->parents->item->object.oid))
+			compute_diff = maybe_changed_path(sb, origin);
+
+		if (compute_diff)
+			diff_tree_oid(get_commit_tree_oid(parent),
+				      get_commit_tree_oid(origin->commit),
+				      "", &diff_opts);
+	}
 	diffcore_std(&diff_opts);
 
 	if (!diff_queued_diff.nr) {
@@ -1336,7 +1485,7 @@ static struct blame_origin *find_origin(struct repository *r,
  * We have an origin -- find the path that corresponds to it in its
  * parent and return an origin structure to represent it.
  */
-static struct blame_origin *find_rename(struct repository *r,
+static struct blame_origin *find_rename(struct blame_scoreboard *sb,
 					struct commit *parent,
 					struct blame_origin *origin)
 {
@@ -1344,7 +1493,7 @@ static struct blame_origin *find_rename(struct repository *r,
 	struct diff_options diff_opts;
 	int i;
 
-	repo_diff_setup(r, &diff_opts);
+	repo_diff_setup(sb->repo, &diff_opts);
 	diff_opts.flags.recursive = 1;
 	diff_opts.detect_rename = DIFF_DETECT_RENAME;
 	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
@@ -1875,10 +2024,8 @@ static void pass_blame_to_parent(struct blame_scoreboard *sb,
 	d.ignore_diffs = ignore_diffs;
 	d.dstq = &newdest; d.srcq = &target->suspects;
 
-	fill_origin_blob(&sb->revs->diffopt, parent, &file_p,
-			 &sb->num_read_blob, ignore_diffs);
-	fill_origin_blob(&sb->revs->diffopt, target, &file_o,
-			 &sb->num_read_blob, ignore_diffs);
+	fill_origin_blob(sb, parent, &file_p, ignore_diffs);
+	fill_origin_blob(sb, target, &file_o, ignore_diffs);
 	sb->num_get_patch++;
 
 	if (diff_hunks(&file_p, &file_o, blame_chunk_cb, &d, sb->xdl_opts))
@@ -2089,8 +2236,7 @@ static void find_move_in_parent(struct blame_scoreboard *sb,
 	if (!unblamed)
 		return; /* nothing remains for this target */
 
-	fill_origin_blob(&sb->revs->diffopt, parent, &file_p,
-			 &sb->num_read_blob, 0);
+	fill_origin_blob(sb, parent, &file_p, 0);
 	if (!file_p.ptr)
 		return;
 
@@ -2219,8 +2365,7 @@ static void find_copy_in_parent(struct blame_scoreboard *sb,
 			norigin = get_origin(parent, p->one->path);
 			oidcpy(&norigin->blob_oid, &p->one->oid);
 			norigin->mode = p->one->mode;
-			fill_origin_blob(&sb->revs->diffopt, norigin, &file_p,
-					 &sb->num_read_blob, 0);
+			fill_origin_blob(sb, norigin, &file_p, 0);
 			if (!file_p.ptr)
 				continue;
 
@@ -2353,7 +2498,7 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 	 * common cases, then we look for renames in the second pass.
 	 */
 	for (pass = 0; pass < 2 - sb->no_whole_file_rename; pass++) {
-		struct blame_origin *(*find)(struct repository *, struct commit *, struct blame_origin *);
+		struct blame_origin *(*find)(struct blame_scoreboard *, struct commit *, struct blame_origin *);
 		find = pass ? find_rename : find_origin;
 
 		for (i = 0, sg = first_scapegoat(revs, commit, sb->reverse);
@@ -2366,7 +2511,7 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 				continue;
 			if (parse_commit(p))
 				continue;
-			porigin = find(sb->repo, p, origin);
+			porigin = find(sb, p, origin);
 			if (!porigin)
 				continue;
 			if (oideq(&porigin->blob_oid, &origin->blob_oid)) {
@@ -2498,6 +2643,305 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 		free(sg_origin);
 }
 
+/*
+ * The blame cache remembers the final blame of a (commit, path) pair
+ * in "$GIT_DIR/blame-cache/", in a file named after the hash of a key
+ * that also records the settings that affect the result.  The file
+ * starts with the NUL-terminated key, which is followed by one record
+ * per blame entry:
+ *
+ *   <lno> SP <num_lines> SP <s_lno> SP <flags> SP <commit> SP <previous>
+ *   NUL <path> NUL <previous path> NUL
+ *
+ * where <previous> is the commit of the origin the entry was last
+ * diffed against, or "-" if there is none, in which case <previous
+ * path> is empty.
+ *
+ * Files are touched whenever they are used, so that "git gc" can
+ * expire the ones that have not been used for a while.
+ */
+#define BLAME_CACHE_BOUNDARY 01
+
+static void blame_cache_key(struct blame_scoreboard *sb,
+			    struct commit *commit, const char *path,
+			    struct strbuf *key)
+{
+	strbuf_addf(key, "%s %d %d %d %d %d",
+		    oid_to_hex(&commit->object.oid),
+		    sb->xdl_opts, sb->show_root, sb->no_whole_file_rename,
+		    sb->revs->first_parent_only,
+		    sb->revs->diffopt.flags.allow_textconv);
+	strbuf_add(key, path, strlen(path) + 1);
+}
+
+static char *blame_cache_path(struct blame_scoreboard *sb,
+			      const struct strbuf *key)
+{
+	unsigned char hash[GIT_MAX_RAWSZ];
+	git_hash_ctx ctx;
+	const char *hex;
+
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, key->buf, key->len);
+	the_hash_algo->final_fn(hash, &ctx);
+	hex = hash_to_hex(hash);
+	return repo_git_path(sb->repo, "blame-cache/%.2s/%s", hex, hex + 2);
+}
+
+struct blame_cache_record {
+	int lno, num_lines, s_lno;
+	unsigned flags;
+	struct commit *commit;
+	const char *path;
+	struct commit *previous;
+	const char *previous_path;
+};
+
+static struct commit *blame_cache_commit(struct repository *r,
+					 const char *hex)
+{
+	struct object_id oid;
+	struct commit *commit;
+
+	if (get_oid_hex(hex, &oid))
+		return NULL;
+	commit = lookup_commit(r, &oid);
+	if (!commit || parse_commit(commit))
+		return NULL;
+	return commit;
+}
+
+/*
+ * Parse the records of a cache file, which must cover the lines from
+ * 0 up to "*num_lines" without a gap.  Returns -1 if the file is
+ * corrupt or mentions a commit we do not have.
+ */
+static int parse_blame_cache(struct repository *r,
+			     const char *buf, const char *end,
+			     struct blame_cache_record **records_p,
+			     int *nr_p, int *num_lines)
+{
+	struct blame_cache_record *records = NULL;
+	int nr = 0, alloc = 0;
+
+	*num_lines = 0;
+	while (buf < end) {
+		struct blame_cache_record *rec;
+		char commit_hex[GIT_MAX_HEXSZ + 1];
+		char previous_hex[GIT_MAX_HEXSZ + 1];
+		const char *path, *previous_path;
+		int len;
+
+		ALLOC_GROW(records, nr + 1, alloc);
+		rec = &records[nr];
+		if (!memchr(buf, '\0', end - buf) ||
+		    sscanf(buf, "%d %d %d %u %64s %64s%n",
+			   &rec->lno, &rec->num_lines, &rec->s_lno,
+			   &rec->flags, commit_hex, previous_hex, &len) != 6)
+			goto corrupt;
+		path = buf + len + 1;
+		if (buf[len] || path >= end)
+			goto corrupt;
+		previous_path = path + strlen(path) + 1;
+		if (previous_path >= end)
+			goto corrupt;
+		buf = previous_path + strlen(previous_path) + 1;
+		if (buf > end)
+			goto corrupt;
+
+		if (rec->lno != *num_lines || rec->num_lines <= 0 ||
+		    rec->s_lno < 0)
+			goto corrupt;
+		*num_lines += rec->num_lines;
+		rec->path = path;
+		rec->commit = blame_cache_commit(r, commit_hex);
+		if (!rec->commit)
+			goto corrupt;
+		if (strcmp(previous_hex, "-")) {
+			rec->previous = blame_cache_commit(r, previous_hex);
+			rec->previous_path = previous_path;
+			if (!rec->previous)
+				goto corrupt;
+		} else {
+			rec->previous = NULL;
+			rec->previous_path = NULL;
+		}
+		nr++;
+	}
+	*records_p = records;
+	*nr_p = nr;
+	return 0;
+
+corrupt:
+	free(records);
+	return -1;
+}
+
+/*
+ * If the final blame of "origin" is cached, hand the blame for all of
+ * its suspects to the origins recorded in the cache and return 1.
+ */
+static int blame_from_cache(struct blame_scoreboard *sb,
+			    struct blame_origin *origin)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	struct blame_cache_record *records = NULL;
+	struct blame_entry *e, *next;
+	char *path;
+	int nr, num_lines, i, ret = 0;
+
+	blame_cache_key(sb, origin->commit, origin->path, &key);
+	path = blame_cache_path(sb, &key);
+	if (strbuf_read_file(&buf, path, 0) < 0 ||
+	    buf.len < key.len || memcmp(buf.buf, key.buf, key.len) ||
+	    parse_blame_cache(sb->repo, buf.buf + key.len, buf.buf + buf.len,
+			      &records, &nr, &num_lines))
+		goto out;
+
+	for (e = origin->suspects; e; e = e->next)
+		if (e->s_lno + e->num_lines > num_lines)
+			goto out;
+	utime(path, NULL);
+
+	for (e = origin->suspects; e; e = next) {
+		int start = e->s_lno, end = e->s_lno + e->num_lines;
+
+		next = e->next;
+		for (i = 0; i < nr && records[i].lno < end; i++) {
+			struct blame_cache_record *rec = &records[i];
+			int from = rec->lno, to = rec->lno + rec->num_lines;
+			struct blame_entry *n;
+
+			if (to <= start)
+				continue;
+			if (from < start)
+				from = start;
+			if (end < to)
+				to = end;
+
+			n = xcalloc(1, sizeof(*n));
+			n->lno = e->lno + from - e->s_lno;
+			n->num_lines = to - from;
+			n->s_lno = rec->s_lno + from - rec->lno;
+			n->suspect = get_origin(rec->commit, rec->path);
+			n->suspect->guilty = 1;
+			if (rec->previous && !n->suspect->previous)
+				n->suspect->previous =
+					get_origin(rec->previous,
+						   rec->previous_path);
+			if (rec->flags & BLAME_CACHE_BOUNDARY)
+				rec->commit->object.flags |= UNINTERESTING;
+
+			if (sb->found_guilty_entry)
+				sb->found_guilty_entry(n, sb->found_guilty_entry_data);
+			n->next = sb->ent;
+			sb->ent = n;
+		}
+		blame_origin_decref(e->suspect);
+		free(e);
+	}
+	origin->suspects = NULL;
+	ret = 1;
+
+out:
+	free(records);
+	free(path);
+	strbuf_release(&buf);
+	strbuf_release(&key);
+	return ret;
+}
+
+void blame_cache_write(struct blame_scoreboard *sb)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf key = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	struct blame_entry *ent;
+	char *path;
+
+	if (is_null_oid(&sb->final->object.oid))
+		return;
+
+	blame_cache_key(sb, sb->final, sb->path, &key);
+	path = blame_cache_path(sb, &key);
+
+	strbuf_addbuf(&buf, &key);
+	for (ent = sb->ent; ent; ent = ent->next) {
+		struct blame_origin *suspect = ent->suspect;
+		struct blame_origin *previous = suspect->previous;
+
+		strbuf_addf(&buf, "%d %d %d %u %s ",
+			    ent->lno, ent->num_lines, ent->s_lno,
+			    (suspect->commit->object.flags & UNINTERESTING) ?
+			    BLAME_CACHE_BOUNDARY : 0,
+			    oid_to_hex(&suspect->commit->object.oid));
+		strbuf_addstr(&buf, previous ?
+			      oid_to_hex(&previous->commit->object.oid) : "-");
+		strbuf_addch(&buf, '\0');
+		strbuf_addstr(&buf, suspect->path);
+		strbuf_addch(&buf, '\0');
+		if (previous)
+			strbuf_addstr(&buf, previous->path);
+		strbuf_addch(&buf, '\0');
+	}
+
+	if (safe_create_leading_directories(path) >= 0 &&
+	    hold_lock_file_for_update(&lock, path, 0) >= 0) {
+		if (write_in_full(get_lock_file_fd(&lock), buf.buf, buf.len) < 0 ||
+		    commit_lock_file(&lock))
+			rollback_lock_file(&lock);
+	}
+
+	free(path);
+	strbuf_release(&buf);
+	strbuf_release(&key);
+}
+
+void blame_cache_prune(struct repository *r, timestamp_t expire)
+{
+	struct strbuf path = STRBUF_INIT;
+	size_t baselen, dirlen;
+	DIR *dir, *subdir;
+	struct dirent *de, *sub;
+
+	strbuf_repo_git_path(&path, r, "blame-cache");
+	dir = opendir(path.buf);
+	if (!dir)
+		goto out;
+	strbuf_addch(&path, '/');
+	baselen = path.len;
+	while ((de = readdir(dir))) {
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		strbuf_setlen(&path, baselen);
+		strbuf_addstr(&path, de->d_name);
+		subdir = opendir(path.buf);
+		if (!subdir)
+			continue;
+		strbuf_addch(&path, '/');
+		dirlen = path.len;
+		while ((sub = readdir(subdir))) {
+			struct stat st;
+
+			if (is_dot_or_dotdot(sub->d_name))
+				continue;
+			strbuf_setlen(&path, dirlen);
+			strbuf_addstr(&path, sub->d_name);
+			if (!lstat(path.buf, &st) && st.st_mtime <= expire)
+				unlink_or_warn(path.buf);
+		}
+		closedir(subdir);
+		strbuf_setlen(&path, dirlen);
+		rmdir(path.buf);
+	}
+	closedir(dir);
+	strbuf_setlen(&path, baselen);
+	rmdir(path.buf);
+out:
+	strbuf_release(&path);
+}
+
 /*
  * The main loop -- while we have blobs with lines whose true origin
  * is still unknown, pick one blob, and allow its lines to pass blames
@@ -2530,9 +2974,12 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		parse_commit(commit);
 		if (sb->reverse ||
 		    (!(commit->object.flags & UNINTERESTING) &&
-		     !(revs->max_age != -1 && commit->date < revs->max_age)))
-			pass_blame(sb, suspect, opt);
-		else {
+		     !(revs->max_age != -1 && commit->date < revs->max_age))) {
+			if (!sb->use_cache ||
+			    is_null_oid(&commit->object.oid) ||
+			    !blame_from_cache(sb, suspect))
+				pass_blame(sb, suspect, opt);
+		} else {
 			commit->object.flags |= UNINTERESTING;
 			if (commit->object.parsed)
 				mark_parents_uninteresting(commit);
@@ -2675,6 +3122,27 @@ static struct commit *find_single_initial(struct rev_info *revs,
 	return found;
 }
 
+static void read_final_blob(struct blame_scoreboard *sb,
+			    struct blame_origin *o)
+{
+	enum object_type type;
+
+	if (sb->revs->diffopt.flags.allow_textconv &&
+	    textconv_object(sb->repo, o->path, o->mode, &o->blob_oid, 1,
+			    (char **) &sb->final_buf, &sb->final_buf_size))
+		;
+	else
+		sb->final_buf = read_object_file(&o->blob_oid, &type,
+						 &sb->final_buf_size);
+
+	if (!sb->final_buf)
+		die(_("cannot read blob %s for path %s"),
+		    oid_to_hex(&o->blob_oid),
+		    o->path);
+	sb->num_read_blob++;
+	prepare_lines(sb);
+}
+
 void init_scoreboard(struct blame_scoreboard *sb)
 {
 	memset(sb, 0, sizeof(struct blame_scoreboard));
@@ -2689,7 +3157,6 @@ void setup_scoreboard(struct blame_scoreboard *sb,
 	const char *final_commit_name = NULL;
 	struct blame_origin *o;
 	struct commit *final_commit = NULL;
-	enum object_type type;
 
 	init_blame_suspects(&blame_suspects);
 
@@ -2763,36 +3230,85 @@ void setup_scoreboard(struct blame_scoreboard *sb,
 		o = get_blame_suspects(sb->final);
 		sb->final_buf = xmemdupz(o->file.ptr, o->file.size);
 		sb->final_buf_size = o->file.size;
-	}
-	else {
+		sb->num_read_blob++;
+		prepare_lines(sb);
+	} else {
 		o = get_origin(sb->final, path);
 		if (fill_blob_sha1_and_mode(sb->repo, o))
 			die(_("no such path %s in %s"), path, final_commit_name);
+		read_final_blob(sb, o);
+	}
 
-		if (sb->revs->diffopt.flags.allow_textconv &&
-		    textconv_object(sb->repo, path, o->mode, &o->blob_oid, 1, (char **) &sb->final_buf,
-				    &sb->final_buf_size))
-			;
-		else
-			sb->final_buf = read_object_file(&o->blob_oid, &type,
-							 &sb->final_buf_size);
+	if (orig)
+		*orig = o;
 
-		if (!sb->final_buf)
-			die(_("cannot read blob %s for path %s"),
-			    oid_to_hex(&o->blob_oid),
-			    path);
+	free((char *)final_commit_name);
+}
+
+void setup_scoreboard_walk(struct blame_scoreboard *sb)
+{
+	init_blame_suspects(&blame_suspects);
+
+	if (!sb->repo)
+		BUG("repo is NULL");
+	if (sb->reverse || sb->contents_from)
+		BUG("cannot blame paths one by one with reverse or contents");
+
+	sb->final = find_single_final(sb->revs, NULL);
+	if (!sb->final)
+		die(_("no commit to blame from"));
+	sb->commits.compare = compare_commits_by_commit_date;
+
+	if (prepare_revision_walk(sb->revs))
+		die(_("revision walk setup failed"));
+}
+
+int setup_scoreboard_path(struct blame_scoreboard *sb,
+			  const char *path,
+			  struct blame_origin **orig)
+{
+	struct blame_origin *o = get_origin(sb->final, path);
+
+	if (fill_blob_sha1_and_mode(sb->repo, o)) {
+		blame_origin_decref(o);
+		return -1;
 	}
-	sb->num_read_blob++;
-	prepare_lines(sb);
+	read_final_blob(sb, o);
+	sb->path = path;
 
 	if (orig)
 		*orig = o;
+	else
+		blame_origin_decref(o);
+	return 0;
+}
 
-	free((char *)final_commit_name);
+void release_scoreboard_path(struct blame_scoreboard *sb)
+{
+	struct blame_entry *ent = sb->ent;
+
+	while (ent) {
+		struct blame_entry *next = ent->next;
+		blame_origin_decref(ent->suspect);
+		free(ent);
+		ent = next;
+	}
+	sb->ent = NULL;
+	free((char *)sb->final_buf);
+	sb->final_buf = NULL;
+	sb->final_buf_size = 0;
+	FREE_AND_NULL(sb->lineno);
+	sb->num_lines = 0;
+	sb->path = NULL;
 }
 
 
 
+void setup_blame_bloom_data(struct blame_scoreboard *sb)
+{
+	sb->bloom_filter_settings = get_bloom_filter_settings(sb->repo);
+}
+
 struct blame_entry *blame_entry_prepend(struct blame_entry *head,
 					long start, long end,
 					struct blame_origin *o)
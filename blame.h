@@ -8,6 +8,9 @@
 #include "prio-queue.h"
 #include "diff.h"
 
+struct bloom_filter_settings;
+struct blame_blob_cache;
+
 #define PICKAXE_BLAME_MOVE		01
 #define PICKAXE_BLAME_COPY		02
 #define PICKAXE_BLAME_COPY_HARDER	04
@@ -154,6 +157,28 @@ struct blame_scoreboard {
 	void(*found_guilty_entry)(struct blame_entry *, void *);
 
 	void *found_guilty_entry_data;
+
+	/*
+	 * Settings of the changed-path Bloom filters to consult before
+	 * diffing a commit against its first parent, or NULL.
+	 */
+	struct bloom_filter_settings *bloom_filter_settings;
+
+	/*
+	 * If set, the contents of the blobs read while assigning blame
+	 * are kept here, so that blaming the next path from the same
+	 * final commit does not need to read them again.
+	 */
+	struct blame_blob_cache *blob_cache;
+
+	/*
+	 * If set, assign_blame() stops digging at any suspect whose
+	 * final blame has been saved by blame_cache_write() and takes
+	 * the blame from there.  The caller must make sure the walk is
+	 * not limited in any way the cache does not know about, like
+	 * bottom commits, --since, -M, -C or ignored revisions.
+	 */
+	int use_cache;
 };
 
 /*
@@ -172,6 +197,16 @@ void blame_coalesce(struct blame_scoreboard *sb);
 void blame_sort_final(struct blame_scoreboard *sb);
 unsigned blame_entry_score(struct blame_scoreboard *sb, struct blame_entry *e);
 void assign_blame(struct blame_scoreboard *sb, int opt);
+
+/*
+ * Save the blame assigned to all the lines of the final commit for use
+ * by later runs with "use_cache".  The entries must be sorted by
+ * blame_sort_final().
+ */
+void blame_cache_write(struct blame_scoreboard *sb);
+
+/* Remove the cached blames that were last used before "expire". */
+void blame_cache_prune(struct repository *r, timestamp_t expire);
 const char *blame_nth_line(struct blame_scoreboard *sb, long lno);
 
 void init_scoreboard(struct blame_scoreboard *sb);
@@ -179,6 +214,37 @@ void setup_scoreboard(struct blame_scoreboard *sb,
 		      const char *path,
 		      struct blame_origin **orig);
 
+/*
+ * Blame many paths of the same final commit one after another,
+ * sharing the revision walk and the parsed commits and trees:
+ * setup_scoreboard_walk() is called once instead of
+ * setup_scoreboard(), and each path is started with
+ * setup_scoreboard_path(), which returns -1 if the final commit has
+ * no such blob.  Once its blame has been assigned and shown, the
+ * entries and contents of the path are freed with
+ * release_scoreboard_path().  This does not support "reverse" or
+ * "contents_from".
+ */
+void setup_scoreboard_walk(struct blame_scoreboard *sb);
+int setup_scoreboard_path(struct blame_scoreboard *sb,
+			  const char *path,
+			  struct blame_origin **orig);
+void release_scoreboard_path(struct blame_scoreboard *sb);
+
+/*
+ * A cache of blob contents for blame_scoreboard.blob_cache that
+ * evicts the least recently used blobs once they take up more than
+ * "limit" bytes.
+ */
+struct blame_blob_cache *blame_blob_cache_new(size_t limit);
+void blame_blob_cache_free(struct blame_blob_cache *cache);
+
+/*
+ * Let the blame walk use changed-path Bloom filters from the
+ * commit-graph, if there are any.
+ */
+void setup_blame_bloom_data(struct blame_scoreboard *sb);
+
 struct blame_entry *blame_entry_prepend(struct blame_entry *head,
 					long start, long end,
 					struct blame_origin *o);
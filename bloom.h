@@ -0,0 +1,123 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+struct commit;
+struct repository;
+
+/*
+ * Changed-path Bloom filters record, for each commit, the set of paths
+ * (and their leading directories) that differ between the commit and
+ * its first parent. A query against the filter answers either
+ * "definitely not changed" or "maybe changed", which lets history walks
+ * limited by a pathspec skip the tree diff for most commits.
+ */
+
+struct bloom_filter_settings {
+	/*
+	 * The version of the hashing technique being used.
+	 * We currently only support version = 1 which is
+	 * the seeded murmur3 hashing technique implemented
+	 * in bloom.c.
+	 */
+	uint32_t hash_version;
+
+	/*
+	 * The number of times a path is hashed, i.e. the
+	 * number of bit positions that cumulatively
+	 * determine whether a path is present in the
+	 * Bloom filter.
+	 */
+	uint32_t num_hashes;
+
+	/*
+	 * The minimum number of bits per entry in the Bloom
+	 * filter. If the filter contains 'n' entries, then
+	 * filter size is the minimum number of 8-bit words
+	 * that contain n*b bits.
+	 */
+	uint32_t bits_per_entry;
+};
+
+#define DEFAULT_BLOOM_FILTER_SETTINGS { 1, 7, 10 }
+#define BITS_PER_WORD 8
+#define BLOOMDATA_CHUNK_HEADER_SIZE (3 * sizeof(uint32_t))
+
+/*
+ * A commit whose diff against its first parent touches more than this
+ * many paths gets a filter that claims every path "maybe changed"
+ * rather than a (large) filter of its own.
+ */
+#define BLOOM_FILTER_MAX_CHANGED_PATHS 512
+
+/*
+ * A bloom_filter struct represents a data segment to
+ * use when testing hash values. The 'len' member
+ * dictates how many entries are stored in 'data'.
+ *
+ * 'data' either points into a commit-graph file or at memory owned by
+ * the filter, in which case 'to_free' is set to the same allocation.
+ */
+struct bloom_filter {
+	unsigned char *data;
+	size_t len;
+	void *to_free;
+};
+
+/*
+ * A bloom_key represents the k hash values for a
+ * given string. These can be precomputed and
+ * stored in a bloom_key for re-use when testing
+ * against a bloom_filter. The number of hashes is
+ * given by the Bloom filter settings and is the same
+ * for all Bloom filters and keys interacting with
+ * the loaded version of the commit graph file and
+ * the Bloom data chunks.
+ */
+struct bloom_key {
+	uint32_t *hashes;
+};
+
+/*
+ * Calculate the murmur3 32-bit hash value for the given data
+ * using the given seed.
+ * Produces a uniformly distributed hash value.
+ * Not considered to be cryptographically secure.
+ * Implemented as described in https://en.wikipedia.org/wiki/MurmurHash#Algorithm
+ */
+uint32_t murmur3_seeded(uint32_t seed, const char *data, size_t len);
+
+void fill_bloom_key(const char *data,
+		    size_t len,
+		    struct bloom_key *key,
+		    const struct bloom_filter_settings *settings);
+void clear_bloom_key(struct bloom_key *key);
+
+void add_key_to_filter(const struct bloom_key *key,
+		       struct bloom_filter *filter,
+		       const struct bloom_filter_settings *settings);
+
+/*
+ * Forget all filters loaded or computed so far. This must be called
+ * before the commit-graph the filters were loaded from is closed.
+ */
+void deinit_bloom_filters(void);
+
+/*
+ * Return the changed-path Bloom filter of 'c', loading it from the
+ * commit-graph if possible. If the commit-graph does not have a filter
+ * for 'c', compute one when 'compute_if_not_present' is set, and
+ * return NULL otherwise.
+ */
+struct bloom_filter *get_bloom_filter(struct repository *r,
+				      struct commit *c,
+				      int compute_if_not_present);
+
+/*
+ * Return 1 if the key may be in the filter and 0 if it definitely is
+ * not. An empty filter, which carries no information, yields -1.
+ */
+int bloom_filter_contains(const struct bloom_filter *filter,
+			  const struct bloom_key *key,
+			  const struct bloom_filter_settings *settings);
+
+#endif
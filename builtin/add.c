@@ -20,6 +20,7 @@
 #include "bulk-checkin.h"
 #include "argv-array.h"
 #include "submodule.h"
+#include "sparse-index.h"
 
 static const char * const builtin_add_usage[] = {
 	N_("git add [<options>] [--] <pathspec>..."),
@@ -38,6 +39,7 @@ static void chmod_pathspec(struct pathspec *pathspec, char flip)
 {
 	int i;
 
+	ensure_full_index(&the_index);
 	for (i = 0; i < active_nr; i++) {
 		struct cache_entry *ce = active_cache[i];
 
@@ -129,6 +131,7 @@ static int renormalize_tracked_files(const struct pathspec *pathspec, int flags)
 {
 	int i, retval = 0;
 
+	ensure_full_index(&the_index);
 	for (i = 0; i < active_nr; i++) {
 		struct cache_entry *ce = active_cache[i];
 
@@ -397,6 +400,7 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 	struct lock_file lock_file = LOCK_INIT;
 
 	git_config(add_config, NULL);
+	command_requires_full_index = 0;
 
 	argc = parse_options(argc, argv, prefix, builtin_add_options,
 			  builtin_add_usage, PARSE_OPT_KEEP_ARGV0);
@@ -503,6 +507,12 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 			const char *path = pathspec.items[i].match;
 			if (pathspec.items[i].magic & PATHSPEC_EXCLUDE)
 				continue;
+			/* the path may be hidden in a sparse directory */
+			if (!seen[i] && path[0] && the_index.sparse_index) {
+				ensure_full_index(&the_index);
+				add_pathspec_matches_against_index(&pathspec,
+								   &the_index, seen);
+			}
 			if (!seen[i] && path[0] &&
 			    ((pathspec.items[i].magic &
 			      (PATHSPEC_GLOB | PATHSPEC_ICASE)) ||
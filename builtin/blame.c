@@ -47,6 +47,7 @@ static int show_root;
 static int reverse;
 static int blank_boundary;
 static int incremental;
+static int batch_mode;
 static int xdl_opts;
 static int abbrev = -1;
 static int no_whole_file_rename;
@@ -56,6 +57,7 @@ static int coloring_mode;
 static struct string_list ignore_revs_file_list = STRING_LIST_INIT_NODUP;
 static int mark_unblamable_lines;
 static int mark_ignored_lines;
+static int use_blame_cache;
 
 static struct date_mode blame_date_mode = { DATE_ISO8601 };
 static size_t blame_date_width;
@@ -69,6 +71,9 @@ static struct string_list mailmap = STRING_LIST_INIT_NODUP;
 static unsigned blame_move_score;
 static unsigned blame_copy_score;
 
+/* How many bytes of blob contents "--batch" keeps around */
+#define BLAME_BATCH_BLOB_CACHE_SIZE (64 * 1024 * 1024)
+
 /* Remember to update object flag allocation in object.h */
 #define METAINFO_SHOWN		(1u<<12)
 #define MORE_THAN_ONE_PATH	(1u<<13)
@@ -725,6 +730,10 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 		mark_ignored_lines = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "blame.cache")) {
+		use_blame_cache = git_config_bool(var, value);
+		return 0;
+	}
 	if (!strcmp(var, "color.blame.repeatedlines")) {
 		if (color_parse_mem(value, strlen(value), repeated_meta_color))
 			warning(_("invalid color '%s' in color.blame.repeatedLines"),
@@ -825,6 +834,97 @@ static void build_ignorelist(struct blame_scoreboard *sb,
 	}
 }
 
+/*
+ * The blame cache only knows about complete walks, so it cannot be
+ * used when the walk stops early or skips some commits.
+ */
+static int blame_cache_usable(struct blame_scoreboard *sb, int opt,
+			      const char *revs_file)
+{
+	struct oidset_iter iter;
+	int i;
+
+	if (!use_blame_cache || sb->reverse || revs_file ||
+	    sb->revs->max_age != -1 ||
+	    (opt & (PICKAXE_BLAME_MOVE | PICKAXE_BLAME_COPY)) ||
+	    oidset_iter_first(&sb->ignore_list, &iter))
+		return 0;
+	for (i = 0; i < sb->revs->pending.nr; i++)
+		if (sb->revs->pending.objects[i].item->flags & UNINTERESTING)
+			return 0;
+	return 1;
+}
+
+static void clear_output_flags(struct blame_scoreboard *sb)
+{
+	struct blame_entry *ent;
+
+	for (ent = sb->ent; ent; ent = ent->next)
+		ent->suspect->commit->object.flags &=
+			~(METAINFO_SHOWN | MORE_THAN_ONE_PATH);
+}
+
+/*
+ * Blame the paths read from the standard input one after another,
+ * all from the same final commit, so that the commits, trees and
+ * blobs they share are only read once.
+ */
+static void blame_batch(struct blame_scoreboard *sb, const char *prefix,
+			int opt, int output_option)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct strbuf unquoted = STRBUF_INIT;
+
+	setup_scoreboard_walk(sb);
+	if (!(opt & PICKAXE_BLAME_COPY))
+		setup_blame_bloom_data(sb);
+	sb->blob_cache = blame_blob_cache_new(BLAME_BATCH_BLOB_CACHE_SIZE);
+
+	while (strbuf_getline(&buf, stdin) != EOF) {
+		struct blame_origin *o;
+		const char *path = buf.buf;
+
+		if (buf.buf[0] == '"') {
+			strbuf_reset(&unquoted);
+			if (unquote_c_style(&unquoted, buf.buf, NULL))
+				die(_("line is badly quoted: %s"), buf.buf);
+			path = unquoted.buf;
+		}
+		path = add_prefix(prefix, path);
+
+		if (setup_scoreboard_path(sb, path, &o) < 0) {
+			printf("%s missing\n", buf.buf);
+		} else {
+			if (sb->num_lines)
+				o->suspects = blame_entry_prepend(NULL, 0,
+								  sb->num_lines,
+								  o);
+			prio_queue_put(&sb->commits, o->commit);
+			blame_origin_decref(o);
+
+			assign_blame(sb, opt);
+			blame_sort_final(sb);
+			if (sb->use_cache)
+				blame_cache_write(sb);
+			blame_coalesce(sb);
+			output(sb, output_option);
+
+			clear_output_flags(sb);
+			release_scoreboard_path(sb);
+		}
+		free((char *)path);
+
+		/* an empty line ends the output for each path */
+		putchar('\n');
+		fflush(stdout);
+	}
+
+	blame_blob_cache_free(sb->blob_cache);
+	sb->blob_cache = NULL;
+	strbuf_release(&unquoted);
+	strbuf_release(&buf);
+}
+
 int cmd_blame(int argc, const char **argv, const char *prefix)
 {
 	struct rev_info revs;
@@ -843,6 +943,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	const char *contents_from = NULL;
 	const struct option options[] = {
 		OPT_BOOL(0, "incremental", &incremental, N_("Show blame entries as we find them, incrementally")),
+		OPT_BOOL(0, "batch", &batch_mode, N_("Blame the paths read from the standard input in porcelain format")),
 		OPT_BOOL('b', NULL, &blank_boundary, N_("Show blank SHA-1 for boundary commits (Default: off)")),
 		OPT_BOOL(0, "root", &show_root, N_("Do not treat root commits as boundaries (Default: off)")),
 		OPT_BOOL(0, "show-stats", &show_stats, N_("Show work cost statistics")),
@@ -924,6 +1025,12 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	revs.diffopt.flags.follow_renames = 0;
 	argc = parse_options_end(&ctx);
 
+	if (batch_mode) {
+		if (incremental || reverse || contents_from || range_list.nr)
+			die(_("--batch cannot be used with --incremental, --reverse, --contents or -L"));
+		output_option |= OUTPUT_PORCELAIN;
+	}
+
 	if (incremental || (output_option & OUTPUT_PORCELAIN)) {
 		if (show_progress > 0)
 			die(_("--progress can't be used with --incremental or porcelain formats"));
@@ -1013,8 +1120,14 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	 *
 	 * Note that we must strip out <path> from the arguments: we do not
 	 * want the path pruning but we may want "bottom" processing.
+	 *
+	 * With --batch, the paths come from the standard input instead.
 	 */
-	if (dashdash_pos) {
+	if (batch_mode) {
+		if (dashdash_pos && dashdash_pos != argc - 1)
+			usage_with_options(blame_opt_usage, options);
+		path = NULL;
+	} else if (dashdash_pos) {
 		switch (argc - dashdash_pos - 1) {
 		case 2: /* (1b) */
 			if (argc != 4)
@@ -1047,7 +1160,9 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 
 	revs.disable_stdin = 1;
 	setup_revisions(argc, argv, &revs, NULL);
-	if (!revs.pending.nr && is_bare_repository()) {
+	if (batch_mode && revs.prune_data.nr)
+		die(_("--batch reads the paths to blame from the standard input"));
+	if (!revs.pending.nr && (batch_mode || is_bare_repository())) {
 		struct commit *head_commit;
 		struct object_id head_oid;
 
@@ -1068,9 +1183,41 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	build_ignorelist(&sb, &ignore_revs_file_list, &ignore_rev_list);
 	string_list_clear(&ignore_revs_file_list, 0);
 	string_list_clear(&ignore_rev_list, 0);
+
+	if (blame_move_score)
+		sb.move_score = blame_move_score;
+	if (blame_copy_score)
+		sb.copy_score = blame_copy_score;
+
+	sb.debug = DEBUG_BLAME;
+	sb.on_sanity_fail = &sanity_check_on_fail;
+
+	sb.show_root = show_root;
+	sb.xdl_opts = xdl_opts;
+	sb.no_whole_file_rename = no_whole_file_rename;
+
+	read_mailmap(&mailmap, NULL);
+
+	sb.use_cache = blame_cache_usable(&sb, opt, revs_file);
+
+	if (batch_mode) {
+		blame_batch(&sb, prefix, opt, output_option);
+		goto show_stats;
+	}
+
 	setup_scoreboard(&sb, path, &o);
 	lno = sb.num_lines;
 
+	/*
+	 * Changed-path filters only know about the path being blamed,
+	 * but looking for copies needs to inspect other paths, too.
+	 */
+	if (!(opt & PICKAXE_BLAME_COPY))
+		setup_blame_bloom_data(&sb);
+
+	/* only the blame of the whole file can be cached */
+	if (range_list.nr)
+		sb.use_cache = 0;
 	if (lno && !range_list.nr)
 		string_list_append(&range_list, "1");
 
@@ -1113,20 +1260,6 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	sb.ent = NULL;
 	sb.path = path;
 
-	if (blame_move_score)
-		sb.move_score = blame_move_score;
-	if (blame_copy_score)
-		sb.copy_score = blame_copy_score;
-
-	sb.debug = DEBUG_BLAME;
-	sb.on_sanity_fail = &sanity_check_on_fail;
-
-	sb.show_root = show_root;
-	sb.xdl_opts = xdl_opts;
-	sb.no_whole_file_rename = no_whole_file_rename;
-
-	read_mailmap(&mailmap, NULL);
-
 	sb.found_guilty_entry = &found_guilty_entry;
 	sb.found_guilty_entry_data = &pi;
 	if (show_progress)
@@ -1136,6 +1269,11 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 
 	stop_progress(&pi.progress);
 
+	if (sb.use_cache) {
+		blame_sort_final(&sb);
+		blame_cache_write(&sb);
+	}
+
 	if (!incremental)
 		setup_pager();
 	else
@@ -1167,6 +1305,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 		ent = e;
 	}
 
+show_stats:
 	if (show_stats) {
 		printf("num read blob: %d\n", sb.num_read_blob);
 		printf("num get patch: %d\n", sb.num_get_patch);
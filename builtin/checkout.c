@@ -18,6 +18,7 @@
 #include "remote.h"
 #include "resolve-undo.h"
 #include "revision.h"
+#include "sparse-index.h"
 #include "run-command.h"
 #include "submodule.h"
 #include "submodule-config.h"
@@ -467,6 +468,9 @@ static int checkout_paths(const struct checkout_opts *opts,
 	if (read_cache_preload(&opts->pathspec) < 0)
 		return error(_("index file corrupt"));
 
+	/* the paths to check out may be within sparse directories */
+	ensure_full_index(&the_index);
+
 	if (opts->source_tree)
 		read_tree_some(opts->source_tree, &opts->pathspec);
 
@@ -1502,6 +1506,7 @@ static int checkout_main(int argc, const char **argv, const char *prefix,
 	opts->show_progress = -1;
 
 	git_config(git_checkout_config, opts);
+	command_requires_full_index = 0;
 
 	opts->track = BRANCH_TRACK_UNSPECIFIED;
 
@@ -0,0 +1,503 @@
+#include "builtin.h"
+#include "config.h"
+#include "fsmonitor.h"
+#include "parse-options.h"
+#include "run-command.h"
+#include "sigchain.h"
+#include "string-list.h"
+#include "tempfile.h"
+#include "unix-socket.h"
+
+static const char * const builtin_fsmonitor__daemon_usage[] = {
+	N_("git fsmonitor--daemon run [--detach]"),
+	N_("git fsmonitor--daemon start"),
+	N_("git fsmonitor--daemon stop"),
+	N_("git fsmonitor--daemon status"),
+	NULL
+};
+
+#ifdef HAVE_FSMONITOR_DAEMON
+#include <sys/inotify.h>
+
+/*
+ * The daemon watches every directory of the worktree (but $GIT_DIR) with
+ * inotify, and records the path of each change in its journal with an
+ * increasing sequence number. A token handed out to a client names this
+ * instance of the daemon and the current sequence number; when the
+ * client sends it back, it gets every path recorded after it.
+ */
+#define TOKEN_INSTANCE_MASK 0x7fffffff
+#define JOURNAL_MAX (1 << 20)
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | \
+		    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | \
+		    IN_MOVE_SELF | IN_EXCL_UNLINK | IN_ONLYDIR)
+
+struct journal_entry {
+	uint32_t seq;
+	char *path;
+};
+
+static struct fsmonitor_daemon_state {
+	int inotify_fd;
+
+	/* the absolute path of the worktree, with a trailing slash */
+	struct strbuf worktree;
+
+	/* the worktree-relative directory of each watch descriptor */
+	char **watch_dirs;
+	int watch_alloc;
+
+	uint32_t instance;
+	uint32_t seq;
+	/* tokens older than this one cannot be answered from the journal */
+	uint32_t oldest_seq;
+
+	struct journal_entry *journal;
+	size_t journal_nr, journal_alloc;
+} state = { -1, STRBUF_INIT };
+
+static void clear_journal(void)
+{
+	size_t i;
+
+	for (i = 0; i < state.journal_nr; i++)
+		free(state.journal[i].path);
+	state.journal_nr = 0;
+	state.oldest_seq = state.seq;
+}
+
+static void record_path(const char *path)
+{
+	if (state.journal_nr >= JOURNAL_MAX)
+		clear_journal();
+	if (!++state.seq) {
+		/* the sequence numbers wrapped: start a new journal */
+		state.instance = (state.instance + 1) & TOKEN_INSTANCE_MASK;
+		state.seq = 1;
+		clear_journal();
+		state.oldest_seq = 0;
+	}
+
+	ALLOC_GROW(state.journal, state.journal_nr + 1, state.journal_alloc);
+	state.journal[state.journal_nr].seq = state.seq;
+	state.journal[state.journal_nr].path = xstrdup(path);
+	state.journal_nr++;
+}
+
+/*
+ * Events were lost, so no token handed out so far can be answered
+ * anymore.
+ */
+static void forget_journal(void)
+{
+	state.seq++;
+	clear_journal();
+}
+
+static uint64_t current_token(void)
+{
+	return FSMONITOR_DAEMON_TOKEN_BIT |
+		((uint64_t)state.instance << 32) | state.seq;
+}
+
+static int is_dot_git(const char *path)
+{
+	return !strcmp(path, ".git") || !strcmp(path, ".git/");
+}
+
+/*
+ * Watch the directory "path" (absolute, with a trailing slash) and every
+ * directory below it.
+ */
+static void add_watches(struct strbuf *path)
+{
+	size_t len = path->len;
+	DIR *d;
+	struct dirent *de;
+	int wd;
+
+	wd = inotify_add_watch(state.inotify_fd, path->buf, WATCH_MASK);
+	if (wd < 0) {
+		if (errno == ENOENT || errno == ENOTDIR)
+			return; /* it went away already */
+		if (errno == ENOSPC)
+			die(_("too many directories to watch; consider raising "
+			      "fs.inotify.max_user_watches"));
+		die_errno(_("unable to watch '%s'"), path->buf);
+	}
+	if (wd >= state.watch_alloc) {
+		int old_alloc = state.watch_alloc;
+
+		ALLOC_GROW(state.watch_dirs, wd + 1, state.watch_alloc);
+		memset(state.watch_dirs + old_alloc, 0,
+		       (state.watch_alloc - old_alloc) * sizeof(*state.watch_dirs));
+	}
+	free(state.watch_dirs[wd]);
+	state.watch_dirs[wd] = xstrdup(path->buf + state.worktree.len);
+
+	d = opendir(path->buf);
+	if (!d)
+		return;
+	while ((de = readdir(d))) {
+		struct stat st;
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		strbuf_setlen(path, len);
+		strbuf_addstr(path, de->d_name);
+		if (len == state.worktree.len && is_dot_git(de->d_name))
+			continue;
+		if (DTYPE(de) != DT_DIR &&
+		    (DTYPE(de) != DT_UNKNOWN || lstat(path->buf, &st) ||
+		     !S_ISDIR(st.st_mode)))
+			continue;
+		strbuf_addch(path, '/');
+		add_watches(path);
+	}
+	closedir(d);
+	strbuf_setlen(path, len);
+}
+
+/* Stop watching "dir" and the directories below it. */
+static void remove_watches(const char *dir)
+{
+	int wd;
+
+	for (wd = 0; wd < state.watch_alloc; wd++) {
+		if (!state.watch_dirs[wd] ||
+		    !starts_with(state.watch_dirs[wd], dir))
+			continue;
+		inotify_rm_watch(state.inotify_fd, wd);
+		FREE_AND_NULL(state.watch_dirs[wd]);
+	}
+}
+
+static void handle_event(const struct inotify_event *ev)
+{
+	struct strbuf path = STRBUF_INIT;
+	const char *dir;
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		forget_journal();
+		return;
+	}
+	if (ev->wd < 0 || ev->wd >= state.watch_alloc ||
+	    !(dir = state.watch_dirs[ev->wd]))
+		return;
+
+	if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+		if (!*dir)
+			exit(0); /* the worktree went away */
+		/* the parent directory reports it */
+		if (ev->mask & IN_IGNORED)
+			FREE_AND_NULL(state.watch_dirs[ev->wd]);
+		return;
+	}
+	if (!ev->len)
+		return;
+
+	strbuf_addstr(&path, dir);
+	strbuf_addstr(&path, ev->name);
+	if (!*dir && is_dot_git(path.buf)) {
+		if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+			exit(0); /* the repository went away */
+		goto out;
+	}
+
+	if (ev->mask & IN_ISDIR) {
+		/* a change to the directory itself is of no interest */
+		if (!(ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))
+			goto out;
+		strbuf_addch(&path, '/');
+		if (ev->mask & IN_MOVED_FROM)
+			remove_watches(path.buf);
+		else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+			struct strbuf abs = STRBUF_INIT;
+
+			/*
+			 * Files may have been created in it before it is
+			 * watched; recording it afterwards covers them.
+			 */
+			strbuf_addbuf(&abs, &state.worktree);
+			strbuf_addbuf(&abs, &path);
+			add_watches(&abs);
+			strbuf_release(&abs);
+		}
+	}
+	record_path(path.buf);
+
+out:
+	strbuf_release(&path);
+}
+
+/* Handle all the events that are queued. */
+static void read_events(void)
+{
+	char buf[64 * 1024]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	for (;;) {
+		ssize_t len = read(state.inotify_fd, buf, sizeof(buf));
+		char *p;
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return;
+			die_errno(_("unable to read inotify events"));
+		}
+		for (p = buf; p < buf + len; ) {
+			const struct inotify_event *ev = (struct inotify_event *)p;
+
+			handle_event(ev);
+			p += sizeof(*ev) + ev->len;
+		}
+	}
+}
+
+static void answer_query(const char *token_str, struct strbuf *answer)
+{
+	struct string_list paths = STRING_LIST_INIT_NODUP;
+	uint64_t token;
+	uint32_t seq;
+	size_t lo, hi;
+	char *end;
+	int i;
+
+	/* the client changed the worktree right before asking */
+	read_events();
+
+	strbuf_addf(answer, "%"PRIuMAX, (uintmax_t)current_token());
+	strbuf_addch(answer, '\0');
+
+	token = strtoumax(token_str, &end, 10);
+	seq = token & 0xffffffff;
+	if (*end || !(token & FSMONITOR_DAEMON_TOKEN_BIT) ||
+	    ((token >> 32) & TOKEN_INSTANCE_MASK) != state.instance ||
+	    seq < state.oldest_seq || seq > state.seq) {
+		/* everything may have changed */
+		strbuf_addstr(answer, "/");
+		strbuf_addch(answer, '\0');
+		return;
+	}
+
+	/* find the first entry recorded after the token */
+	lo = 0;
+	hi = state.journal_nr;
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+
+		if (state.journal[mi].seq <= seq)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	for (; lo < state.journal_nr; lo++)
+		string_list_append(&paths, state.journal[lo].path);
+	string_list_sort(&paths);
+	string_list_remove_duplicates(&paths, 0);
+
+	for (i = 0; i < paths.nr; i++) {
+		strbuf_addstr(answer, paths.items[i].string);
+		strbuf_addch(answer, '\0');
+	}
+	string_list_clear(&paths, 0);
+}
+
+static void serve_one_client(int fd)
+{
+	struct strbuf request = STRBUF_INIT;
+	struct strbuf answer = STRBUF_INIT;
+	const char *p;
+
+	if (strbuf_read(&request, fd, 0) < 0) {
+		warning_errno(_("unable to read request"));
+		goto out;
+	}
+	strbuf_trim_trailing_newline(&request);
+
+	if (skip_prefix(request.buf, "query ", &p))
+		answer_query(p, &answer);
+	else if (!strcmp(request.buf, "status"))
+		strbuf_addstr(&answer, "ok\n");
+	else if (!strcmp(request.buf, "stop"))
+		/*
+		 * Exiting removes the socket in the atexit() handler
+		 * before the client sees the connection close.
+		 */
+		exit(0);
+	else
+		warning(_("fsmonitor--daemon client sent unknown request: %s"),
+			request.buf);
+
+	/* a client that went away, e.g. on ^C, is not worth a warning */
+	if (write_in_full(fd, answer.buf, answer.len) < 0 && errno != EPIPE)
+		warning_errno(_("unable to write answer"));
+out:
+	strbuf_release(&request);
+	strbuf_release(&answer);
+}
+
+static void serve(int listen_fd)
+{
+	struct pollfd pfd[2];
+
+	pfd[0].fd = state.inotify_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = listen_fd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno != EINTR)
+				die_errno(_("poll failed"));
+			continue;
+		}
+
+		if (pfd[0].revents & POLLIN)
+			read_events();
+		if (pfd[1].revents & POLLIN) {
+			int client = accept(listen_fd, NULL, NULL);
+
+			if (client < 0) {
+				warning_errno(_("accept failed"));
+				continue;
+			}
+			serve_one_client(client);
+			close(client);
+		}
+	}
+}
+
+static int fsmonitor_run_daemon(int detach)
+{
+	struct strbuf answer = STRBUF_INIT;
+	struct strbuf path = STRBUF_INIT;
+	char *socket_path;
+	int fd;
+
+	if (!fsmonitor_daemon_send("status\n", &answer))
+		die(_("fsmonitor--daemon is already running in '%s'"),
+		    get_git_work_tree());
+
+	state.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (state.inotify_fd < 0)
+		die_errno(_("unable to initialize inotify"));
+	state.instance = (getpid() ^ getnanotime()) & TOKEN_INSTANCE_MASK;
+
+	strbuf_realpath(&state.worktree, get_git_work_tree(), 1);
+	strbuf_complete(&state.worktree, '/');
+	socket_path = absolute_pathdup(git_path("fsmonitor--daemon.ipc"));
+
+	/*
+	 * Do not tie up the worktree with our cwd: removing it would not
+	 * be noticed otherwise.
+	 */
+	if (chdir("/"))
+		die_errno(_("unable to chdir to '/'"));
+
+	/* every directory is watched before the first token is handed out */
+	strbuf_addbuf(&path, &state.worktree);
+	add_watches(&path);
+	strbuf_release(&path);
+
+	fd = unix_stream_listen(socket_path);
+	if (fd < 0)
+		die_errno(_("unable to bind to '%s'"), socket_path);
+	register_tempfile(socket_path);
+
+	if (detach) {
+		printf("ok\n");
+		fclose(stdout);
+		if (!freopen("/dev/null", "w", stderr))
+			die_errno("unable to point stderr to /dev/null");
+	}
+
+	/* a client closing its end early must not kill us */
+	sigchain_push(SIGPIPE, SIG_IGN);
+	serve(fd);
+	return 0;
+}
+
+static int fsmonitor_start_daemon(void)
+{
+	struct child_process daemon = CHILD_PROCESS_INIT;
+	char buf[128];
+	int r;
+
+	argv_array_pushl(&daemon.args, "fsmonitor--daemon", "run", "--detach",
+			 NULL);
+	daemon.git_cmd = 1;
+	daemon.no_stdin = 1;
+	daemon.out = -1;
+
+	if (start_command(&daemon))
+		die_errno(_("unable to start fsmonitor--daemon"));
+	r = read_in_full(daemon.out, buf, sizeof(buf));
+	if (r < 0)
+		die_errno(_("unable to read result code from fsmonitor--daemon"));
+	if (r != 3 || memcmp(buf, "ok\n", 3))
+		die(_("fsmonitor--daemon did not start"));
+	close(daemon.out);
+	return 0;
+}
+
+int cmd_fsmonitor__daemon(int argc, const char **argv, const char *prefix)
+{
+	struct strbuf answer = STRBUF_INIT;
+	const char *subcmd;
+	int detach = 0;
+	struct option options[] = {
+		OPT_BOOL(0, "detach", &detach,
+			 N_("detach from the terminal once listening")),
+		OPT_END()
+	};
+
+	git_config(git_default_config, NULL);
+
+	argc = parse_options(argc, argv, prefix, options,
+			     builtin_fsmonitor__daemon_usage, 0);
+	if (argc != 1)
+		usage_with_options(builtin_fsmonitor__daemon_usage, options);
+	subcmd = argv[0];
+
+	if (!strcmp(subcmd, "run"))
+		return fsmonitor_run_daemon(detach);
+	if (!strcmp(subcmd, "start"))
+		return fsmonitor_start_daemon();
+	if (!strcmp(subcmd, "stop")) {
+		if (fsmonitor_daemon_send("stop\n", &answer))
+			return error(_("fsmonitor--daemon is not running"));
+		return 0;
+	}
+	if (!strcmp(subcmd, "status")) {
+		if (fsmonitor_daemon_send("status\n", &answer)) {
+			printf(_("fsmonitor--daemon is not watching '%s'\n"),
+			       get_git_work_tree());
+			return 1;
+		}
+		printf(_("fsmonitor--daemon is watching '%s'\n"),
+		       get_git_work_tree());
+		return 0;
+	}
+
+	usage_with_options(builtin_fsmonitor__daemon_usage, options);
+}
+
+#else
+
+int cmd_fsmonitor__daemon(int argc, const char **argv, const char *prefix)
+{
+	struct option options[] = {
+		OPT_END()
+	};
+
+	if (argc == 2 && !strcmp(argv[1], "-h"))
+		usage_with_options(builtin_fsmonitor__daemon_usage, options);
+
+	die(_("fsmonitor--daemon is not supported on this platform"));
+}
+
+#endif
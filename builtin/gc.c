@@ -27,6 +27,8 @@
 #include "pack-objects.h"
 #include "blob.h"
 #include "tree.h"
+#include "trigram-index.h"
+#include "blame.h"
 
 #define FAILED_RUN "failed to run %s"
 
@@ -42,11 +44,13 @@ static int aggressive_window = 250;
 static int gc_auto_threshold = 6700;
 static int gc_auto_pack_limit = 50;
 static int gc_write_commit_graph;
+static int gc_write_trigram_index;
 static int detach_auto = 1;
 static timestamp_t gc_log_expire_time;
 static const char *gc_log_expire = "1.day.ago";
 static const char *prune_expire = "2.weeks.ago";
 static const char *prune_worktrees_expire = "3.months.ago";
+static const char *blame_cache_expire = "1.month.ago";
 static unsigned long big_pack_threshold;
 static unsigned long max_delta_cache_size = DEFAULT_DELTA_CACHE_SIZE;
 
@@ -149,9 +153,11 @@ static void gc_config(void)
 	git_config_get_int("gc.auto", &gc_auto_threshold);
 	git_config_get_int("gc.autopacklimit", &gc_auto_pack_limit);
 	git_config_get_bool("gc.writecommitgraph", &gc_write_commit_graph);
+	git_config_get_bool("gc.writetrigramindex", &gc_write_trigram_index);
 	git_config_get_bool("gc.autodetach", &detach_auto);
 	git_config_get_expiry("gc.pruneexpire", &prune_expire);
 	git_config_get_expiry("gc.worktreepruneexpire", &prune_worktrees_expire);
+	git_config_get_expiry("gc.blamecacheexpire", &blame_cache_expire);
 	git_config_get_expiry("gc.logexpiry", &gc_log_expire);
 
 	git_config_get_ulong("gc.bigpackthreshold", &big_pack_threshold);
@@ -678,6 +684,15 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 	if (run_command_v_opt(rerere.argv, RUN_GIT_CMD))
 		die(FAILED_RUN, rerere.argv[0]);
 
+	if (blame_cache_expire) {
+		timestamp_t expire;
+
+		if (parse_expiry_date(blame_cache_expire, &expire))
+			die(_("failed to parse blame cache expiry value %s"),
+			    blame_cache_expire);
+		blame_cache_prune(the_repository, expire);
+	}
+
 	report_garbage = report_pack_garbage;
 	reprepare_packed_git(the_repository);
 	if (pack_garbage.nr > 0) {
@@ -691,6 +706,11 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 					 NULL))
 		return 1;
 
+	if (gc_write_trigram_index &&
+	    write_trigram_index(the_repository,
+				!quiet && !daemonized ? TRIGRAM_INDEX_PROGRESS : 0))
+		return 1;
+
 	if (auto_gc && too_many_loose_objects())
 		warning(_("There are too many unreachable loose objects; "
 			"run 'git prune' to remove them."));
@@ -24,6 +24,8 @@
 #include "submodule.h"
 #include "submodule-config.h"
 #include "object-store.h"
+#include "trigram-index.h"
+#include "task-pool.h"
 
 static char const * const grep_usage[] = {
 	N_("git grep [<options>] [-e] <pattern> [<rev>...] [[--] <path>...]"),
@@ -32,38 +34,40 @@ static char const * const grep_usage[] = {
 
 static int recurse_submodules;
 
-#define GREP_NUM_THREADS_DEFAULT 8
-static int num_threads;
+static int use_trigram_index = 1;
+static struct trigram_filter *trigram_filter;
 
-static pthread_t *threads;
+static int num_threads;
 
-/* We use one producer thread and THREADS consumer
- * threads. The producer adds struct work_items to 'todo' and the
- * consumers pick work items from the same array.
+/* We use one producer thread and a pool of THREADS workers.
+ * The producer adds struct work_items to 'todo' and hands each
+ * of them to the pool as a task.
  */
+static struct task_pool *pool;
+
+/* The grep_opt of each worker, with its own compiled patterns. */
+static struct grep_opt **worker_opt;
+
 struct work_item {
 	struct grep_source source;
 	char done;
+	char hit;
 	struct strbuf out;
 };
 
-/* In the range [todo_done, todo_start) in 'todo' we have work_items
- * that have been or are processed by a consumer thread. We haven't
- * written the result for these to stdout yet.
- *
- * The work_items in [todo_start, todo_end) are waiting to be picked
- * up by a consumer thread.
+/* In the range [todo_done, todo_end) in 'todo' we have work_items
+ * that have been handed to the pool.  We haven't written the result
+ * for these to stdout yet.
  *
  * The ranges are modulo TODO_SIZE.
  */
 #define TODO_SIZE 128
 static struct work_item todo[TODO_SIZE];
-static int todo_start;
 static int todo_end;
 static int todo_done;
 
-/* Has all work items been added? */
-static int all_work_added;
+/* Did any of the work_items written out match? */
+static int work_hit;
 
 /* This lock protects all the variables above. */
 static pthread_mutex_t grep_mutex;
@@ -78,56 +82,36 @@ static inline void grep_unlock(void)
 	pthread_mutex_unlock(&grep_mutex);
 }
 
-/* Signalled when a new work_item is added to todo. */
-static pthread_cond_t cond_add;
-
 /* Signalled when the result from one work_item is written to
  * stdout.
  */
 static pthread_cond_t cond_write;
 
-/* Signalled when we are finished with everything. */
-static pthread_cond_t cond_result;
-
 static int skip_first_line;
 
+static void grep_work(void *data, int worker);
+
 static void add_work(struct grep_opt *opt, const struct grep_source *gs)
 {
+	struct work_item *w;
+
 	grep_lock();
 
 	while ((todo_end+1) % ARRAY_SIZE(todo) == todo_done) {
 		pthread_cond_wait(&cond_write, &grep_mutex);
 	}
 
-	todo[todo_end].source = *gs;
+	w = &todo[todo_end];
+	w->source = *gs;
 	if (opt->binary != GREP_BINARY_TEXT)
-		grep_source_load_driver(&todo[todo_end].source,
-					opt->repo->index);
-	todo[todo_end].done = 0;
-	strbuf_reset(&todo[todo_end].out);
+		grep_source_load_driver(&w->source, opt->repo->index);
+	w->done = 0;
+	w->hit = 0;
+	strbuf_reset(&w->out);
 	todo_end = (todo_end + 1) % ARRAY_SIZE(todo);
-
-	pthread_cond_signal(&cond_add);
 	grep_unlock();
-}
-
-static struct work_item *get_work(void)
-{
-	struct work_item *ret;
-
-	grep_lock();
-	while (todo_start == todo_end && !all_work_added) {
-		pthread_cond_wait(&cond_add, &grep_mutex);
-	}
 
-	if (todo_start == todo_end && all_work_added) {
-		ret = NULL;
-	} else {
-		ret = &todo[todo_start];
-		todo_start = (todo_start + 1) % ARRAY_SIZE(todo);
-	}
-	grep_unlock();
-	return ret;
+	task_pool_add(pool, grep_work, w);
 }
 
 static void work_done(struct work_item *w)
@@ -137,9 +121,10 @@ static void work_done(struct work_item *w)
 	grep_lock();
 	w->done = 1;
 	old_done = todo_done;
-	for(; todo[todo_done].done && todo_done != todo_start;
+	for(; todo[todo_done].done && todo_done != todo_end;
 	    todo_done = (todo_done+1) % ARRAY_SIZE(todo)) {
 		w = &todo[todo_done];
+		work_hit |= w->hit;
 		if (w->out.len) {
 			const char *p = w->out.buf;
 			size_t len = w->out.len;
@@ -162,31 +147,18 @@ static void work_done(struct work_item *w)
 	if (old_done != todo_done)
 		pthread_cond_signal(&cond_write);
 
-	if (all_work_added && todo_done == todo_end)
-		pthread_cond_signal(&cond_result);
-
 	grep_unlock();
 }
 
-static void *run(void *arg)
+static void grep_work(void *data, int worker)
 {
-	int hit = 0;
-	struct grep_opt *opt = arg;
+	struct work_item *w = data;
+	struct grep_opt *opt = worker_opt[worker];
 
-	while (1) {
-		struct work_item *w = get_work();
-		if (!w)
-			break;
-
-		opt->output_priv = w;
-		hit |= grep_source(opt, &w->source);
-		grep_source_clear_data(&w->source);
-		work_done(w);
-	}
-	free_grep_patterns(arg);
-	free(arg);
-
-	return (void*) (intptr_t) hit;
+	opt->output_priv = w;
+	w->hit = !!grep_source(opt, &w->source);
+	grep_source_clear_data(&w->source);
+	work_done(w);
 }
 
 static void strbuf_out(struct grep_opt *opt, const void *buf, size_t size)
@@ -200,71 +172,51 @@ static void start_threads(struct grep_opt *opt)
 	int i;
 
 	pthread_mutex_init(&grep_mutex, NULL);
-	pthread_mutex_init(&grep_read_mutex, NULL);
 	pthread_mutex_init(&grep_attr_mutex, NULL);
-	pthread_cond_init(&cond_add, NULL);
 	pthread_cond_init(&cond_write, NULL);
-	pthread_cond_init(&cond_result, NULL);
 	grep_use_locks = 1;
+	enable_obj_read_lock();
 
 	for (i = 0; i < ARRAY_SIZE(todo); i++) {
 		strbuf_init(&todo[i].out, 0);
 	}
 
-	threads = xcalloc(num_threads, sizeof(*threads));
+	ALLOC_ARRAY(worker_opt, num_threads);
 	for (i = 0; i < num_threads; i++) {
-		int err;
 		struct grep_opt *o = grep_opt_dup(opt);
 		o->output = strbuf_out;
 		if (i)
 			o->debug = 0;
 		compile_grep_patterns(o);
-		err = pthread_create(&threads[i], NULL, run, o);
-
-		if (err)
-			die(_("grep: failed to create thread: %s"),
-			    strerror(err));
+		worker_opt[i] = o;
 	}
+	pool = task_pool_start("grep", num_threads);
 }
 
 static int wait_all(void)
 {
-	int hit = 0;
 	int i;
 
 	if (!HAVE_THREADS)
 		BUG("Never call this function unless you have started threads");
 
-	grep_lock();
-	all_work_added = 1;
-
-	/* Wait until all work is done. */
-	while (todo_done != todo_end)
-		pthread_cond_wait(&cond_result, &grep_mutex);
-
-	/* Wake up all the consumer threads so they can see that there
-	 * is no more work to do.
-	 */
-	pthread_cond_broadcast(&cond_add);
-	grep_unlock();
+	/* Once all tasks are done, all results have been written. */
+	task_pool_finish(pool);
+	pool = NULL;
 
 	for (i = 0; i < num_threads; i++) {
-		void *h;
-		pthread_join(threads[i], &h);
-		hit |= (int) (intptr_t) h;
+		free_grep_patterns(worker_opt[i]);
+		free(worker_opt[i]);
 	}
-
-	free(threads);
+	FREE_AND_NULL(worker_opt);
 
 	pthread_mutex_destroy(&grep_mutex);
-	pthread_mutex_destroy(&grep_read_mutex);
 	pthread_mutex_destroy(&grep_attr_mutex);
-	pthread_cond_destroy(&cond_add);
 	pthread_cond_destroy(&cond_write);
-	pthread_cond_destroy(&cond_result);
 	grep_use_locks = 0;
+	disable_obj_read_lock();
 
-	return hit;
+	return work_hit;
 }
 
 static int grep_cmd_config(const char *var, const char *value, void *cb)
@@ -292,17 +244,10 @@ static int grep_cmd_config(const char *var, const char *value, void *cb)
 	if (!strcmp(var, "submodule.recurse"))
 		recurse_submodules = git_config_bool(var, value);
 
-	return st;
-}
-
-static void *lock_and_read_oid_file(const struct object_id *oid, enum object_type *type, unsigned long *size)
-{
-	void *data;
+	if (!strcmp(var, "grep.trigramindex"))
+		use_trigram_index = git_config_bool(var, value);
 
-	grep_read_lock();
-	data = read_object_file(oid, type, size);
-	grep_read_unlock();
-	return data;
+	return st;
 }
 
 static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
@@ -312,6 +257,10 @@ static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 	struct strbuf pathbuf = STRBUF_INIT;
 	struct grep_source gs;
 
+	if (trigram_filter && opt->repo == the_repository &&
+	    !trigram_filter_may_match(trigram_filter, oid))
+		return 0;
+
 	if (opt->relative && opt->prefix_length) {
 		quote_path_relative(filename + tree_name_len, opt->prefix, &pathbuf);
 		strbuf_insert(&pathbuf, 0, filename, tree_name_len);
@@ -339,6 +288,38 @@ static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 	}
 }
 
+/*
+ * Let grep_oid() skip the blobs that the trigram index tells cannot
+ * contain a match, which is only possible when every matching line
+ * must contain strings we know of.
+ */
+static void setup_trigram_filter(struct grep_opt *opt)
+{
+	struct string_list literals = STRING_LIST_INIT_DUP;
+	struct grep_pat *p;
+
+	if (!use_trigram_index || opt->extended || opt->invert ||
+	    opt->unmatch_name_only || opt->allow_textconv)
+		return;
+	trigram_filter = trigram_filter_new(opt->repo);
+	if (!trigram_filter)
+		return;
+
+	for (p = opt->pattern_list; p; p = p->next) {
+		int ret = grep_pattern_literals(opt, p, &literals);
+
+		if (!ret)
+			ret = trigram_filter_add(trigram_filter, &literals,
+						 opt->ignore_case);
+		string_list_clear(&literals, 0);
+		if (ret < 0) {
+			trigram_filter_free(trigram_filter);
+			trigram_filter = NULL;
+			return;
+		}
+	}
+}
+
 static int grep_file(struct grep_opt *opt, const char *filename)
 {
 	struct strbuf buf = STRBUF_INIT;
@@ -407,8 +388,7 @@ static int grep_submodule(struct grep_opt *opt,
 {
 	struct repository subrepo;
 	struct repository *superproject = opt->repo;
-	const struct submodule *sub = submodule_from_path(superproject,
-							  &null_oid, path);
+	const struct submodule *sub;
 	struct grep_opt subopt;
 	int hit;
 
@@ -418,15 +398,16 @@ static int grep_submodule(struct grep_opt *opt,
 	 * uses get_oid() which, for now, relies on the global the_repository
 	 * object.
 	 */
-	grep_read_lock();
+	obj_read_lock();
+	sub = submodule_from_path(superproject, &null_oid, path);
 
 	if (!is_submodule_active(superproject, path)) {
-		grep_read_unlock();
+		obj_read_unlock();
 		return 0;
 	}
 
 	if (repo_submodule_init(&subrepo, superproject, sub)) {
-		grep_read_unlock();
+		obj_read_unlock();
 		return 0;
 	}
 
@@ -443,7 +424,7 @@ static int grep_submodule(struct grep_opt *opt,
 	 * object.
 	 */
 	add_to_alternates_memory(subrepo.objects->odb->path);
-	grep_read_unlock();
+	obj_read_unlock();
 
 	memcpy(&subopt, opt, sizeof(subopt));
 	subopt.repo = &subrepo;
@@ -455,13 +436,13 @@ static int grep_submodule(struct grep_opt *opt,
 		unsigned long size;
 		struct strbuf base = STRBUF_INIT;
 
+		obj_read_lock();
 		object = parse_object_or_die(oid, oid_to_hex(oid));
+		obj_read_unlock();
 
-		grep_read_lock();
 		data = read_object_with_reference(&subrepo,
 						  &object->oid, tree_type,
 						  &size, NULL);
-		grep_read_unlock();
 
 		if (!data)
 			die(_("unable to read tree (%s)"), oid_to_hex(&object->oid));
@@ -587,7 +568,7 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 			void *data;
 			unsigned long size;
 
-			data = lock_and_read_oid_file(&entry.oid, &type, &size);
+			data = read_object_file(&entry.oid, &type, &size);
 			if (!data)
 				die(_("unable to read tree (%s)"),
 				    oid_to_hex(&entry.oid));
@@ -625,11 +606,9 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 		struct strbuf base;
 		int hit, len;
 
-		grep_read_lock();
 		data = read_object_with_reference(opt->repo,
 						  &obj->oid, tree_type,
 						  &size, NULL);
-		grep_read_unlock();
 
 		if (!data)
 			die(_("unable to read tree (%s)"), oid_to_hex(&obj->oid));
@@ -659,13 +638,18 @@ static int grep_objects(struct grep_opt *opt, const struct pathspec *pathspec,
 
 	for (i = 0; i < nr; i++) {
 		struct object *real_obj;
+
+		obj_read_lock();
 		real_obj = deref_tag(opt->repo, list->objects[i].item,
 				     NULL, 0);
+		obj_read_unlock();
 
 		/* load the gitmodules file for this rev */
 		if (recurse_submodules) {
 			submodule_free(opt->repo);
+			obj_read_lock();
 			gitmodules_config_oid(&real_obj->oid);
+			obj_read_unlock();
 		}
 		if (grep_object(opt, pathspec, real_obj, list->objects[i].name,
 				list->objects[i].path)) {
@@ -1062,7 +1046,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	pathspec.recursive = 1;
 	pathspec.recurse_submodules = !!recurse_submodules;
 
-	if (list.nr || cached || show_in_pager) {
+	if (show_in_pager) {
 		if (num_threads > 1)
 			warning(_("invalid option combination, ignoring --threads"));
 		num_threads = 1;
@@ -1072,7 +1056,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	} else if (num_threads < 0)
 		die(_("invalid number of threads specified (%d)"), num_threads);
 	else if (num_threads == 0)
-		num_threads = HAVE_THREADS ? GREP_NUM_THREADS_DEFAULT : 1;
+		num_threads = HAVE_THREADS ? online_cpus() : 1;
 
 	if (num_threads > 1) {
 		if (!HAVE_THREADS)
@@ -1124,6 +1108,9 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	if (!use_index && (untracked || cached))
 		die(_("--cached or --untracked cannot be used with --no-index"));
 
+	if (use_index && !untracked)
+		setup_trigram_filter(&opt);
+
 	if (!use_index || untracked) {
 		int use_exclude = (opt_exclude < 0) ? use_index : !!opt_exclude;
 		hit = grep_directory(&opt, &pathspec, use_exclude, use_index);
@@ -1147,5 +1134,6 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 		run_pager(&opt, prefix);
 	clear_pathspec(&pathspec);
 	free_grep_patterns(&opt);
+	trigram_filter_free(trigram_filter);
 	return !hit;
 }
@@ -15,6 +15,7 @@
 #include "packfile.h"
 #include "object-store.h"
 #include "fetch-object.h"
+#include "task-pool.h"
 
 static const char index_pack_usage[] =
 "git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--verify] [--strict] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
@@ -43,7 +44,6 @@ struct base_data {
 };
 
 struct thread_local {
-	pthread_t thread;
 	struct base_data *base_cache;
 	size_t base_cache_used;
 	int pack_fd;
@@ -98,7 +98,6 @@ static int input_fd, output_fd;
 static const char *curr_pack;
 
 static struct thread_local *thread_data;
-static int nr_dispatched;
 static int threads_active;
 
 static pthread_mutex_t read_mutex;
@@ -109,10 +108,6 @@ static pthread_mutex_t counter_mutex;
 #define counter_lock()		lock_mutex(&counter_mutex)
 #define counter_unlock()	unlock_mutex(&counter_mutex)
 
-static pthread_mutex_t work_mutex;
-#define work_lock()		lock_mutex(&work_mutex)
-#define work_unlock()		unlock_mutex(&work_mutex)
-
 static pthread_mutex_t deepest_delta_mutex;
 #define deepest_delta_lock()	lock_mutex(&deepest_delta_mutex)
 #define deepest_delta_unlock()	unlock_mutex(&deepest_delta_mutex)
@@ -143,7 +138,6 @@ static void init_thread(void)
 	int i;
 	init_recursive_mutex(&read_mutex);
 	pthread_mutex_init(&counter_mutex, NULL);
-	pthread_mutex_init(&work_mutex, NULL);
 	pthread_mutex_init(&type_cas_mutex, NULL);
 	if (show_stat)
 		pthread_mutex_init(&deepest_delta_mutex, NULL);
@@ -166,7 +160,6 @@ static void cleanup_thread(void)
 	threads_active = 0;
 	pthread_mutex_destroy(&read_mutex);
 	pthread_mutex_destroy(&counter_mutex);
-	pthread_mutex_destroy(&work_mutex);
 	pthread_mutex_destroy(&type_cas_mutex);
 	if (show_stat)
 		pthread_mutex_destroy(&deepest_delta_mutex);
@@ -1076,28 +1069,26 @@ static void resolve_base(struct object_entry *obj)
 	find_unresolved_deltas(base_obj);
 }
 
-static void *threaded_second_pass(void *data)
+/*
+ * Bases are handed to the threads in chunks, small enough for idle
+ * threads to find some left to steal when a few bases with many
+ * deltas keep the others busy.
+ */
+#define RESOLVE_CHUNK_SIZE 64
+
+static void threaded_second_pass(size_t begin, size_t end, int worker,
+				 void *data)
 {
-	set_thread_data(data);
-	for (;;) {
-		int i;
+	set_thread_data(&thread_data[worker]);
+	for (; begin < end; begin++) {
+		if (is_delta_type(objects[begin].type))
+			continue;
 		counter_lock();
 		display_progress(progress, nr_resolved_deltas);
 		counter_unlock();
-		work_lock();
-		while (nr_dispatched < nr_objects &&
-		       is_delta_type(objects[nr_dispatched].type))
-			nr_dispatched++;
-		if (nr_dispatched >= nr_objects) {
-			work_unlock();
-			break;
-		}
-		i = nr_dispatched++;
-		work_unlock();
 
-		resolve_base(&objects[i]);
+		resolve_base(&objects[begin]);
 	}
-	return NULL;
 }
 
 /*
@@ -1195,18 +1186,10 @@ static void resolve_deltas(void)
 		progress = start_progress(_("Resolving deltas"),
 					  nr_ref_deltas + nr_ofs_deltas);
 
-	nr_dispatched = 0;
 	if (nr_threads > 1 || getenv("GIT_FORCE_THREADS")) {
 		init_thread();
-		for (i = 0; i < nr_threads; i++) {
-			int ret = pthread_create(&thread_data[i].thread, NULL,
-						 threaded_second_pass, thread_data + i);
-			if (ret)
-				die(_("unable to create thread: %s"),
-				    strerror(ret));
-		}
-		for (i = 0; i < nr_threads; i++)
-			pthread_join(thread_data[i].thread, NULL);
+		parallel_for("index-pack", nr_threads, nr_objects,
+			     RESOLVE_CHUNK_SIZE, threaded_second_pass, NULL);
 		cleanup_thread();
 		return;
 	}
@@ -1442,12 +1425,14 @@ static void write_special_file(const char *suffix, const char *msg,
 
 static void final(const char *final_pack_name, const char *curr_pack_name,
 		  const char *final_index_name, const char *curr_index_name,
+		  const char *final_rev_name, const char *curr_rev_name,
 		  const char *keep_msg, const char *promisor_msg,
 		  unsigned char *hash)
 {
 	const char *report = "pack";
 	struct strbuf pack_name = STRBUF_INIT;
 	struct strbuf index_name = STRBUF_INIT;
+	struct strbuf rev_name = STRBUF_INIT;
 	int err;
 
 	if (!from_stdin) {
@@ -1482,6 +1467,16 @@ static void final(const char *final_pack_name, const char *curr_pack_name,
 	} else
 		chmod(final_index_name, 0444);
 
+	if (curr_rev_name) {
+		if (final_rev_name != curr_rev_name) {
+			if (!final_rev_name)
+				final_rev_name = odb_pack_name(&rev_name, hash, "rev");
+			if (finalize_object_file(curr_rev_name, final_rev_name))
+				die(_("cannot store reverse index file"));
+		} else
+			chmod(final_rev_name, 0444);
+	}
+
 	if (do_fsck_object) {
 		struct packed_git *p;
 		p = add_packed_git(final_index_name, strlen(final_index_name), 0);
@@ -1511,6 +1506,7 @@ static void final(const char *final_pack_name, const char *curr_pack_name,
 		}
 	}
 
+	strbuf_release(&rev_name);
 	strbuf_release(&index_name);
 	strbuf_release(&pack_name);
 }
@@ -1525,6 +1521,13 @@ static int git_index_pack_config(const char *k, const char *v, void *cb)
 			die(_("bad pack.indexversion=%"PRIu32), opts->version);
 		return 0;
 	}
+	if (!strcmp(k, "pack.writereverseindex")) {
+		if (git_config_bool(k, v))
+			opts->flags |= WRITE_REV;
+		else
+			opts->flags &= ~WRITE_REV;
+		return 0;
+	}
 	if (!strcmp(k, "pack.threads")) {
 		nr_threads = git_config_int(k, v);
 		if (nr_threads < 0)
@@ -1658,11 +1661,12 @@ static void show_pack_info(int stat_only)
 int cmd_index_pack(int argc, const char **argv, const char *prefix)
 {
 	int i, fix_thin_pack = 0, verify = 0, stat_only = 0;
-	const char *curr_index;
-	const char *index_name = NULL, *pack_name = NULL;
+	const char *curr_index, *curr_rev = NULL;
+	const char *index_name = NULL, *pack_name = NULL, *rev_name = NULL;
 	const char *keep_msg = NULL;
 	const char *promisor_msg = NULL;
 	struct strbuf index_name_buf = STRBUF_INIT;
+	struct strbuf rev_name_buf = STRBUF_INIT;
 	struct pack_idx_entry **idx_objects;
 	struct pack_idx_option opts;
 	unsigned char pack_hash[GIT_MAX_RAWSZ];
@@ -1685,6 +1689,8 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 
 	reset_pack_idx_option(&opts);
 	git_config(git_index_pack_config, &opts);
+	if (git_env_bool(GIT_TEST_WRITE_REV_INDEX, 0))
+		opts.flags |= WRITE_REV;
 	if (prefix && chdir(prefix))
 		die(_("Cannot come back to cwd"));
 
@@ -1788,6 +1794,16 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	}
 	if (strict)
 		opts.flags |= WRITE_IDX_STRICT;
+	if (verify)
+		opts.flags &= ~WRITE_REV;
+	if ((opts.flags & WRITE_REV) && index_name) {
+		size_t len;
+		if (strip_suffix(index_name, ".idx", &len)) {
+			strbuf_add(&rev_name_buf, index_name, len);
+			strbuf_addstr(&rev_name_buf, ".rev");
+			rev_name = rev_name_buf.buf;
+		}
+	}
 
 	if (HAVE_THREADS && !nr_threads) {
 		nr_threads = online_cpus();
@@ -1819,11 +1835,14 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	for (i = 0; i < nr_objects; i++)
 		idx_objects[i] = &objects[i].idx;
 	curr_index = write_idx_file(index_name, idx_objects, nr_objects, &opts, pack_hash);
+	curr_rev = write_rev_file(rev_name, idx_objects, nr_objects, pack_hash,
+				  opts.flags);
 	free(idx_objects);
 
 	if (!verify)
 		final(pack_name, curr_pack,
 		      index_name, curr_index,
+		      rev_name, curr_rev,
 		      keep_msg, promisor_msg,
 		      pack_hash);
 	else
@@ -1834,6 +1853,9 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 
 	free(objects);
 	strbuf_release(&index_name_buf);
+	strbuf_release(&rev_name_buf);
+	if (curr_rev != rev_name)
+		free((void *)curr_rev);
 	if (pack_name == NULL)
 		free((void *) curr_pack);
 	if (index_name == NULL)
@@ -35,6 +35,7 @@
 #include "commit-reach.h"
 #include "interdiff.h"
 #include "range-diff.h"
+#include "tmp-objdir.h"
 
 #define MAIL_DEFAULT_WRAP 72
 
@@ -409,8 +410,14 @@ static int cmd_log_walk(struct rev_info *rev)
 			 */
 			free_commit_buffer(the_repository->parsed_objects,
 					   commit);
-			free_commit_list(commit->parents);
-			commit->parents = NULL;
+			/*
+			 * Re-merging needs the parents to find the merge
+			 * bases of the merges that are still to come.
+			 */
+			if (!rev->remerge_diff) {
+				free_commit_list(commit->parents);
+				commit->parents = NULL;
+			}
 		}
 		if (saved_nrl < rev->diffopt.needed_rename_limit)
 			saved_nrl = rev->diffopt.needed_rename_limit;
@@ -419,6 +426,10 @@ static int cmd_log_walk(struct rev_info *rev)
 	}
 	rev->diffopt.degraded_cc_to_c = saved_dcctc;
 	rev->diffopt.needed_rename_limit = saved_nrl;
+	if (rev->remerge_objdir) {
+		tmp_objdir_destroy(rev->remerge_objdir);
+		rev->remerge_objdir = NULL;
+	}
 	if (close_file)
 		fclose(rev->diffopt.file);
 
@@ -705,8 +716,9 @@ static void log_setup_revisions_tweak(struct rev_info *rev,
 	    rev->prune_data.nr == 1)
 		rev->diffopt.flags.follow_renames = 1;
 
-	/* Turn --cc/-c into -p --cc/-c when -p was not given */
-	if (!rev->diffopt.output_format && rev->combine_merges)
+	/* Turn --cc/-c/--remerge-diff into -p ... when -p was not given */
+	if (!rev->diffopt.output_format &&
+	    (rev->combine_merges || rev->remerge_diff))
 		rev->diffopt.output_format = DIFF_FORMAT_PATCH;
 
 	/* Turn -m on when --cc/-c was given */
@@ -7,8 +7,11 @@
 #include "blob.h"
 #include "exec-cmd.h"
 #include "merge-blobs.h"
-
-static const char merge_tree_usage[] = "git merge-tree <base-tree> <branch1> <branch2>";
+#include "parse-options.h"
+#include "commit.h"
+#include "commit-reach.h"
+#include "merge-ort.h"
+#include "quote.h"
 
 struct merge_list {
 	struct merge_list *next;
@@ -28,7 +31,7 @@ static void add_merge_entry(struct merge_list *entry)
 	merge_result_end = &entry->next;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base);
+static void trivial_merge_trees(struct tree_desc t[3], const char *base);
 
 static const char *explanation(struct merge_list *entry)
 {
@@ -227,7 +230,7 @@ static void unresolved_directory(const struct traverse_info *info,
 	buf2 = fill_tree_descriptor(r, t + 2, ENTRY_OID(n + 2));
 #undef ENTRY_OID
 
-	merge_trees(t, newbase);
+	trivial_merge_trees(t, newbase);
 
 	free(buf0);
 	free(buf1);
@@ -344,7 +347,7 @@ static int threeway_callback(int n, unsigned long mask, unsigned long dirmask, s
 	return mask;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base)
+static void trivial_merge_trees(struct tree_desc t[3], const char *base)
 {
 	struct traverse_info info;
 
@@ -368,19 +371,18 @@ static void *get_tree_descriptor(struct repository *r,
 	return buf;
 }
 
-int cmd_merge_tree(int argc, const char **argv, const char *prefix)
+static int trivial_merge(const char *base,
+			 const char *branch1,
+			 const char *branch2)
 {
 	struct repository *r = the_repository;
 	struct tree_desc t[3];
 	void *buf1, *buf2, *buf3;
 
-	if (argc != 4)
-		usage(merge_tree_usage);
-
-	buf1 = get_tree_descriptor(r, t+0, argv[1]);
-	buf2 = get_tree_descriptor(r, t+1, argv[2]);
-	buf3 = get_tree_descriptor(r, t+2, argv[3]);
-	merge_trees(t, "");
+	buf1 = get_tree_descriptor(r, t+0, base);
+	buf2 = get_tree_descriptor(r, t+1, branch1);
+	buf3 = get_tree_descriptor(r, t+2, branch2);
+	trivial_merge_trees(t, "");
 	free(buf1);
 	free(buf2);
 	free(buf3);
@@ -388,3 +390,200 @@ int cmd_merge_tree(int argc, const char **argv, const char *prefix)
 	show_result();
 	return 0;
 }
+
+enum mode {
+	MODE_UNKNOWN,
+	MODE_TRIVIAL,
+	MODE_REAL,
+};
+
+struct merge_tree_options {
+	int mode;
+	int allow_unrelated_histories;
+	int show_messages;
+	int name_only;
+	int use_stdin;
+};
+
+static int line_termination = '\n';
+
+static int real_merge(struct merge_tree_options *o,
+		      const char *branch1, const char *branch2,
+		      const char *prefix)
+{
+	struct commit *parent1, *parent2;
+	struct commit_list *common, *j, *merge_bases = NULL;
+	struct merge_options opt;
+	struct merge_result result;
+	int show_messages = o->show_messages;
+
+	parent1 = get_merge_parent(branch1);
+	if (!parent1)
+		die(_("unable to parse commit '%s'"), branch1);
+	parent2 = get_merge_parent(branch2);
+	if (!parent2)
+		die(_("unable to parse commit '%s'"), branch2);
+
+	/* merge_incore_recursive() wants the merge bases in reverse order */
+	common = get_merge_bases(parent1, parent2);
+	if (!common && !o->allow_unrelated_histories)
+		die(_("refusing to merge unrelated histories"));
+	for (j = common; j; j = j->next)
+		commit_list_insert(j->item, &merge_bases);
+	free_commit_list(common);
+
+	init_merge_options(&opt, the_repository);
+	opt.show_rename_progress = 0;
+	opt.branch1 = branch1;
+	opt.branch2 = branch2;
+
+	merge_incore_recursive(&opt, merge_bases, parent1, parent2, &result);
+	if (result.clean < 0)
+		die(_("failure to merge"));
+
+	if (show_messages == -1)
+		show_messages = !result.clean;
+
+	if (o->use_stdin)
+		printf("%d%c", result.clean, line_termination);
+	printf("%s%c", oid_to_hex(&result.tree->object.oid), line_termination);
+	if (!result.clean) {
+		struct string_list conflicted = STRING_LIST_INIT_NODUP;
+		const char *last = NULL;
+		int i;
+
+		merge_get_conflicted_files(&result, &conflicted);
+		for (i = 0; i < conflicted.nr; i++) {
+			const char *name = conflicted.items[i].string;
+			struct stage_info *c = conflicted.items[i].util;
+
+			if (o->name_only && last && !strcmp(last, name))
+				continue;
+			if (!o->name_only)
+				printf("%06o %s %d\t",
+				       c->mode, oid_to_hex(&c->oid), c->stage);
+			write_name_quoted_relative(name, prefix, stdout,
+						   line_termination);
+			last = name;
+		}
+		string_list_clear(&conflicted, 1);
+	}
+	if (show_messages) {
+		putchar(line_termination);
+		merge_display_update_messages(&opt, &result);
+	}
+	merge_finalize(&opt, &result);
+	return !result.clean;
+}
+
+static int merge_batch(struct merge_tree_options *o, const char *prefix)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	while (strbuf_getline_lf(&buf, stdin) != EOF) {
+		struct strbuf **split;
+
+		split = strbuf_split(&buf, ' ');
+		if (!split[0] || !split[1] || split[2])
+			die(_("malformed input line: '%s'."), buf.buf);
+		strbuf_rtrim(split[0]);
+		real_merge(o, split[0]->buf, split[1]->buf, prefix);
+		putchar(line_termination);
+		strbuf_list_free(split);
+		/* Let the caller read the result before sending more input */
+		maybe_flush_or_die(stdout, "stdout");
+	}
+	strbuf_release(&buf);
+	return 0;
+}
+
+static const char * const merge_tree_usage[] = {
+	N_("git merge-tree [--write-tree] [<options>] <branch1> <branch2>"),
+	N_("git merge-tree --write-tree --stdin [<options>]"),
+	N_("git merge-tree [--trivial-merge] <base-tree> <branch1> <branch2>"),
+	NULL
+};
+
+int cmd_merge_tree(int argc, const char **argv, const char *prefix)
+{
+	struct merge_tree_options o = { .show_messages = -1 };
+	int expected_remaining_argc;
+	int original_argc;
+
+	struct option mt_options[] = {
+		OPT_CMDMODE(0, "write-tree", &o.mode,
+			    N_("do a real merge instead of a trivial merge"),
+			    MODE_REAL),
+		OPT_CMDMODE(0, "trivial-merge", &o.mode,
+			    N_("do a trivial merge only"), MODE_TRIVIAL),
+		OPT_BOOL(0, "messages", &o.show_messages,
+			 N_("also show informational/conflict messages")),
+		OPT_SET_INT('z', NULL, &line_termination,
+			    N_("separate paths with the NUL character"), '\0'),
+		OPT_BOOL_F(0, "name-only", &o.name_only,
+			   N_("list filenames without modes/oids/stages"),
+			   PARSE_OPT_NONEG),
+		OPT_BOOL_F(0, "allow-unrelated-histories",
+			   &o.allow_unrelated_histories,
+			   N_("allow merging unrelated histories"),
+			   PARSE_OPT_NONEG),
+		OPT_BOOL_F(0, "stdin", &o.use_stdin,
+			   N_("perform multiple merges, one per line of input"),
+			   PARSE_OPT_NONEG),
+		OPT_END()
+	};
+
+	/* Parse arguments */
+	original_argc = argc - 1; /* ignoring argv[0] */
+	argc = parse_options(argc, argv, prefix, mt_options,
+			     merge_tree_usage, PARSE_OPT_STOP_AT_NON_OPTION);
+
+	if (o.use_stdin) {
+		if (o.mode == MODE_TRIVIAL)
+			die(_("--trivial-merge is incompatible with all other options"));
+		if (o.show_messages == 1)
+			die(_("--messages cannot be used with --stdin"));
+		if (argc)
+			usage_with_options(merge_tree_usage, mt_options);
+		o.mode = MODE_REAL;
+		o.show_messages = 0;
+		return merge_batch(&o, prefix);
+	}
+
+	switch (o.mode) {
+	default:
+		BUG("unexpected command mode %d", o.mode);
+	case MODE_UNKNOWN:
+		switch (argc) {
+		default:
+			usage_with_options(merge_tree_usage, mt_options);
+		case 2:
+			o.mode = MODE_REAL;
+			break;
+		case 3:
+			o.mode = MODE_TRIVIAL;
+			break;
+		}
+		expected_remaining_argc = argc;
+		break;
+	case MODE_REAL:
+		expected_remaining_argc = 2;
+		break;
+	case MODE_TRIVIAL:
+		expected_remaining_argc = 3;
+		/* Removal of `--trivial-merge` is expected */
+		original_argc--;
+		break;
+	}
+	if (o.mode == MODE_TRIVIAL && argc < original_argc)
+		die(_("--trivial-merge is incompatible with all other options"));
+
+	if (argc != expected_remaining_argc)
+		usage_with_options(merge_tree_usage, mt_options);
+
+	/* Do the relevant type of merge */
+	if (o.mode == MODE_REAL)
+		return real_merge(&o, argv[0], argv[1], prefix);
+	else
+		return trivial_merge(argv[0], argv[1], argv[2]);
+}
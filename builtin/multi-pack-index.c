@@ -6,13 +6,15 @@
 #include "trace2.h"
 
 static char const * const builtin_multi_pack_index_usage[] = {
-	N_("git multi-pack-index [--object-dir=<dir>] (write|verify|expire|repack --batch-size=<size>)"),
+	N_("git multi-pack-index [--object-dir=<dir>] (write [--preferred-pack=<pack>] [--bitmap]|verify|expire|repack --batch-size=<size>)"),
 	NULL
 };
 
 static struct opts_multi_pack_index {
 	const char *object_dir;
+	const char *preferred_pack;
 	unsigned long batch_size;
+	int write_bitmap;
 } opts;
 
 int cmd_multi_pack_index(int argc, const char **argv,
@@ -23,6 +25,10 @@ int cmd_multi_pack_index(int argc, const char **argv,
 		  N_("object directory containing set of packfile and pack-index pairs")),
 		OPT_MAGNITUDE(0, "batch-size", &opts.batch_size,
 		  N_("during repack, collect pack-files of smaller size into a batch that is larger than this size")),
+		OPT_STRING(0, "preferred-pack", &opts.preferred_pack, N_("pack"),
+		  N_("during write, prefer the objects of this pack-file")),
+		OPT_BOOL(0, "bitmap", &opts.write_bitmap,
+		  N_("during write, also write a reachability bitmap")),
 		OPT_END(),
 	};
 
@@ -52,7 +58,10 @@ int cmd_multi_pack_index(int argc, const char **argv,
 		die(_("--batch-size option is only for 'repack' subcommand"));
 
 	if (!strcmp(argv[0], "write"))
-		return write_midx_file(opts.object_dir);
+		return write_midx_file(opts.object_dir, opts.preferred_pack,
+				       opts.write_bitmap ? MIDX_WRITE_BITMAP : 0);
+	if (opts.preferred_pack || opts.write_bitmap)
+		die(_("--preferred-pack and --bitmap options are only for 'write' subcommand"));
 	if (!strcmp(argv[0], "verify"))
 		return verify_midx_file(the_repository, opts.object_dir);
 	if (!strcmp(argv[0], "expire"))
@@ -16,13 +16,19 @@
 #include "hashmap.h"
 #include "replace-object.h"
 #include "progress.h"
+#include "bloom.h"
 
 #define GRAPH_SIGNATURE 0x43475048 /* "CGPH" */
 #define GRAPH_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
 #define GRAPH_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
 #define GRAPH_CHUNKID_DATA 0x43444154 /* "CDAT" */
+#define GRAPH_CHUNKID_GENERATION_DATA 0x47444154 /* "GDAT" */
+#define GRAPH_CHUNKID_GENERATION_DATA_OVERFLOW 0x47444f56 /* "GDOV" */
 #define GRAPH_CHUNKID_EXTRAEDGES 0x45444745 /* "EDGE" */
 #define GRAPH_CHUNKID_BASE 0x42415345 /* "BASE" */
+#define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
+#define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
+#define MAX_NUM_CHUNKS 9
 
 #define GRAPH_DATA_WIDTH (the_hash_algo->rawsz + 16)
 
@@ -35,6 +41,8 @@
 
 #define GRAPH_LAST_EDGE 0x80000000
 
+#define CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW 0x80000000
+
 #define GRAPH_HEADER_SIZE 8
 #define GRAPH_FANOUT_SIZE (4 * 256)
 #define GRAPH_CHUNKLOOKUP_WIDTH 12
@@ -178,6 +186,8 @@ struct commit_graph *parse_commit_graph(void *graph_map, int fd,
 	uint32_t last_chunk_id;
 	uint32_t graph_signature;
 	unsigned char graph_version, hash_version;
+	uint64_t bloom_indexes_len = 0;
+	uint64_t generation_data_len = 0;
 
 	if (!graph_map)
 		return NULL;
@@ -221,7 +231,7 @@ struct commit_graph *parse_commit_graph(void *graph_map, int fd,
 	chunk_lookup = data + 8;
 	for (i = 0; i < graph->num_chunks; i++) {
 		uint32_t chunk_id;
-		uint64_t chunk_offset;
+		uint64_t chunk_offset, next_chunk_offset;
 		int chunk_repeated = 0;
 
 		if (data + graph_size - chunk_lookup <
@@ -243,6 +253,19 @@ struct commit_graph *parse_commit_graph(void *graph_map, int fd,
 			return NULL;
 		}
 
+		/*
+		 * The table of contents is terminated by an entry whose
+		 * offset marks the end of the last chunk, so the next
+		 * entry always tells us where this chunk ends.
+		 */
+		if (data + graph_size - chunk_lookup >= GRAPH_CHUNKLOOKUP_WIDTH)
+			next_chunk_offset = get_be64(chunk_lookup + 4);
+		else
+			next_chunk_offset = chunk_offset;
+		if (next_chunk_offset < chunk_offset ||
+		    next_chunk_offset > graph_size - the_hash_algo->rawsz)
+			next_chunk_offset = chunk_offset;
+
 		switch (chunk_id) {
 		case GRAPH_CHUNKID_OIDFANOUT:
 			if (graph->chunk_oid_fanout)
@@ -265,6 +288,24 @@ struct commit_graph *parse_commit_graph(void *graph_map, int fd,
 				graph->chunk_commit_data = data + chunk_offset;
 			break;
 
+		case GRAPH_CHUNKID_GENERATION_DATA:
+			if (graph->chunk_generation_data)
+				chunk_repeated = 1;
+			else {
+				graph->chunk_generation_data = data + chunk_offset;
+				generation_data_len = next_chunk_offset - chunk_offset;
+			}
+			break;
+
+		case GRAPH_CHUNKID_GENERATION_DATA_OVERFLOW:
+			if (graph->chunk_generation_data_overflow)
+				chunk_repeated = 1;
+			else {
+				graph->chunk_generation_data_overflow = data + chunk_offset;
+				graph->generation_data_overflow_len = next_chunk_offset - chunk_offset;
+			}
+			break;
+
 		case GRAPH_CHUNKID_EXTRAEDGES:
 			if (graph->chunk_extra_edges)
 				chunk_repeated = 1;
@@ -277,6 +318,38 @@ struct commit_graph *parse_commit_graph(void *graph_map, int fd,
 				chunk_repeated = 1;
 			else
 				graph->chunk_base_graphs = data + chunk_offset;
+			break;
+
+		case GRAPH_CHUNKID_BLOOMINDEXES:
+			if (graph->chunk_bloom_indexes)
+				chunk_repeated = 1;
+			else {
+				graph->chunk_bloom_indexes = data + chunk_offset;
+				bloom_indexes_len = next_chunk_offset - chunk_offset;
+			}
+			break;
+
+		case GRAPH_CHUNKID_BLOOMDATA:
+			if (graph->chunk_bloom_data)
+				chunk_repeated = 1;
+			else if (next_chunk_offset - chunk_offset <
+				 BLOOMDATA_CHUNK_HEADER_SIZE)
+				warning(_("commit-graph changed-path data chunk is too small"));
+			else {
+				uint32_t hash_version;
+				graph->chunk_bloom_data = data + chunk_offset;
+				graph->bloom_data_len = next_chunk_offset - chunk_offset;
+				hash_version = get_be32(data + chunk_offset);
+
+				if (hash_version != 1)
+					break;
+
+				graph->bloom_filter_settings = xmalloc(sizeof(struct bloom_filter_settings));
+				graph->bloom_filter_settings->hash_version = hash_version;
+				graph->bloom_filter_settings->num_hashes = get_be32(data + chunk_offset + 4);
+				graph->bloom_filter_settings->bits_per_entry = get_be32(data + chunk_offset + 8);
+			}
+			break;
 		}
 
 		if (chunk_repeated) {
@@ -295,9 +368,32 @@ struct commit_graph *parse_commit_graph(void *graph_map, int fd,
 		last_chunk_offset = chunk_offset;
 	}
 
+	if (graph->chunk_generation_data &&
+	    generation_data_len < (uint64_t)4 * graph->num_commits) {
+		warning(_("commit-graph generation data chunk is too small"));
+		graph->chunk_generation_data = NULL;
+	}
+	graph->read_generation_data = !!graph->chunk_generation_data;
+
+	if (graph->chunk_bloom_indexes && graph->chunk_bloom_data &&
+	    graph->bloom_filter_settings &&
+	    bloom_indexes_len < (uint64_t)4 * graph->num_commits) {
+		warning(_("commit-graph changed-path index chunk is too small"));
+		graph->chunk_bloom_indexes = NULL;
+	}
+
+	if (!graph->chunk_bloom_indexes || !graph->chunk_bloom_data ||
+	    !graph->bloom_filter_settings) {
+		/* We need all three pieces to make use of the filters. */
+		graph->chunk_bloom_indexes = NULL;
+		graph->chunk_bloom_data = NULL;
+		FREE_AND_NULL(graph->bloom_filter_settings);
+	}
+
 	hashcpy(graph->oid.hash, graph->data + graph->data_len - graph->hash_len);
 
 	if (verify_commit_graph_lite(graph)) {
+		free(graph->bloom_filter_settings);
 		free(graph);
 		return NULL;
 	}
@@ -369,6 +465,25 @@ static int add_graph_to_chain(struct commit_graph *g,
 	return 1;
 }
 
+/*
+ * Corrected commit dates and topological levels cannot be compared
+ * with each other, so only use the former if every file in the chain
+ * has them.
+ */
+static void validate_mixed_generation_chain(struct commit_graph *g)
+{
+	struct commit_graph *p;
+
+	for (p = g; p; p = p->base_graph)
+		if (!p->read_generation_data)
+			break;
+	if (!p)
+		return;
+
+	for (p = g; p; p = p->base_graph)
+		p->read_generation_data = 0;
+}
+
 static struct commit_graph *load_commit_graph_chain(struct repository *r, const char *obj_dir)
 {
 	struct commit_graph *graph_chain = NULL;
@@ -436,6 +551,8 @@ static struct commit_graph *load_commit_graph_chain(struct repository *r, const
 	fclose(fp);
 	strbuf_release(&line);
 
+	validate_mixed_generation_chain(graph_chain);
+
 	return graph_chain;
 }
 
@@ -458,6 +575,17 @@ static void prepare_commit_graph_one(struct repository *r, const char *obj_dir)
 	r->objects->commit_graph = read_commit_graph_one(r, obj_dir);
 }
 
+static int get_configured_generation_version(struct repository *r)
+{
+	int version = 2;
+
+	if (git_env_bool(GIT_TEST_COMMIT_GRAPH_NO_GDAT, 0))
+		return 1;
+
+	repo_config_get_int(r, "commitgraph.generationversion", &version);
+	return version;
+}
+
 /*
  * Return 1 if commit_graph is non-NULL, and 0 otherwise.
  *
@@ -496,6 +624,15 @@ static int prepare_commit_graph(struct repository *r)
 	     !r->objects->commit_graph && odb;
 	     odb = odb->next)
 		prepare_commit_graph_one(r, odb->path);
+
+	if (r->objects->commit_graph &&
+	    get_configured_generation_version(r) < 2) {
+		struct commit_graph *g;
+
+		for (g = r->objects->commit_graph; g; g = g->base_graph)
+			g->read_generation_data = 0;
+	}
+
 	return !!r->objects->commit_graph;
 }
 
@@ -517,6 +654,28 @@ int generation_numbers_enabled(struct repository *r)
 	return !!first_generation;
 }
 
+int corrected_commit_dates_enabled(struct repository *r)
+{
+	if (!prepare_commit_graph(r))
+		return 0;
+
+	return r->objects->commit_graph->read_generation_data;
+}
+
+struct bloom_filter_settings *get_bloom_filter_settings(struct repository *r)
+{
+	struct commit_graph *g;
+
+	if (!prepare_commit_graph(r))
+		return NULL;
+
+	for (g = r->objects->commit_graph; g; g = g->base_graph)
+		if (g->bloom_filter_settings)
+			return g->bloom_filter_settings;
+
+	return NULL;
+}
+
 static void close_commit_graph_one(struct commit_graph *g)
 {
 	if (!g)
@@ -528,6 +687,8 @@ static void close_commit_graph_one(struct commit_graph *g)
 
 void close_commit_graph(struct raw_object_store *o)
 {
+	/* Loaded filters point into the files we are about to unmap. */
+	deinit_bloom_filters();
 	close_commit_graph_one(o->commit_graph);
 	o->commit_graph = NULL;
 }
@@ -577,18 +738,68 @@ static struct commit_list **insert_parent_or_die(struct repository *r,
 	return &commit_list_insert(c, pptr)->next;
 }
 
+static timestamp_t graph_commit_date(struct commit_graph *g, uint32_t lex_index)
+{
+	const unsigned char *commit_data = g->chunk_commit_data +
+					   GRAPH_DATA_WIDTH * lex_index;
+	uint64_t date_high = get_be32(commit_data + g->hash_len + 8) & 0x3;
+	uint64_t date_low = get_be32(commit_data + g->hash_len + 12);
+
+	return (timestamp_t)((date_high << 32) | date_low);
+}
+
+static uint32_t graph_topo_level(struct commit_graph *g, uint32_t lex_index)
+{
+	const unsigned char *commit_data = g->chunk_commit_data +
+					   GRAPH_DATA_WIDTH * lex_index;
+
+	return get_be32(commit_data + g->hash_len + 8) >> 2;
+}
+
+static timestamp_t graph_corrected_commit_date(struct commit_graph *g,
+					       uint32_t lex_index,
+					       timestamp_t date)
+{
+	uint32_t offset = get_be32(g->chunk_generation_data + sizeof(uint32_t) * lex_index);
+	if (offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW) {
+		uint64_t pos = offset ^ CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
+
+		if (!g->chunk_generation_data_overflow ||
+		    (pos + 1) * sizeof(uint64_t) > g->generation_data_overflow_len)
+			die(_("commit-graph requires overflow generation data but has none"));
+
+		return date + get_be64(g->chunk_generation_data_overflow +
+				       sizeof(uint64_t) * pos);
+	}
+
+	return date + offset;
+}
+
+/*
+ * The generation number of the commit at 'lex_index' in 'g': its
+ * corrected commit date if we trust the generation data chunk of 'g',
+ * or its topological level otherwise.
+ */
+static timestamp_t graph_generation(struct commit_graph *g, uint32_t lex_index,
+				    timestamp_t date)
+{
+	if (!g->read_generation_data)
+		return graph_topo_level(g, lex_index);
+
+	return graph_corrected_commit_date(g, lex_index, date);
+}
+
 static void fill_commit_graph_info(struct commit *item, struct commit_graph *g, uint32_t pos)
 {
-	const unsigned char *commit_data;
 	uint32_t lex_index;
 
 	while (pos < g->num_commits_in_base)
 		g = g->base_graph;
 
 	lex_index = pos - g->num_commits_in_base;
-	commit_data = g->chunk_commit_data + GRAPH_DATA_WIDTH * lex_index;
 	item->graph_pos = pos;
-	item->generation = get_be32(commit_data + g->hash_len + 8) >> 2;
+	item->generation = graph_generation(g, lex_index,
+					    graph_commit_date(g, lex_index));
 }
 
 static inline void set_commit_tree(struct commit *c, struct tree *t)
@@ -602,7 +813,6 @@ static int fill_commit_in_graph(struct repository *r,
 {
 	uint32_t edge_value;
 	uint32_t *parent_data_ptr;
-	uint64_t date_low, date_high;
 	struct commit_list **pptr;
 	const unsigned char *commit_data;
 	uint32_t lex_index;
@@ -626,11 +836,8 @@ static int fill_commit_in_graph(struct repository *r,
 
 	set_commit_tree(item, NULL);
 
-	date_high = get_be32(commit_data + g->hash_len + 8) & 0x3;
-	date_low = get_be32(commit_data + g->hash_len + 12);
-	item->date = (timestamp_t)((date_high << 32) | date_low);
-
-	item->generation = get_be32(commit_data + g->hash_len + 8) >> 2;
+	item->date = graph_commit_date(g, lex_index);
+	item->generation = graph_generation(g, lex_index, item->date);
 
 	pptr = &item->parents;
 
@@ -760,6 +967,18 @@ struct packed_oid_list {
 	int alloc;
 };
 
+/*
+ * The generation numbers of a commit that is about to be written: its
+ * topological level goes into the commit data chunk, and its corrected
+ * commit date into the generation data chunk.
+ */
+struct generation_info {
+	uint32_t topo_level;
+	timestamp_t corrected_commit_date;
+};
+
+define_commit_slab(generation_info_slab, struct generation_info);
+
 struct write_commit_graph_context {
 	struct repository *r;
 	char *obj_dir;
@@ -784,7 +1003,14 @@ struct write_commit_graph_context {
 	unsigned append:1,
 		 report_progress:1,
 		 split:1,
-		 check_oids:1;
+		 check_oids:1,
+		 changed_paths:1,
+		 write_generation_data:1;
+
+	struct generation_info_slab generations;
+	uint32_t num_generation_data_overflows;
+
+	size_t total_bloom_filter_data_size;
 
 	const struct split_commit_graph_opts *split_opts;
 };
@@ -917,7 +1143,7 @@ static void write_graph_chunk_data(struct hashfile *f, int hash_len,
 		else
 			packedDate[0] = 0;
 
-		packedDate[0] |= htonl((*list)->generation << 2);
+		packedDate[0] |= htonl(generation_info_slab_at(&ctx->generations, *list)->topo_level << 2);
 
 		packedDate[1] = htonl((*list)->date);
 		hashwrite(f, packedDate, 8);
@@ -926,6 +1152,51 @@ static void write_graph_chunk_data(struct hashfile *f, int hash_len,
 	}
 }
 
+static timestamp_t corrected_commit_date_offset(struct write_commit_graph_context *ctx,
+						struct commit *c)
+{
+	return generation_info_slab_at(&ctx->generations, c)->corrected_commit_date -
+	       c->date;
+}
+
+static void write_graph_chunk_generation_data(struct hashfile *f,
+					      struct write_commit_graph_context *ctx)
+{
+	int i;
+	uint32_t num_generation_data_overflows = 0;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		timestamp_t offset = corrected_commit_date_offset(ctx, ctx->commits.list[i]);
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+
+		if (offset > GENERATION_NUMBER_V2_OFFSET_MAX) {
+			offset = CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW |
+				 num_generation_data_overflows;
+			num_generation_data_overflows++;
+		}
+
+		hashwrite_be32(f, offset);
+	}
+}
+
+static void write_graph_chunk_generation_data_overflow(struct hashfile *f,
+						       struct write_commit_graph_context *ctx)
+{
+	int i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		timestamp_t offset = corrected_commit_date_offset(ctx, ctx->commits.list[i]);
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+
+		if (offset > GENERATION_NUMBER_V2_OFFSET_MAX) {
+			hashwrite_be32(f, offset >> 32);
+			hashwrite_be32(f, (uint32_t)offset);
+		}
+	}
+}
+
 static void write_graph_chunk_extra_edges(struct hashfile *f,
 					  struct write_commit_graph_context *ctx)
 {
@@ -978,6 +1249,47 @@ static void write_graph_chunk_extra_edges(struct hashfile *f,
 	}
 }
 
+static void write_graph_chunk_bloom_indexes(struct hashfile *f,
+					    struct write_commit_graph_context *ctx)
+{
+	struct commit **list = ctx->commits.list;
+	struct commit **last = ctx->commits.list + ctx->commits.nr;
+	uint32_t cur_pos = 0;
+
+	while (list < last) {
+		struct bloom_filter *filter = get_bloom_filter(ctx->r, *list, 0);
+
+		if (!filter)
+			BUG("missing changed-path filter for %s",
+			    oid_to_hex(&(*list)->object.oid));
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		cur_pos += filter->len;
+		hashwrite_be32(f, cur_pos);
+		list++;
+	}
+}
+
+static void write_graph_chunk_bloom_data(struct hashfile *f,
+					 struct write_commit_graph_context *ctx,
+					 const struct bloom_filter_settings *settings)
+{
+	struct commit **list = ctx->commits.list;
+	struct commit **last = ctx->commits.list + ctx->commits.nr;
+
+	hashwrite_be32(f, settings->hash_version);
+	hashwrite_be32(f, settings->num_hashes);
+	hashwrite_be32(f, settings->bits_per_entry);
+
+	while (list < last) {
+		struct bloom_filter *filter = get_bloom_filter(ctx->r, *list, 0);
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite(f, filter->data, filter->len * sizeof(unsigned char));
+		list++;
+	}
+}
+
 static int oid_compare(const void *_a, const void *_b)
 {
 	const struct object_id *a = (const struct object_id *)_a;
@@ -1080,6 +1392,53 @@ static void close_reachable(struct write_commit_graph_context *ctx)
 	stop_progress(&ctx->progress);
 }
 
+/*
+ * A generation data chunk is only of use if every file below it in the
+ * chain has one as well.
+ */
+static int base_graphs_have_generation_data(struct commit_graph *g)
+{
+	for (; g; g = g->base_graph)
+		if (!g->chunk_generation_data)
+			return 0;
+	return 1;
+}
+
+/*
+ * Return the generation numbers of 'c' known so far, taking them from
+ * the commit-graph we are replacing or extending when 'c' is in there.
+ */
+static struct generation_info *commit_generation_info(struct write_commit_graph_context *ctx,
+						      struct commit *c)
+{
+	struct generation_info *info = generation_info_slab_at(&ctx->generations, c);
+	struct commit_graph *g = ctx->r->objects->commit_graph;
+	uint32_t lex_index;
+
+	if (info->topo_level || !g || c->graph_pos == COMMIT_NOT_FROM_GRAPH ||
+	    c->graph_pos >= g->num_commits + g->num_commits_in_base)
+		return info;
+
+	while (c->graph_pos < g->num_commits_in_base)
+		g = g->base_graph;
+	lex_index = c->graph_pos - g->num_commits_in_base;
+
+	info->topo_level = graph_topo_level(g, lex_index);
+	if (info->topo_level && base_graphs_have_generation_data(g))
+		info->corrected_commit_date =
+			graph_corrected_commit_date(g, lex_index,
+						    graph_commit_date(g, lex_index));
+
+	return info;
+}
+
+static int generation_info_complete(struct write_commit_graph_context *ctx,
+				    const struct generation_info *info)
+{
+	return info->topo_level &&
+	       (!ctx->write_generation_data || info->corrected_commit_date);
+}
+
 static void compute_generation_numbers(struct write_commit_graph_context *ctx)
 {
 	int i;
@@ -1091,8 +1450,8 @@ static void compute_generation_numbers(struct write_commit_graph_context *ctx)
 					ctx->commits.nr);
 	for (i = 0; i < ctx->commits.nr; i++) {
 		display_progress(ctx->progress, i + 1);
-		if (ctx->commits.list[i]->generation != GENERATION_NUMBER_INFINITY &&
-		    ctx->commits.list[i]->generation != GENERATION_NUMBER_ZERO)
+		if (generation_info_complete(ctx,
+				commit_generation_info(ctx, ctx->commits.list[i])))
 			continue;
 
 		commit_list_insert(ctx->commits.list[i], &list);
@@ -1100,29 +1459,83 @@ static void compute_generation_numbers(struct write_commit_graph_context *ctx)
 			struct commit *current = list->item;
 			struct commit_list *parent;
 			int all_parents_computed = 1;
-			uint32_t max_generation = 0;
+			uint32_t max_level = 0;
+			timestamp_t max_corrected_commit_date = 0;
+
+			repo_parse_commit(ctx->r, current);
 
 			for (parent = current->parents; parent; parent = parent->next) {
-				if (parent->item->generation == GENERATION_NUMBER_INFINITY ||
-				    parent->item->generation == GENERATION_NUMBER_ZERO) {
+				struct generation_info *p =
+					commit_generation_info(ctx, parent->item);
+
+				if (!generation_info_complete(ctx, p)) {
 					all_parents_computed = 0;
 					commit_list_insert(parent->item, &list);
 					break;
-				} else if (parent->item->generation > max_generation) {
-					max_generation = parent->item->generation;
 				}
+				if (p->topo_level > max_level)
+					max_level = p->topo_level;
+				if (p->corrected_commit_date > max_corrected_commit_date)
+					max_corrected_commit_date = p->corrected_commit_date;
 			}
 
 			if (all_parents_computed) {
-				current->generation = max_generation + 1;
+				struct generation_info *info =
+					commit_generation_info(ctx, current);
+
 				pop_commit(&list);
 
-				if (current->generation > GENERATION_NUMBER_MAX)
-					current->generation = GENERATION_NUMBER_MAX;
+				info->topo_level = max_level + 1;
+				if (info->topo_level > GENERATION_NUMBER_V1_MAX)
+					info->topo_level = GENERATION_NUMBER_V1_MAX;
+
+				/*
+				 * The corrected commit date is the commit date,
+				 * bumped up to be larger than those of all the
+				 * parents if the clock was skewed.
+				 */
+				info->corrected_commit_date = max_corrected_commit_date + 1;
+				if (current->date > info->corrected_commit_date)
+					info->corrected_commit_date = current->date;
 			}
 		}
 	}
 	stop_progress(&ctx->progress);
+
+	ctx->num_generation_data_overflows = 0;
+	if (!ctx->write_generation_data)
+		return;
+	for (i = 0; i < ctx->commits.nr; i++)
+		if (corrected_commit_date_offset(ctx, ctx->commits.list[i]) >
+		    GENERATION_NUMBER_V2_OFFSET_MAX)
+			ctx->num_generation_data_overflows++;
+}
+
+static void compute_bloom_filters(struct write_commit_graph_context *ctx)
+{
+	int i;
+	struct progress *progress = NULL;
+
+	ctx->total_bloom_filter_data_size = 0;
+
+	if (ctx->report_progress)
+		progress = start_delayed_progress(
+			_("Computing commit changed paths Bloom filters"),
+			ctx->commits.nr);
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct commit *c = ctx->commits.list[i];
+		struct bloom_filter *filter = get_bloom_filter(ctx->r, c, 1);
+
+		if (!filter)
+			die(_("unable to compute changed-path filter for %s"),
+			    oid_to_hex(&c->object.oid));
+
+		ctx->total_bloom_filter_data_size += filter->len;
+		display_progress(progress, i + 1);
+	}
+
+	stop_progress(&progress);
 }
 
 static int add_ref_to_list(const char *refname,
@@ -1345,12 +1758,13 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 	int fd;
 	struct hashfile *f;
 	struct lock_file lk = LOCK_INIT;
-	uint32_t chunk_ids[6];
-	uint64_t chunk_offsets[6];
+	uint32_t chunk_ids[MAX_NUM_CHUNKS + 1];
+	uint64_t chunk_offsets[MAX_NUM_CHUNKS + 1];
 	const unsigned hashsz = the_hash_algo->rawsz;
 	struct strbuf progress_title = STRBUF_INIT;
 	int num_chunks = 3;
 	struct object_id file_hash;
+	const struct bloom_filter_settings bloom_settings = DEFAULT_BLOOM_FILTER_SETTINGS;
 
 	if (ctx->split) {
 		struct strbuf tmp_file = STRBUF_INIT;
@@ -1391,10 +1805,24 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 	chunk_ids[0] = GRAPH_CHUNKID_OIDFANOUT;
 	chunk_ids[1] = GRAPH_CHUNKID_OIDLOOKUP;
 	chunk_ids[2] = GRAPH_CHUNKID_DATA;
+	if (ctx->write_generation_data) {
+		chunk_ids[num_chunks] = GRAPH_CHUNKID_GENERATION_DATA;
+		num_chunks++;
+	}
+	if (ctx->num_generation_data_overflows) {
+		chunk_ids[num_chunks] = GRAPH_CHUNKID_GENERATION_DATA_OVERFLOW;
+		num_chunks++;
+	}
 	if (ctx->num_extra_edges) {
 		chunk_ids[num_chunks] = GRAPH_CHUNKID_EXTRAEDGES;
 		num_chunks++;
 	}
+	if (ctx->changed_paths) {
+		chunk_ids[num_chunks] = GRAPH_CHUNKID_BLOOMINDEXES;
+		num_chunks++;
+		chunk_ids[num_chunks] = GRAPH_CHUNKID_BLOOMDATA;
+		num_chunks++;
+	}
 	if (ctx->num_commit_graphs_after > 1) {
 		chunk_ids[num_chunks] = GRAPH_CHUNKID_BASE;
 		num_chunks++;
@@ -1408,11 +1836,31 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 	chunk_offsets[3] = chunk_offsets[2] + (hashsz + 16) * ctx->commits.nr;
 
 	num_chunks = 3;
+	if (ctx->write_generation_data) {
+		chunk_offsets[num_chunks + 1] = chunk_offsets[num_chunks] +
+						sizeof(uint32_t) * ctx->commits.nr;
+		num_chunks++;
+	}
+	if (ctx->num_generation_data_overflows) {
+		chunk_offsets[num_chunks + 1] = chunk_offsets[num_chunks] +
+						sizeof(uint64_t) * ctx->num_generation_data_overflows;
+		num_chunks++;
+	}
 	if (ctx->num_extra_edges) {
 		chunk_offsets[num_chunks + 1] = chunk_offsets[num_chunks] +
 						4 * ctx->num_extra_edges;
 		num_chunks++;
 	}
+	if (ctx->changed_paths) {
+		chunk_offsets[num_chunks + 1] = chunk_offsets[num_chunks] +
+						sizeof(uint32_t) * ctx->commits.nr;
+		num_chunks++;
+
+		chunk_offsets[num_chunks + 1] = chunk_offsets[num_chunks] +
+						BLOOMDATA_CHUNK_HEADER_SIZE +
+						ctx->total_bloom_filter_data_size;
+		num_chunks++;
+	}
 	if (ctx->num_commit_graphs_after > 1) {
 		chunk_offsets[num_chunks + 1] = chunk_offsets[num_chunks] +
 						hashsz * (ctx->num_commit_graphs_after - 1);
@@ -1448,8 +1896,16 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 	write_graph_chunk_fanout(f, ctx);
 	write_graph_chunk_oids(f, hashsz, ctx);
 	write_graph_chunk_data(f, hashsz, ctx);
+	if (ctx->write_generation_data)
+		write_graph_chunk_generation_data(f, ctx);
+	if (ctx->num_generation_data_overflows)
+		write_graph_chunk_generation_data_overflow(f, ctx);
 	if (ctx->num_extra_edges)
 		write_graph_chunk_extra_edges(f, ctx);
+	if (ctx->changed_paths) {
+		write_graph_chunk_bloom_indexes(f, ctx);
+		write_graph_chunk_bloom_data(f, ctx, &bloom_settings);
+	}
 	if (ctx->num_commit_graphs_after > 1 &&
 	    write_graph_chunk_base(f, ctx)) {
 		return -1;
@@ -1780,7 +2236,20 @@ int write_commit_graph(const char *obj_dir,
 	ctx->report_progress = flags & COMMIT_GRAPH_WRITE_PROGRESS ? 1 : 0;
 	ctx->split = flags & COMMIT_GRAPH_WRITE_SPLIT ? 1 : 0;
 	ctx->check_oids = flags & COMMIT_GRAPH_WRITE_CHECK_OIDS ? 1 : 0;
+	ctx->changed_paths = flags & COMMIT_GRAPH_WRITE_BLOOM_FILTERS ? 1 : 0;
+	ctx->write_generation_data = get_configured_generation_version(ctx->r) == 2;
 	ctx->split_opts = split_opts;
+	init_generation_info_slab(&ctx->generations);
+
+	if (!ctx->changed_paths &&
+	    !(flags & COMMIT_GRAPH_NO_WRITE_BLOOM_FILTERS)) {
+		int config_value;
+
+		if (git_env_bool(GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS, 0) ||
+		    (!repo_config_get_bool(ctx->r, "commitgraph.changedpaths",
+					   &config_value) && config_value))
+			ctx->changed_paths = 1;
+	}
 
 	if (ctx->split) {
 		struct commit_graph *g;
@@ -1803,6 +2272,14 @@ int write_commit_graph(const char *obj_dir,
 				g = g->base_graph;
 			}
 		}
+
+		/*
+		 * Unless told otherwise, keep writing changed-path filters
+		 * when the chain we are extending has them.
+		 */
+		if (!(flags & COMMIT_GRAPH_NO_WRITE_BLOOM_FILTERS) &&
+		    get_bloom_filter_settings(ctx->r))
+			ctx->changed_paths = 1;
 	}
 
 	ctx->approx_nr_objects = approximate_object_count();
@@ -1870,11 +2347,17 @@ int write_commit_graph(const char *obj_dir,
 		split_graph_merge_strategy(ctx);
 
 		merge_commit_graphs(ctx);
+
+		if (!base_graphs_have_generation_data(ctx->new_base_graph))
+			ctx->write_generation_data = 0;
 	} else
 		ctx->num_commit_graphs_after = 1;
 
 	compute_generation_numbers(ctx);
 
+	if (ctx->changed_paths)
+		compute_bloom_filters(ctx);
+
 	res = write_commit_graph_file(ctx);
 
 	if (ctx->split)
@@ -1883,6 +2366,7 @@ int write_commit_graph(const char *obj_dir,
 	expire_commit_graphs(ctx);
 
 cleanup:
+	clear_generation_info_slab(&ctx->generations);
 	free(ctx->graph_name);
 	free(ctx->commits.list);
 	free(ctx->oids.list);
@@ -1907,6 +2391,14 @@ int write_commit_graph(const char *obj_dir,
 	return res;
 }
 
+static uint32_t commit_topo_level(struct commit_graph *g, const struct commit *c)
+{
+	while (c->graph_pos < g->num_commits_in_base)
+		g = g->base_graph;
+
+	return graph_topo_level(g, c->graph_pos - g->num_commits_in_base);
+}
+
 #define VERIFY_COMMIT_GRAPH_ERROR_HASH 2
 static int verify_commit_graph_error;
 
@@ -1977,6 +2469,16 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 		if (!parse_commit_in_graph_one(r, g, graph_commit))
 			graph_report(_("failed to parse commit %s from commit-graph"),
 				     oid_to_hex(&cur_oid));
+
+		if (g->chunk_bloom_indexes) {
+			uint32_t start = i ? get_be32(g->chunk_bloom_indexes + 4 * (i - 1)) : 0;
+			uint32_t end = get_be32(g->chunk_bloom_indexes + 4 * i);
+
+			if (end < start ||
+			    BLOOMDATA_CHUNK_HEADER_SIZE + end > g->bloom_data_len)
+				graph_report(_("commit-graph has invalid changed-path filter range for commit %s"),
+					     oid_to_hex(&cur_oid));
+		}
 	}
 
 	while (cur_fanout_pos < 256) {
@@ -1997,7 +2499,8 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 	for (i = 0; i < g->num_commits; i++) {
 		struct commit *graph_commit, *odb_commit;
 		struct commit_list *graph_parents, *odb_parents;
-		uint32_t max_generation = 0;
+		uint32_t topo_level, max_level = 0;
+		timestamp_t max_generation = 0;
 
 		display_progress(progress, i + 1);
 		hashcpy(cur_oid.hash, g->chunk_oid_lookup + g->hash_len * i);
@@ -2038,6 +2541,8 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 
 			if (graph_parents->item->generation > max_generation)
 				max_generation = graph_parents->item->generation;
+			if (commit_topo_level(g, graph_parents->item) > max_level)
+				max_level = commit_topo_level(g, graph_parents->item);
 
 			graph_parents = graph_parents->next;
 			odb_parents = odb_parents->next;
@@ -2047,7 +2552,21 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 			graph_report(_("commit-graph parent list for commit %s terminates early"),
 				     oid_to_hex(&cur_oid));
 
-		if (!graph_commit->generation) {
+		if (g->read_generation_data) {
+			timestamp_t corrected_commit_date = max_generation + 1;
+
+			if (graph_commit->date > corrected_commit_date)
+				corrected_commit_date = graph_commit->date;
+
+			if (graph_commit->generation != corrected_commit_date)
+				graph_report(_("commit-graph corrected commit date for commit %s is %"PRItime" != %"PRItime),
+					     oid_to_hex(&cur_oid),
+					     graph_commit->generation,
+					     corrected_commit_date);
+		}
+
+		topo_level = commit_topo_level(g, graph_commit);
+		if (!topo_level) {
 			if (generation_zero == GENERATION_NUMBER_EXISTS)
 				graph_report(_("commit-graph has generation number zero for commit %s, but non-zero elsewhere"),
 					     oid_to_hex(&cur_oid));
@@ -2060,18 +2579,18 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 			continue;
 
 		/*
-		 * If one of our parents has generation GENERATION_NUMBER_MAX, then
-		 * our generation is also GENERATION_NUMBER_MAX. Decrement to avoid
-		 * extra logic in the following condition.
+		 * If one of our parents has generation GENERATION_NUMBER_V1_MAX,
+		 * then our generation is also GENERATION_NUMBER_V1_MAX. Decrement
+		 * to avoid extra logic in the following condition.
 		 */
-		if (max_generation == GENERATION_NUMBER_MAX)
-			max_generation--;
+		if (max_level == GENERATION_NUMBER_V1_MAX)
+			max_level--;
 
-		if (graph_commit->generation != max_generation + 1)
+		if (topo_level != max_level + 1)
 			graph_report(_("commit-graph generation for commit %s is %u != %u"),
 				     oid_to_hex(&cur_oid),
-				     graph_commit->generation,
-				     max_generation + 1);
+				     topo_level,
+				     max_level + 1);
 
 		if (graph_commit->date != odb_commit->date)
 			graph_report(_("commit date for commit %s in commit-graph is %"PRItime" != %"PRItime),
@@ -2099,5 +2618,6 @@ void free_commit_graph(struct commit_graph *g)
 		close(g->graph_fd);
 	}
 	free(g->filename);
+	free(g->bloom_filter_settings);
 	free(g);
 }
@@ -8,8 +8,11 @@
 
 #define GIT_TEST_COMMIT_GRAPH "GIT_TEST_COMMIT_GRAPH"
 #define GIT_TEST_COMMIT_GRAPH_DIE_ON_LOAD "GIT_TEST_COMMIT_GRAPH_DIE_ON_LOAD"
+#define GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS "GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS"
+#define GIT_TEST_COMMIT_GRAPH_NO_GDAT "GIT_TEST_COMMIT_GRAPH_NO_GDAT"
 
 struct commit;
+struct bloom_filter_settings;
 
 char *get_commit_graph_filename(const char *obj_dir);
 int open_commit_graph(const char *graph_file, int *fd, struct stat *st);
@@ -56,8 +59,23 @@ struct commit_graph {
 	const uint32_t *chunk_oid_fanout;
 	const unsigned char *chunk_oid_lookup;
 	const unsigned char *chunk_commit_data;
+	const unsigned char *chunk_generation_data;
+	const unsigned char *chunk_generation_data_overflow;
+	size_t generation_data_overflow_len;
 	const unsigned char *chunk_extra_edges;
 	const unsigned char *chunk_base_graphs;
+	const unsigned char *chunk_bloom_indexes;
+	const unsigned char *chunk_bloom_data;
+	size_t bloom_data_len;
+
+	struct bloom_filter_settings *bloom_filter_settings;
+
+	/*
+	 * Set when this file and every file below it in the chain store
+	 * corrected commit dates, which are then used as the generation
+	 * numbers of their commits instead of the topological levels.
+	 */
+	unsigned read_generation_data : 1;
 };
 
 struct commit_graph *load_commit_graph_one_fd_st(int fd, struct stat *st);
@@ -71,12 +89,31 @@ struct commit_graph *parse_commit_graph(void *graph_map, int fd,
  */
 int generation_numbers_enabled(struct repository *r);
 
+/*
+ * Return 1 if and only if the generation numbers of the commits in the
+ * repository's commit-graph are corrected commit dates.
+ */
+int corrected_commit_dates_enabled(struct repository *r);
+
+/*
+ * Return the settings of the changed-path Bloom filters stored in the
+ * repository's commit-graph, or NULL if it has none.
+ */
+struct bloom_filter_settings *get_bloom_filter_settings(struct repository *r);
+
 enum commit_graph_write_flags {
 	COMMIT_GRAPH_WRITE_APPEND     = (1 << 0),
 	COMMIT_GRAPH_WRITE_PROGRESS   = (1 << 1),
 	COMMIT_GRAPH_WRITE_SPLIT      = (1 << 2),
 	/* Make sure that each OID in the input is a valid commit OID. */
-	COMMIT_GRAPH_WRITE_CHECK_OIDS = (1 << 3)
+	COMMIT_GRAPH_WRITE_CHECK_OIDS = (1 << 3),
+	/* Write changed-path Bloom filters for each commit. */
+	COMMIT_GRAPH_WRITE_BLOOM_FILTERS = (1 << 4),
+	/*
+	 * Do not write changed-path Bloom filters, even if the existing
+	 * commit-graph has them.
+	 */
+	COMMIT_GRAPH_NO_WRITE_BLOOM_FILTERS = (1 << 5)
 };
 
 struct split_commit_graph_opts {
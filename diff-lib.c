@@ -377,6 +377,25 @@ static int show_modified(struct rev_info *revs,
 	return 0;
 }
 
+/*
+ * A sparse directory entry of a sparse index stands for a whole tree,
+ * which is compared with the tree of the same directory, if any.
+ */
+static void diff_sparse_directory(struct rev_info *revs,
+				  const struct cache_entry *tree,
+				  const struct cache_entry *idx)
+{
+	unsigned recursive = revs->diffopt.flags.recursive;
+
+	if (tree && oideq(&tree->oid, &idx->oid))
+		return;
+
+	revs->diffopt.flags.recursive = 1;
+	diff_tree_oid(tree ? &tree->oid : NULL, &idx->oid, idx->name,
+		      &revs->diffopt);
+	revs->diffopt.flags.recursive = recursive;
+}
+
 /*
  * This gets a mix of an existing index and a tree, one pathname entry
  * at a time. The index entry may be a single stage-0 one, but it could
@@ -423,6 +442,11 @@ static void do_oneway_diff(struct unpack_trees_options *o,
 		return;
 	}
 
+	if (idx && S_ISSPARSEDIR(idx->ce_mode)) {
+		diff_sparse_directory(revs, tree, idx);
+		return;
+	}
+
 	/*
 	 * Something added to the tree?
 	 */
@@ -19,6 +19,7 @@ struct option;
 struct repository;
 struct rev_info;
 struct strbuf;
+struct strmap;
 struct userdiff_driver;
 
 typedef int (*pathchange_fn_t)(struct diff_options *options,
@@ -156,8 +157,17 @@ struct diff_options {
 	int rename_score;
 	int rename_limit;
 	int needed_rename_limit;
+	/* 0 picks a count based on the number of CPUs */
+	int rename_threads;
 	int degraded_cc_to_c;
 	int show_rename_progress;
+
+	/*
+	 * If set, only the deleted paths in this map are considered as
+	 * sources for inexact rename detection; all of them are still
+	 * paired up with identical destinations.
+	 */
+	struct strmap *relevant_sources;
 	int dirstat_permille;
 	int setup;
 	int abbrev;
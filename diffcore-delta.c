@@ -1,6 +1,7 @@
 #include "cache.h"
 #include "diff.h"
 #include "diffcore.h"
+#include "fingerprint-cache.h"
 
 /*
  * Idea here is very simple.
@@ -121,6 +122,32 @@ static int spanhash_cmp(const void *a_, const void *b_)
 		a->hashval > b->hashval ? 1 : 0;
 }
 
+static void cache_spanhash(struct repository *r,
+			   struct diff_filespec *one,
+			   struct spanhash_top *hash, int is_text)
+{
+	uint32_t *pairs;
+	unsigned int flags = 0;
+	int i, nr = 0;
+
+	if (!one->oid_valid || !fingerprint_cache_enabled(r))
+		return;
+
+	while (nr < (1 << hash->alloc_log2) && hash->data[nr].cnt)
+		nr++;
+	ALLOC_ARRAY(pairs, st_mult(nr, 2));
+	for (i = 0; i < nr; i++) {
+		pairs[2 * i] = hash->data[i].hashval;
+		pairs[2 * i + 1] = hash->data[i].cnt;
+	}
+	if (is_text)
+		flags |= FINGERPRINT_TEXT;
+	if (memmem(one->data, one->size, "\r\n", 2))
+		flags |= FINGERPRINT_CRLF;
+	fingerprint_cache_add(r, &one->oid, one->size, flags, pairs, nr);
+	free(pairs);
+}
+
 static struct spanhash_top *hash_chars(struct repository *r,
 				       struct diff_filespec *one)
 {
@@ -160,9 +187,55 @@ static struct spanhash_top *hash_chars(struct repository *r,
 		accum1 = accum2 = 0;
 	}
 	QSORT(hash->data, 1ul << hash->alloc_log2, spanhash_cmp);
+	cache_spanhash(r, one, hash, is_text);
 	return hash;
 }
 
+int diffcore_lookup_count_changes(struct repository *r,
+				  struct diff_filespec *one,
+				  void **count_p)
+{
+	struct fingerprint fp;
+	struct spanhash_top *hash;
+	uint32_t i;
+	int log2 = 0;
+
+	if (*count_p || !one->oid_valid ||
+	    fingerprint_cache_get(r, &one->oid, &fp))
+		return -1;
+
+	/*
+	 * Whether CR in CRLF is ignored depends on the attributes of the
+	 * path, not only on the contents.
+	 */
+	if ((fp.flags & FINGERPRINT_CRLF) &&
+	    !diff_filespec_is_binary(r, one) != !!(fp.flags & FINGERPRINT_TEXT))
+		return -1;
+
+	while ((1u << log2) < fp.nr + 1)
+		log2++;
+	hash = xmalloc(st_add(sizeof(*hash),
+			      st_mult(sizeof(struct spanhash), 1u << log2)));
+	hash->alloc_log2 = log2;
+	hash->free = 0;
+	memset(hash->data, 0, sizeof(struct spanhash) * (1u << log2));
+	for (i = 0; i < fp.nr; i++) {
+		hash->data[i].hashval = get_be32(fp.pairs + i * 8);
+		hash->data[i].cnt = get_be32(fp.pairs + i * 8 + 4);
+	}
+	one->size = fp.size;
+	*count_p = hash;
+	return 0;
+}
+
+void diffcore_prepare_count_changes(struct repository *r,
+				    struct diff_filespec *one,
+				    void **count_p)
+{
+	if (!*count_p)
+		*count_p = hash_chars(r, one);
+}
+
 int diffcore_count_changes(struct repository *r,
 			   struct diff_filespec *src,
 			   struct diff_filespec *dst,
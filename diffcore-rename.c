@@ -7,6 +7,9 @@
 #include "object-store.h"
 #include "hashmap.h"
 #include "progress.h"
+#include "strmap.h"
+#include "thread-utils.h"
+#include "fingerprint-cache.h"
 
 /* Table of rename/copy destinations */
 
@@ -156,6 +159,13 @@ static int estimate_similarity(struct repository *r,
 	if (!S_ISREG(src->mode) || !S_ISREG(dst->mode))
 		return 0;
 
+	/*
+	 * The fingerprint cache may know the size and the fingerprint
+	 * of either side without our having to read it.
+	 */
+	diffcore_lookup_count_changes(r, src, &src->cnt_data);
+	diffcore_lookup_count_changes(r, dst, &dst->cnt_data);
+
 	/*
 	 * Need to check that source and destination sizes are
 	 * filled in before comparing them.
@@ -380,6 +390,157 @@ static void record_if_better(struct diff_score m[], struct diff_score *o)
 		m[worst] = *o;
 }
 
+/*
+ * Fill in the row "m" of the rename matrix with the best candidates for
+ * the destination rename_dst[dst_index].  With "prepared", the data of
+ * all candidates has been hashed beforehand, which makes this safe to
+ * call from several threads at once.
+ */
+static void score_rename_row(struct repository *r,
+			     struct diff_score *m, int dst_index,
+			     int minimum_score, int skip_unmodified,
+			     int prepared)
+{
+	struct diff_filespec *two = rename_dst[dst_index].two;
+	int j;
+
+	for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+		m[j].dst = -1;
+
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+		struct diff_score this_src;
+
+		if (skip_unmodified &&
+		    diff_unmodified_pair(rename_src[j].p))
+			continue;
+
+		if (prepared && (!one->cnt_data || !two->cnt_data))
+			this_src.score = 0;
+		else
+			this_src.score = estimate_similarity(r, one, two,
+							     minimum_score);
+		this_src.name_score = basename_same(one, two);
+		this_src.dst = dst_index;
+		this_src.src = j;
+		record_if_better(m, &this_src);
+		if (prepared)
+			continue;
+		/*
+		 * Once we run estimate_similarity,
+		 * We do not need the text anymore.
+		 */
+		diff_free_filespec_blob(one);
+		diff_free_filespec_blob(two);
+	}
+}
+
+/*
+ * Below this many candidate pairs, hashing every file up front and
+ * starting threads costs more than it saves, unless the user asked
+ * for a specific number of threads.
+ */
+#define RENAME_THREADS_MIN_PAIRS 10000
+
+struct rename_matrix {
+	struct repository *repo;
+	struct diff_score *mx;
+	int *rows;
+	int nr_rows;
+	int minimum_score;
+	int skip_unmodified;
+	struct progress *progress;
+
+	pthread_mutex_t mutex;
+	int next_row;
+	uint64_t done;
+};
+
+static int get_rename_threads(struct diff_options *options, int num_create)
+{
+	int nr = options->rename_threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+	if (nr <= 0) {
+		if ((uint64_t)num_create * rename_src_nr <
+		    RENAME_THREADS_MIN_PAIRS)
+			return 1;
+		nr = online_cpus();
+	}
+	return nr < num_create ? nr : num_create;
+}
+
+/*
+ * Hash the contents of every file that takes part in the matrix once, so
+ * that the workers never need to read from the object store.
+ */
+static void prepare_rename_file(struct repository *r, struct diff_filespec *one)
+{
+	if (!S_ISREG(one->mode) || one->cnt_data ||
+	    !diffcore_lookup_count_changes(r, one, &one->cnt_data))
+		return;
+	if (diff_populate_filespec(r, one, 0))
+		return;
+	diffcore_prepare_count_changes(r, one, &one->cnt_data);
+	diff_free_filespec_blob(one);
+}
+
+static void *rename_matrix_worker(void *data)
+{
+	struct rename_matrix *rm = data;
+
+	for (;;) {
+		int row;
+
+		pthread_mutex_lock(&rm->mutex);
+		row = rm->next_row++;
+		pthread_mutex_unlock(&rm->mutex);
+		if (row >= rm->nr_rows)
+			break;
+
+		score_rename_row(rm->repo, &rm->mx[row * NUM_CANDIDATE_PER_DST],
+				 rm->rows[row], rm->minimum_score,
+				 rm->skip_unmodified, 1);
+
+		pthread_mutex_lock(&rm->mutex);
+		rm->done += rename_src_nr;
+		display_progress(rm->progress, rm->done);
+		pthread_mutex_unlock(&rm->mutex);
+	}
+	return NULL;
+}
+
+static void score_rename_matrix_threaded(struct rename_matrix *rm,
+					 int nr_threads)
+{
+	pthread_t *threads;
+	int i;
+
+	for (i = 0; i < rename_src_nr; i++) {
+		if (rm->skip_unmodified &&
+		    diff_unmodified_pair(rename_src[i].p))
+			continue;
+		prepare_rename_file(rm->repo, rename_src[i].p->one);
+	}
+	for (i = 0; i < rm->nr_rows; i++)
+		prepare_rename_file(rm->repo, rename_dst[rm->rows[i]].two);
+
+	pthread_mutex_init(&rm->mutex, NULL);
+	ALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 rename_matrix_worker, rm);
+		if (err)
+			die(_("unable to create threaded rename detection: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&rm->mutex);
+}
+
 /*
  * Returns:
  * 0 if we are under the limit;
@@ -428,6 +589,238 @@ static int too_many_rename_candidates(int num_create,
 	return 1;
 }
 
+static void remove_irrelevant_sources(struct strmap *relevant_sources)
+{
+	int i, nr = 0;
+
+	for (i = 0; i < rename_src_nr; i++) {
+		if (!strmap_contains(relevant_sources,
+				     rename_src[i].p->one->path))
+			continue;
+		rename_src[nr++] = rename_src[i];
+	}
+	rename_src_nr = nr;
+}
+
+static const char *get_basename(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+/* Turn "dir" into its parent directory, "" for the toplevel */
+static void strip_last_component(struct strbuf *dir)
+{
+	strbuf_setlen(dir, get_basename(dir->buf) - dir->buf);
+	strbuf_strip_suffix(dir, "/");
+}
+
+static void get_dirname(struct strbuf *dir, const char *path)
+{
+	strbuf_reset(dir);
+	strbuf_addstr(dir, path);
+	strip_last_component(dir);
+}
+
+/*
+ * Pair up a source and a destination that have the same basename if
+ * they are similar enough, without looking at any other candidates.
+ */
+static int try_basename_pair(struct repository *r,
+			     int dst_index, int src_index,
+			     int minimum_score)
+{
+	struct diff_filespec *one = rename_src[src_index].p->one;
+	struct diff_filespec *two = rename_dst[dst_index].two;
+	int score;
+
+	if (one->rename_used || rename_dst[dst_index].pair ||
+	    !basename_same(one, two))
+		return 0;
+
+	score = estimate_similarity(r, one, two, minimum_score);
+	diff_free_filespec_blob(one);
+	diff_free_filespec_blob(two);
+	if (score < minimum_score)
+		return 0;
+	record_rename_pair(dst_index, src_index, score);
+	return 1;
+}
+
+#define UNIQUE_INDEX(i) ((void *)(intptr_t)((i) + 1))
+#define INDEX_OF(v) ((int)(intptr_t)(v) - 1)
+
+static void add_unique(struct strmap *map, const char *key, int i)
+{
+	if (strmap_contains(map, key))
+		strmap_put(map, key, NULL);
+	else
+		strmap_put(map, key, UNIQUE_INDEX(i));
+}
+
+/*
+ * When a file whose basename appears only once among the remaining
+ * sources and only once among the remaining destinations moved to
+ * another directory, it was most likely renamed, so compare the two
+ * directly instead of against every other candidate.
+ */
+static int find_basename_matches(struct diff_options *options,
+				 int minimum_score)
+{
+	struct strmap sources, dests;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	int i, count = 0;
+
+	strmap_init_with_options(&sources, NULL, 0);
+	strmap_init_with_options(&dests, NULL, 0);
+	for (i = 0; i < rename_src_nr; i++)
+		if (!rename_src[i].p->one->rename_used)
+			add_unique(&sources,
+				   get_basename(rename_src[i].p->one->path), i);
+	for (i = 0; i < rename_dst_nr; i++)
+		if (!rename_dst[i].pair)
+			add_unique(&dests, get_basename(rename_dst[i].two->path), i);
+
+	strmap_for_each_entry(&dests, &iter, e) {
+		void *src = strmap_get(&sources, e->key);
+
+		if (!e->value || !src)
+			continue;
+		count += try_basename_pair(options->repo, INDEX_OF(e->value),
+					   INDEX_OF(src), minimum_score);
+	}
+
+	strmap_clear(&sources, 0);
+	strmap_clear(&dests, 0);
+	return count;
+}
+
+static void count_dir_rename(struct strmap *dir_counts,
+			     const char *old_dir, const char *new_dir)
+{
+	struct strmap *counts = strmap_get(dir_counts, old_dir);
+
+	if (!counts) {
+		counts = xmalloc(sizeof(*counts));
+		strmap_init(counts);
+		strmap_put(dir_counts, old_dir, counts);
+	}
+	strmap_put(counts, new_dir,
+		   (void *)((intptr_t)strmap_get(counts, new_dir) + 1));
+}
+
+/*
+ * Guess where each directory went from the renames found so far, by
+ * picking the directory most of its files were renamed into, and look
+ * for each remaining source under the same basename there.  A rename
+ * from "a/b/c/file" to "x/b/c/file" also counts as "a/b" having moved
+ * to "x/b" and "a" to "x", which lets files in "a/d/" be found in
+ * "x/d/" even if nothing in "a/d/" has been paired up yet.
+ */
+static int find_dir_guided_matches(struct diff_options *options,
+				   int minimum_score)
+{
+	struct strmap dir_counts, dir_renames, dests;
+	struct hashmap_iter iter, iter2;
+	struct strmap_entry *e, *e2;
+	struct strbuf old_dir = STRBUF_INIT, new_dir = STRBUF_INIT;
+	int i, count = 0;
+
+	strmap_init(&dir_counts);
+	for (i = 0; i < rename_dst_nr; i++) {
+		struct diff_filepair *p = rename_dst[i].pair;
+
+		if (!p)
+			continue;
+		get_dirname(&old_dir, p->one->path);
+		get_dirname(&new_dir, p->two->path);
+		while (strcmp(old_dir.buf, new_dir.buf)) {
+			const char *old_base = get_basename(old_dir.buf);
+			const char *new_base = get_basename(new_dir.buf);
+
+			count_dir_rename(&dir_counts, old_dir.buf, new_dir.buf);
+			if (old_base == old_dir.buf || new_base == new_dir.buf ||
+			    strcmp(old_base, new_base))
+				break;
+			strip_last_component(&old_dir);
+			strip_last_component(&new_dir);
+		}
+	}
+	if (strmap_empty(&dir_counts)) {
+		strmap_clear(&dir_counts, 0);
+		strbuf_release(&old_dir);
+		strbuf_release(&new_dir);
+		return 0;
+	}
+
+	strmap_init(&dir_renames);
+	strmap_for_each_entry(&dir_counts, &iter, e) {
+		struct strmap *counts = e->value;
+		const char *best = NULL;
+		intptr_t best_count = 0;
+
+		strmap_for_each_entry(counts, &iter2, e2) {
+			intptr_t n = (intptr_t)e2->value;
+
+			if (n > best_count ||
+			    (n == best_count && strcmp(e2->key, best) < 0)) {
+				best = e2->key;
+				best_count = n;
+			}
+		}
+		strmap_put(&dir_renames, e->key, xstrdup(best));
+		strmap_clear(counts, 0);
+	}
+	strmap_clear(&dir_counts, 1);
+
+	strmap_init_with_options(&dests, NULL, 0);
+	for (i = 0; i < rename_dst_nr; i++)
+		if (!rename_dst[i].pair)
+			strmap_put(&dests, rename_dst[i].two->path,
+				   UNIQUE_INDEX(i));
+
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filespec *one = rename_src[i].p->one;
+		const char *dir;
+		void *dst;
+
+		if (one->rename_used)
+			continue;
+		get_dirname(&old_dir, one->path);
+		while (!(dir = strmap_get(&dir_renames, old_dir.buf)) &&
+		       old_dir.len)
+			strip_last_component(&old_dir);
+		if (!dir)
+			continue;
+		strbuf_reset(&new_dir);
+		strbuf_addf(&new_dir, "%s%s", dir, one->path + old_dir.len);
+		dst = strmap_get(&dests, new_dir.buf);
+		if (dst)
+			count += try_basename_pair(options->repo, INDEX_OF(dst),
+						   i, minimum_score);
+	}
+
+	strmap_clear(&dests, 0);
+	strmap_clear(&dir_renames, 1);
+	strbuf_release(&old_dir);
+	strbuf_release(&new_dir);
+	return count;
+}
+
+/* Sources that have already been renamed cannot be renamed again */
+static void remove_used_sources(void)
+{
+	int i, nr = 0;
+
+	for (i = 0; i < rename_src_nr; i++) {
+		if (rename_src[i].p->one->rename_used)
+			continue;
+		rename_src[nr++] = rename_src[i];
+	}
+	rename_src_nr = nr;
+}
+
 static int find_renames(struct diff_score *mx, int dst_cnt, int minimum_score, int copies)
 {
 	int count = 0, i;
@@ -456,8 +849,8 @@ void diffcore_rename(struct diff_options *options)
 	struct diff_queue_struct *q = &diff_queued_diff;
 	struct diff_queue_struct outq;
 	struct diff_score *mx;
-	int i, j, rename_count, skip_unmodified = 0;
-	int num_create, dst_cnt;
+	int i, rename_count, skip_unmodified = 0;
+	int num_create, dst_cnt, nr_threads;
 	struct progress *progress = NULL;
 
 	if (!minimum_score)
@@ -528,6 +921,33 @@ void diffcore_rename(struct diff_options *options)
 	if (!num_create)
 		goto cleanup;
 
+	/*
+	 * Sources that the caller does not care about do not need to
+	 * be compared against every remaining destination.
+	 */
+	if (options->relevant_sources) {
+		remove_irrelevant_sources(options->relevant_sources);
+		if (!rename_src_nr)
+			goto cleanup;
+	}
+
+	if (detect_rename == DIFF_DETECT_RENAME) {
+		/*
+		 * Pairing up files by name is cheap but does not weigh
+		 * them against the other candidates, so require them to
+		 * be more similar than the matrix below would.
+		 */
+		int basename_score = minimum_score +
+				     (MAX_SCORE - minimum_score) / 2;
+
+		rename_count += find_basename_matches(options, basename_score);
+		rename_count += find_dir_guided_matches(options, basename_score);
+		remove_used_sources();
+		num_create = rename_dst_nr - rename_count;
+		if (!num_create || !rename_src_nr)
+			goto cleanup;
+	}
+
 	switch (too_many_rename_candidates(num_create, options)) {
 	case 1:
 		goto cleanup;
@@ -546,41 +966,32 @@ void diffcore_rename(struct diff_options *options)
 	}
 
 	mx = xcalloc(st_mult(NUM_CANDIDATE_PER_DST, num_create), sizeof(*mx));
-	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
-		struct diff_filespec *two = rename_dst[i].two;
-		struct diff_score *m;
-
-		if (rename_dst[i].pair)
-			continue; /* dealt with exact match already. */
-
-		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
-		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
-			m[j].dst = -1;
-
-		for (j = 0; j < rename_src_nr; j++) {
-			struct diff_filespec *one = rename_src[j].p->one;
-			struct diff_score this_src;
-
-			if (skip_unmodified &&
-			    diff_unmodified_pair(rename_src[j].p))
-				continue;
-
-			this_src.score = estimate_similarity(options->repo,
-							     one, two,
-							     minimum_score);
-			this_src.name_score = basename_same(one, two);
-			this_src.dst = i;
-			this_src.src = j;
-			record_if_better(m, &this_src);
-			/*
-			 * Once we run estimate_similarity,
-			 * We do not need the text anymore.
-			 */
-			diff_free_filespec_blob(one);
-			diff_free_filespec_blob(two);
+	nr_threads = get_rename_threads(options, num_create);
+	if (nr_threads > 1) {
+		struct rename_matrix rm = { options->repo, mx };
+
+		ALLOC_ARRAY(rm.rows, num_create);
+		for (i = 0; i < rename_dst_nr; i++)
+			if (!rename_dst[i].pair)
+				rm.rows[rm.nr_rows++] = i;
+		rm.minimum_score = minimum_score;
+		rm.skip_unmodified = skip_unmodified;
+		rm.progress = progress;
+		score_rename_matrix_threaded(&rm, nr_threads);
+		dst_cnt = rm.nr_rows;
+		free(rm.rows);
+	} else {
+		for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
+			if (rename_dst[i].pair)
+				continue; /* dealt with exact match already. */
+
+			score_rename_row(options->repo,
+					 &mx[dst_cnt * NUM_CANDIDATE_PER_DST],
+					 i, minimum_score, skip_unmodified, 0);
+			dst_cnt++;
+			display_progress(progress,
+					 (uint64_t)(i+1)*(uint64_t)rename_src_nr);
 		}
-		dst_cnt++;
-		display_progress(progress, (uint64_t)(i+1)*(uint64_t)rename_src_nr);
 	}
 	stop_progress(&progress);
 
@@ -680,5 +1091,6 @@ void diffcore_rename(struct diff_options *options)
 	rename_dst_nr = rename_dst_alloc = 0;
 	FREE_AND_NULL(rename_src);
 	rename_src_nr = rename_src_alloc = 0;
+	fingerprint_cache_flush(options->repo);
 	return;
 }
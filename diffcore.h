@@ -150,4 +150,21 @@ int diffcore_count_changes(struct repository *r,
 			   unsigned long *src_copied,
 			   unsigned long *literal_added);
 
+/*
+ * Compute the data diffcore_count_changes() needs about "one" and keep
+ * it in *count_p, unless it is already there.  "one" must have been
+ * populated.
+ */
+void diffcore_prepare_count_changes(struct repository *r,
+				    struct diff_filespec *one,
+				    void **count_p);
+
+/*
+ * Fill in one->size and *count_p from the fingerprint cache without
+ * reading "one".  Returns 0 on success and -1 if "one" is not cached.
+ */
+int diffcore_lookup_count_changes(struct repository *r,
+				  struct diff_filespec *one,
+				  void **count_p);
+
 #endif
@@ -22,6 +22,7 @@
 #include "connected.h"
 #include "fetch-negotiator.h"
 #include "fsck.h"
+#include "url.h"
 
 static int transfer_unpack_limit = -1;
 static int fetch_unpack_limit = -1;
@@ -38,6 +39,7 @@ static struct lock_file shallow_lock;
 static const char *alternate_shallow_file;
 static char *negotiation_algorithm;
 static struct strbuf fsck_msg_types = STRBUF_INIT;
+static struct string_list uri_protocols = STRING_LIST_INIT_DUP;
 
 /* Remember to update object flag allocation in object.h */
 #define COMPLETE	(1U << 0)
@@ -758,8 +760,18 @@ static int sideband_demux(int in, int out, void *data)
 	return ret;
 }
 
+static void add_index_pack_keep_option(struct argv_array *args)
+{
+	char hostname[HOST_NAME_MAX + 1];
+
+	if (xgethostname(hostname, sizeof(hostname)))
+		xsnprintf(hostname, sizeof(hostname), "localhost");
+	argv_array_pushf(args, "--keep=fetch-pack %"PRIuMAX " on %s",
+			 (uintmax_t)getpid(), hostname);
+}
+
 static int get_pack(struct fetch_pack_args *args,
-		    int xd[2], char **pack_lockfile)
+		    int xd[2], struct string_list *pack_lockfiles)
 {
 	struct async demux;
 	int do_keep = args->keep_pack;
@@ -802,7 +814,7 @@ static int get_pack(struct fetch_pack_args *args,
 	}
 
 	if (do_keep || args->from_promisor) {
-		if (pack_lockfile)
+		if (pack_lockfiles)
 			cmd.out = -1;
 		cmd_name = "index-pack";
 		argv_array_push(&cmd.args, cmd_name);
@@ -811,14 +823,8 @@ static int get_pack(struct fetch_pack_args *args,
 			argv_array_push(&cmd.args, "-v");
 		if (args->use_thin_pack)
 			argv_array_push(&cmd.args, "--fix-thin");
-		if (do_keep && (args->lock_pack || unpack_limit)) {
-			char hostname[HOST_NAME_MAX + 1];
-			if (xgethostname(hostname, sizeof(hostname)))
-				xsnprintf(hostname, sizeof(hostname), "localhost");
-			argv_array_pushf(&cmd.args,
-					"--keep=fetch-pack %"PRIuMAX " on %s",
-					(uintmax_t)getpid(), hostname);
-		}
+		if (do_keep && (args->lock_pack || unpack_limit))
+			add_index_pack_keep_option(&cmd.args);
 		if (args->check_self_contained_and_connected)
 			argv_array_push(&cmd.args, "--check-self-contained-and-connected");
 		if (args->from_promisor)
@@ -857,8 +863,10 @@ static int get_pack(struct fetch_pack_args *args,
 	cmd.git_cmd = 1;
 	if (start_command(&cmd))
 		die(_("fetch-pack: unable to fork off %s"), cmd_name);
-	if (do_keep && pack_lockfile) {
-		*pack_lockfile = index_pack_lockfile(cmd.out);
+	if (do_keep && pack_lockfiles) {
+		char *pack_lockfile = index_pack_lockfile(cmd.out);
+		if (pack_lockfile)
+			string_list_append_nodup(pack_lockfiles, pack_lockfile);
 		close(cmd.out);
 	}
 
@@ -890,7 +898,7 @@ static struct ref *do_fetch_pack(struct fetch_pack_args *args,
 				 const struct ref *orig_ref,
 				 struct ref **sought, int nr_sought,
 				 struct shallow_info *si,
-				 char **pack_lockfile)
+				 struct string_list *pack_lockfiles)
 {
 	struct ref *ref = copy_ref_list(orig_ref);
 	struct object_id oid;
@@ -1009,7 +1017,7 @@ static struct ref *do_fetch_pack(struct fetch_pack_args *args,
 		alternate_shallow_file = setup_temporary_shallow(si->shallow);
 	else
 		alternate_shallow_file = NULL;
-	if (get_pack(args, fd, pack_lockfile))
+	if (get_pack(args, fd, pack_lockfiles))
 		die(_("git fetch-pack: fetch failed."));
 
  all_done:
@@ -1143,6 +1151,19 @@ static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 		packet_buf_write(&req_buf, "ofs-delta");
 	if (sideband_all)
 		packet_buf_write(&req_buf, "sideband-all");
+	if (uri_protocols.nr &&
+	    server_supports_feature("fetch", "packfile-uris", 0)) {
+		struct strbuf protocols = STRBUF_INIT;
+		int i;
+
+		for (i = 0; i < uri_protocols.nr; i++) {
+			if (i)
+				strbuf_addch(&protocols, ',');
+			strbuf_addstr(&protocols, uri_protocols.items[i].string);
+		}
+		packet_buf_write(&req_buf, "packfile-uris %s", protocols.buf);
+		strbuf_release(&protocols);
+	}
 
 	/* Add shallow-info and deepen request */
 	if (server_supports_feature("fetch", "shallow", 0))
@@ -1363,6 +1384,111 @@ static void receive_wanted_refs(struct packet_reader *reader,
 		die(_("error processing wanted refs: %d"), reader->status);
 }
 
+static void receive_packfile_uris(struct packet_reader *reader,
+				  struct string_list *uris)
+{
+	process_section_header(reader, "packfile-uris", 0);
+	while (packet_reader_read(reader) == PACKET_READ_NORMAL) {
+		struct object_id oid;
+		const char *end;
+
+		if (parse_oid_hex(reader->line, &oid, &end) || *end++ != ' ')
+			die(_("expected packfile-uri, got '%s'"), reader->line);
+		string_list_append(uris, end)->util = xstrdup(oid_to_hex(&oid));
+	}
+
+	if (reader->status != PACKET_READ_DELIM)
+		die(_("error processing packfile uris: %d"), reader->status);
+}
+
+/*
+ * Download the pack at "uri" and index it, making sure that it is the
+ * pack "hash" that the server told us about. file:// URIs are read
+ * directly, anything else is handed to http-fetch.
+ */
+static void fetch_packfile_uri(struct fetch_pack_args *args,
+			       const char *hash, const char *uri,
+			       struct string_list *pack_lockfiles)
+{
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	struct argv_array index_pack_args = ARGV_ARRAY_INIT;
+	char packname[GIT_MAX_HEXSZ + 6];
+	const int len = the_hash_algo->hexsz + 6;
+	const char *path, *name, *end;
+	char *scheme;
+	int i;
+
+	end = strstr(uri, "://");
+	scheme = end ? xstrndup(uri, end - uri) : NULL;
+	if (!scheme || !unsorted_string_list_has_string(&uri_protocols, scheme))
+		die(_("fetch-pack: unexpected packfile uri '%s'"), uri);
+	transport_check_allowed(scheme);
+	free(scheme);
+
+	if (!args->quiet && !args->no_progress)
+		argv_array_push(&index_pack_args, "-v");
+	if (pack_lockfiles)
+		add_index_pack_keep_option(&index_pack_args);
+	if (args->from_promisor)
+		argv_array_push(&index_pack_args, "--promisor");
+	if (fetch_fsck_objects >= 0
+	    ? fetch_fsck_objects
+	    : transfer_fsck_objects >= 0
+	    ? transfer_fsck_objects
+	    : 0)
+		/*
+		 * The objects this pack refers to may only arrive with
+		 * the packfile that follows, so only check the objects
+		 * themselves; connectivity is checked after the fetch.
+		 */
+		argv_array_push(&index_pack_args, "--fsck-objects");
+
+	if (skip_prefix(uri, "file://", &path)) {
+		char *decoded = url_decode(path);
+
+		cmd.in = open(decoded, O_RDONLY);
+		if (cmd.in < 0)
+			die_errno(_("unable to open packfile '%s'"), uri);
+		free(decoded);
+		argv_array_pushl(&cmd.args, "index-pack", "--stdin", NULL);
+		argv_array_pushv(&cmd.args, index_pack_args.argv);
+	} else {
+		argv_array_push(&cmd.args, "http-fetch");
+		argv_array_pushf(&cmd.args, "--packfile=%s", hash);
+		for (i = 0; i < index_pack_args.argc; i++)
+			argv_array_pushf(&cmd.args, "--index-pack-arg=%s",
+					 index_pack_args.argv[i]);
+		argv_array_push(&cmd.args, uri);
+	}
+	argv_array_clear(&index_pack_args);
+
+	cmd.out = -1;
+	cmd.git_cmd = 1;
+	if (start_command(&cmd))
+		die(_("fetch-pack: unable to fork off %s"), cmd.args.argv[0]);
+
+	/* index-pack reports "pack\t<hash>" or "keep\t<hash>" */
+	if (read_in_full(cmd.out, packname, len) == len &&
+	    packname[len - 1] == '\n')
+		packname[len - 1] = '\0';
+	else
+		packname[0] = '\0';
+	close(cmd.out);
+	if (finish_command(&cmd))
+		die(_("fetch-pack: unable to fetch packfile from '%s'"), uri);
+
+	if (skip_prefix(packname, "keep\t", &name))
+		string_list_append_nodup(pack_lockfiles,
+					 xstrfmt("%s/pack/pack-%s.keep",
+						 get_object_directory(), name));
+	else if (!skip_prefix(packname, "pack\t", &name))
+		die(_("fetch-pack: invalid index-pack output"));
+
+	if (strcmp(name, hash))
+		die(_("fetch-pack: pack downloaded from '%s' does not match "
+		      "expected hash %s"), uri, hash);
+}
+
 enum fetch_state {
 	FETCH_CHECK_LOCAL = 0,
 	FETCH_SEND_REQUEST,
@@ -1377,7 +1503,7 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 				    struct ref **sought, int nr_sought,
 				    struct oid_array *shallows,
 				    struct shallow_info *si,
-				    char **pack_lockfile)
+				    struct string_list *pack_lockfiles)
 {
 	struct ref *ref = copy_ref_list(orig_ref);
 	enum fetch_state state = FETCH_CHECK_LOCAL;
@@ -1386,6 +1512,9 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 	int in_vain = 0;
 	int haves_to_send = INITIAL_FLUSH;
 	struct fetch_negotiator negotiator;
+	struct string_list packfile_uris = STRING_LIST_INIT_DUP;
+	int i;
+
 	fetch_negotiator_init(&negotiator, negotiation_algorithm);
 	packet_reader_init(&reader, fd[0], NULL, 0,
 			   PACKET_READ_CHOMP_NEWLINE |
@@ -1456,10 +1585,24 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 			if (process_section_header(&reader, "wanted-refs", 1))
 				receive_wanted_refs(&reader, sought, nr_sought);
 
+			/*
+			 * The packfile may be thin against the packs at
+			 * these URIs, so they have to be in place first.
+			 */
+			if (process_section_header(&reader, "packfile-uris", 1))
+				receive_packfile_uris(&reader, &packfile_uris);
+			for (i = 0; i < packfile_uris.nr; i++)
+				fetch_packfile_uri(args,
+						   packfile_uris.items[i].util,
+						   packfile_uris.items[i].string,
+						   pack_lockfiles);
+
 			/* get the pack */
 			process_section_header(&reader, "packfile", 0);
-			if (get_pack(args, fd, pack_lockfile))
+			if (get_pack(args, fd, pack_lockfiles))
 				die(_("git fetch-pack: fetch failed."));
+			if (packfile_uris.nr)
+				args->self_contained_and_connected = 0;
 
 			state = FETCH_DONE;
 			break;
@@ -1470,6 +1613,7 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 
 	negotiator.release(&negotiator);
 	oidset_clear(&common);
+	string_list_clear(&packfile_uris, 1);
 	return ref;
 }
 
@@ -1500,6 +1644,8 @@ static int fetch_pack_config_cb(const char *var, const char *value, void *cb)
 
 static void fetch_pack_config(void)
 {
+	const char *uri_protocols_value;
+
 	git_config_get_int("fetch.unpacklimit", &fetch_unpack_limit);
 	git_config_get_int("transfer.unpacklimit", &transfer_unpack_limit);
 	git_config_get_bool("repack.usedeltabaseoffset", &prefer_ofs_delta);
@@ -1507,6 +1653,8 @@ static void fetch_pack_config(void)
 	git_config_get_bool("transfer.fsckobjects", &transfer_fsck_objects);
 	git_config_get_string("fetch.negotiationalgorithm",
 			      &negotiation_algorithm);
+	if (!git_config_get_value("fetch.uriprotocols", &uri_protocols_value))
+		string_list_split(&uri_protocols, uri_protocols_value, ',', -1);
 
 	git_config(fetch_pack_config_cb, NULL);
 }
@@ -1659,7 +1807,7 @@ struct ref *fetch_pack(struct fetch_pack_args *args,
 		       const struct ref *ref,
 		       struct ref **sought, int nr_sought,
 		       struct oid_array *shallow,
-		       char **pack_lockfile,
+		       struct string_list *pack_lockfiles,
 		       enum protocol_version version)
 {
 	struct ref *ref_cpy;
@@ -1694,11 +1842,11 @@ struct ref *fetch_pack(struct fetch_pack_args *args,
 		memset(&si, 0, sizeof(si));
 		ref_cpy = do_fetch_pack_v2(args, fd, ref, sought, nr_sought,
 					   &shallows_scratch, &si,
-					   pack_lockfile);
+					   pack_lockfiles);
 	} else {
 		prepare_shallow_info(&si, shallow);
 		ref_cpy = do_fetch_pack(args, fd, ref, sought, nr_sought,
-					&si, pack_lockfile);
+					&si, pack_lockfiles);
 	}
 	reprepare_packed_git(the_repository);
 
@@ -0,0 +1,446 @@
+#include "cache.h"
+#include "config.h"
+#include "repository.h"
+#include "object-store.h"
+#include "oidmap.h"
+#include "lockfile.h"
+#include "csum-file.h"
+#include "fingerprint-cache.h"
+
+#define FINGERPRINT_SIGNATURE 0x46505254 /* "FPRT" */
+#define FINGERPRINT_JOURNAL_SIGNATURE 0x46504a4e /* "FPJN" */
+#define FINGERPRINT_VERSION 1
+
+/*
+ * The table starts with the signature, the version, the hash algorithm
+ * and the number of entries, followed by a 256-entry fanout of the
+ * first byte of the object names, the sorted object names, a 64-bit
+ * offset into the file for each of them, and the records.
+ *
+ * A record is the 64-bit size of the blob, 32-bit flags, the 32-bit
+ * number of pairs and the pairs themselves.  A journal entry is the
+ * journal signature and the object name followed by a record.
+ *
+ * All numbers are in network byte order.
+ */
+#define TABLE_HEADER_SIZE 16
+#define TABLE_FANOUT_SIZE (256 * 4)
+#define RECORD_HEADER_SIZE 16
+#define PAIR_SIZE 8
+
+/* Journals smaller than this are not worth folding into the table. */
+#define JOURNAL_COMPACT_MIN (256 * 1024)
+
+struct fingerprint_table {
+	const unsigned char *map;
+	size_t size;
+	uint32_t nr;
+	const unsigned char *fanout;
+	const unsigned char *oids;
+	const unsigned char *offsets;
+};
+
+struct fingerprint_entry {
+	struct oidmap_entry ent;
+	const unsigned char *record;
+	unsigned char buf[FLEX_ARRAY];
+};
+
+static struct fingerprint_cache {
+	struct repository *repo;
+	int enabled;
+	char *table_path;
+	char *journal_path;
+	struct fingerprint_table table;
+	/* the journal as it was when we started, and the entries in it */
+	struct strbuf journal;
+	struct oidmap entries;
+	/* journal entries we still have to write out */
+	struct strbuf pending;
+} cache;
+
+/*
+ * Return the length of the record at "rec", or 0 if it does not fit
+ * into the "avail" bytes there.
+ */
+static size_t record_len(const unsigned char *rec, size_t avail)
+{
+	uint32_t nr;
+
+	if (avail < RECORD_HEADER_SIZE)
+		return 0;
+	nr = get_be32(rec + 12);
+	if (nr > (avail - RECORD_HEADER_SIZE) / PAIR_SIZE)
+		return 0;
+	return RECORD_HEADER_SIZE + (size_t)nr * PAIR_SIZE;
+}
+
+static void unmap_table(struct fingerprint_table *t)
+{
+	if (t->map)
+		munmap((void *)t->map, t->size);
+	memset(t, 0, sizeof(*t));
+}
+
+static int map_table(struct fingerprint_table *t, const char *path)
+{
+	size_t hashsz = the_hash_algo->rawsz;
+	struct stat st;
+	int fd = git_open(path);
+
+	memset(t, 0, sizeof(*t));
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) ||
+	    st.st_size < TABLE_HEADER_SIZE + TABLE_FANOUT_SIZE) {
+		close(fd);
+		return -1;
+	}
+	t->size = xsize_t(st.st_size);
+	t->map = xmmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (get_be32(t->map) != FINGERPRINT_SIGNATURE ||
+	    get_be32(t->map + 4) != FINGERPRINT_VERSION ||
+	    get_be32(t->map + 8) != the_hash_algo->format_id)
+		goto corrupt;
+	t->nr = get_be32(t->map + 12);
+	t->fanout = t->map + TABLE_HEADER_SIZE;
+	if (get_be32(t->fanout + 255 * 4) != t->nr ||
+	    (t->size - TABLE_HEADER_SIZE - TABLE_FANOUT_SIZE) / (hashsz + 8) < t->nr)
+		goto corrupt;
+	t->oids = t->fanout + TABLE_FANOUT_SIZE;
+	t->offsets = t->oids + (size_t)t->nr * hashsz;
+	return 0;
+
+corrupt:
+	warning(_("ignoring corrupt fingerprint cache '%s'"), path);
+	unmap_table(t);
+	return -1;
+}
+
+static const unsigned char *table_record(const struct fingerprint_table *t,
+					 uint32_t pos, size_t *len)
+{
+	uint64_t offset = get_be64(t->offsets + (size_t)pos * 8);
+
+	if (offset > t->size)
+		return NULL;
+	*len = record_len(t->map + offset, t->size - offset);
+	return *len ? t->map + offset : NULL;
+}
+
+static const unsigned char *table_lookup(const struct fingerprint_table *t,
+					 const struct object_id *oid)
+{
+	size_t hashsz = the_hash_algo->rawsz;
+	int first = oid->hash[0];
+	uint32_t lo, hi;
+	size_t len;
+
+	if (!t->map)
+		return NULL;
+	lo = first ? get_be32(t->fanout + (first - 1) * 4) : 0;
+	hi = get_be32(t->fanout + first * 4);
+	if (hi > t->nr)
+		return NULL;
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = hashcmp(oid->hash, t->oids + (size_t)mi * hashsz);
+
+		if (!cmp)
+			return table_record(t, mi, &len);
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return NULL;
+}
+
+typedef void (*journal_fn)(const unsigned char *hash,
+			   const unsigned char *rec, size_t len,
+			   void *data);
+
+/*
+ * Call "fn" for each entry in the journal "buf".  Parsing stops at the
+ * first entry that is cut short, e.g. by a process dying while it was
+ * appending to the journal.
+ */
+static void parse_journal(const struct strbuf *buf, journal_fn fn, void *data)
+{
+	size_t hashsz = the_hash_algo->rawsz;
+	const unsigned char *p = (const unsigned char *)buf->buf;
+	size_t avail = buf->len;
+
+	while (avail >= 4 + hashsz) {
+		size_t len;
+
+		if (get_be32(p) != FINGERPRINT_JOURNAL_SIGNATURE)
+			break;
+		len = record_len(p + 4 + hashsz, avail - 4 - hashsz);
+		if (!len)
+			break;
+		fn(p + 4, p + 4 + hashsz, len, data);
+		p += 4 + hashsz + len;
+		avail -= 4 + hashsz + len;
+	}
+}
+
+static void add_entry(const unsigned char *hash,
+		      const unsigned char *rec, size_t len,
+		      int copy)
+{
+	struct fingerprint_entry *e;
+	struct object_id oid;
+
+	hashcpy(oid.hash, hash);
+	if (oidmap_get(&cache.entries, &oid))
+		return;
+	e = xcalloc(1, st_add(sizeof(*e), copy ? len : 0));
+	oidcpy(&e->ent.oid, &oid);
+	if (copy) {
+		memcpy(e->buf, rec, len);
+		rec = e->buf;
+	}
+	e->record = rec;
+	oidmap_put(&cache.entries, e);
+}
+
+static void load_journal_entry(const unsigned char *hash,
+			       const unsigned char *rec, size_t len,
+			       void *data)
+{
+	add_entry(hash, rec, len, 0);
+}
+
+static int init_cache(struct repository *r)
+{
+	int enabled;
+
+	if (cache.repo)
+		return cache.repo == r && cache.enabled;
+	cache.repo = r;
+	if (repo_config_get_bool(r, "diff.fingerprintcache", &enabled) ||
+	    !enabled)
+		return 0;
+
+	cache.enabled = 1;
+	cache.table_path = xstrfmt("%s/info/fingerprints",
+				   r->objects->odb->path);
+	cache.journal_path = xstrfmt("%s-journal", cache.table_path);
+	map_table(&cache.table, cache.table_path);
+	strbuf_init(&cache.journal, 0);
+	strbuf_init(&cache.pending, 0);
+	oidmap_init(&cache.entries, 0);
+	if (strbuf_read_file(&cache.journal, cache.journal_path, 0) > 0)
+		parse_journal(&cache.journal, load_journal_entry, NULL);
+	return 1;
+}
+
+int fingerprint_cache_enabled(struct repository *r)
+{
+	return init_cache(r);
+}
+
+int fingerprint_cache_get(struct repository *r,
+			  const struct object_id *oid,
+			  struct fingerprint *fp)
+{
+	struct fingerprint_entry *e;
+	const unsigned char *rec;
+
+	if (!init_cache(r))
+		return -1;
+	e = oidmap_get(&cache.entries, oid);
+	if (e)
+		rec = e->record;
+	else if (!(rec = table_lookup(&cache.table, oid)))
+		return -1;
+
+	fp->size = get_be64(rec);
+	fp->flags = get_be32(rec + 8);
+	fp->nr = get_be32(rec + 12);
+	fp->pairs = rec + RECORD_HEADER_SIZE;
+	return 0;
+}
+
+static void strbuf_add_be32(struct strbuf *sb, uint32_t v)
+{
+	v = htonl(v);
+	strbuf_add(sb, &v, sizeof(v));
+}
+
+void fingerprint_cache_add(struct repository *r,
+			   const struct object_id *oid,
+			   unsigned long size, unsigned int flags,
+			   const uint32_t *pairs, uint32_t nr)
+{
+	size_t start;
+	uint64_t size64 = htonll((uint64_t)size);
+	uint32_t i;
+
+	if (!init_cache(r) ||
+	    oidmap_get(&cache.entries, oid) ||
+	    table_lookup(&cache.table, oid))
+		return;
+
+	strbuf_add_be32(&cache.pending, FINGERPRINT_JOURNAL_SIGNATURE);
+	strbuf_add(&cache.pending, oid->hash, the_hash_algo->rawsz);
+	start = cache.pending.len;
+	strbuf_add(&cache.pending, &size64, sizeof(size64));
+	strbuf_add_be32(&cache.pending, flags);
+	strbuf_add_be32(&cache.pending, nr);
+	for (i = 0; i < nr; i++) {
+		strbuf_add_be32(&cache.pending, pairs[2 * i]);
+		strbuf_add_be32(&cache.pending, pairs[2 * i + 1]);
+	}
+	add_entry(oid->hash, (unsigned char *)cache.pending.buf + start,
+		  cache.pending.len - start, 1);
+}
+
+struct compact_item {
+	const unsigned char *hash;
+	const unsigned char *rec;
+	size_t len;
+};
+
+struct compact_list {
+	struct compact_item *items;
+	size_t nr, alloc;
+};
+
+static void collect_item(const unsigned char *hash,
+			 const unsigned char *rec, size_t len,
+			 void *data)
+{
+	struct compact_list *list = data;
+
+	ALLOC_GROW(list->items, list->nr + 1, list->alloc);
+	list->items[list->nr].hash = hash;
+	list->items[list->nr].rec = rec;
+	list->items[list->nr].len = len;
+	list->nr++;
+}
+
+static int compact_item_cmp(const void *a_, const void *b_)
+{
+	const struct compact_item *a = a_, *b = b_;
+
+	return hashcmp(a->hash, b->hash);
+}
+
+/*
+ * Fold the journal into the table.  Whoever holds the lock of the table
+ * is doing so already, so there is no need to wait for them.
+ */
+static void compact_cache(void)
+{
+	size_t hashsz = the_hash_algo->rawsz;
+	struct lock_file lk = LOCK_INIT;
+	struct fingerprint_table table;
+	struct strbuf journal = STRBUF_INIT;
+	struct compact_list list = { NULL };
+	struct hashfile *f;
+	uint32_t fanout[256];
+	uint64_t offset;
+	size_t i, nr;
+
+	if (hold_lock_file_for_update(&lk, cache.table_path, 0) < 0)
+		return;
+
+	/* Another process may have rewritten both since we read them. */
+	map_table(&table, cache.table_path);
+	strbuf_read_file(&journal, cache.journal_path, 0);
+
+	for (i = 0; i < table.nr; i++) {
+		size_t len;
+		const unsigned char *rec = table_record(&table, i, &len);
+
+		if (rec)
+			collect_item(table.oids + i * hashsz, rec, len, &list);
+	}
+	parse_journal(&journal, collect_item, &list);
+
+	QSORT(list.items, list.nr, compact_item_cmp);
+	for (nr = i = 0; i < list.nr; i++) {
+		if (nr && !hashcmp(list.items[nr - 1].hash, list.items[i].hash))
+			continue;
+		list.items[nr++] = list.items[i];
+	}
+	if (nr > UINT32_MAX) {
+		rollback_lock_file(&lk);
+		goto out;
+	}
+
+	memset(fanout, 0, sizeof(fanout));
+	for (i = 0; i < nr; i++)
+		fanout[list.items[i].hash[0]]++;
+	for (i = 1; i < ARRAY_SIZE(fanout); i++)
+		fanout[i] += fanout[i - 1];
+
+	f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+	hashwrite_be32(f, FINGERPRINT_SIGNATURE);
+	hashwrite_be32(f, FINGERPRINT_VERSION);
+	hashwrite_be32(f, the_hash_algo->format_id);
+	hashwrite_be32(f, nr);
+	for (i = 0; i < ARRAY_SIZE(fanout); i++)
+		hashwrite_be32(f, fanout[i]);
+	for (i = 0; i < nr; i++)
+		hashwrite(f, list.items[i].hash, hashsz);
+	offset = TABLE_HEADER_SIZE + TABLE_FANOUT_SIZE + nr * (hashsz + 8);
+	for (i = 0; i < nr; i++) {
+		hashwrite_be32(f, offset >> 32);
+		hashwrite_be32(f, offset & 0xffffffff);
+		offset += list.items[i].len;
+	}
+	for (i = 0; i < nr; i++)
+		hashwrite(f, list.items[i].rec, list.items[i].len);
+	finalize_hashfile(f, NULL, CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+
+	/*
+	 * Entries appended to the journal after we read it are lost, but
+	 * that only means that somebody has to compute them again.
+	 */
+	unlink_or_warn(cache.journal_path);
+	commit_lock_file(&lk);
+
+out:
+	free(list.items);
+	unmap_table(&table);
+	strbuf_release(&journal);
+}
+
+void fingerprint_cache_flush(struct repository *r)
+{
+	struct stat st;
+	int fd;
+
+	if (!init_cache(r) || !cache.pending.len)
+		return;
+
+	safe_create_leading_directories_const(cache.journal_path);
+	fd = open(cache.journal_path, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd < 0) {
+		strbuf_reset(&cache.pending);
+		return;
+	}
+	adjust_shared_perm(cache.journal_path);
+
+	/*
+	 * With O_APPEND, a single write keeps our entries from being
+	 * interleaved with those of other processes appending at the
+	 * same time.
+	 */
+	if (write_in_full(fd, cache.pending.buf, cache.pending.len) < 0)
+		warning_errno(_("unable to append to '%s'"),
+			      cache.journal_path);
+	strbuf_reset(&cache.pending);
+
+	if (!fstat(fd, &st) &&
+	    (git_env_bool("GIT_TEST_FINGERPRINT_COMPACT", 0) ||
+	     (st.st_size >= JOURNAL_COMPACT_MIN &&
+	      st.st_size >= cache.table.size / 4)))
+		compact_cache();
+	close(fd);
+}
@@ -0,0 +1,60 @@
+#ifndef FINGERPRINT_CACHE_H
+#define FINGERPRINT_CACHE_H
+
+struct repository;
+struct object_id;
+
+/*
+ * An on-disk cache of the fingerprints diffcore_count_changes() computes
+ * for blobs, so that rename and copy detection does not need to read a
+ * blob again once it has been hashed by an earlier command.  It is only
+ * used when diff.fingerprintCache is set.
+ *
+ * The cache consists of a table sorted by object name that is read with
+ * mmap, "$GIT_OBJECT_DIRECTORY/info/fingerprints", and a journal next to
+ * it that processes append their new entries to.  Once the journal grows
+ * too large, it is folded into the table while holding the lock of the
+ * table.  Entries appended to the journal while it is being folded may
+ * be lost, which only means they have to be computed again.
+ */
+
+/* The blob was hashed as text, i.e. with CRLF folded into LF. */
+#define FINGERPRINT_TEXT (1u << 0)
+/* The blob contains CRLF, so the above matters. */
+#define FINGERPRINT_CRLF (1u << 1)
+
+struct fingerprint {
+	unsigned long size;
+	unsigned int flags;
+	uint32_t nr;
+	/* "nr" pairs of network byte order 32-bit (hash, count) */
+	const unsigned char *pairs;
+};
+
+/*
+ * Look up the fingerprint of the blob "oid".  Returns 0 and fills in
+ * "fp" if it is cached, and -1 if it is not or the cache is disabled.
+ */
+int fingerprint_cache_get(struct repository *r,
+			  const struct object_id *oid,
+			  struct fingerprint *fp);
+
+/*
+ * Remember the fingerprint of the blob "oid", given as "nr" host byte
+ * order (hash, count) pairs.  It is only written out by the next
+ * fingerprint_cache_flush().
+ */
+void fingerprint_cache_add(struct repository *r,
+			   const struct object_id *oid,
+			   unsigned long size, unsigned int flags,
+			   const uint32_t *pairs, uint32_t nr);
+
+/*
+ * Append the fingerprints added since the last call to the journal,
+ * and fold the journal into the table if it has grown too large.
+ */
+void fingerprint_cache_flush(struct repository *r);
+
+int fingerprint_cache_enabled(struct repository *r);
+
+#endif
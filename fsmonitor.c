@@ -5,6 +5,9 @@
 #include "fsmonitor.h"
 #include "run-command.h"
 #include "strbuf.h"
+#ifdef HAVE_FSMONITOR_DAEMON
+#include "unix-socket.h"
+#endif
 
 #define INDEX_EXTENSION_VERSION	(1)
 #define HOOK_INTERFACE_VERSION	(1)
@@ -110,10 +113,92 @@ static int query_fsmonitor(int version, uint64_t last_update, struct strbuf *que
 	return capture_command(&cp, query_result, 1024);
 }
 
+#ifdef HAVE_FSMONITOR_DAEMON
+int fsmonitor_daemon_send(const char *command, struct strbuf *answer)
+{
+	char *path = git_pathdup("fsmonitor--daemon.ipc");
+	int fd = unix_stream_connect(path);
+	int ret = 0;
+
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	if (write_in_full(fd, command, strlen(command)) < 0) {
+		close(fd);
+		return error_errno(_("unable to write to fsmonitor--daemon"));
+	}
+	shutdown(fd, SHUT_WR);
+
+	if (strbuf_read(answer, fd, 0) < 0)
+		ret = error_errno(_("unable to read from fsmonitor--daemon"));
+	close(fd);
+	return ret;
+}
+#else
+int fsmonitor_daemon_send(const char *command, struct strbuf *answer)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
+/*
+ * Ask the built-in daemon for the paths that changed since the token
+ * "last_update", in the format of the hook, and for a new token.
+ */
+static int query_fsmonitor_daemon(uint64_t last_update, uint64_t *token,
+				  struct strbuf *query_result)
+{
+	struct strbuf command = STRBUF_INIT;
+	const char *nul;
+	char *end;
+	int ret;
+
+	strbuf_addf(&command, "query %"PRIuMAX"\n", (uintmax_t)last_update);
+	ret = fsmonitor_daemon_send(command.buf, query_result);
+	strbuf_release(&command);
+	if (ret)
+		return -1;
+
+	/* the answer starts with the new token, terminated by a NUL */
+	nul = memchr(query_result->buf, '\0', query_result->len);
+	if (!nul)
+		return error(_("bogus answer from fsmonitor--daemon"));
+	*token = strtoumax(query_result->buf, &end, 10);
+	if (end != nul || !(*token & FSMONITOR_DAEMON_TOKEN_BIT))
+		return error(_("bogus token from fsmonitor--daemon"));
+	strbuf_remove(query_result, 0, nul + 1 - query_result->buf);
+	return 0;
+}
+
 static void fsmonitor_refresh_callback(struct index_state *istate, const char *name)
 {
-	int pos = index_name_pos(istate, name, strlen(name));
+	int len = strlen(name);
+	int pos;
+
+	if (len && name[len - 1] == '/') {
+		/*
+		 * The directory was created, removed or renamed: anything
+		 * below it may have changed.
+		 */
+		pos = index_name_pos(istate, name, len);
+		if (pos < 0)
+			pos = -pos - 1;
+		for (; pos < istate->cache_nr; pos++) {
+			struct cache_entry *ce = istate->cache[pos];
+
+			if (!starts_with(ce->name, name))
+				break;
+			ce->ce_flags &= ~CE_FSMONITOR_VALID;
+		}
+
+		trace_printf_key(&trace_fsmonitor, "fsmonitor_refresh_callback '%s'", name);
+		untracked_cache_invalidate_path(istate, name, 1);
+		return;
+	}
 
+	pos = index_name_pos(istate, name, len);
 	if (pos >= 0) {
 		struct cache_entry *ce = istate->cache[pos];
 		ce->ce_flags &= ~CE_FSMONITOR_VALID;
@@ -152,7 +237,16 @@ void refresh_fsmonitor(struct index_state *istate)
 	 * changes since that time, else assume everything is possibly dirty
 	 * and check it all.
 	 */
-	if (istate->fsmonitor_last_update) {
+	if (istate->fsmonitor_last_update && core_use_builtin_fsmonitor) {
+		uint64_t start = last_update;
+
+		query_success = !query_fsmonitor_daemon(istate->fsmonitor_last_update,
+							&last_update, &query_result);
+		trace_performance_since(start, "fsmonitor--daemon query");
+		trace_printf_key(&trace_fsmonitor, "fsmonitor--daemon query returned %s",
+			query_success ? "success" : "failure");
+	} else if (istate->fsmonitor_last_update &&
+		   !(istate->fsmonitor_last_update & FSMONITOR_DAEMON_TOKEN_BIT)) {
 		query_success = !query_fsmonitor(HOOK_INTERFACE_VERSION,
 			istate->fsmonitor_last_update, &query_result);
 		trace_performance_since(last_update, "fsmonitor process '%s'", core_fsmonitor);
@@ -6,6 +6,25 @@
 
 extern struct trace_key trace_fsmonitor;
 
+#if defined(HAVE_INOTIFY) && !defined(NO_UNIX_SOCKETS)
+#define HAVE_FSMONITOR_DAEMON
+#endif
+
+/*
+ * The built-in file system monitor daemon ("git fsmonitor--daemon")
+ * names the state of its change journal with opaque tokens, which are
+ * stored in the index instead of the time of the last update when
+ * core.useBuiltinFSMonitor is set. They have this bit set, so that they
+ * are never mistaken for a time (and sent to a hook) or vice versa.
+ */
+#define FSMONITOR_DAEMON_TOKEN_BIT ((uint64_t)1 << 63)
+
+/*
+ * Send "command" to the daemon watching the current worktree, and read
+ * its whole answer into "answer". Returns -1 if no daemon is listening.
+ */
+int fsmonitor_daemon_send(const char *command, struct strbuf *answer);
+
 /*
  * Read the fsmonitor index extension and (if configured) restore the
  * CE_FSMONITOR_VALID state.
@@ -37,10 +56,11 @@ void remove_fsmonitor(struct index_state *istate);
 void tweak_fsmonitor(struct index_state *istate);
 
 /*
- * Run the configured fsmonitor integration script and clear the
- * CE_FSMONITOR_VALID bit for any files returned as dirty.  Also invalidate
- * any corresponding untracked cache directory structures. Optimized to only
- * run the first time it is called.
+ * Run the configured fsmonitor integration script (or query the built-in
+ * daemon) and clear the CE_FSMONITOR_VALID bit for any files returned as
+ * dirty, or for all files below a returned directory (ending with a slash).
+ * Also invalidate any corresponding untracked cache directory structures.
+ * Optimized to only run the first time it is called.
  */
 void refresh_fsmonitor(struct index_state *istate);
 
@@ -8,8 +8,13 @@
 #include "diffcore.h"
 #include "commit.h"
 #include "quote.h"
+#include "string-list.h"
 #include "help.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static int grep_source_load(struct grep_source *gs);
 static int grep_source_is_binary(struct grep_source *gs,
 				 struct index_state *istate);
@@ -648,6 +653,167 @@ static void compile_fixed_regexp(struct grep_pat *p, struct grep_opt *opt)
 	}
 }
 
+static void add_literal(struct string_list *out, struct strbuf *run)
+{
+	if (run->len >= 3)
+		string_list_append(out, run->buf);
+	strbuf_reset(run);
+}
+
+/*
+ * Skip the bracket expression starting at "s", returning the position
+ * after its closing bracket, or NULL if it is not closed.
+ */
+static const char *skip_bracket(const char *s)
+{
+	s++;
+	if (*s == '^')
+		s++;
+	if (*s == ']')
+		s++;
+	while (*s && *s != ']') {
+		if (*s == '[' && (s[1] == ':' || s[1] == '.' || s[1] == '=')) {
+			const char *end = s + 2;
+			while (*end && !(end[0] == s[1] && end[1] == ']'))
+				end++;
+			if (!*end)
+				return NULL;
+			s = end + 2;
+		} else {
+			s++;
+		}
+	}
+	return *s ? s + 1 : NULL;
+}
+
+/*
+ * Skip the group whose opening parenthesis ends right before "s",
+ * returning the position after the closing one, or NULL if it is not
+ * closed.  Groups are "(...)" in extended and "\(...\)" in basic
+ * regular expressions.
+ */
+static const char *skip_group(const char *s, int ere)
+{
+	int depth = 1;
+
+	while (*s) {
+		if (*s == '[') {
+			s = skip_bracket(s);
+			if (!s)
+				return NULL;
+			continue;
+		}
+		if (*s == '\\') {
+			if (!s[1])
+				return NULL;
+			if (!ere && s[1] == '(')
+				depth++;
+			else if (!ere && s[1] == ')' && !--depth)
+				return s + 2;
+			s += 2;
+			continue;
+		}
+		if (ere && *s == '(')
+			depth++;
+		else if (ere && *s == ')' && !--depth)
+			return s + 1;
+		s++;
+	}
+	return NULL;
+}
+
+int grep_pattern_literals(const struct grep_opt *opt,
+			  const struct grep_pat *p,
+			  struct string_list *out)
+{
+	int ere = opt->extended_regexp_option;
+	struct strbuf run = STRBUF_INIT;
+	const char *s = p->pattern;
+
+	if (p->token != GREP_PATTERN || has_null(p->pattern, p->patternlen))
+		return -1;
+	if (p->fixed || opt->fixed) {
+		if (p->patternlen >= 3)
+			string_list_append(out, p->pattern);
+		return 0;
+	}
+	if (opt->pcre1 || opt->pcre2)
+		return -1;
+
+	/*
+	 * Collect the runs of ordinary characters, dropping the last one
+	 * of a run when it is followed by something that lets it repeat
+	 * zero times.  Groups and bracket expressions end a run and are
+	 * skipped; an alternation outside of a group makes us give up.
+	 */
+	while (*s) {
+		char c = *s;
+
+		if (c == '\\') {
+			char next = s[1];
+
+			if (!next)
+				goto fail;
+			s += 2;
+			if (!ere && next == '|')
+				goto fail;
+			if (!ere && next == '(') {
+				add_literal(out, &run);
+				s = skip_group(s, 0);
+				if (!s)
+					goto fail;
+			} else if (!ere && (next == '?' || next == '{')) {
+				strbuf_setlen(&run, run.len ? run.len - 1 : 0);
+				add_literal(out, &run);
+				if (next == '{' && !(s = strstr(s, "\\}")))
+					goto fail;
+				if (next == '{')
+					s += 2;
+			} else if (ispunct(next) && !strchr("<>`'", next) &&
+				   (ere || !strchr("+)}", next))) {
+				strbuf_addch(&run, next);
+			} else {
+				/* \w, \b, back-references and the like */
+				add_literal(out, &run);
+			}
+			continue;
+		}
+		s++;
+		if (ere && c == '|')
+			goto fail;
+		if (ere && c == '(') {
+			add_literal(out, &run);
+			s = skip_group(s, 1);
+			if (!s)
+				goto fail;
+		} else if (c == '[') {
+			add_literal(out, &run);
+			s = skip_bracket(s - 1);
+			if (!s)
+				goto fail;
+		} else if (c == '*' || (ere && (c == '?' || c == '{'))) {
+			strbuf_setlen(&run, run.len ? run.len - 1 : 0);
+			add_literal(out, &run);
+			if (c == '{' && !(s = strchr(s, '}')))
+				goto fail;
+			if (c == '{')
+				s++;
+		} else if (c == '.' || c == '^' || c == '$' || (ere && c == '+')) {
+			/* a "+" still needs what it repeats once, so keep it */
+			add_literal(out, &run);
+		} else {
+			strbuf_addch(&run, c);
+		}
+	}
+	add_literal(out, &run);
+	strbuf_release(&run);
+	return 0;
+
+fail:
+	strbuf_release(&run);
+	return -1;
+}
+
 static void compile_regexp(struct grep_pat *p, struct grep_opt *opt)
 {
 	int ascii_only;
@@ -667,8 +833,8 @@ static void compile_regexp(struct grep_pat *p, struct grep_opt *opt)
 	 * the other hand, even without -F, if the pattern does not
 	 * have any regexp special characters and there is no need for
 	 * case-folding search, we can internally turn it into a
-	 * simple string match using kws.  p->fixed tells us if we
-	 * want to use kws.
+	 * simple string match using find_fixed().  p->fixed tells us
+	 * if we want to use it.
 	 */
 	if (opt->fixed ||
 	    has_null(p->pattern, p->patternlen) ||
@@ -676,9 +842,6 @@ static void compile_regexp(struct grep_pat *p, struct grep_opt *opt)
 		p->fixed = !p->ignore_case || ascii_only;
 
 	if (p->fixed) {
-		p->kws = kwsalloc(p->ignore_case ? tolower_trans_tbl : NULL);
-		kwsincr(p->kws, p->pattern, p->patternlen);
-		kwsprep(p->kws);
 		return;
 	} else if (opt->fixed) {
 		/*
@@ -1053,13 +1216,11 @@ void free_grep_patterns(struct grep_opt *opt)
 		case GREP_PATTERN: /* atom */
 		case GREP_PATTERN_HEAD:
 		case GREP_PATTERN_BODY:
-			if (p->kws)
-				kwsfree(p->kws);
-			else if (p->pcre1_regexp)
+			if (p->pcre1_regexp)
 				free_pcre1_regexp(p);
 			else if (p->pcre2_pattern)
 				free_pcre2_pattern(p);
-			else
+			else if (!p->fixed)
 				regfree(&p->regexp);
 			free(p->pattern);
 			break;
@@ -1115,17 +1276,135 @@ static void show_name(struct grep_opt *opt, const char *name)
 	opt->output(opt, opt->null_following_name ? "\0" : "\n", 1);
 }
 
+static int fixed_matches_at(const unsigned char *s,
+			    const unsigned char *pat, size_t len,
+			    int ignore_case)
+{
+	size_t i;
+
+	if (!ignore_case)
+		return !memcmp(s, pat, len);
+	for (i = 0; i < len; i++)
+		if (tolower(s[i]) != tolower(pat[i]))
+			return 0;
+	return 1;
+}
+
+/*
+ * Find the leftmost occurrence of the fixed pattern of "p" in "buf".
+ *
+ * Candidate positions are those where both the first and the last
+ * byte of the pattern appear at the right distance from each other,
+ * which is checked for many positions at once; only the candidates
+ * are compared in full.  Patterns are ASCII-only when ignoring case
+ * (see compile_regexp()), so letters can be compared with their case
+ * bit set on both sides.
+ */
+static const char *find_fixed(struct grep_pat *p,
+			      const char *buf, size_t len)
+{
+	const unsigned char *pat = (const unsigned char *)p->pattern;
+	const unsigned char *s = (const unsigned char *)buf;
+	size_t n = p->patternlen, end, i = 0;
+	unsigned char first, last, first_fold = 0, last_fold = 0;
+
+	if (!n)
+		return buf;
+	if (len < n)
+		return NULL;
+	end = len - n + 1; /* number of possible starting positions */
+
+	first = pat[0];
+	last = pat[n - 1];
+	if (p->ignore_case) {
+		if (isalpha(first)) {
+			first = tolower(first);
+			first_fold = 0x20;
+		}
+		if (isalpha(last)) {
+			last = tolower(last);
+			last_fold = 0x20;
+		}
+	}
+
+#ifdef __SSE2__
+	{
+		const __m128i vfirst = _mm_set1_epi8(first);
+		const __m128i vlast = _mm_set1_epi8(last);
+		const __m128i ffirst = _mm_set1_epi8(first_fold);
+		const __m128i flast = _mm_set1_epi8(last_fold);
+
+		for (; i + 16 <= end; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+			__m128i b = _mm_loadu_si128((const __m128i *)(s + i + n - 1));
+			unsigned int mask;
+
+			a = _mm_cmpeq_epi8(_mm_or_si128(a, ffirst), vfirst);
+			b = _mm_cmpeq_epi8(_mm_or_si128(b, flast), vlast);
+			mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+			while (mask) {
+				size_t at = i + __builtin_ctz(mask);
+
+				if (fixed_matches_at(s + at, pat, n,
+						     p->ignore_case))
+					return buf + at;
+				mask &= mask - 1;
+			}
+		}
+	}
+#else
+	{
+		/*
+		 * Look at eight positions at a time, using the classic
+		 * test for a zero byte in a word on the bytes that differ
+		 * from the first or the last byte of the pattern.  The
+		 * test may report positions that do not match, but never
+		 * misses one that does.
+		 */
+		const uint64_t ones = 0x0101010101010101ULL;
+		const uint64_t highs = 0x8080808080808080ULL;
+		const uint64_t wfirst = ones * first, wlast = ones * last;
+		const uint64_t ffirst = ones * first_fold;
+		const uint64_t flast = ones * last_fold;
+
+		for (; i + 8 <= end; i += 8) {
+			uint64_t a, b, x;
+			size_t at;
+
+			memcpy(&a, s + i, sizeof(a));
+			memcpy(&b, s + i + n - 1, sizeof(b));
+			x = ((a | ffirst) ^ wfirst) | ((b | flast) ^ wlast);
+			if (!((x - ones) & ~x & highs))
+				continue;
+			for (at = i; at < i + 8; at++)
+				if ((s[at] | first_fold) == first &&
+				    (s[at + n - 1] | last_fold) == last &&
+				    fixed_matches_at(s + at, pat, n,
+						     p->ignore_case))
+					return buf + at;
+		}
+	}
+#endif
+
+	for (; i < end; i++)
+		if ((s[i] | first_fold) == first &&
+		    (s[i + n - 1] | last_fold) == last &&
+		    fixed_matches_at(s + i, pat, n, p->ignore_case))
+			return buf + i;
+	return NULL;
+}
+
 static int fixmatch(struct grep_pat *p, char *line, char *eol,
 		    regmatch_t *match)
 {
-	struct kwsmatch kwsm;
-	size_t offset = kwsexec(p->kws, line, eol - line, &kwsm);
-	if (offset == -1) {
+	const char *hit = find_fixed(p, line, eol - line);
+
+	if (!hit) {
 		match->rm_so = match->rm_eo = -1;
 		return REG_NOMATCH;
 	} else {
-		match->rm_so = offset;
-		match->rm_eo = match->rm_so + kwsm.size[0];
+		match->rm_so = hit - line;
+		match->rm_eo = match->rm_so + p->patternlen;
 		return 0;
 	}
 }
@@ -1533,11 +1812,6 @@ static inline void grep_attr_unlock(void)
 		pthread_mutex_unlock(&grep_attr_mutex);
 }
 
-/*
- * Same as git_attr_mutex, but protecting the thread-unsafe object db access.
- */
-pthread_mutex_t grep_read_mutex;
-
 static int match_funcname(struct grep_opt *opt, struct grep_source *gs, char *bol, char *eol)
 {
 	xdemitconf_t *xecfg = opt->priv;
@@ -1738,9 +2012,9 @@ static int fill_textconv_grep(struct repository *r,
 	 * behind the scenes, and it modifies the global diff tempfile
 	 * structure.
 	 */
-	grep_read_lock();
+	obj_read_lock();
 	size = fill_textconv(r, driver, df, &buf);
-	grep_read_unlock();
+	obj_read_unlock();
 	free_filespec(df);
 
 	/*
@@ -2109,9 +2383,7 @@ static int grep_source_load_oid(struct grep_source *gs)
 {
 	enum object_type type;
 
-	grep_read_lock();
 	gs->buf = read_object_file(gs->identifier, &type, &gs->size);
-	grep_read_unlock();
 
 	if (!gs->buf)
 		return error(_("'%s': unable to read %s"),
@@ -32,11 +32,11 @@ typedef int pcre2_compile_context;
 typedef int pcre2_match_context;
 typedef int pcre2_jit_stack;
 #endif
-#include "kwset.h"
 #include "thread-utils.h"
 #include "userdiff.h"
 
 struct repository;
+struct string_list;
 
 enum grep_pat_token {
 	GREP_PATTERN,
@@ -97,7 +97,6 @@ struct grep_pat {
 	pcre2_match_context *pcre2_match_context;
 	pcre2_jit_stack *pcre2_jit_stack;
 	uint32_t pcre2_jit_on;
-	kwset_t kws;
 	unsigned fixed:1;
 	unsigned ignore_case:1;
 	unsigned word_regexp:1;
@@ -196,6 +195,15 @@ void append_grep_pattern(struct grep_opt *opt, const char *pat, const char *orig
 void append_header_grep_pattern(struct grep_opt *, enum grep_header_field, const char *);
 void compile_grep_patterns(struct grep_opt *opt);
 void free_grep_patterns(struct grep_opt *opt);
+
+/*
+ * Append to "out" strings that every line matching "p" must contain,
+ * or return -1 if the pattern is too complex to tell.  Strings shorter
+ * than three bytes are not worth reporting and are left out.
+ */
+int grep_pattern_literals(const struct grep_opt *opt,
+			  const struct grep_pat *p,
+			  struct string_list *out);
 int grep_buffer(struct grep_opt *opt, char *buf, unsigned long size);
 
 struct grep_source {
@@ -235,18 +243,5 @@ int grep_threads_ok(const struct grep_opt *opt);
  */
 extern int grep_use_locks;
 extern pthread_mutex_t grep_attr_mutex;
-extern pthread_mutex_t grep_read_mutex;
-
-static inline void grep_read_lock(void)
-{
-	if (grep_use_locks)
-		pthread_mutex_lock(&grep_read_mutex);
-}
-
-static inline void grep_read_unlock(void)
-{
-	if (grep_use_locks)
-		pthread_mutex_unlock(&grep_read_mutex);
-}
 
 #endif
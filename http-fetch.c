@@ -3,9 +3,49 @@
 #include "exec-cmd.h"
 #include "http.h"
 #include "walker.h"
+#include "run-command.h"
+#include "argv-array.h"
 
 static const char http_fetch_usage[] = "git http-fetch "
-"[-c] [-t] [-a] [-v] [--recover] [-w ref] [--stdin] commit-id url";
+"[-c] [-t] [-a] [-v] [--recover] [-w ref] [--stdin] commit-id url\n"
+"   or: git http-fetch --packfile=<hash> [--index-pack-arg=<arg>...] url";
+
+/*
+ * Download a single pack and feed it to index-pack, whose output tells
+ * the caller (usually fetch-pack) which pack it ended up with.
+ */
+static int fetch_single_packfile(const char *hash, const char *url,
+				 const char **index_pack_args)
+{
+	struct child_process ip = CHILD_PROCESS_INIT;
+	struct strbuf tmpfile = STRBUF_INIT;
+	int ret;
+
+	http_init(NULL, url, 0);
+
+	strbuf_addf(&tmpfile, "%s/pack/tmp_uri_pack_%s",
+		    get_object_directory(), hash);
+	if (http_get_file(url, tmpfile.buf, NULL) != HTTP_OK) {
+		ret = error("Unable to get pack file %s", url);
+		goto cleanup;
+	}
+
+	ip.in = open(tmpfile.buf, O_RDONLY);
+	if (ip.in < 0) {
+		ret = error_errno("Unable to open local file %s", tmpfile.buf);
+		goto cleanup;
+	}
+	ip.git_cmd = 1;
+	argv_array_pushl(&ip.args, "index-pack", "--stdin", NULL);
+	argv_array_pushv(&ip.args, index_pack_args);
+	ret = run_command(&ip);
+
+cleanup:
+	unlink_or_warn(tmpfile.buf);
+	strbuf_release(&tmpfile);
+	http_cleanup();
+	return ret;
+}
 
 int cmd_main(int argc, const char **argv)
 {
@@ -19,6 +59,9 @@ int cmd_main(int argc, const char **argv)
 	int rc = 0;
 	int get_verbosely = 0;
 	int get_recover = 0;
+	const char *packfile = NULL;
+	struct argv_array index_pack_args = ARGV_ARRAY_INIT;
+	const char *p;
 
 	while (arg < argc && argv[arg][0] == '-') {
 		if (argv[arg][1] == 't') {
@@ -35,9 +78,23 @@ int cmd_main(int argc, const char **argv)
 			get_recover = 1;
 		} else if (!strcmp(argv[arg], "--stdin")) {
 			commits_on_stdin = 1;
+		} else if (skip_prefix(argv[arg], "--packfile=", &p)) {
+			packfile = p;
+		} else if (skip_prefix(argv[arg], "--index-pack-arg=", &p)) {
+			argv_array_push(&index_pack_args, p);
 		}
 		arg++;
 	}
+	if (packfile) {
+		if (argc != arg + 1 || commits_on_stdin)
+			usage(http_fetch_usage);
+		setup_git_directory();
+		git_config(git_default_config, NULL);
+		rc = fetch_single_packfile(packfile, argv[arg],
+					   index_pack_args.argv);
+		argv_array_clear(&index_pack_args);
+		return !!rc;
+	}
 	if (argc != arg + 2 - commits_on_stdin)
 		usage(http_fetch_usage);
 	if (commits_on_stdin) {
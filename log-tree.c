@@ -17,6 +17,8 @@
 #include "help.h"
 #include "interdiff.h"
 #include "range-diff.h"
+#include "merge-ort.h"
+#include "tmp-objdir.h"
 
 static struct decoration name_decoration = { "object names" };
 static int decoration_loaded;
@@ -837,6 +839,58 @@ static int do_diff_combined(struct rev_info *opt, struct commit *commit)
 	return !opt->loginfo;
 }
 
+/*
+ * Show how the merge "commit" differs from what merging its two parents
+ * mechanically results in, conflict markers and all.  The merge is done
+ * in memory; the objects it needs to write go to a temporary object
+ * directory, which is emptied again afterwards.
+ */
+static int do_remerge_diff(struct rev_info *opt,
+			   struct commit_list *parents,
+			   struct object_id *oid)
+{
+	struct merge_options o;
+	struct merge_result res;
+	struct commit *parent1 = parents->item;
+	struct commit *parent2 = parents->next->item;
+	struct strbuf parent1_desc = STRBUF_INIT;
+	struct strbuf parent2_desc = STRBUF_INIT;
+	struct pretty_print_context ctx = { 0 };
+
+	if (!opt->remerge_objdir) {
+		opt->remerge_objdir = tmp_objdir_create();
+		if (!opt->remerge_objdir)
+			die(_("unable to create temporary object directory"));
+		tmp_objdir_replace_primary_odb(opt->remerge_objdir);
+	}
+
+	parse_commit_or_die(parent1);
+	parse_commit_or_die(parent2);
+
+	init_merge_options(&o, the_repository);
+	o.show_rename_progress = 0;
+	ctx.abbrev = DEFAULT_ABBREV;
+	format_commit_message(parent1, "%h (%s)", &parent1_desc, &ctx);
+	format_commit_message(parent2, "%h (%s)", &parent2_desc, &ctx);
+	o.branch1 = parent1_desc.buf;
+	o.branch2 = parent2_desc.buf;
+
+	/* merge_incore_recursive() finds the merge bases itself */
+	merge_incore_recursive(&o, NULL, parent1, parent2, &res);
+	if (res.clean < 0)
+		die(_("unable to re-merge the parents of %s"), oid_to_hex(oid));
+
+	diff_tree_oid(&res.tree->object.oid, oid, "", &opt->diffopt);
+	log_tree_diff_flush(opt);
+
+	merge_finalize(&o, &res);
+	strbuf_release(&parent1_desc);
+	strbuf_release(&parent2_desc);
+	tmp_objdir_discard_objects(opt->remerge_objdir);
+
+	return !opt->loginfo;
+}
+
 /*
  * Show the diff of a commit.
  *
@@ -868,6 +922,12 @@ static int log_tree_diff(struct rev_info *opt, struct commit *commit, struct log
 	if (parents && parents->next) {
 		if (opt->ignore_merges)
 			return 0;
+		else if (opt->remerge_diff) {
+			/* Octopus merges are not re-merged */
+			if (parents->next->next)
+				return 0;
+			return do_remerge_diff(opt, parents, oid);
+		}
 		else if (opt->combine_merges)
 			return do_diff_combined(opt, commit);
 		else if (opt->first_parent_only) {
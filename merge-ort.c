@@ -0,0 +1,1439 @@
+/*
+ * "Ostensibly Recursive's Twin" merge strategy, or "ort" for short.
+ *
+ * Unlike merge-recursive, which builds its result in the index and the
+ * working tree while it is still merging, this backend collects the three
+ * trees into path-keyed maps, resolves everything in memory, writes the
+ * resulting trees to the object database, and only then updates the index
+ * and working tree with a single two-way unpack_trees() from HEAD to the
+ * result.  Subtrees that are identical on all three sides are never opened,
+ * so the work done is proportional to the number of changed paths rather
+ * than to the size of the tree.
+ */
+#include "cache.h"
+#include "merge-ort.h"
+
+#include "alloc.h"
+#include "blob.h"
+#include "commit.h"
+#include "commit-reach.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "ll-merge.h"
+#include "mem-pool.h"
+#include "object-store.h"
+#include "repository.h"
+#include "strmap.h"
+#include "submodule.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "unpack-trees.h"
+#include "xdiff-interface.h"
+
+struct version_info {
+	struct object_id oid;
+	unsigned short mode;
+};
+
+/*
+ * The merged result for a path.  Paths whose outcome is obvious while
+ * walking the trees (e.g. all three sides match) only ever get one of
+ * these; everything else starts out as a conflict_info, which embeds one.
+ */
+struct merged_info {
+	struct version_info result;
+	unsigned is_null:1;
+	unsigned clean:1;
+	/* offset of the basename within the full path */
+	size_t basename_offset;
+	/* the containing directory, shared by all its entries */
+	const char *directory_name;
+};
+
+struct conflict_info {
+	struct merged_info merged;
+	/* the merge base, side1 and side2 versions, if they are not trees */
+	struct version_info stages[3];
+	/* where the stages came from; differs from the path for renames */
+	const char *pathnames[3];
+	/* a conflict for this path was already reported (e.g. rename/delete) */
+	unsigned path_conflict:1;
+	unsigned filemask:3;
+	unsigned dirmask:3;
+};
+
+struct rename_info {
+	/* deletions and additions on each side; renames after detection */
+	struct diff_queue_struct pairs[3];
+	/* source path -> renamed filepair, for each side */
+	struct strmap sources[3];
+	/* destination path -> renamed filepair, for each side */
+	struct strmap targets[3];
+};
+
+struct merge_options_internal {
+	struct merge_options *opt;
+
+	/* all allocations below that live as long as the merge */
+	struct mem_pool *pool;
+
+	/* path -> merged_info or conflict_info, for every path we looked at */
+	struct strmap paths;
+
+	/* path -> conflict_info, for the paths left unmerged */
+	struct strmap conflicted;
+
+	/* directory -> string_list of its merged entries, for writing trees */
+	struct strmap dir_versions;
+
+	struct rename_info renames;
+
+	/* messages about the merge, shown by merge_switch_to_result() */
+	struct strbuf output;
+
+	/* the directory traverse_trees() is currently walking */
+	const char *current_dir_name;
+};
+
+static int show(struct merge_options *opt, int v)
+{
+	return (!opt->call_depth && opt->verbosity >= v) || opt->verbosity >= 5;
+}
+
+static void flush_output(struct merge_options *opt)
+{
+	if (opt->buffer_output < 2 && opt->obuf.len) {
+		fputs(opt->obuf.buf, stdout);
+		strbuf_reset(&opt->obuf);
+	}
+}
+
+static int err(struct merge_options *opt, const char *err, ...)
+{
+	va_list params;
+
+	if (opt->buffer_output < 2)
+		flush_output(opt);
+	else {
+		strbuf_complete(&opt->obuf, '\n');
+		strbuf_addstr(&opt->obuf, "error: ");
+	}
+	va_start(params, err);
+	strbuf_vaddf(&opt->obuf, err, params);
+	va_end(params);
+	if (opt->buffer_output > 1)
+		strbuf_addch(&opt->obuf, '\n');
+	else {
+		error("%s", opt->obuf.buf);
+		strbuf_reset(&opt->obuf);
+	}
+
+	return -1;
+}
+
+__attribute__((format (printf, 3, 4)))
+static void path_msg(struct merge_options_internal *mi, int v,
+		     const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show(mi->opt, v))
+		return;
+
+	strbuf_addchars(&mi->output, ' ', mi->opt->call_depth * 2);
+	va_start(ap, fmt);
+	strbuf_vaddf(&mi->output, fmt, ap);
+	va_end(ap);
+	strbuf_addch(&mi->output, '\n');
+}
+
+static char *pool_strndup(struct mem_pool *pool, const char *str, size_t len)
+{
+	char *ret = mem_pool_alloc(pool, len + 1);
+
+	memcpy(ret, str, len);
+	ret[len] = '\0';
+	return ret;
+}
+
+static struct tree *shift_tree_object(struct repository *repo,
+				      struct tree *one, struct tree *two,
+				      const char *subtree_shift)
+{
+	struct object_id shifted;
+
+	if (!*subtree_shift) {
+		shift_tree(repo, &one->object.oid, &two->object.oid, &shifted, 0);
+	} else {
+		shift_tree_by(repo, &one->object.oid, &two->object.oid, &shifted,
+			      subtree_shift);
+	}
+	if (oideq(&two->object.oid, &shifted))
+		return two;
+	return lookup_tree(repo, &shifted);
+}
+
+static struct commit *make_virtual_commit(struct repository *repo,
+					  struct tree *tree,
+					  const char *comment)
+{
+	struct commit *commit = alloc_commit_node(repo);
+
+	set_merge_remote_desc(commit, comment, (struct object *)commit);
+	commit->maybe_tree = tree;
+	commit->object.parsed = 1;
+	return commit;
+}
+
+static int versions_equal(const struct version_info *a,
+			  const struct version_info *b)
+{
+	return a->mode == b->mode && oideq(&a->oid, &b->oid);
+}
+
+static int same_entry(const struct name_entry *a, const struct name_entry *b)
+{
+	return a->mode && b->mode &&
+	       a->mode == b->mode &&
+	       oideq(&a->oid, &b->oid);
+}
+
+/*** Collecting the trees ***/
+
+static void add_pair(struct merge_options_internal *mi,
+		     const struct name_entry *names,
+		     const char *pathname,
+		     unsigned side,
+		     int is_add)
+{
+	struct diff_filespec *one, *two;
+	const struct name_entry *e = is_add ? &names[side] : &names[0];
+
+	one = alloc_filespec(pathname);
+	two = alloc_filespec(pathname);
+	fill_filespec(is_add ? two : one, &e->oid, 1, e->mode);
+	diff_queue(&mi->renames.pairs[side], one, two);
+}
+
+static int collect_merge_info_callback(int n,
+				       unsigned long mask,
+				       unsigned long dirmask,
+				       struct name_entry *names,
+				       struct traverse_info *info)
+{
+	struct merge_options_internal *mi = info->data;
+	unsigned long filemask = mask & ~dirmask;
+	struct conflict_info *ci;
+	struct name_entry *p;
+	size_t len;
+	char *fullpath;
+	int i;
+
+	/* Any non-empty entry gives us the name */
+	p = names;
+	while (!p->mode)
+		p++;
+
+	len = traverse_path_len(info, p->pathlen);
+	fullpath = mem_pool_alloc(mi->pool, len + 1);
+	make_traverse_path(fullpath, len + 1, info, p->path, p->pathlen);
+
+	/*
+	 * If all three sides match, there is nothing to merge, and nothing
+	 * below this path can be the source or destination of a rename
+	 * either.  Take it as-is, without opening the tree if it is one.
+	 */
+	if (same_entry(&names[0], &names[1]) && same_entry(&names[0], &names[2])) {
+		struct merged_info *merged = mem_pool_calloc(mi->pool, 1, sizeof(*merged));
+
+		merged->result.mode = names[0].mode;
+		oidcpy(&merged->result.oid, &names[0].oid);
+		merged->clean = 1;
+		merged->basename_offset = info->pathlen;
+		merged->directory_name = mi->current_dir_name;
+		strmap_put(&mi->paths, fullpath, merged);
+		return mask;
+	}
+
+	/*
+	 * Likewise, a file present on all three sides cannot be involved in
+	 * a rename, so if only one side changed it (or both did the same),
+	 * that side wins.
+	 */
+	if (filemask == 7) {
+		int side = 0;
+
+		if (same_entry(&names[0], &names[1]))
+			side = 2;
+		else if (same_entry(&names[0], &names[2]) ||
+			 same_entry(&names[1], &names[2]))
+			side = 1;
+		if (side) {
+			struct merged_info *merged = mem_pool_calloc(mi->pool, 1, sizeof(*merged));
+
+			merged->result.mode = names[side].mode;
+			oidcpy(&merged->result.oid, &names[side].oid);
+			merged->clean = 1;
+			merged->basename_offset = info->pathlen;
+			merged->directory_name = mi->current_dir_name;
+			strmap_put(&mi->paths, fullpath, merged);
+			return mask;
+		}
+	}
+
+	ci = mem_pool_calloc(mi->pool, 1, sizeof(*ci));
+	ci->merged.basename_offset = info->pathlen;
+	ci->merged.directory_name = mi->current_dir_name;
+	ci->filemask = filemask;
+	ci->dirmask = dirmask;
+	for (i = 0; i < 3; i++) {
+		ci->pathnames[i] = fullpath;
+		if (!(filemask & (1ul << i)))
+			continue;
+		ci->stages[i].mode = names[i].mode;
+		oidcpy(&ci->stages[i].oid, &names[i].oid);
+	}
+	strmap_put(&mi->paths, fullpath, ci);
+
+	/*
+	 * A file that is in the merge base but not on one side may have been
+	 * renamed by that side; a file that is on one side but not in the
+	 * merge base may be where it was renamed to.
+	 */
+	if (merge_detect_rename(mi->opt)) {
+		for (i = 1; i < 3; i++) {
+			unsigned long side_mask = 1ul << i;
+
+			if ((filemask & 1) && !(filemask & side_mask))
+				add_pair(mi, names, fullpath, i, 0);
+			else if (!(filemask & 1) && (filemask & side_mask))
+				add_pair(mi, names, fullpath, i, 1);
+		}
+	}
+
+	if (dirmask) {
+		struct traverse_info newinfo;
+		struct tree_desc t[3];
+		void *buf[3];
+		const char *original_dir_name;
+		int ret;
+
+		newinfo = *info;
+		newinfo.prev = info;
+		newinfo.name = p->path;
+		newinfo.namelen = p->pathlen;
+		newinfo.pathlen = st_add3(newinfo.pathlen, p->pathlen, 1);
+
+		for (i = 0; i < 3; i++) {
+			const struct object_id *oid = NULL;
+
+			if (dirmask & (1ul << i))
+				oid = &names[i].oid;
+			buf[i] = fill_tree_descriptor(mi->opt->repo, t + i, oid);
+		}
+
+		original_dir_name = mi->current_dir_name;
+		mi->current_dir_name = fullpath;
+		ret = traverse_trees(NULL, 3, t, &newinfo);
+		mi->current_dir_name = original_dir_name;
+
+		for (i = 0; i < 3; i++)
+			free(buf[i]);
+		if (ret < 0)
+			return -1;
+	}
+
+	return mask;
+}
+
+static int collect_merge_info(struct merge_options_internal *mi,
+			      struct tree *merge_base,
+			      struct tree *side1,
+			      struct tree *side2)
+{
+	struct traverse_info info;
+	struct tree_desc t[3];
+
+	if (parse_tree(merge_base) < 0 ||
+	    parse_tree(side1) < 0 ||
+	    parse_tree(side2) < 0)
+		return -1;
+	init_tree_desc(t + 0, merge_base->buffer, merge_base->size);
+	init_tree_desc(t + 1, side1->buffer, side1->size);
+	init_tree_desc(t + 2, side2->buffer, side2->size);
+
+	setup_traverse_info(&info, "");
+	info.fn = collect_merge_info_callback;
+	info.data = mi;
+	info.show_all_errors = 1;
+
+	return traverse_trees(NULL, 3, t, &info);
+}
+
+/*** Merging file contents ***/
+
+static int merge_3way(struct merge_options_internal *mi,
+		      mmbuffer_t *result_buf,
+		      const struct version_info *o,
+		      const struct version_info *a,
+		      const struct version_info *b,
+		      const char *pathnames[3],
+		      const int extra_marker_size)
+{
+	struct merge_options *opt = mi->opt;
+	mmfile_t orig, src1, src2;
+	struct ll_merge_options ll_opts = {0};
+	char *base_name, *name1, *name2;
+	int merge_status;
+
+	ll_opts.renormalize = opt->renormalize;
+	ll_opts.extra_marker_size = extra_marker_size;
+	ll_opts.xdl_opts = opt->xdl_opts;
+
+	if (opt->call_depth) {
+		ll_opts.virtual_ancestor = 1;
+		ll_opts.variant = 0;
+	} else {
+		switch (opt->recursive_variant) {
+		case MERGE_RECURSIVE_OURS:
+			ll_opts.variant = XDL_MERGE_FAVOR_OURS;
+			break;
+		case MERGE_RECURSIVE_THEIRS:
+			ll_opts.variant = XDL_MERGE_FAVOR_THEIRS;
+			break;
+		default:
+			ll_opts.variant = 0;
+			break;
+		}
+	}
+
+	if (strcmp(pathnames[1], pathnames[2]) ||
+	    (opt->ancestor && strcmp(pathnames[1], pathnames[0]))) {
+		base_name = opt->ancestor == NULL ? NULL :
+			mkpathdup("%s:%s", opt->ancestor, pathnames[0]);
+		name1 = mkpathdup("%s:%s", opt->branch1, pathnames[1]);
+		name2 = mkpathdup("%s:%s", opt->branch2, pathnames[2]);
+	} else {
+		base_name = opt->ancestor == NULL ? NULL :
+			mkpathdup("%s", opt->ancestor);
+		name1 = mkpathdup("%s", opt->branch1);
+		name2 = mkpathdup("%s", opt->branch2);
+	}
+
+	read_mmblob(&orig, &o->oid);
+	read_mmblob(&src1, &a->oid);
+	read_mmblob(&src2, &b->oid);
+
+	merge_status = ll_merge(result_buf, pathnames[1], &orig, base_name,
+				&src1, name1, &src2, name2,
+				opt->repo->index, &ll_opts);
+
+	free(base_name);
+	free(name1);
+	free(name2);
+	free(orig.ptr);
+	free(src1.ptr);
+	free(src2.ptr);
+	return merge_status;
+}
+
+static int merge_submodule(struct merge_options_internal *mi,
+			   const char *path,
+			   const struct object_id *o,
+			   const struct object_id *a,
+			   const struct object_id *b,
+			   struct object_id *result)
+{
+	struct merge_options *opt = mi->opt;
+	struct commit *commit_o, *commit_a, *commit_b;
+
+	/* store a in result in case we fail */
+	oidcpy(result, a);
+
+	/* we can not handle deletion conflicts */
+	if (is_null_oid(o) || is_null_oid(a) || is_null_oid(b))
+		return 0;
+
+	if (add_submodule_odb(path)) {
+		path_msg(mi, 1, _("Failed to merge submodule %s (not checked out)"),
+			 path);
+		return 0;
+	}
+
+	if (!(commit_o = lookup_commit_reference(opt->repo, o)) ||
+	    !(commit_a = lookup_commit_reference(opt->repo, a)) ||
+	    !(commit_b = lookup_commit_reference(opt->repo, b))) {
+		path_msg(mi, 1, _("Failed to merge submodule %s (commits not present)"),
+			 path);
+		return 0;
+	}
+
+	/* check whether both changes are forward */
+	if (!in_merge_bases(commit_o, commit_a) ||
+	    !in_merge_bases(commit_o, commit_b)) {
+		path_msg(mi, 1, _("Failed to merge submodule %s (commits don't follow merge-base)"),
+			 path);
+		return 0;
+	}
+
+	/* a is contained in b or vice versa */
+	if (in_merge_bases(commit_a, commit_b)) {
+		oidcpy(result, b);
+		path_msg(mi, 2, _("Fast-forwarding submodule %s"), path);
+		return 1;
+	}
+	if (in_merge_bases(commit_b, commit_a)) {
+		oidcpy(result, a);
+		path_msg(mi, 2, _("Fast-forwarding submodule %s"), path);
+		return 1;
+	}
+
+	path_msg(mi, 1, _("Failed to merge submodule %s (not fast-forward)"),
+		 path);
+	return 0;
+}
+
+/*
+ * Three-way merge of the mode and contents of a path, as in
+ * merge_mode_and_contents() in merge-recursive.c.  An absent merge base
+ * (mode 0, null oid) makes this a two-way merge for add/add conflicts.
+ * Returns 1 if clean, 0 if there were conflicts and -1 on error; the
+ * result is filled in either way.
+ */
+static int handle_content_merge(struct merge_options_internal *mi,
+				const char *path,
+				const struct version_info *o,
+				const struct version_info *a,
+				const struct version_info *b,
+				const char *pathnames[3],
+				const int extra_marker_size,
+				struct version_info *result)
+{
+	struct merge_options *opt = mi->opt;
+	int clean = 1;
+
+	if ((S_IFMT & a->mode) != (S_IFMT & b->mode)) {
+		if (S_ISREG(a->mode))
+			*result = *a;
+		else
+			*result = *b;
+		return 0;
+	}
+
+	if (a->mode == b->mode || a->mode == o->mode)
+		result->mode = b->mode;
+	else {
+		result->mode = a->mode;
+		clean = (b->mode == o->mode);
+	}
+
+	if (oideq(&a->oid, &b->oid) || oideq(&a->oid, &o->oid))
+		oidcpy(&result->oid, &b->oid);
+	else if (oideq(&b->oid, &o->oid))
+		oidcpy(&result->oid, &a->oid);
+	else if (S_ISREG(a->mode)) {
+		mmbuffer_t result_buf;
+		int ret = 0, merge_status;
+
+		path_msg(mi, 2, _("Auto-merging %s"), path);
+		merge_status = merge_3way(mi, &result_buf, o, a, b,
+					  pathnames, extra_marker_size);
+
+		if ((merge_status < 0) || !result_buf.ptr)
+			ret = err(opt, _("Failed to execute internal merge"));
+
+		if (!ret &&
+		    write_object_file(result_buf.ptr, result_buf.size,
+				      blob_type, &result->oid))
+			ret = err(opt, _("Unable to add %s to database"), path);
+
+		free(result_buf.ptr);
+		if (ret)
+			return ret;
+		clean &= (merge_status == 0);
+	} else if (S_ISGITLINK(a->mode)) {
+		clean &= merge_submodule(mi, path, &o->oid, &a->oid, &b->oid,
+					 &result->oid);
+	} else if (S_ISLNK(a->mode)) {
+		switch (opt->recursive_variant) {
+		case MERGE_RECURSIVE_NORMAL:
+			oidcpy(&result->oid, &a->oid);
+			clean = 0;
+			break;
+		case MERGE_RECURSIVE_OURS:
+			oidcpy(&result->oid, &a->oid);
+			break;
+		case MERGE_RECURSIVE_THEIRS:
+			oidcpy(&result->oid, &b->oid);
+			break;
+		}
+	} else
+		BUG("unsupported object type in the tree: %06o for %s",
+		    a->mode, path);
+
+	return clean;
+}
+
+/*** Renames ***/
+
+static void detect_regular_renames(struct merge_options_internal *mi,
+				   unsigned side)
+{
+	struct merge_options *opt = mi->opt;
+	struct rename_info *renames = &mi->renames;
+	struct diff_options diff_opts;
+	int i;
+
+	repo_diff_setup(opt->repo, &diff_opts);
+	diff_opts.flags.recursive = 1;
+	diff_opts.flags.rename_empty = 0;
+	/*
+	 * As in merge-recursive, copies are never detected; a change to a
+	 * base file should not be propagated to several others.
+	 */
+	diff_opts.detect_rename = DIFF_DETECT_RENAME;
+	diff_opts.rename_limit = opt->merge_rename_limit >= 0 ? opt->merge_rename_limit :
+				 opt->diff_rename_limit >= 0 ? opt->diff_rename_limit :
+				 1000;
+	diff_opts.rename_score = opt->rename_score;
+	diff_opts.show_rename_progress = opt->show_rename_progress;
+	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&diff_opts);
+
+	diff_queued_diff = renames->pairs[side];
+	diffcore_rename(&diff_opts);
+	renames->pairs[side] = diff_queued_diff;
+	DIFF_QUEUE_CLEAR(&diff_queued_diff);
+
+	if (diff_opts.needed_rename_limit > opt->needed_rename_limit)
+		opt->needed_rename_limit = diff_opts.needed_rename_limit;
+
+	for (i = 0; i < renames->pairs[side].nr; i++) {
+		struct diff_filepair *p = renames->pairs[side].queue[i];
+
+		if (!p->renamed_pair)
+			continue;
+		strmap_put(&renames->sources[side], p->one->path, p);
+		strmap_put(&renames->targets[side], p->two->path, p);
+	}
+}
+
+static struct conflict_info *get_conflict_info(struct merge_options_internal *mi,
+					       const char *path)
+{
+	struct conflict_info *ci = strmap_get(&mi->paths, path);
+
+	if (!ci || ci->merged.clean)
+		BUG("rename path %s was resolved while collecting", path);
+	return ci;
+}
+
+/*
+ * Move what the renaming side's counterpart knows about the source path
+ * over to the destination, so that process_entries() merges the contents
+ * there, and leave the source to resolve as a deletion.
+ */
+static int process_renames(struct merge_options_internal *mi)
+{
+	struct merge_options *opt = mi->opt;
+	unsigned side;
+	int i;
+
+	for (side = 1; side < 3; side++) {
+		unsigned other = 3 - side;
+		const char *branch = side == 1 ? opt->branch1 : opt->branch2;
+		const char *other_branch = side == 1 ? opt->branch2 : opt->branch1;
+		struct diff_queue_struct *q = &mi->renames.pairs[side];
+
+		for (i = 0; i < q->nr; i++) {
+			struct diff_filepair *p = q->queue[i], *other_p;
+			struct conflict_info *oldinfo, *newinfo;
+			const char *oldpath, *newpath;
+
+			if (!p->renamed_pair)
+				continue;
+			oldinfo = get_conflict_info(mi, p->one->path);
+			newinfo = get_conflict_info(mi, p->two->path);
+			oldpath = oldinfo->pathnames[0];
+			newpath = newinfo->pathnames[side];
+
+			other_p = strmap_get(&mi->renames.sources[other], oldpath);
+			if (other_p) {
+				struct conflict_info *other_newinfo;
+
+				/* handled when looking at the first side */
+				if (side == 2)
+					continue;
+
+				other_newinfo = get_conflict_info(mi, other_p->two->path);
+				if (newinfo == other_newinfo) {
+					/* rename/rename(1to1); merge as usual */
+					newinfo->stages[0] = oldinfo->stages[0];
+					newinfo->pathnames[0] = oldpath;
+					continue;
+				}
+
+				path_msg(mi, 1, _("CONFLICT (rename/rename): "
+					 "Rename \"%s\"->\"%s\" in branch \"%s\" "
+					 "rename \"%s\"->\"%s\" in \"%s\"%s"),
+					 oldpath, newpath, branch,
+					 oldpath, other_newinfo->pathnames[other],
+					 other_branch,
+					 opt->call_depth ? _(" (left unresolved)") : "");
+				/*
+				 * Leave the base version unmerged at the
+				 * source and each side's version at its
+				 * destination.
+				 */
+				oldinfo->path_conflict = 1;
+				newinfo->path_conflict = 1;
+				other_newinfo->path_conflict = 1;
+				continue;
+			}
+
+			if (!oldinfo->stages[other].mode) {
+				path_msg(mi, 1, _("CONFLICT (rename/delete): %s deleted in %s "
+					 "and renamed to %s in %s. Version %s of %s left in tree."),
+					 oldpath, other_branch, newpath, branch,
+					 branch, newpath);
+				newinfo->path_conflict = 1;
+				continue;
+			}
+
+			if (newinfo->stages[other].mode) {
+				/*
+				 * The other side has its own file at the
+				 * destination, either added or renamed there.
+				 * Merge the renamed file with the other side's
+				 * version of the source first, and leave the
+				 * rest to the add/add handling.
+				 */
+				const char *pathnames[3];
+				const struct version_info *sides[3];
+				struct version_info merged;
+
+				other_p = strmap_get(&mi->renames.targets[other], newpath);
+				if (other_p)
+					path_msg(mi, 1, _("CONFLICT (rename/rename): "
+						 "Rename %s->%s in %s. "
+						 "Rename %s->%s in %s"),
+						 oldpath, newpath, branch,
+						 other_p->one->path, newpath, other_branch);
+				else
+					path_msg(mi, 1, _("CONFLICT (rename/add): "
+						 "Rename %s->%s in %s.  Added %s in %s"),
+						 oldpath, newpath, branch,
+						 newpath, other_branch);
+
+				pathnames[0] = oldpath;
+				pathnames[side] = newpath;
+				pathnames[other] = oldpath;
+				sides[side] = &newinfo->stages[side];
+				sides[other] = &oldinfo->stages[other];
+				if (handle_content_merge(mi, newpath,
+							 &oldinfo->stages[0],
+							 sides[1], sides[2],
+							 pathnames,
+							 1 + opt->call_depth * 2,
+							 &merged) < 0)
+					return -1;
+				newinfo->stages[side] = merged;
+			} else {
+				newinfo->stages[0] = oldinfo->stages[0];
+				newinfo->pathnames[0] = oldpath;
+				newinfo->stages[other] = oldinfo->stages[other];
+				newinfo->pathnames[other] = oldpath;
+			}
+
+			/* the other side's version went along with the rename */
+			memset(&oldinfo->stages[other], 0, sizeof(oldinfo->stages[other]));
+		}
+	}
+	return 0;
+}
+
+static void free_renames(struct rename_info *renames)
+{
+	int side, i;
+
+	for (side = 1; side < 3; side++) {
+		struct diff_queue_struct *q = &renames->pairs[side];
+
+		for (i = 0; i < q->nr; i++)
+			diff_free_filepair(q->queue[i]);
+		free(q->queue);
+		DIFF_QUEUE_CLEAR(q);
+		strmap_clear(&renames->sources[side], 0);
+		strmap_clear(&renames->targets[side], 0);
+	}
+}
+
+static int detect_and_process_renames(struct merge_options_internal *mi)
+{
+	int ret = 0;
+
+	if (merge_detect_rename(mi->opt)) {
+		detect_regular_renames(mi, 1);
+		detect_regular_renames(mi, 2);
+		ret = process_renames(mi);
+	}
+	free_renames(&mi->renames);
+	return ret;
+}
+
+/*** Processing entries and writing trees ***/
+
+static int tree_entry_order(const void *a_, const void *b_)
+{
+	const struct string_list_item *a = a_;
+	const struct string_list_item *b = b_;
+	const struct merged_info *ami = a->util;
+	const struct merged_info *bmi = b->util;
+
+	return base_name_compare(a->string, strlen(a->string), ami->result.mode,
+				 b->string, strlen(b->string), bmi->result.mode);
+}
+
+static int write_tree(struct object_id *result_oid,
+		      struct string_list *versions)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int i, ret;
+
+	QSORT(versions->items, versions->nr, tree_entry_order);
+	for (i = 0; i < versions->nr; i++) {
+		struct merged_info *merged = versions->items[i].util;
+
+		strbuf_addf(&buf, "%o %s%c", merged->result.mode,
+			    versions->items[i].string, '\0');
+		strbuf_add(&buf, merged->result.oid.hash, the_hash_algo->rawsz);
+	}
+
+	ret = write_object_file(buf.buf, buf.len, tree_type, result_oid);
+	strbuf_release(&buf);
+	return ret;
+}
+
+static void record_entry_for_tree(struct merge_options_internal *mi,
+				  const char *directory_name,
+				  const char *basename,
+				  struct merged_info *merged)
+{
+	struct string_list *versions;
+
+	if (merged->is_null)
+		return;
+	versions = strmap_get(&mi->dir_versions, directory_name);
+	if (!versions) {
+		versions = xcalloc(1, sizeof(*versions));
+		string_list_init(versions, 0);
+		strmap_put(&mi->dir_versions, directory_name, versions);
+	}
+	string_list_append(versions, basename)->util = merged;
+}
+
+/*
+ * Write out the tree for a directory whose entries have all been
+ * processed.  Returns NULL if nothing is left in it.
+ */
+static struct merged_info *write_completed_directory(struct merge_options_internal *mi,
+						     const char *path,
+						     int *error)
+{
+	struct string_list *versions = strmap_get(&mi->dir_versions, path);
+	struct merged_info *merged;
+
+	if (!versions)
+		return NULL;
+
+	merged = mem_pool_calloc(mi->pool, 1, sizeof(*merged));
+	merged->result.mode = S_IFDIR;
+	merged->clean = 1;
+	if (write_tree(&merged->result.oid, versions))
+		*error = err(mi->opt, _("unable to write tree for %s"),
+			     *path ? path : ".");
+
+	strmap_remove(&mi->dir_versions, path, 0);
+	string_list_clear(versions, 0);
+	free(versions);
+	return merged;
+}
+
+/* add a string to a strbuf, but converting "/" to "_" */
+static void add_flattened_path(struct strbuf *out, const char *s)
+{
+	size_t i = out->len;
+	strbuf_addstr(out, s);
+	for (; i < out->len; i++)
+		if (out->buf[i] == '/')
+			out->buf[i] = '_';
+}
+
+static char *unique_path(struct merge_options_internal *mi,
+			 const char *path,
+			 const char *branch)
+{
+	struct strbuf newpath = STRBUF_INIT;
+	int suffix = 0;
+	size_t base_len;
+	char *ret;
+
+	strbuf_addf(&newpath, "%s~", path);
+	add_flattened_path(&newpath, branch);
+
+	base_len = newpath.len;
+	while (strmap_contains(&mi->paths, newpath.buf)) {
+		strbuf_setlen(&newpath, base_len);
+		strbuf_addf(&newpath, "_%d", suffix++);
+	}
+
+	ret = pool_strndup(mi->pool, newpath.buf, newpath.len);
+	strbuf_release(&newpath);
+	return ret;
+}
+
+static void set_result(struct merged_info *merged,
+		       const struct version_info *version)
+{
+	if (!version || !version->mode) {
+		merged->is_null = 1;
+		return;
+	}
+	merged->result = *version;
+}
+
+static int process_file_entry(struct merge_options_internal *mi,
+			      const char *path,
+			      struct conflict_info *ci)
+{
+	struct merge_options *opt = mi->opt;
+	struct merged_info *merged = &ci->merged;
+	const struct version_info *o = &ci->stages[0];
+	const struct version_info *a = &ci->stages[1];
+	const struct version_info *b = &ci->stages[2];
+	int o_valid = !!o->mode, a_valid = !!a->mode, b_valid = !!b->mode;
+
+	merged->clean = !ci->path_conflict;
+
+	if (ci->path_conflict && (!a_valid || !b_valid)) {
+		/* already reported while handling renames */
+		set_result(merged, a_valid ? a : b);
+	} else if (!a_valid && !b_valid) {
+		set_result(merged, NULL);
+	} else if (a_valid && b_valid && versions_equal(a, b)) {
+		set_result(merged, a);
+	} else if (o_valid && a_valid && versions_equal(o, a)) {
+		set_result(merged, b);
+	} else if (o_valid && b_valid && versions_equal(o, b)) {
+		set_result(merged, a);
+	} else if (!o_valid && (!a_valid || !b_valid)) {
+		set_result(merged, a_valid ? a : b);
+	} else if (a_valid && b_valid) {
+		int clean = handle_content_merge(mi, path, o, a, b, ci->pathnames,
+						 opt->call_depth * 2,
+						 &merged->result);
+		if (clean < 0)
+			return -1;
+		if (!clean) {
+			const char *reason = _("content");
+
+			if (!o_valid)
+				reason = _("add/add");
+			if (S_ISGITLINK(merged->result.mode))
+				reason = _("submodule");
+			path_msg(mi, 1, _("CONFLICT (%s): Merge conflict in %s"),
+				 reason, path);
+			merged->clean = 0;
+		}
+	} else {
+		const char *change_branch = a_valid ? opt->branch1 : opt->branch2;
+		const char *delete_branch = a_valid ? opt->branch2 : opt->branch1;
+
+		path_msg(mi, 1, _("CONFLICT (%s/delete): %s deleted in %s "
+			 "and %s in %s. Version %s of %s left in tree."),
+			 _("modify"), path, delete_branch, _("modified"),
+			 change_branch, change_branch, path);
+		/*
+		 * There is no sane middle point between a modification and
+		 * a deletion, so virtual merge bases keep the base version.
+		 */
+		set_result(merged, opt->call_depth ? o : a_valid ? a : b);
+		merged->clean = 0;
+	}
+	return 0;
+}
+
+static int process_entry(struct merge_options_internal *mi,
+			 const char *path,
+			 struct conflict_info *ci)
+{
+	struct merge_options *opt = mi->opt;
+	const char *basename = path + ci->merged.basename_offset;
+	struct merged_info *dir_result = NULL;
+	int ret = 0;
+
+	/* all entries below this directory have been processed by now */
+	if (ci->dirmask) {
+		dir_result = write_completed_directory(mi, path, &ret);
+		if (ret < 0)
+			return ret;
+		if (dir_result)
+			record_entry_for_tree(mi, ci->merged.directory_name,
+					      basename, dir_result);
+	}
+
+	if (process_file_entry(mi, path, ci) < 0)
+		return -1;
+
+	if (dir_result && !ci->merged.is_null) {
+		/* file/directory conflict; the directory keeps the path */
+		const char *file_branch, *dir_branch;
+		char *new_path;
+
+		if (ci->stages[1].mode && !(ci->dirmask & 2)) {
+			file_branch = opt->branch1;
+			dir_branch = opt->branch2;
+		} else {
+			file_branch = opt->branch2;
+			dir_branch = opt->branch1;
+		}
+		new_path = unique_path(mi, path, file_branch);
+		path_msg(mi, 1, _("CONFLICT (%s): There is a directory with name %s in %s. "
+			 "Adding %s as %s"),
+			 _("file/directory"), path, dir_branch, path, new_path);
+		strmap_put(&mi->paths, new_path, ci);
+		path = new_path;
+		basename = path + ci->merged.basename_offset;
+		ci->merged.clean = 0;
+	}
+
+	record_entry_for_tree(mi, ci->merged.directory_name, basename,
+			      &ci->merged);
+	if (!ci->merged.clean)
+		strmap_put(&mi->conflicted, path, ci);
+	return 0;
+}
+
+static int process_entries(struct merge_options_internal *mi,
+			   struct object_id *result_oid)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	struct string_list plist = STRING_LIST_INIT_NODUP;
+	struct string_list *root;
+	int i, ret = 0;
+
+	strmap_for_each_entry(&mi->paths, &iter, e)
+		string_list_append(&plist, e->key)->util = e->value;
+	string_list_sort(&plist);
+
+	/*
+	 * Walk the paths in reverse order, so that everything below a
+	 * directory has been merged (and the directory's tree can be
+	 * written) by the time we get to the directory itself.
+	 */
+	for (i = plist.nr - 1; i >= 0; i--) {
+		const char *path = plist.items[i].string;
+		struct merged_info *merged = plist.items[i].util;
+
+		if (merged->clean) {
+			record_entry_for_tree(mi, merged->directory_name,
+					      path + merged->basename_offset,
+					      merged);
+			continue;
+		}
+		ret = process_entry(mi, path, (struct conflict_info *)merged);
+		if (ret < 0)
+			goto cleanup;
+	}
+
+	root = strmap_get(&mi->dir_versions, "");
+	if (!root) {
+		oidcpy(result_oid, the_hash_algo->empty_tree);
+		if (write_object_file("", 0, tree_type, result_oid))
+			ret = err(mi->opt, _("unable to write tree for %s"), ".");
+	} else {
+		struct merged_info *merged = write_completed_directory(mi, "", &ret);
+		oidcpy(result_oid, &merged->result.oid);
+	}
+
+cleanup:
+	string_list_clear(&plist, 0);
+	return ret;
+}
+
+/*** Updating the index and working tree ***/
+
+static int checkout(struct merge_options *opt,
+		    struct tree *prev,
+		    struct tree *next)
+{
+	struct tree_desc trees[2];
+	struct unpack_trees_options unpack_opts;
+	int ret;
+
+	if (parse_tree(prev) < 0 || parse_tree(next) < 0)
+		return -1;
+	init_tree_desc(&trees[0], prev->buffer, prev->size);
+	init_tree_desc(&trees[1], next->buffer, next->size);
+
+	memset(&unpack_opts, 0, sizeof(unpack_opts));
+	unpack_opts.head_idx = 1;
+	unpack_opts.src_index = opt->repo->index;
+	unpack_opts.dst_index = opt->repo->index;
+	unpack_opts.merge = 1;
+	unpack_opts.update = 1;
+	unpack_opts.fn = twoway_merge;
+	setup_unpack_trees_porcelain(&unpack_opts, "merge");
+
+	refresh_index(opt->repo->index, REFRESH_QUIET, NULL, NULL, NULL);
+	ret = unpack_trees(2, trees, &unpack_opts);
+	clear_unpack_trees_porcelain(&unpack_opts);
+	return ret;
+}
+
+static int record_conflicted_index_entries(struct merge_options_internal *mi,
+					   struct index_state *index)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&mi->conflicted, &iter, e) {
+		const char *path = e->key;
+		struct conflict_info *ci = e->value;
+		int i;
+
+		if (remove_file_from_index(index, path))
+			return err(mi->opt, _("unable to remove %s from index"),
+				   path);
+		for (i = 0; i < 3; i++) {
+			struct cache_entry *ce;
+
+			if (!ci->stages[i].mode)
+				continue;
+			ce = make_cache_entry(index, ci->stages[i].mode,
+					      &ci->stages[i].oid, path,
+					      i + 1, 0);
+			if (!ce ||
+			    add_index_entry(index, ce, ADD_CACHE_OK_TO_ADD |
+						       ADD_CACHE_OK_TO_REPLACE))
+				return err(mi->opt, _("unable to add %s to index"),
+					   path);
+		}
+	}
+	return 0;
+}
+
+/*** Public API ***/
+
+static void merge_start(struct merge_options *opt, struct merge_result *result)
+{
+	struct merge_options_internal *mi;
+	int i;
+
+	assert(opt->repo);
+	assert(opt->branch1 && opt->branch2);
+
+	mi = xcalloc(1, sizeof(*mi));
+	mi->opt = opt;
+	mem_pool_init(&mi->pool, 0);
+	strmap_init_with_options(&mi->paths, mi->pool, 0);
+	strmap_init_with_options(&mi->conflicted, mi->pool, 0);
+	strmap_init_with_options(&mi->dir_versions, mi->pool, 0);
+	for (i = 1; i < 3; i++) {
+		strmap_init_with_options(&mi->renames.sources[i], NULL, 0);
+		strmap_init_with_options(&mi->renames.targets[i], NULL, 0);
+	}
+	strbuf_init(&mi->output, 0);
+	mi->current_dir_name = "";
+
+	memset(result, 0, sizeof(*result));
+	result->priv = mi;
+}
+
+void merge_finalize(struct merge_options *opt,
+		    struct merge_result *result)
+{
+	struct merge_options_internal *mi = result->priv;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	if (!mi)
+		return;
+
+	free_renames(&mi->renames);
+	strmap_for_each_entry(&mi->dir_versions, &iter, e) {
+		string_list_clear(e->value, 0);
+		free(e->value);
+	}
+	strmap_clear(&mi->dir_versions, 0);
+	strmap_clear(&mi->conflicted, 0);
+	strmap_clear(&mi->paths, 0);
+	mem_pool_discard(mi->pool, 0);
+	strbuf_release(&mi->output);
+	FREE_AND_NULL(result->priv);
+}
+
+static void merge_ort_nonrecursive_internal(struct merge_options *opt,
+					    struct tree *merge_base,
+					    struct tree *side1,
+					    struct tree *side2,
+					    struct merge_result *result)
+{
+	struct merge_options_internal *mi;
+	struct object_id working_tree_oid;
+
+	merge_start(opt, result);
+	mi = result->priv;
+
+	if (opt->subtree_shift) {
+		side2 = shift_tree_object(opt->repo, side1, side2,
+					  opt->subtree_shift);
+		merge_base = shift_tree_object(opt->repo, side1, merge_base,
+					       opt->subtree_shift);
+	}
+
+	if (collect_merge_info(mi, merge_base, side1, side2) < 0) {
+		err(opt, _("collecting merge info failed for trees %s, %s, %s"),
+		    oid_to_hex(&merge_base->object.oid),
+		    oid_to_hex(&side1->object.oid),
+		    oid_to_hex(&side2->object.oid));
+		result->clean = -1;
+		return;
+	}
+
+	if (detect_and_process_renames(mi) < 0 ||
+	    process_entries(mi, &working_tree_oid) < 0) {
+		result->clean = -1;
+		return;
+	}
+
+	result->clean = strmap_empty(&mi->conflicted);
+	result->tree = lookup_tree(opt->repo, &working_tree_oid);
+	if (!result->tree)
+		result->clean = -1;
+}
+
+static struct commit_list *reverse_commit_list(struct commit_list *list)
+{
+	struct commit_list *next = NULL, *current, *backup;
+	for (current = list; current; current = backup) {
+		backup = current->next;
+		current->next = next;
+		next = current;
+	}
+	return next;
+}
+
+static void merge_ort_internal(struct merge_options *opt,
+			       struct commit_list *merge_bases,
+			       struct commit *h1,
+			       struct commit *h2,
+			       struct merge_result *result)
+{
+	struct commit_list *iter;
+	struct commit *merged_merge_bases;
+
+	if (!merge_bases) {
+		merge_bases = get_merge_bases(h1, h2);
+		merge_bases = reverse_commit_list(merge_bases);
+	}
+
+	merged_merge_bases = pop_commit(&merge_bases);
+	if (merged_merge_bases == NULL) {
+		/* if there is no common ancestor, use an empty tree */
+		struct tree *tree;
+
+		tree = lookup_tree(opt->repo, opt->repo->hash_algo->empty_tree);
+		merged_merge_bases = make_virtual_commit(opt->repo, tree,
+							 "ancestor");
+	}
+
+	for (iter = merge_bases; iter; iter = iter->next) {
+		const char *saved_b1, *saved_b2;
+		struct merge_result inner;
+		struct commit *prev = merged_merge_bases;
+
+		opt->call_depth++;
+		/*
+		 * The cleanness of the merge of the merge bases is
+		 * ignored; any conflicts are committed into the virtual
+		 * merge base with their conflict markers.
+		 */
+		saved_b1 = opt->branch1;
+		saved_b2 = opt->branch2;
+		opt->branch1 = "Temporary merge branch 1";
+		opt->branch2 = "Temporary merge branch 2";
+		merge_ort_internal(opt, NULL, prev, iter->item, &inner);
+		opt->branch1 = saved_b1;
+		opt->branch2 = saved_b2;
+		opt->call_depth--;
+
+		if (inner.clean < 0) {
+			merge_finalize(opt, &inner);
+			result->clean = inner.clean;
+			return;
+		}
+
+		merged_merge_bases = make_virtual_commit(opt->repo, inner.tree,
+							 "merged tree");
+		commit_list_insert(prev, &merged_merge_bases->parents);
+		commit_list_insert(iter->item,
+				   &merged_merge_bases->parents->next);
+		merge_finalize(opt, &inner);
+	}
+
+	opt->ancestor = "merged common ancestors";
+	merge_ort_nonrecursive_internal(opt,
+					get_commit_tree(merged_merge_bases),
+					get_commit_tree(h1),
+					get_commit_tree(h2),
+					result);
+}
+
+void merge_incore_nonrecursive(struct merge_options *opt,
+			       struct tree *merge_base,
+			       struct tree *side1,
+			       struct tree *side2,
+			       struct merge_result *result)
+{
+	assert(opt->ancestor != NULL);
+	merge_ort_nonrecursive_internal(opt, merge_base, side1, side2, result);
+}
+
+void merge_incore_recursive(struct merge_options *opt,
+			    struct commit_list *merge_bases,
+			    struct commit *side1,
+			    struct commit *side2,
+			    struct merge_result *result)
+{
+	merge_ort_internal(opt, merge_bases, side1, side2, result);
+}
+
+void merge_get_conflicted_files(struct merge_result *result,
+				struct string_list *conflicted_files)
+{
+	struct merge_options_internal *mi = result->priv;
+	struct string_list paths = STRING_LIST_INIT_NODUP;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	struct string_list_item *item;
+
+	strmap_for_each_entry(&mi->conflicted, &iter, e)
+		string_list_append(&paths, e->key)->util = e->value;
+	string_list_sort(&paths);
+
+	for_each_string_list_item(item, &paths) {
+		struct conflict_info *ci = item->util;
+		int i;
+
+		for (i = 0; i < 3; i++) {
+			struct stage_info *si;
+
+			if (!ci->stages[i].mode)
+				continue;
+			si = xmalloc(sizeof(*si));
+			oidcpy(&si->oid, &ci->stages[i].oid);
+			si->mode = ci->stages[i].mode;
+			si->stage = i + 1;
+			string_list_append(conflicted_files, item->string)->util = si;
+		}
+	}
+	string_list_clear(&paths, 0);
+}
+
+void merge_display_update_messages(struct merge_options *opt,
+				   struct merge_result *result)
+{
+	struct merge_options_internal *mi = result->priv;
+
+	fputs(mi->output.buf, stdout);
+}
+
+void merge_switch_to_result(struct merge_options *opt,
+			    struct tree *head,
+			    struct merge_result *result,
+			    int update_worktree_and_index,
+			    int display_update_msgs)
+{
+	struct merge_options_internal *mi = result->priv;
+
+	if (result->clean >= 0 && update_worktree_and_index) {
+		if (checkout(opt, head, result->tree) ||
+		    record_conflicted_index_entries(mi, opt->repo->index))
+			result->clean = -1;
+	}
+
+	if (display_update_msgs && mi)
+		strbuf_addbuf(&opt->obuf, &mi->output);
+
+	merge_finalize(opt, result);
+}
+
+int merge_ort_nonrecursive(struct merge_options *opt,
+			   struct tree *head,
+			   struct tree *merge,
+			   struct tree *common)
+{
+	struct merge_result result;
+	struct strbuf sb = STRBUF_INIT;
+
+	if (repo_index_has_changes(opt->repo, head, &sb)) {
+		err(opt, _("Your local changes to the following files would be overwritten by merge:\n  %s"),
+		    sb.buf);
+		strbuf_release(&sb);
+		return -1;
+	}
+
+	if (oideq(&common->object.oid, &merge->object.oid)) {
+		if (show(opt, 0)) {
+			strbuf_addstr(&opt->obuf, _("Already up to date!"));
+			strbuf_addch(&opt->obuf, '\n');
+			if (!opt->buffer_output)
+				flush_output(opt);
+		}
+		return 1;
+	}
+
+	if (!opt->ancestor)
+		opt->ancestor = "constructed merge base";
+	merge_incore_nonrecursive(opt, common, head, merge, &result);
+	merge_switch_to_result(opt, head, &result, 1, 1);
+	if (!opt->buffer_output)
+		flush_output(opt);
+	return result.clean;
+}
+
+int merge_ort_recursive(struct merge_options *opt,
+			struct commit *h1,
+			struct commit *h2,
+			struct commit_list *ancestors,
+			struct commit **result)
+{
+	struct merge_result tmp;
+	struct tree *head = get_commit_tree(h1);
+	struct strbuf sb = STRBUF_INIT;
+
+	if (repo_index_has_changes(opt->repo, head, &sb)) {
+		err(opt, _("Your local changes to the following files would be overwritten by merge:\n  %s"),
+		    sb.buf);
+		strbuf_release(&sb);
+		return -1;
+	}
+
+	merge_incore_recursive(opt, ancestors, h1, h2, &tmp);
+	if (result && tmp.clean >= 0) {
+		*result = make_virtual_commit(opt->repo, tmp.tree, "merged tree");
+		commit_list_insert(h1, &(*result)->parents);
+		commit_list_insert(h2, &(*result)->parents->next);
+	}
+	merge_switch_to_result(opt, head, &tmp, 1, 1);
+
+	flush_output(opt);
+	if (opt->buffer_output < 2)
+		strbuf_release(&opt->obuf);
+	if (show(opt, 2))
+		diff_warn_rename_limit("merge.renamelimit",
+				       opt->needed_rename_limit, 0);
+	return tmp.clean;
+}
@@ -0,0 +1,117 @@
+#ifndef MERGE_ORT_H
+#define MERGE_ORT_H
+
+#include "merge-recursive.h"
+
+struct commit;
+struct commit_list;
+struct string_list;
+struct tree;
+
+struct merge_result {
+	/*
+	 * Whether the merge is clean; possible values:
+	 *    1: clean
+	 *    0: not clean (merge conflicts)
+	 *   <0: operation aborted prematurely.  (object database
+	 *       unreadable, disk full, etc.)  Worktree may be left in an
+	 *       inconsistent state if operation failed near the end.
+	 */
+	int clean;
+
+	/*
+	 * Result of merge.  If !clean, represents what would go in worktree
+	 * (thus possibly including files containing conflict markers).
+	 */
+	struct tree *tree;
+
+	/*
+	 * Additional metadata used by merge_switch_to_result() or future calls
+	 * to merge_incore_*().  Not for external use.
+	 */
+	void *priv;
+};
+
+/*
+ * The "ort" merge backend computes the whole merge result as trees in the
+ * object database, without touching the index or the working tree, and
+ * only afterwards updates both in one go via merge_switch_to_result().
+ * The merge_options are shared with merge-recursive; rename detection
+ * honours the same settings, but directory renames and renormalization
+ * are not supported.
+ */
+
+/*
+ * rename-detecting three-way merge with recursive ancestor consolidation.
+ * working tree and index are untouched.
+ */
+void merge_incore_recursive(struct merge_options *opt,
+			    struct commit_list *merge_bases,
+			    struct commit *side1,
+			    struct commit *side2,
+			    struct merge_result *result);
+
+/*
+ * rename-detecting three-way merge, no recursion.
+ * working tree and index are untouched.
+ */
+void merge_incore_nonrecursive(struct merge_options *opt,
+			       struct tree *merge_base,
+			       struct tree *side1,
+			       struct tree *side2,
+			       struct merge_result *result);
+
+/*
+ * Update the working tree and index from head to the result of a merge,
+ * recording conflicted paths as unmerged index entries, and optionally
+ * show the messages collected during the merge.  The caller is expected
+ * to hold the index lock and to write the index out afterwards.
+ *
+ * Frees the internal state of the merge, like merge_finalize().
+ */
+void merge_switch_to_result(struct merge_options *opt,
+			    struct tree *head,
+			    struct merge_result *result,
+			    int update_worktree_and_index,
+			    int display_update_msgs);
+
+struct stage_info {
+	struct object_id oid;
+	int mode;
+	int stage;
+};
+
+/*
+ * Append one item per stage of each conflicted path of the merge to
+ * "conflicted_files", sorted by path and stage, with "util" pointing
+ * to a newly allocated "struct stage_info".  The strings are only
+ * valid until the merge is finalized, unless the list duplicates them.
+ */
+void merge_get_conflicted_files(struct merge_result *result,
+				struct string_list *conflicted_files);
+
+/* Show the messages collected during the merge on the standard output. */
+void merge_display_update_messages(struct merge_options *opt,
+				   struct merge_result *result);
+
+/* Do needed cleanup when not calling merge_switch_to_result() */
+void merge_finalize(struct merge_options *opt,
+		    struct merge_result *result);
+
+/*
+ * Drop-in equivalents of merge_trees() and merge_recursive() built on top
+ * of the functions above.  Return 1 for a clean merge, 0 if there were
+ * conflicts and a negative value on error.
+ */
+int merge_ort_nonrecursive(struct merge_options *opt,
+			   struct tree *head,
+			   struct tree *merge,
+			   struct tree *common);
+
+int merge_ort_recursive(struct merge_options *opt,
+			struct commit *h1,
+			struct commit *h2,
+			struct commit_list *ancestors,
+			struct commit **result);
+
+#endif
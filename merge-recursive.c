@@ -1858,15 +1858,371 @@ static int handle_rename_rename_2to1(struct merge_options *opt,
 				     &mfi_c1.blob, &mfi_c2.blob);
 }
 
+struct cached_rename {
+	struct object_id src_oid;
+	struct object_id dst_oid;	/* unused if not renamed */
+	int score;
+	char dst[FLEX_ARRAY];		/* empty if not renamed */
+};
+
+void init_rename_cache(struct rename_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+	strmap_init(&cache->sources);
+	strmap_init(&cache->unmatched);
+}
+
+void clear_rename_cache(struct rename_cache *cache)
+{
+	strmap_clear(&cache->sources, 1);
+	strmap_clear(&cache->unmatched, 1);
+	init_rename_cache(cache);
+}
+
+static void start_rename_cache(struct rename_cache *cache,
+			       struct tree *head,
+			       struct tree *common)
+{
+	if (!cache->valid ||
+	    !oideq(&common->object.oid, &cache->merge) ||
+	    !oideq(&head->object.oid, &cache->result)) {
+		clear_rename_cache(cache);
+		return;
+	}
+	cache->valid = 0;
+	cache->current = 1;
+}
+
+static void finish_rename_cache(struct merge_options *opt,
+				struct tree *merge)
+{
+	struct rename_cache *cache = opt->rename_cache;
+	struct tree *result;
+
+	if (!cache->current || !(result = write_tree_from_memory(opt)))
+		return;
+	oidcpy(&cache->merge, &merge->object.oid);
+	oidcpy(&cache->result, &result->object.oid);
+	cache->valid = 1;
+}
+
+/*
+ * Turn the deletion/addition pairs in diff_queued_diff that the cache
+ * knows to be renames into rename pairs, so that diffcore_rename() does
+ * not have to score them again.  If all remaining additions were
+ * already present last time with the same content, the deletions that
+ * did not match any of them then and did not change will not match now
+ * either; they are moved to "held_back" to keep them out of rename
+ * detection altogether.  Only pairs whose source and destination blobs
+ * are still the same are reused, so the result does not differ from a
+ * fresh run.
+ */
+static void use_cached_renames(struct rename_cache *cache,
+			       struct diff_queue_struct *held_back)
+{
+	struct diff_queue_struct *q = &diff_queued_diff;
+	struct diff_queue_struct outq;
+	struct strmap deleted, added, renamed;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	int i, hold_unmatched = 1;
+
+	if (strmap_empty(&cache->sources))
+		return;
+
+	strmap_init_with_options(&deleted, NULL, 0);
+	strmap_init_with_options(&added, NULL, 0);
+	strmap_init_with_options(&renamed, NULL, 0);
+	for (i = 0; i < q->nr; i++) {
+		struct diff_filepair *p = q->queue[i];
+
+		if (!DIFF_FILE_VALID(p->one) && DIFF_FILE_VALID(p->two))
+			strmap_put(&added, p->two->path, p);
+		else if (DIFF_FILE_VALID(p->one) && !DIFF_FILE_VALID(p->two))
+			strmap_put(&deleted, p->one->path, p);
+	}
+
+	strmap_for_each_entry(&cache->sources, &iter, e) {
+		struct cached_rename *re = e->value;
+		struct diff_filepair *src, *dst, *p;
+
+		if (!*re->dst)
+			continue;
+		src = strmap_get(&deleted, e->key);
+		dst = strmap_get(&added, re->dst);
+		if (!src || !dst ||
+		    !oideq(&src->one->oid, &re->src_oid) ||
+		    !oideq(&dst->two->oid, &re->dst_oid) ||
+		    (src->one->mode & S_IFMT) != (dst->two->mode & S_IFMT))
+			continue;
+
+		p = diff_queue(NULL, src->one, dst->two);
+		p->renamed_pair = 1;
+		p->score = re->score;
+		src->one->rename_used++;
+		strmap_put(&renamed, e->key, p);
+		strmap_remove(&added, re->dst, 0);
+	}
+
+	strmap_for_each_entry(&added, &iter, e) {
+		struct diff_filepair *p = e->value;
+		struct object_id *oid = strmap_get(&cache->unmatched, e->key);
+
+		if (!oid || !oideq(oid, &p->two->oid)) {
+			hold_unmatched = 0;
+			break;
+		}
+	}
+
+	DIFF_QUEUE_CLEAR(&outq);
+	for (i = 0; i < q->nr; i++) {
+		struct diff_filepair *p = q->queue[i];
+
+		if (!DIFF_FILE_VALID(p->one) && DIFF_FILE_VALID(p->two)) {
+			if (strmap_get(&added, p->two->path) != p) {
+				/* now the destination of a rename pair */
+				free_filespec(p->one);
+				free(p);
+				continue;
+			}
+		} else if (DIFF_FILE_VALID(p->one) && !DIFF_FILE_VALID(p->two)) {
+			struct diff_filepair *re = strmap_get(&renamed, p->one->path);
+
+			if (re) {
+				diff_q(&outq, re);
+				free_filespec(p->two);
+				free(p);
+				continue;
+			}
+			if (hold_unmatched) {
+				struct cached_rename *unmatched =
+					strmap_get(&cache->sources, p->one->path);
+
+				if (unmatched && !*unmatched->dst &&
+				    oideq(&unmatched->src_oid, &p->one->oid)) {
+					diff_q(held_back, p);
+					continue;
+				}
+			}
+		}
+		diff_q(&outq, p);
+	}
+	free(q->queue);
+	*q = outq;
+
+	strmap_clear(&deleted, 0);
+	strmap_clear(&added, 0);
+	strmap_clear(&renamed, 0);
+}
+
+static void update_rename_cache(struct rename_cache *cache, int complete,
+				struct strmap *relevant_sources)
+{
+	struct diff_queue_struct *q = &diff_queued_diff;
+	int i;
+
+	clear_rename_cache(cache);
+	for (i = 0; i < q->nr; i++) {
+		struct diff_filepair *p = q->queue[i];
+		struct cached_rename *re;
+
+		switch (p->status) {
+		case DIFF_STATUS_RENAMED:
+			FLEX_ALLOC_STR(re, dst, p->two->path);
+			oidcpy(&re->src_oid, &p->one->oid);
+			oidcpy(&re->dst_oid, &p->two->oid);
+			re->score = p->score;
+			strmap_put(&cache->sources, p->one->path, re);
+			break;
+		case DIFF_STATUS_DELETED:
+			/*
+			 * Only if it really was compared against all
+			 * additions, which does not happen if rename
+			 * detection gave up early or skipped it.
+			 */
+			if (complete &&
+			    (!relevant_sources ||
+			     strmap_contains(relevant_sources, p->one->path))) {
+				FLEX_ALLOC_STR(re, dst, "");
+				oidcpy(&re->src_oid, &p->one->oid);
+				strmap_put(&cache->sources, p->one->path, re);
+			}
+			break;
+		case DIFF_STATUS_ADDED:
+			strmap_put(&cache->unmatched, p->two->path,
+				   oiddup(&p->two->oid));
+			break;
+		}
+	}
+	cache->current = 1;
+}
+
+struct changed_paths {
+	struct strmap added;	/* possible rename destinations */
+	struct strmap deleted;	/* possible rename sources */
+	struct strmap touched;	/* modified or deleted */
+	struct strmap dirs;	/* leading directories of added paths */
+};
+
+static void add_leading_dirs(struct strmap *dirs, const char *path)
+{
+	struct strbuf dir = STRBUF_INIT;
+	const char *slash;
+
+	strbuf_addstr(&dir, path);
+	while ((slash = strrchr(dir.buf, '/'))) {
+		strbuf_setlen(&dir, slash - dir.buf);
+		if (strmap_contains(dirs, dir.buf))
+			break;
+		strmap_put(dirs, dir.buf, NULL);
+	}
+	strbuf_release(&dir);
+}
+
+static int has_leading_dir_in(struct strmap *map, const char *path)
+{
+	struct strbuf dir = STRBUF_INIT;
+	const char *slash;
+	int found = 0;
+
+	strbuf_addstr(&dir, path);
+	while (!found && (slash = strrchr(dir.buf, '/'))) {
+		strbuf_setlen(&dir, slash - dir.buf);
+		found = strmap_contains(map, dir.buf);
+	}
+	strbuf_release(&dir);
+	return found;
+}
+
+static void get_changed_paths(struct merge_options *opt,
+			      struct tree *o_tree,
+			      struct tree *tree,
+			      struct changed_paths *changes)
+{
+	struct diff_options opts;
+	int i;
+
+	strmap_init(&changes->added);
+	strmap_init(&changes->deleted);
+	strmap_init(&changes->touched);
+	strmap_init(&changes->dirs);
+
+	repo_diff_setup(opt->repo, &opts);
+	opts.flags.recursive = 1;
+	opts.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&opts);
+	diff_tree_oid(&o_tree->object.oid, &tree->object.oid, "", &opts);
+	for (i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filepair *p = diff_queued_diff.queue[i];
+
+		if (!DIFF_FILE_VALID(p->one)) {
+			strmap_put(&changes->added, p->two->path, NULL);
+			add_leading_dirs(&changes->dirs, p->two->path);
+			continue;
+		}
+		strmap_put(&changes->touched, p->one->path, NULL);
+		if (!DIFF_FILE_VALID(p->two))
+			strmap_put(&changes->deleted, p->one->path, NULL);
+	}
+	diff_flush(&opts);
+}
+
+static void free_changed_paths(struct changed_paths *changes)
+{
+	strmap_clear(&changes->added, 0);
+	strmap_clear(&changes->deleted, 0);
+	strmap_clear(&changes->touched, 0);
+	strmap_clear(&changes->dirs, 0);
+}
+
+/*
+ * Whether a path added on one side could run into something added on
+ * the other side, as in rename/add, rename/rename(2to1) and
+ * file/directory conflicts.
+ */
+static int may_collide(struct changed_paths *side,
+		       struct changed_paths *other)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&side->added, &iter, e)
+		if (strmap_contains(&other->added, e->key) ||
+		    strmap_contains(&other->dirs, e->key) ||
+		    has_leading_dir_in(&other->added, e->key))
+			return 1;
+	return 0;
+}
+
+static void find_relevant_sources(struct changed_paths *side,
+				  struct changed_paths *other,
+				  int dir_renames,
+				  struct strmap *relevant)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&side->deleted, &iter, e)
+		if (strmap_contains(&other->touched, e->key) ||
+		    (dir_renames && has_leading_dir_in(&other->dirs, e->key)))
+			strmap_put(relevant, e->key, NULL);
+}
+
+/*
+ * A path deleted on one side only needs to be paired up with its new
+ * name if the other side changed (or deleted) it, or if the other side
+ * added files to a directory that it might have been moved out of.
+ * Otherwise taking the deletion and the addition as they are gives the
+ * same result as handling a rename would, so there is no need to
+ * compare it against every added path.
+ *
+ * Fill "relevant_head" and "relevant_merge" with the paths that do
+ * need it, and return 1; or return 0 if all of them have to be
+ * considered, as some rename on one side might end up conflicting with
+ * a path added on the other.
+ */
+static int get_relevant_sources(struct merge_options *opt,
+				struct tree *common,
+				struct tree *head,
+				struct tree *merge,
+				int dir_renames,
+				struct strmap *relevant_head,
+				struct strmap *relevant_merge)
+{
+	struct changed_paths head_changes, merge_changes;
+	int ret = 0;
+
+	get_changed_paths(opt, common, head, &head_changes);
+	get_changed_paths(opt, common, merge, &merge_changes);
+
+	if (may_collide(&head_changes, &merge_changes) ||
+	    may_collide(&merge_changes, &head_changes))
+		goto out;
+
+	find_relevant_sources(&head_changes, &merge_changes, dir_renames,
+			      relevant_head);
+	find_relevant_sources(&merge_changes, &head_changes, dir_renames,
+			      relevant_merge);
+	ret = 1;
+out:
+	free_changed_paths(&head_changes);
+	free_changed_paths(&merge_changes);
+	return ret;
+}
+
 /*
  * Get the diff_filepairs changed between o_tree and tree.
  */
 static struct diff_queue_struct *get_diffpairs(struct merge_options *opt,
 					       struct tree *o_tree,
-					       struct tree *tree)
+					       struct tree *tree,
+					       struct rename_cache *cache,
+					       struct strmap *relevant_sources)
 {
 	struct diff_queue_struct *ret;
+	struct diff_queue_struct held_back;
 	struct diff_options opts;
+	int i;
 
 	repo_diff_setup(opt->repo, &opts);
 	opts.flags.recursive = 1;
@@ -1885,12 +2241,24 @@ static struct diff_queue_struct *get_diffpairs(struct merge_options *opt,
 			    1000;
 	opts.rename_score = opt->rename_score;
 	opts.show_rename_progress = opt->show_rename_progress;
+	opts.relevant_sources = relevant_sources;
 	opts.output_format = DIFF_FORMAT_NO_OUTPUT;
 	diff_setup_done(&opts);
 	diff_tree_oid(&o_tree->object.oid, &tree->object.oid, "", &opts);
+	DIFF_QUEUE_CLEAR(&held_back);
+	if (cache)
+		use_cached_renames(cache, &held_back);
 	diffcore_std(&opts);
 	if (opts.needed_rename_limit > opt->needed_rename_limit)
 		opt->needed_rename_limit = opts.needed_rename_limit;
+	for (i = 0; i < held_back.nr; i++) {
+		held_back.queue[i]->status = DIFF_STATUS_DELETED;
+		diff_q(&diff_queued_diff, held_back.queue[i]);
+	}
+	free(held_back.queue);
+	if (cache)
+		update_rename_cache(cache, !opts.needed_rename_limit,
+				    relevant_sources);
 
 	ret = xmalloc(sizeof(*ret));
 	*ret = diff_queued_diff;
@@ -2852,7 +3220,8 @@ static int detect_and_process_renames(struct merge_options *opt,
 {
 	struct diff_queue_struct *head_pairs, *merge_pairs;
 	struct hashmap *dir_re_head, *dir_re_merge;
-	int clean = 1;
+	struct strmap relevant_head, relevant_merge;
+	int dir_renames, use_relevant, clean = 1;
 
 	ri->head_renames = NULL;
 	ri->merge_renames = NULL;
@@ -2860,11 +3229,23 @@ static int detect_and_process_renames(struct merge_options *opt,
 	if (!merge_detect_rename(opt))
 		return 1;
 
-	head_pairs = get_diffpairs(opt, common, head);
-	merge_pairs = get_diffpairs(opt, common, merge);
-
-	if ((opt->detect_directory_renames == 2) ||
-	    (opt->detect_directory_renames == 1 && !opt->call_depth)) {
+	dir_renames = (opt->detect_directory_renames == 2) ||
+		      (opt->detect_directory_renames == 1 && !opt->call_depth);
+
+	strmap_init(&relevant_head);
+	strmap_init(&relevant_merge);
+	use_relevant = get_relevant_sources(opt, common, head, merge,
+					    dir_renames,
+					    &relevant_head, &relevant_merge);
+	head_pairs = get_diffpairs(opt, common, head,
+				   opt->call_depth ? NULL : opt->rename_cache,
+				   use_relevant ? &relevant_head : NULL);
+	merge_pairs = get_diffpairs(opt, common, merge, NULL,
+				    use_relevant ? &relevant_merge : NULL);
+	strmap_clear(&relevant_head, 0);
+	strmap_clear(&relevant_merge, 0);
+
+	if (dir_renames) {
 		dir_re_head = get_directory_renames(head_pairs);
 		dir_re_merge = get_directory_renames(merge_pairs);
 
@@ -3401,6 +3782,9 @@ int merge_trees(struct merge_options *opt,
 		common = shift_tree_object(opt->repo, head, common, opt->subtree_shift);
 	}
 
+	if (opt->rename_cache && !opt->call_depth)
+		start_rename_cache(opt->rename_cache, head, common);
+
 	if (oid_eq(&common->object.oid, &merge->object.oid)) {
 		output(opt, 0, _("Already up to date!"));
 		*result = head;
@@ -3480,6 +3864,9 @@ int merge_trees(struct merge_options *opt,
 	if (opt->call_depth && !(*result = write_tree_from_memory(opt)))
 		return -1;
 
+	if (opt->rename_cache && !opt->call_depth && clean > 0)
+		finish_rename_cache(opt, merge);
+
 	return clean;
 }
 
@@ -2,6 +2,7 @@
 #define MERGE_RECURSIVE_H
 
 #include "string-list.h"
+#include "strmap.h"
 #include "unpack-trees.h"
 
 struct commit;
@@ -31,6 +32,7 @@ struct merge_options {
 	int needed_rename_limit;
 	int show_rename_progress;
 	int call_depth;
+	struct rename_cache *rename_cache;
 	struct strbuf obuf;
 	struct hashmap current_file_dir_set;
 	struct string_list df_conflict_file_set;
@@ -39,6 +41,42 @@ struct merge_options {
 	struct repository *repo;
 };
 
+/*
+ * When cherry-picking or rebasing a series of commits, every pick is a
+ * merge between the same "upstream" side and a new commit, so the
+ * renames between the merge base and "head" are the same for each pick.
+ * A rename_cache handed to merge_trees() via merge_options remembers
+ * them, so that only the renames on the side being picked have to be
+ * found again.
+ *
+ * The cached renames are only reused if the next merge is the next pick
+ * of the series, i.e. its merge base is the tree that was merged in and
+ * its head is the result of the previous merge; otherwise the cache is
+ * emptied.
+ */
+struct rename_cache {
+	/* The tree merged in by the previous merge, and its clean result */
+	struct object_id merge;
+	struct object_id result;
+	unsigned valid : 1;
+	/* The renames below are those of the merge in progress */
+	unsigned current : 1;
+
+	/*
+	 * Deleted paths between the merge base and head, mapped to their
+	 * blob and the rename found for them, if any.
+	 */
+	struct strmap sources;
+	/*
+	 * Added paths that did not turn out to be rename destinations,
+	 * mapped to their blob.
+	 */
+	struct strmap unmatched;
+};
+
+void init_rename_cache(struct rename_cache *cache);
+void clear_rename_cache(struct rename_cache *cache);
+
 /*
  * For dir_rename_entry, directory names are stored as a full path from the
  * toplevel of the repository and do not include a trailing '/'.  Also:
@@ -10,6 +10,11 @@
 #include "progress.h"
 #include "trace2.h"
 #include "run-command.h"
+#include "commit.h"
+#include "revision.h"
+#include "list-objects.h"
+#include "pack-objects.h"
+#include "pack-bitmap.h"
 
 #define MIDX_SIGNATURE 0x4d494458 /* "MIDX" */
 #define MIDX_VERSION 1
@@ -22,17 +27,19 @@
 #define MIDX_HASH_LEN 20
 #define MIDX_MIN_SIZE (MIDX_HEADER_SIZE + MIDX_HASH_LEN)
 
-#define MIDX_MAX_CHUNKS 5
+#define MIDX_MAX_CHUNKS 6
 #define MIDX_CHUNK_ALIGNMENT 4
 #define MIDX_CHUNKID_PACKNAMES 0x504e414d /* "PNAM" */
 #define MIDX_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
 #define MIDX_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
 #define MIDX_CHUNKID_OBJECTOFFSETS 0x4f4f4646 /* "OOFF" */
 #define MIDX_CHUNKID_LARGEOFFSETS 0x4c4f4646 /* "LOFF" */
+#define MIDX_CHUNKID_REVINDEX 0x52494458 /* "RIDX" */
 #define MIDX_CHUNKLOOKUP_WIDTH (sizeof(uint32_t) + sizeof(uint64_t))
 #define MIDX_CHUNK_FANOUT_SIZE (sizeof(uint32_t) * 256)
 #define MIDX_CHUNK_OFFSET_WIDTH (2 * sizeof(uint32_t))
 #define MIDX_CHUNK_LARGE_OFFSET_WIDTH (sizeof(uint64_t))
+#define MIDX_CHUNK_REVINDEX_WIDTH (sizeof(uint32_t))
 #define MIDX_LARGE_OFFSET_NEEDED 0x80000000
 
 #define PACK_EXPIRED UINT_MAX
@@ -129,6 +136,10 @@ struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local
 				m->chunk_large_offsets = m->data + chunk_offset;
 				break;
 
+			case MIDX_CHUNKID_REVINDEX:
+				m->chunk_revindex = m->data + chunk_offset;
+				break;
+
 			case 0:
 				die(_("terminating multi-pack-index chunk id appears earlier than expected"));
 				break;
@@ -248,7 +259,7 @@ struct object_id *nth_midxed_object_oid(struct object_id *oid,
 	return oid;
 }
 
-static off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
+off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 {
 	const unsigned char *offset_data;
 	uint32_t offset32;
@@ -267,11 +278,92 @@ static off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 	return offset32;
 }
 
-static uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos)
+uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos)
 {
 	return get_be32(m->chunk_object_offsets + pos * MIDX_CHUNK_OFFSET_WIDTH);
 }
 
+const unsigned char *get_midx_checksum(struct multi_pack_index *m)
+{
+	return m->data + m->data_len - m->hash_len;
+}
+
+char *get_midx_bitmap_filename(struct multi_pack_index *m)
+{
+	return xstrfmt("%s/pack/multi-pack-index-%s.bitmap", m->object_dir,
+		       hash_to_hex(get_midx_checksum(m)));
+}
+
+uint32_t pack_pos_to_midx(struct multi_pack_index *m, uint32_t pos)
+{
+	if (!m->chunk_revindex)
+		BUG("multi-pack-index has no reverse index");
+	if (pos >= m->num_objects)
+		BUG("pseudo-pack position out of range: %"PRIu32" (%"PRIu32" objects)",
+		    pos, m->num_objects);
+
+	return get_be32(m->chunk_revindex + pos * MIDX_CHUNK_REVINDEX_WIDTH);
+}
+
+int midx_preferred_pack(struct multi_pack_index *m, uint32_t *pack_int_id)
+{
+	if (!m->chunk_revindex || !m->num_objects)
+		return -1;
+
+	/* the preferred pack always comes first */
+	*pack_int_id = nth_midxed_pack_int_id(m, pack_pos_to_midx(m, 0));
+	return 0;
+}
+
+static int midx_pack_order_cmp(uint32_t preferred,
+			       uint32_t pack_a, off_t offset_a,
+			       uint32_t pack_b, off_t offset_b)
+{
+	if (pack_a != pack_b) {
+		if (pack_a == preferred)
+			return -1;
+		if (pack_b == preferred)
+			return 1;
+		return pack_a < pack_b ? -1 : 1;
+	}
+
+	if (offset_a != offset_b)
+		return offset_a < offset_b ? -1 : 1;
+	return 0;
+}
+
+int midx_to_pack_pos(struct multi_pack_index *m, uint32_t at, uint32_t *pos)
+{
+	uint32_t preferred, want_pack, lo = 0, hi;
+	off_t want_offset;
+
+	if (at >= m->num_objects || midx_preferred_pack(m, &preferred) < 0)
+		return -1;
+
+	want_pack = nth_midxed_pack_int_id(m, at);
+	want_offset = nth_midxed_offset(m, at);
+
+	hi = m->num_objects;
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		uint32_t n = pack_pos_to_midx(m, mi);
+		int cmp = midx_pack_order_cmp(preferred, want_pack, want_offset,
+					      nth_midxed_pack_int_id(m, n),
+					      nth_midxed_offset(m, n));
+
+		if (!cmp) {
+			*pos = mi;
+			return 0;
+		}
+		if (cmp > 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+
+	return -1;
+}
+
 static int nth_midxed_pack_entry(struct repository *r,
 				 struct multi_pack_index *m,
 				 struct pack_entry *e,
@@ -492,6 +584,7 @@ struct pack_midx_entry {
 	uint32_t pack_int_id;
 	time_t pack_mtime;
 	uint64_t offset;
+	unsigned preferred : 1;
 };
 
 static int midx_oid_compare(const void *_a, const void *_b)
@@ -503,6 +596,12 @@ static int midx_oid_compare(const void *_a, const void *_b)
 	if (cmp)
 		return cmp;
 
+	/* the preferred pack wins every tie, so that it keeps all its objects */
+	if (a->preferred > b->preferred)
+		return -1;
+	else if (a->preferred < b->preferred)
+		return 1;
+
 	if (a->pack_mtime > b->pack_mtime)
 		return -1;
 	else if (a->pack_mtime < b->pack_mtime)
@@ -524,6 +623,7 @@ static int nth_midxed_pack_midx_entry(struct multi_pack_index *m,
 
 	/* consider objects in midx to be from "old" packs */
 	e->pack_mtime = 0;
+	e->preferred = 0;
 	return 0;
 }
 
@@ -537,6 +637,7 @@ static void fill_pack_entry(uint32_t pack_int_id,
 
 	entry->pack_int_id = pack_int_id;
 	entry->pack_mtime = p->mtime;
+	entry->preferred = 0;
 
 	entry->offset = nth_packed_object_offset(p, cur_object);
 }
@@ -550,12 +651,14 @@ static void fill_pack_entry(uint32_t pack_int_id,
  * tables to group the data, copy to a local array, then sort.
  *
  * Copy only the de-duplicated entries (selected by most-recent modified time
- * of a packfile containing the object).
+ * of a packfile containing the object, unless the preferred pack contains
+ * it).
  */
 static struct pack_midx_entry *get_sorted_entries(struct multi_pack_index *m,
 						  struct pack_info *info,
 						  uint32_t nr_packs,
-						  uint32_t *nr_objects)
+						  uint32_t *nr_objects,
+						  int preferred_pack)
 {
 	uint32_t cur_fanout, cur_pack, cur_object;
 	uint32_t alloc_fanout, alloc_objects, total_objects = 0;
@@ -606,6 +709,8 @@ static struct pack_midx_entry *get_sorted_entries(struct multi_pack_index *m,
 			for (cur_object = start; cur_object < end; cur_object++) {
 				ALLOC_GROW(entries_by_fanout, nr_fanout + 1, alloc_fanout);
 				fill_pack_entry(cur_pack, info[cur_pack].p, cur_object, &entries_by_fanout[nr_fanout]);
+				if (cur_pack == preferred_pack)
+					entries_by_fanout[nr_fanout].preferred = 1;
 				nr_fanout++;
 			}
 		}
@@ -785,8 +890,262 @@ static size_t write_midx_large_offsets(struct hashfile *f, uint32_t nr_large_off
 	return written;
 }
 
+struct midx_pack_order_entry {
+	uint32_t nr;
+	uint32_t pack;
+	uint64_t offset;
+};
+
+static int midx_pack_order_entry_cmp(const void *_a, const void *_b)
+{
+	const struct midx_pack_order_entry *a = _a, *b = _b;
+
+	if (a->pack != b->pack)
+		return a->pack < b->pack ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Write the positions of the objects in the pseudo-pack order, i.e.
+ * sorted by (preferred pack first, pack-int-id, offset).
+ */
+static size_t write_midx_revindex(struct hashfile *f, uint32_t *perm,
+				  uint32_t preferred,
+				  struct pack_midx_entry *objects, uint32_t nr_objects)
+{
+	struct midx_pack_order_entry *order;
+	uint32_t i;
+
+	ALLOC_ARRAY(order, nr_objects);
+	for (i = 0; i < nr_objects; i++) {
+		uint32_t pack = perm[objects[i].pack_int_id];
+
+		order[i].nr = i;
+		order[i].pack = pack == preferred ? 0 : pack + 1;
+		order[i].offset = objects[i].offset;
+	}
+	QSORT(order, nr_objects, midx_pack_order_entry_cmp);
+
+	for (i = 0; i < nr_objects; i++)
+		hashwrite_be32(f, order[i].nr);
+
+	free(order);
+	return nr_objects * MIDX_CHUNK_REVINDEX_WIDTH;
+}
+
+/*
+ * The multi-pack-index can only prefer packs whose objects it reads from
+ * the packs themselves, so open those that the existing one refers to.
+ */
+static int open_midx_packs(const char *object_dir, struct pack_list *packs)
+{
+	struct strbuf path = STRBUF_INIT;
+	uint32_t i;
+	int ret = 0;
+
+	for (i = 0; i < packs->nr; i++) {
+		struct pack_info *info = &packs->info[i];
+
+		if (info->p)
+			continue;
+
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/pack/%s", object_dir, info->pack_name);
+		info->p = add_packed_git(path.buf, path.len, 0);
+		if (!info->p) {
+			ret = error(_("failed to add packfile '%s'"), path.buf);
+			break;
+		}
+		if (open_pack_index(info->p)) {
+			ret = error(_("failed to open pack-index '%s'"), path.buf);
+			break;
+		}
+	}
+
+	strbuf_release(&path);
+	return ret;
+}
+
+static int find_preferred_pack(struct pack_list *packs, const char *name)
+{
+	uint32_t i;
+	int preferred = -1;
+
+	for (i = 0; i < packs->nr; i++) {
+		if (name) {
+			if (!cmp_idx_or_pack_name(name, packs->info[i].pack_name))
+				return i;
+		} else if (preferred < 0 ||
+			   packs->info[i].p->num_objects >
+			   packs->info[preferred].p->num_objects) {
+			preferred = i;
+		}
+	}
+
+	return preferred;
+}
+
+struct midx_bitmap_walk {
+	struct packing_data *pdata;
+	struct commit **commits;
+	uint32_t commits_nr, commits_alloc;
+	int missing;
+};
+
+static struct object_entry *midx_bitmap_entry(struct midx_bitmap_walk *walk,
+					      struct object *obj)
+{
+	struct object_entry *entry = packlist_find(walk->pdata, &obj->oid, NULL);
+
+	if (!entry) {
+		if (!walk->missing++)
+			error(_("object %s is reachable, but not in the multi-pack-index"),
+			      oid_to_hex(&obj->oid));
+		return NULL;
+	}
+
+	oe_set_type(entry, obj->type);
+	return entry;
+}
+
+static void midx_bitmap_show_commit(struct commit *commit, void *data)
+{
+	struct midx_bitmap_walk *walk = data;
+
+	if (!midx_bitmap_entry(walk, &commit->object))
+		return;
+
+	ALLOC_GROW(walk->commits, walk->commits_nr + 1, walk->commits_alloc);
+	walk->commits[walk->commits_nr++] = commit;
+}
+
+static void midx_bitmap_show_object(struct object *obj, const char *name,
+				    void *data)
+{
+	struct object_entry *entry = midx_bitmap_entry(data, obj);
+
+	if (entry)
+		entry->hash = pack_name_hash(name);
+}
+
+/*
+ * Write a reachability bitmap for all refs over the objects of the
+ * multi-pack-index in "object_dir", which must have a reverse index.
+ */
+static int write_midx_bitmap(const char *object_dir)
+{
+	struct multi_pack_index *m = load_multi_pack_index(object_dir, 1);
+	struct packing_data pdata;
+	struct midx_bitmap_walk walk = { &pdata };
+	struct pack_idx_entry **index = NULL;
+	struct rev_info revs;
+	const char *argv[] = { NULL, "--all", NULL };
+	unsigned char checksum[GIT_MAX_RAWSZ];
+	char *bitmap_name = NULL;
+	int hash_cache = 1, ret = 0;
+	uint32_t i;
+
+	memset(&pdata, 0, sizeof(pdata));
+	if (!m || !m->chunk_revindex) {
+		ret = error(_("cannot write a bitmap without a multi-pack reverse index"));
+		goto cleanup;
+	}
+
+	prepare_packing_data(the_repository, &pdata);
+	for (i = 0; i < m->num_objects; i++) {
+		struct object_id oid;
+		uint32_t index_pos;
+
+		nth_midxed_object_oid(&oid, m, i);
+		packlist_find(&pdata, &oid, &index_pos);
+		packlist_alloc(&pdata, oid.hash, index_pos);
+	}
+
+	repo_init_revisions(the_repository, &revs, NULL);
+	setup_revisions(ARRAY_SIZE(argv) - 1, argv, &revs, NULL);
+	revs.tag_objects = 1;
+	revs.tree_objects = 1;
+	revs.blob_objects = 1;
+	if (prepare_revision_walk(&revs))
+		die(_("revision walk setup failed"));
+	traverse_commit_list(&revs, midx_bitmap_show_commit,
+			     midx_bitmap_show_object, &walk);
+	if (walk.missing) {
+		ret = -1;
+		goto cleanup;
+	}
+
+	/* the bits are in pseudo-pack order... */
+	ALLOC_ARRAY(index, pdata.nr_objects);
+	for (i = 0; i < pdata.nr_objects; i++)
+		index[i] = &pdata.objects[pack_pos_to_midx(m, i)].idx;
+
+	hashcpy(checksum, get_midx_checksum(m));
+	bitmap_writer_set_checksum(checksum);
+	bitmap_writer_build_type_index(&pdata, index, pdata.nr_objects);
+	bitmap_writer_select_commits(walk.commits, walk.commits_nr, -1);
+	bitmap_writer_build(&pdata);
+
+	/* ...but commits and name-hashes are stored in midx order */
+	for (i = 0; i < pdata.nr_objects; i++)
+		index[i] = &pdata.objects[i].idx;
+
+	git_config_get_bool("pack.writebitmaphashcache", &hash_cache);
+	bitmap_name = get_midx_bitmap_filename(m);
+	bitmap_writer_finish(index, pdata.nr_objects, bitmap_name,
+			     hash_cache ? BITMAP_OPT_HASH_CACHE : 0);
+
+cleanup:
+	free(pdata.objects);
+	free(pdata.index);
+	free(pdata.in_pack_pos);
+	free(pdata.in_pack);
+	free(pdata.in_pack_by_idx);
+	free(walk.commits);
+	free(index);
+	free(bitmap_name);
+	close_midx(m);
+	free(m);
+	return ret;
+}
+
+static void remove_midx_bitmap(const char *full_path, size_t full_path_len,
+			       const char *file_name, void *data)
+{
+	const char *keep = data;
+
+	if (!starts_with(file_name, "multi-pack-index-") ||
+	    !ends_with(file_name, ".bitmap"))
+		return;
+	if (keep && !strcmp(file_name, keep))
+		return;
+
+	if (unlink(full_path))
+		warning_errno(_("failed to remove %s"), full_path);
+}
+
+/*
+ * Remove the bitmaps of all multi-pack-indexes but the one whose
+ * checksum is "keep_hash" (or all of them, if it is NULL).
+ */
+static void clear_midx_bitmaps(const char *object_dir,
+			       const unsigned char *keep_hash)
+{
+	char *keep = NULL;
+
+	if (keep_hash)
+		keep = xstrfmt("multi-pack-index-%s.bitmap",
+			       hash_to_hex(keep_hash));
+	for_each_file_in_pack_dir(object_dir, remove_midx_bitmap, keep);
+	free(keep);
+}
+
 static int write_midx_internal(const char *object_dir, struct multi_pack_index *m,
-			       struct string_list *packs_to_drop)
+			       struct string_list *packs_to_drop,
+			       const char *preferred_pack_name,
+			       unsigned flags)
 {
 	unsigned char cur_chunk, num_chunks = 0;
 	char *midx_name;
@@ -803,6 +1162,8 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 	int large_offsets_needed = 0;
 	int pack_name_concat_len = 0;
 	int dropped_packs = 0;
+	int preferred_pack = -1;
+	unsigned char midx_hash[GIT_MAX_RAWSZ];
 	int result = 0;
 
 	midx_name = get_midx_filename(object_dir);
@@ -836,10 +1197,35 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 
 	for_each_file_in_pack_dir(object_dir, add_pack_to_midx, &packs);
 
-	if (packs.m && packs.nr == packs.m->num_packs && !packs_to_drop)
+	if (packs.m && packs.nr == packs.m->num_packs && !packs_to_drop &&
+	    !preferred_pack_name && !(flags & MIDX_WRITE_BITMAP))
 		goto cleanup;
 
-	entries = get_sorted_entries(packs.m, packs.info, packs.nr, &nr_entries);
+	if (preferred_pack_name || (flags & MIDX_WRITE_BITMAP)) {
+		if (open_midx_packs(object_dir, &packs)) {
+			result = 1;
+			goto cleanup;
+		}
+
+		preferred_pack = find_preferred_pack(&packs, preferred_pack_name);
+		if (preferred_pack_name && preferred_pack < 0) {
+			error(_("unknown preferred pack: '%s'"),
+			      preferred_pack_name);
+			result = 1;
+			goto cleanup;
+		}
+
+		/*
+		 * Read all objects from the packs, as the existing
+		 * multi-pack-index may have chosen other copies of the
+		 * objects of the preferred pack.
+		 */
+		entries = get_sorted_entries(NULL, packs.info, packs.nr,
+					     &nr_entries, preferred_pack);
+	} else {
+		entries = get_sorted_entries(packs.m, packs.info, packs.nr,
+					     &nr_entries, -1);
+	}
 
 	for (i = 0; i < nr_entries; i++) {
 		if (entries[i].offset > 0x7fffffff)
@@ -912,6 +1298,8 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 
 	cur_chunk = 0;
 	num_chunks = large_offsets_needed ? 5 : 4;
+	if (flags & MIDX_WRITE_BITMAP)
+		num_chunks++;
 
 	written = write_midx_header(f, num_chunks, packs.nr - dropped_packs);
 
@@ -940,6 +1328,14 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 					   num_large_offsets * MIDX_CHUNK_LARGE_OFFSET_WIDTH;
 	}
 
+	if (flags & MIDX_WRITE_BITMAP) {
+		chunk_ids[cur_chunk] = MIDX_CHUNKID_REVINDEX;
+
+		cur_chunk++;
+		chunk_offsets[cur_chunk] = chunk_offsets[cur_chunk - 1] +
+					   nr_entries * MIDX_CHUNK_REVINDEX_WIDTH;
+	}
+
 	chunk_ids[cur_chunk] = 0;
 
 	for (i = 0; i <= num_chunks; i++) {
@@ -987,6 +1383,13 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 				written += write_midx_large_offsets(f, num_large_offsets, entries, nr_entries);
 				break;
 
+			case MIDX_CHUNKID_REVINDEX:
+				written += write_midx_revindex(f, pack_perm,
+							       preferred_pack < 0 ? PACK_EXPIRED :
+							       pack_perm[preferred_pack],
+							       entries, nr_entries);
+				break;
+
 			default:
 				BUG("trying to write unknown chunk id %"PRIx32,
 				    chunk_ids[i]);
@@ -998,9 +1401,13 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 		    written,
 		    chunk_offsets[num_chunks]);
 
-	finalize_hashfile(f, NULL, CSUM_FSYNC | CSUM_HASH_IN_STREAM);
+	finalize_hashfile(f, midx_hash, CSUM_FSYNC | CSUM_HASH_IN_STREAM);
 	commit_lock_file(&lk);
 
+	if ((flags & MIDX_WRITE_BITMAP) && write_midx_bitmap(object_dir))
+		result = 1;
+	clear_midx_bitmaps(object_dir, result ? NULL : midx_hash);
+
 cleanup:
 	for (i = 0; i < packs.nr; i++) {
 		if (packs.info[i].p) {
@@ -1017,9 +1424,11 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 	return result;
 }
 
-int write_midx_file(const char *object_dir)
+int write_midx_file(const char *object_dir, const char *preferred_pack_name,
+		    unsigned flags)
 {
-	return write_midx_internal(object_dir, NULL, NULL);
+	return write_midx_internal(object_dir, NULL, NULL, preferred_pack_name,
+				   flags);
 }
 
 void clear_midx_file(struct repository *r)
@@ -1031,6 +1440,8 @@ void clear_midx_file(struct repository *r)
 		r->objects->multi_pack_index = NULL;
 	}
 
+	clear_midx_bitmaps(r->objects->odb->path, NULL);
+
 	if (remove_path(midx)) {
 		UNLEAK(midx);
 		die(_("failed to clear multi-pack-index at %s"), midx);
@@ -1222,7 +1633,7 @@ int expire_midx_packs(struct repository *r, const char *object_dir)
 	free(count);
 
 	if (packs_to_drop.nr)
-		result = write_midx_internal(object_dir, m, &packs_to_drop);
+		result = write_midx_internal(object_dir, m, &packs_to_drop, NULL, 0);
 
 	string_list_clear(&packs_to_drop, 0);
 	return result;
@@ -1371,7 +1782,7 @@ int midx_repack(struct repository *r, const char *object_dir, size_t batch_size)
 		goto cleanup;
 	}
 
-	result = write_midx_internal(object_dir, m, NULL);
+	result = write_midx_internal(object_dir, m, NULL, NULL, 0);
 	m = NULL;
 
 cleanup:
@@ -9,6 +9,8 @@ struct repository;
 
 #define GIT_TEST_MULTI_PACK_INDEX "GIT_TEST_MULTI_PACK_INDEX"
 
+#define MIDX_WRITE_BITMAP (1 << 0)
+
 struct multi_pack_index {
 	struct multi_pack_index *next;
 
@@ -31,6 +33,7 @@ struct multi_pack_index {
 	const unsigned char *chunk_oid_lookup;
 	const unsigned char *chunk_object_offsets;
 	const unsigned char *chunk_large_offsets;
+	const unsigned char *chunk_revindex;
 
 	const char **pack_names;
 	struct packed_git **packs;
@@ -43,11 +46,26 @@ int bsearch_midx(const struct object_id *oid, struct multi_pack_index *m, uint32
 struct object_id *nth_midxed_object_oid(struct object_id *oid,
 					struct multi_pack_index *m,
 					uint32_t n);
+off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos);
+uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos);
+const unsigned char *get_midx_checksum(struct multi_pack_index *m);
+char *get_midx_bitmap_filename(struct multi_pack_index *m);
+
+/*
+ * The "pseudo-pack" order of a multi-pack-index with a reverse index
+ * lists the objects of its preferred pack first, followed by the
+ * objects of the other packs in pack-int-id order, each pack in the
+ * order of the offsets of its objects. Multi-pack bitmaps use it as
+ * their bit order.
+ */
+int midx_preferred_pack(struct multi_pack_index *m, uint32_t *pack_int_id);
+uint32_t pack_pos_to_midx(struct multi_pack_index *m, uint32_t pos);
+int midx_to_pack_pos(struct multi_pack_index *m, uint32_t at, uint32_t *pos);
 int fill_midx_entry(struct repository *r, const struct object_id *oid, struct pack_entry *e, struct multi_pack_index *m);
 int midx_contains_pack(struct multi_pack_index *m, const char *idx_or_pack_name);
 int prepare_multi_pack_index_one(struct repository *r, const char *object_dir, int local);
 
-int write_midx_file(const char *object_dir);
+int write_midx_file(const char *object_dir, const char *preferred_pack_name, unsigned flags);
 void clear_midx_file(struct repository *r);
 int verify_midx_file(struct repository *r, const char *object_dir);
 int expire_midx_packs(struct repository *r, const char *object_dir);
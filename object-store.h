@@ -6,6 +6,7 @@
 #include "list.h"
 #include "sha1-array.h"
 #include "strbuf.h"
+#include "thread-utils.h"
 
 struct object_directory {
 	struct object_directory *next;
@@ -49,6 +50,14 @@ void add_to_alternates_file(const char *dir);
  */
 void add_to_alternates_memory(const char *dir);
 
+/*
+ * Make "dir" the primary object directory, so that new objects are
+ * written there, with the current one as its first alternate.  Undo it
+ * with restore_primary_odb(), passing the return value.
+ */
+struct object_directory *set_temporary_primary_odb(const char *dir);
+void restore_primary_odb(struct object_directory *odb);
+
 /*
  * Populate and return the loose object cache array corresponding to the
  * given object ID.
@@ -82,6 +91,9 @@ struct packed_git {
 		 multi_pack_index:1;
 	unsigned char hash[GIT_MAX_RAWSZ];
 	struct revindex_entry *revindex;
+	const uint32_t *revindex_data;
+	const void *revindex_map;
+	size_t revindex_size;
 	/* something like ".git/objects/pack/xxxxx.pack" */
 	char pack_name[FLEX_ARRAY]; /* more */
 };
@@ -382,4 +394,34 @@ int for_each_object_in_pack(struct packed_git *p,
 int for_each_packed_object(each_packed_object_fn, void *,
 			   enum for_each_object_flags flags);
 
+/*
+ * Enabling the object read lock lets several threads call
+ * read_object_file(), read_object_with_reference(), oid_object_info()
+ * and oid_object_info_extended() at the same time.  The lock is
+ * released while objects are inflated and deltas are applied, so that
+ * part of the work, which is most of it, runs in parallel.
+ *
+ * obj_read_lock() and obj_read_unlock() also protect other code that
+ * must not run in parallel with object reading.  The lock is recursive,
+ * so such code may read objects itself, but those reads are not done
+ * in parallel with the others.
+ */
+extern int obj_read_use_lock;
+extern pthread_mutex_t obj_read_mutex;
+
+void enable_obj_read_lock(void);
+void disable_obj_read_lock(void);
+
+static inline void obj_read_lock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_lock(&obj_read_mutex);
+}
+
+static inline void obj_read_unlock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_unlock(&obj_read_mutex);
+}
+
 #endif /* OBJECT_STORE_H */
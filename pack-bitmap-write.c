@@ -12,10 +12,12 @@
 #include "sha1-lookup.h"
 #include "pack-objects.h"
 #include "commit-reach.h"
+#include "thread-utils.h"
 
 struct bitmapped_commit {
 	struct commit *commit;
 	struct ewah_bitmap *bitmap;
+	struct ewah_bitmap *existing;
 	struct ewah_bitmap *write_as;
 	int flags;
 	int xor_offset;
@@ -29,7 +31,7 @@ struct bitmap_writer {
 	struct ewah_bitmap *tags;
 
 	kh_oid_map_t *bitmaps;
-	kh_oid_map_t *reused;
+	struct bitmap_index *existing;
 	struct packing_data *to_pack;
 
 	struct bitmapped_commit *selected;
@@ -37,6 +39,7 @@ struct bitmap_writer {
 
 	struct progress *progress;
 	int show_progress;
+	int nr_threads;
 	unsigned char pack_checksum[GIT_MAX_RAWSZ];
 };
 
@@ -47,6 +50,76 @@ void bitmap_writer_show_progress(int show)
 	writer.show_progress = show;
 }
 
+void bitmap_writer_set_threads(int nr_threads)
+{
+	writer.nr_threads = nr_threads;
+}
+
+typedef void (*bitmap_writer_fn)(void *item, void *cb_data);
+
+struct bitmap_writer_thread {
+	pthread_t thread;
+	char *items;
+	size_t size, nr;
+	bitmap_writer_fn fn;
+	void *cb_data;
+};
+
+static void *run_bitmap_writer_thread(void *arg)
+{
+	struct bitmap_writer_thread *t = arg;
+	size_t i;
+
+	for (i = 0; i < t->nr; i++)
+		t->fn(t->items + i * t->size, t->cb_data);
+	return NULL;
+}
+
+/*
+ * Run "fn" over the "nr" items of "data" (each "size" bytes large) from
+ * up to writer.nr_threads threads, giving each thread a contiguous range.
+ * "fn" must not touch any state that other items use, except for reading.
+ */
+static void for_each_item_in_parallel(void *data, size_t nr, size_t size,
+				      bitmap_writer_fn fn, void *cb_data)
+{
+	struct bitmap_writer_thread *threads;
+	int nr_threads = writer.nr_threads;
+	size_t i, offset = 0;
+
+	if (nr_threads <= 0)
+		nr_threads = online_cpus();
+	if (nr_threads > nr)
+		nr_threads = nr;
+	if (!HAVE_THREADS || nr_threads <= 1) {
+		for (i = 0; i < nr; i++)
+			fn((char *)data + i * size, cb_data);
+		return;
+	}
+
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		struct bitmap_writer_thread *t = &threads[i];
+		int err;
+
+		t->items = (char *)data + offset * size;
+		t->size = size;
+		t->nr = (nr - offset) / (nr_threads - i);
+		t->fn = fn;
+		t->cb_data = cb_data;
+		offset += t->nr;
+
+		err = pthread_create(&t->thread, NULL,
+				     run_bitmap_writer_thread, t);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(threads[i].thread, NULL))
+			die(_("unable to join thread"));
+	free(threads);
+}
+
 /**
  * Build the initial type index for the packfile
  */
@@ -113,7 +186,8 @@ void bitmap_writer_build_type_index(struct packing_data *to_pack,
 static struct object **seen_objects;
 static unsigned int seen_objects_nr, seen_objects_alloc;
 
-static inline void push_bitmapped_commit(struct commit *commit, struct ewah_bitmap *reused)
+static inline void push_bitmapped_commit(struct commit *commit,
+					 struct ewah_bitmap *existing)
 {
 	if (writer.selected_nr >= writer.selected_alloc) {
 		writer.selected_alloc = (writer.selected_alloc + 32) * 2;
@@ -121,7 +195,8 @@ static inline void push_bitmapped_commit(struct commit *commit, struct ewah_bitm
 	}
 
 	writer.selected[writer.selected_nr].commit = commit;
-	writer.selected[writer.selected_nr].bitmap = reused;
+	writer.selected[writer.selected_nr].bitmap = NULL;
+	writer.selected[writer.selected_nr].existing = existing;
 	writer.selected[writer.selected_nr].flags = 0;
 
 	writer.selected_nr++;
@@ -208,44 +283,89 @@ should_include(struct commit *commit, void *_data)
 	return 1;
 }
 
-static void compute_xor_offsets(void)
+static void compute_xor_offset(void *item, void *cb_data)
 {
 	static const int MAX_XOR_OFFSET_SEARCH = 10;
 
-	int i, next = 0;
-
-	while (next < writer.selected_nr) {
-		struct bitmapped_commit *stored = &writer.selected[next];
+	struct bitmapped_commit *stored = item;
+	int i, next = stored - writer.selected;
 
-		int best_offset = 0;
-		struct ewah_bitmap *best_bitmap = stored->bitmap;
-		struct ewah_bitmap *test_xor;
+	int best_offset = 0;
+	struct ewah_bitmap *best_bitmap = stored->bitmap;
+	struct ewah_bitmap *test_xor;
 
-		for (i = 1; i <= MAX_XOR_OFFSET_SEARCH; ++i) {
-			int curr = next - i;
+	for (i = 1; i <= MAX_XOR_OFFSET_SEARCH; ++i) {
+		int curr = next - i;
 
-			if (curr < 0)
-				break;
+		if (curr < 0)
+			break;
 
-			test_xor = ewah_pool_new();
-			ewah_xor(writer.selected[curr].bitmap, stored->bitmap, test_xor);
+		/* the ewah pool is not thread-safe */
+		test_xor = ewah_new();
+		ewah_xor(writer.selected[curr].bitmap, stored->bitmap, test_xor);
 
-			if (test_xor->buffer_size < best_bitmap->buffer_size) {
-				if (best_bitmap != stored->bitmap)
-					ewah_pool_free(best_bitmap);
+		if (test_xor->buffer_size < best_bitmap->buffer_size) {
+			if (best_bitmap != stored->bitmap)
+				ewah_free(best_bitmap);
 
-				best_bitmap = test_xor;
-				best_offset = i;
-			} else {
-				ewah_pool_free(test_xor);
-			}
+			best_bitmap = test_xor;
+			best_offset = i;
+		} else {
+			ewah_free(test_xor);
 		}
+	}
 
-		stored->xor_offset = best_offset;
-		stored->write_as = best_bitmap;
+	stored->xor_offset = best_offset;
+	stored->write_as = best_bitmap;
+}
 
-		next++;
-	}
+static void compute_xor_offsets(void)
+{
+	for_each_item_in_parallel(writer.selected, writer.selected_nr,
+				  sizeof(*writer.selected),
+				  compute_xor_offset, NULL);
+}
+
+/*
+ * Translate the bitmaps of the selected commits that the previous bitmap
+ * index already had to the object order of the new pack.
+ */
+static void rebuild_existing_bitmap(void *item, void *cb_data)
+{
+	struct bitmapped_commit *stored = item;
+	const uint32_t *reposition = cb_data;
+	struct bitmap *rebuild;
+
+	if (!stored->existing)
+		return;
+
+	rebuild = bitmap_new();
+	if (!rebuild_bitmap(reposition, stored->existing, rebuild))
+		stored->bitmap = bitmap_to_ewah(rebuild);
+	bitmap_free(rebuild);
+	stored->existing = NULL;
+}
+
+static void rebuild_existing_bitmaps(void)
+{
+	uint32_t *reposition;
+
+	if (!writer.existing)
+		return;
+
+	if (writer.show_progress)
+		writer.progress = start_progress("Reusing bitmaps", 0);
+
+	reposition = create_bitmap_mapping(writer.existing, writer.to_pack);
+	for_each_item_in_parallel(writer.selected, writer.selected_nr,
+				  sizeof(*writer.selected),
+				  rebuild_existing_bitmap, reposition);
+	free(reposition);
+
+	stop_progress(&writer.progress);
+
+	free_bitmap_index(writer.existing);
+	writer.existing = NULL;
 }
 
 void bitmap_writer_build(struct packing_data *to_pack)
@@ -259,6 +379,8 @@ void bitmap_writer_build(struct packing_data *to_pack)
 	writer.bitmaps = kh_init_oid_map();
 	writer.to_pack = to_pack;
 
+	rebuild_existing_bitmaps();
+
 	if (writer.show_progress)
 		writer.progress = start_progress("Building bitmaps", writer.selected_nr);
 
@@ -362,31 +484,14 @@ static int date_compare(const void *_a, const void *_b)
 
 void bitmap_writer_reuse_bitmaps(struct packing_data *to_pack)
 {
-	struct bitmap_index *bitmap_git;
-	if (!(bitmap_git = prepare_bitmap_git(to_pack->repo)))
-		return;
-
-	writer.reused = kh_init_oid_map();
-	rebuild_existing_bitmaps(bitmap_git, to_pack, writer.reused,
-				 writer.show_progress);
-	/*
-	 * NEEDSWORK: rebuild_existing_bitmaps() makes writer.reused reference
-	 * some bitmaps in bitmap_git, so we can't free the latter.
-	 */
+	writer.existing = prepare_bitmap_git(to_pack->repo);
 }
 
-static struct ewah_bitmap *find_reused_bitmap(const struct object_id *oid)
+static struct ewah_bitmap *find_existing_bitmap(struct commit *commit)
 {
-	khiter_t hash_pos;
-
-	if (!writer.reused)
-		return NULL;
-
-	hash_pos = kh_get_oid_map(writer.reused, *oid);
-	if (hash_pos >= kh_end(writer.reused))
+	if (!writer.existing)
 		return NULL;
-
-	return kh_value(writer.reused, hash_pos);
+	return bitmap_for_commit(writer.existing, commit);
 }
 
 void bitmap_writer_select_commits(struct commit **indexed_commits,
@@ -402,7 +507,8 @@ void bitmap_writer_select_commits(struct commit **indexed_commits,
 
 	if (indexed_commits_nr < 100) {
 		for (i = 0; i < indexed_commits_nr; ++i)
-			push_bitmapped_commit(indexed_commits[i], NULL);
+			push_bitmapped_commit(indexed_commits[i],
+					      find_existing_bitmap(indexed_commits[i]));
 		return;
 	}
 
@@ -410,6 +516,8 @@ void bitmap_writer_select_commits(struct commit **indexed_commits,
 		struct ewah_bitmap *reused_bitmap = NULL;
 		struct commit *chosen = NULL;
 
+		int chosen_score = 0;
+
 		next = next_commit_index(i);
 
 		if (i + next >= indexed_commits_nr)
@@ -422,20 +530,36 @@ void bitmap_writer_select_commits(struct commit **indexed_commits,
 
 		if (next == 0) {
 			chosen = indexed_commits[i];
-			reused_bitmap = find_reused_bitmap(&chosen->object.oid);
+			reused_bitmap = find_existing_bitmap(chosen);
 		} else {
 			chosen = indexed_commits[i + next];
 
+			/*
+			 * Prefer the tips that need a bitmap and already had
+			 * one, then any commit that had one, then the tips,
+			 * then the most recent merge in the window.
+			 */
 			for (j = 0; j <= next; ++j) {
 				struct commit *cm = indexed_commits[i + j];
+				struct ewah_bitmap *existing;
+				int score = 0;
+
+				existing = find_existing_bitmap(cm);
+				if (existing)
+					score += 2;
+				if (cm->object.flags & NEEDS_BITMAP)
+					score += 1;
 
-				reused_bitmap = find_reused_bitmap(&cm->object.oid);
-				if (reused_bitmap || (cm->object.flags & NEEDS_BITMAP) != 0) {
+				if (score > chosen_score) {
 					chosen = cm;
-					break;
+					chosen_score = score;
+					reused_bitmap = existing;
+					if (score == 3)
+						break;
 				}
 
-				if (cm->parents && cm->parents->next)
+				if (!chosen_score &&
+				    cm->parents && cm->parents->next)
 					chosen = cm;
 			}
 		}
@@ -12,6 +12,7 @@
 #include "packfile.h"
 #include "repository.h"
 #include "object-store.h"
+#include "midx.h"
 
 /*
  * An entry on the bitmap index, representing the bitmap for a given
@@ -31,17 +32,17 @@ struct stored_bitmap {
  *
  * If there is more than one bitmap index available (e.g. because of alternates),
  * the active bitmap index is the largest one.
+ *
+ * A bitmap index may instead belong to the multi-pack-index, in which case
+ * its bits follow the pseudo-pack order of the multi-pack-index.
  */
 struct bitmap_index {
-	/* Packfile to which this bitmap index belongs to */
-	struct packed_git *pack;
-
 	/*
-	 * Mark the first `reuse_objects` in the packfile as reused:
-	 * they will be sent as-is without using them for repacking
-	 * calculations
+	 * Packfile or multi-pack-index to which this bitmap index belongs
+	 * to; exactly one of them is set.
 	 */
-	uint32_t reuse_objects;
+	struct packed_git *pack;
+	struct multi_pack_index *midx;
 
 	/* mmapped buffer of the whole bitmap index */
 	unsigned char *map;
@@ -93,6 +94,23 @@ struct bitmap_index {
 	unsigned int version;
 };
 
+static uint32_t bitmap_num_objects(struct bitmap_index *index)
+{
+	if (index->midx)
+		return index->midx->num_objects;
+	return index->pack->num_objects;
+}
+
+/* The object at "pos" in the object order of the .idx or multi-pack-index */
+static void nth_bitmap_object_oid(struct bitmap_index *index,
+				  struct object_id *oid, uint32_t pos)
+{
+	if (index->midx)
+		nth_midxed_object_oid(oid, index->midx, pos);
+	else
+		nth_packed_object_oid(oid, index->pack, pos);
+}
+
 static struct ewah_bitmap *lookup_stored_bitmap(struct stored_bitmap *st)
 {
 	struct ewah_bitmap *parent;
@@ -158,10 +176,14 @@ static int load_bitmap_header(struct bitmap_index *index)
 
 		if (flags & BITMAP_OPT_HASH_CACHE) {
 			unsigned char *end = index->map + index->map_size - the_hash_algo->rawsz;
-			index->hashes = ((uint32_t *)end) - index->pack->num_objects;
+			index->hashes = ((uint32_t *)end) - bitmap_num_objects(index);
 		}
 	}
 
+	if (index->midx &&
+	    !hasheq(header->checksum, get_midx_checksum(index->midx)))
+		return error("Bitmap does not match the multi-pack-index");
+
 	index->entry_count = ntohl(header->entry_count);
 	index->map_pos += sizeof(*header) - GIT_MAX_RAWSZ + the_hash_algo->rawsz;
 	return 0;
@@ -221,13 +243,15 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 		struct ewah_bitmap *bitmap = NULL;
 		struct stored_bitmap *xor_bitmap = NULL;
 		uint32_t commit_idx_pos;
-		const unsigned char *sha1;
+		struct object_id oid;
 
 		commit_idx_pos = read_be32(index->map, &index->map_pos);
 		xor_offset = read_u8(index->map, &index->map_pos);
 		flags = read_u8(index->map, &index->map_pos);
 
-		sha1 = nth_packed_object_sha1(index->pack, commit_idx_pos);
+		if (commit_idx_pos >= bitmap_num_objects(index))
+			return error("Corrupted bitmap index (commit out of range)");
+		nth_bitmap_object_oid(index, &oid, commit_idx_pos);
 
 		bitmap = read_bitmap_1(index);
 		if (!bitmap)
@@ -244,7 +268,7 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 		}
 
 		recent_bitmaps[i % MAX_XOR_OFFSET] = store_bitmap(
-			index, bitmap, sha1, xor_bitmap, flags);
+			index, bitmap, oid.hash, xor_bitmap, flags);
 	}
 
 	return 0;
@@ -280,7 +304,7 @@ static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git
 		return -1;
 	}
 
-	if (bitmap_git->pack) {
+	if (bitmap_git->pack || bitmap_git->midx) {
 		warning("ignoring extra bitmap file: %s", packfile->pack_name);
 		close(fd);
 		return -1;
@@ -302,13 +326,64 @@ static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git
 	return 0;
 }
 
-static int load_pack_bitmap(struct bitmap_index *bitmap_git)
+static int open_midx_bitmap_1(struct repository *r,
+			      struct bitmap_index *bitmap_git,
+			      struct multi_pack_index *midx)
+{
+	int fd;
+	struct stat st;
+	char *bitmap_name;
+	uint32_t i;
+
+	/* the bits are in the pseudo-pack order of the reverse index */
+	if (!midx->chunk_revindex)
+		return -1;
+
+	bitmap_name = get_midx_bitmap_filename(midx);
+	fd = git_open(bitmap_name);
+	free(bitmap_name);
+
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+
+	for (i = 0; i < midx->num_packs; i++) {
+		if (prepare_midx_pack(r, midx, i)) {
+			warning("could not open pack %s of multi-pack bitmap",
+				midx->pack_names[i]);
+			close(fd);
+			return -1;
+		}
+	}
+
+	bitmap_git->midx = midx;
+	bitmap_git->map_size = xsize_t(st.st_size);
+	bitmap_git->map = xmmap(NULL, bitmap_git->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	bitmap_git->map_pos = 0;
+	close(fd);
+
+	if (load_bitmap_header(bitmap_git) < 0) {
+		munmap(bitmap_git->map, bitmap_git->map_size);
+		bitmap_git->map = NULL;
+		bitmap_git->map_size = 0;
+		bitmap_git->midx = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int load_bitmap(struct bitmap_index *bitmap_git)
 {
 	assert(bitmap_git->map);
 
 	bitmap_git->bitmaps = kh_init_oid_map();
 	bitmap_git->ext_index.positions = kh_init_oid_pos();
-	if (load_pack_revindex(bitmap_git->pack))
+	if (bitmap_git->pack && load_pack_revindex(bitmap_git->pack))
 		goto failed;
 
 	if (!(bitmap_git->commits = read_bitmap_1(bitmap_git)) ||
@@ -335,8 +410,6 @@ static int open_pack_bitmap(struct repository *r,
 	struct packed_git *p;
 	int ret = -1;
 
-	assert(!bitmap_git->map);
-
 	for (p = get_all_packs(r); p; p = p->next) {
 		if (open_pack_bitmap_1(bitmap_git, p) == 0)
 			ret = 0;
@@ -345,11 +418,30 @@ static int open_pack_bitmap(struct repository *r,
 	return ret;
 }
 
+/*
+ * Prefer the bitmap of the local multi-pack-index, which covers the
+ * objects of many packs, over that of a single pack.
+ */
+static int open_bitmap(struct repository *r,
+		       struct bitmap_index *bitmap_git)
+{
+	struct multi_pack_index *midx;
+
+	assert(!bitmap_git->map);
+
+	for (midx = get_multi_pack_index(r); midx; midx = midx->next) {
+		if (midx->local && !open_midx_bitmap_1(r, bitmap_git, midx))
+			return 0;
+	}
+
+	return open_pack_bitmap(r, bitmap_git);
+}
+
 struct bitmap_index *prepare_bitmap_git(struct repository *r)
 {
 	struct bitmap_index *bitmap_git = xcalloc(1, sizeof(*bitmap_git));
 
-	if (!open_pack_bitmap(r, bitmap_git) && !load_pack_bitmap(bitmap_git))
+	if (!open_bitmap(r, bitmap_git) && !load_bitmap(bitmap_git))
 		return bitmap_git;
 
 	free_bitmap_index(bitmap_git);
@@ -370,7 +462,7 @@ static inline int bitmap_position_extended(struct bitmap_index *bitmap_git,
 
 	if (pos < kh_end(positions)) {
 		int bitmap_pos = kh_value(positions, pos);
-		return bitmap_pos + bitmap_git->pack->num_objects;
+		return bitmap_pos + bitmap_num_objects(bitmap_git);
 	}
 
 	return -1;
@@ -386,10 +478,32 @@ static inline int bitmap_position_packfile(struct bitmap_index *bitmap_git,
 	return find_revindex_position(bitmap_git->pack, offset);
 }
 
+static inline int bitmap_position_midx(struct bitmap_index *bitmap_git,
+				       const struct object_id *oid)
+{
+	uint32_t want, got;
+
+	if (!bsearch_midx(oid, bitmap_git->midx, &want))
+		return -1;
+	if (midx_to_pack_pos(bitmap_git->midx, want, &got) < 0)
+		return -1;
+
+	return got;
+}
+
+/* The position of "oid" among the objects covered by the bitmap, if any */
+static int bitmap_position_indexed(struct bitmap_index *bitmap_git,
+				   const struct object_id *oid)
+{
+	if (bitmap_git->midx)
+		return bitmap_position_midx(bitmap_git, oid);
+	return bitmap_position_packfile(bitmap_git, oid);
+}
+
 static int bitmap_position(struct bitmap_index *bitmap_git,
 			   const struct object_id *oid)
 {
-	int pos = bitmap_position_packfile(bitmap_git, oid);
+	int pos = bitmap_position_indexed(bitmap_git, oid);
 	return (pos >= 0) ? pos : bitmap_position_extended(bitmap_git, oid);
 }
 
@@ -419,7 +533,7 @@ static int ext_index_add_object(struct bitmap_index *bitmap_git,
 		bitmap_pos = kh_value(eindex->positions, hash_pos);
 	}
 
-	return bitmap_pos + bitmap_git->pack->num_objects;
+	return bitmap_pos + bitmap_num_objects(bitmap_git);
 }
 
 struct bitmap_show_data {
@@ -608,7 +722,7 @@ static void show_extended_objects(struct bitmap_index *bitmap_git,
 	for (i = 0; i < eindex->count; ++i) {
 		struct object *obj;
 
-		if (!bitmap_get(objects, bitmap_git->pack->num_objects + i))
+		if (!bitmap_get(objects, bitmap_num_objects(bitmap_git) + i))
 			continue;
 
 		obj = eindex->objects[i];
@@ -630,9 +744,6 @@ static void show_objects_for_type(
 
 	struct bitmap *objects = bitmap_git->result;
 
-	if (bitmap_git->reuse_objects == bitmap_git->pack->num_objects)
-		return;
-
 	ewah_iterator_init(&it, type_filter);
 
 	while (i < objects->word_alloc && ewah_iterator_next(&filter, &it)) {
@@ -640,24 +751,32 @@ static void show_objects_for_type(
 
 		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
 			struct object_id oid;
-			struct revindex_entry *entry;
-			uint32_t hash = 0;
+			struct packed_git *pack;
+			uint32_t index_pos, hash = 0;
+			off_t ofs;
 
 			if ((word >> offset) == 0)
 				break;
 
 			offset += ewah_bit_ctz64(word >> offset);
 
-			if (pos + offset < bitmap_git->reuse_objects)
-				continue;
+			if (bitmap_git->midx) {
+				struct multi_pack_index *m = bitmap_git->midx;
 
-			entry = &bitmap_git->pack->revindex[pos + offset];
-			nth_packed_object_oid(&oid, bitmap_git->pack, entry->nr);
+				index_pos = pack_pos_to_midx(m, pos + offset);
+				pack = m->packs[nth_midxed_pack_int_id(m, index_pos)];
+				ofs = nth_midxed_offset(m, index_pos);
+			} else {
+				pack = bitmap_git->pack;
+				index_pos = pack_pos_to_index(pack, pos + offset);
+				ofs = pack_pos_to_offset(pack, pos + offset);
+			}
+			nth_bitmap_object_oid(bitmap_git, &oid, index_pos);
 
 			if (bitmap_git->hashes)
-				hash = get_be32(bitmap_git->hashes + entry->nr);
+				hash = get_be32(bitmap_git->hashes + index_pos);
 
-			show_reach(&oid, object_type, 0, hash, bitmap_git->pack, entry->offset);
+			show_reach(&oid, object_type, 0, hash, pack, ofs);
 		}
 
 		pos += BITS_IN_EWORD;
@@ -672,7 +791,12 @@ static int in_bitmapped_pack(struct bitmap_index *bitmap_git,
 		struct object *object = roots->item;
 		roots = roots->next;
 
-		if (find_pack_entry_one(object->oid.hash, bitmap_git->pack) > 0)
+		if (bitmap_git->midx) {
+			uint32_t pos;
+
+			if (bsearch_midx(&object->oid, bitmap_git->midx, &pos))
+				return 1;
+		} else if (find_pack_entry_one(object->oid.hash, bitmap_git->pack) > 0)
 			return 1;
 	}
 
@@ -692,7 +816,7 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs)
 	struct bitmap_index *bitmap_git = xcalloc(1, sizeof(*bitmap_git));
 	/* try to open a bitmapped pack, but don't parse it yet
 	 * because we may not need to use it */
-	if (open_pack_bitmap(revs->repo, bitmap_git) < 0)
+	if (open_bitmap(revs->repo, bitmap_git) < 0)
 		goto cleanup;
 
 	for (i = 0; i < revs->pending.nr; ++i) {
@@ -737,7 +861,7 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs)
 	 * from disk. this is the point of no return; after this the rev_list
 	 * becomes invalidated and we must perform the revwalk through bitmaps
 	 */
-	if (load_pack_bitmap(bitmap_git) < 0)
+	if (load_bitmap(bitmap_git) < 0)
 		goto cleanup;
 
 	object_array_clear(&revs->pending);
@@ -770,65 +894,144 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs)
 	return NULL;
 }
 
+/*
+ * The pack whose objects come first in the bit order of a multi-pack
+ * bitmap, if the multi-pack-index took all of them from that pack, so
+ * that the bit positions of its objects match their order in the pack.
+ */
+static struct packed_git *midx_preferred_reuse_pack(struct bitmap_index *bitmap_git)
+{
+	struct multi_pack_index *m = bitmap_git->midx;
+	struct packed_git *p;
+	uint32_t preferred, last;
+
+	if (midx_preferred_pack(m, &preferred) < 0)
+		return NULL;
+
+	p = m->packs[preferred];
+	if (!p || load_pack_revindex(p) ||
+	    !p->num_objects || p->num_objects > m->num_objects)
+		return NULL;
+
+	last = pack_pos_to_midx(m, p->num_objects - 1);
+	if (nth_midxed_pack_int_id(m, last) != preferred)
+		return NULL;
+
+	return p;
+}
+
+/*
+ * Mark the object at position "pos" of "pack" in "reuse" if it can be
+ * copied verbatim from "pack": either it is not a delta, or its base
+ * comes before it in the pack and is copied, too.
+ */
+static void try_partial_reuse(struct packed_git *pack, uint32_t pos,
+			      struct bitmap *reuse,
+			      struct pack_window **w_curs)
+{
+	off_t offset, delta_obj_offset;
+	enum object_type type;
+	unsigned long size;
+
+	offset = delta_obj_offset = pack_pos_to_offset(pack, pos);
+	type = unpack_object_header(pack, w_curs, &offset, &size);
+	if (type < 0)
+		return; /* broken packfile, punt */
+
+	if (type == OBJ_REF_DELTA || type == OBJ_OFS_DELTA) {
+		off_t base_offset;
+		int base_pos;
+
+		/*
+		 * If the base cannot be found in the pack, the pack is
+		 * corrupt; leave the object to the slow path, which
+		 * complains about it in more detail.
+		 */
+		base_offset = get_delta_base(pack, w_curs, &offset, type,
+					     delta_obj_offset);
+		if (!base_offset)
+			return;
+		base_pos = find_revindex_position(pack, base_offset);
+		if (base_pos < 0)
+			return;
+
+		/*
+		 * Deltas in a pack we wrote always point backwards, which
+		 * lets us decide in a single pass, and the base must be
+		 * sent in the reused part, too; otherwise it would come
+		 * after us and we would have to turn this object into a
+		 * REF_DELTA on the fly. Let the slow path deal with it.
+		 */
+		if (base_pos >= pos || !bitmap_get(reuse, base_pos))
+			return;
+	}
+
+	bitmap_set(reuse, pos);
+}
+
 int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
-				       struct packed_git **packfile,
+				       struct packed_git **packfile_out,
 				       uint32_t *entries,
-				       off_t *up_to)
+				       struct bitmap **reuse_out)
 {
-	/*
-	 * Reuse the packfile content if we need more than
-	 * 90% of its objects
-	 */
-	static const double REUSE_PERCENT = 0.9;
-
 	struct bitmap *result = bitmap_git->result;
-	uint32_t reuse_threshold;
-	uint32_t i, reuse_objects = 0;
+	struct packed_git *pack = bitmap_git->pack;
+	struct bitmap *reuse;
+	struct pack_window *w_curs = NULL;
+	size_t i = 0;
+	uint32_t offset;
 
 	assert(result);
 
-	for (i = 0; i < result->word_alloc; ++i) {
-		if (result->words[i] != (eword_t)~0) {
-			reuse_objects += ewah_bit_ctz64(~result->words[i]);
-			break;
-		}
+	if (bitmap_git->midx &&
+	    !(pack = midx_preferred_reuse_pack(bitmap_git)))
+		return -1;
 
-		reuse_objects += BITS_IN_EWORD;
-	}
+	/*
+	 * Whole words of objects at the start of the pack can be copied
+	 * without looking at them, as their deltas cannot refer to
+	 * anything we do not send.
+	 */
+	while (i < result->word_alloc && result->words[i] == (eword_t)~0)
+		i++;
 
-#ifdef GIT_BITMAP_DEBUG
-	{
-		const unsigned char *sha1;
-		struct revindex_entry *entry;
+	/* Don't mark objects not in the packfile */
+	if (i > pack->num_objects / BITS_IN_EWORD)
+		i = pack->num_objects / BITS_IN_EWORD;
 
-		entry = &bitmap_git->reverse_index->revindex[reuse_objects];
-		sha1 = nth_packed_object_sha1(bitmap_git->pack, entry->nr);
+	reuse = bitmap_word_alloc(i);
+	memset(reuse->words, 0xFF, i * sizeof(eword_t));
 
-		fprintf(stderr, "Failed to reuse at %d (%016llx)\n",
-			reuse_objects, result->words[i]);
-		fprintf(stderr, " %s\n", hash_to_hex(sha1));
-	}
-#endif
+	for (; i < result->word_alloc; ++i) {
+		eword_t word = result->words[i];
+		size_t pos = (i * BITS_IN_EWORD);
 
-	if (!reuse_objects)
-		return -1;
+		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
+			if ((word >> offset) == 0)
+				break;
 
-	if (reuse_objects >= bitmap_git->pack->num_objects) {
-		bitmap_git->reuse_objects = *entries = bitmap_git->pack->num_objects;
-		*up_to = -1; /* reuse the full pack */
-		*packfile = bitmap_git->pack;
-		return 0;
+			offset += ewah_bit_ctz64(word >> offset);
+			if (pos + offset >= pack->num_objects)
+				break;
+			try_partial_reuse(pack, pos + offset, reuse, &w_curs);
+		}
 	}
 
-	reuse_threshold = bitmap_popcount(bitmap_git->result) * REUSE_PERCENT;
+	unuse_pack(&w_curs);
 
-	if (reuse_objects < reuse_threshold)
+	*entries = bitmap_popcount(reuse);
+	if (!*entries) {
+		bitmap_free(reuse);
 		return -1;
+	}
 
-	bitmap_git->reuse_objects = *entries = reuse_objects;
-	*up_to = bitmap_git->pack->revindex[reuse_objects].offset;
-	*packfile = bitmap_git->pack;
-
+	/*
+	 * Drop any reused objects from the result, since they will not
+	 * need to be handled separately.
+	 */
+	bitmap_and_not(result, reuse);
+	*packfile_out = pack;
+	*reuse_out = reuse;
 	return 0;
 }
 
@@ -887,7 +1090,7 @@ static uint32_t count_object_type(struct bitmap_index *bitmap_git,
 
 	for (i = 0; i < eindex->count; ++i) {
 		if (eindex->objects[i]->type == type &&
-			bitmap_get(objects, bitmap_git->pack->num_objects + i))
+			bitmap_get(objects, bitmap_num_objects(bitmap_git) + i))
 			count++;
 	}
 
@@ -1008,9 +1211,47 @@ void test_bitmap_walk(struct rev_info *revs)
 	free_bitmap_index(bitmap_git);
 }
 
-static int rebuild_bitmap(uint32_t *reposition,
-			  struct ewah_bitmap *source,
-			  struct bitmap *dest)
+struct ewah_bitmap *bitmap_for_commit(struct bitmap_index *bitmap_git,
+				      struct commit *commit)
+{
+	khiter_t hash_pos = kh_get_oid_map(bitmap_git->bitmaps,
+					   commit->object.oid);
+	if (hash_pos >= kh_end(bitmap_git->bitmaps))
+		return NULL;
+	return lookup_stored_bitmap(kh_value(bitmap_git->bitmaps, hash_pos));
+}
+
+uint32_t *create_bitmap_mapping(struct bitmap_index *bitmap_git,
+				struct packing_data *mapping)
+{
+	uint32_t i, num_objects;
+	uint32_t *reposition;
+
+	num_objects = bitmap_num_objects(bitmap_git);
+	CALLOC_ARRAY(reposition, num_objects);
+
+	for (i = 0; i < num_objects; ++i) {
+		struct object_id oid;
+		struct object_entry *oe;
+
+		if (bitmap_git->midx)
+			nth_bitmap_object_oid(bitmap_git, &oid,
+					      pack_pos_to_midx(bitmap_git->midx, i));
+		else
+			nth_bitmap_object_oid(bitmap_git, &oid,
+					      pack_pos_to_index(bitmap_git->pack, i));
+		oe = packlist_find(mapping, &oid, NULL);
+
+		if (oe)
+			reposition[i] = oe_in_pack_pos(mapping, oe) + 1;
+	}
+
+	return reposition;
+}
+
+int rebuild_bitmap(const uint32_t *reposition,
+		   struct ewah_bitmap *source,
+		   struct bitmap *dest)
 {
 	uint32_t pos = 0;
 	struct ewah_iterator it;
@@ -1039,65 +1280,6 @@ static int rebuild_bitmap(uint32_t *reposition,
 	return 0;
 }
 
-int rebuild_existing_bitmaps(struct bitmap_index *bitmap_git,
-			     struct packing_data *mapping,
-			     kh_oid_map_t *reused_bitmaps,
-			     int show_progress)
-{
-	uint32_t i, num_objects;
-	uint32_t *reposition;
-	struct bitmap *rebuild;
-	struct stored_bitmap *stored;
-	struct progress *progress = NULL;
-
-	khiter_t hash_pos;
-	int hash_ret;
-
-	num_objects = bitmap_git->pack->num_objects;
-	reposition = xcalloc(num_objects, sizeof(uint32_t));
-
-	for (i = 0; i < num_objects; ++i) {
-		struct object_id oid;
-		struct revindex_entry *entry;
-		struct object_entry *oe;
-
-		entry = &bitmap_git->pack->revindex[i];
-		nth_packed_object_oid(&oid, bitmap_git->pack, entry->nr);
-		oe = packlist_find(mapping, &oid, NULL);
-
-		if (oe)
-			reposition[i] = oe_in_pack_pos(mapping, oe) + 1;
-	}
-
-	rebuild = bitmap_new();
-	i = 0;
-
-	if (show_progress)
-		progress = start_progress("Reusing bitmaps", 0);
-
-	kh_foreach_value(bitmap_git->bitmaps, stored, {
-		if (stored->flags & BITMAP_FLAG_REUSE) {
-			if (!rebuild_bitmap(reposition,
-					    lookup_stored_bitmap(stored),
-					    rebuild)) {
-				hash_pos = kh_put_oid_map(reused_bitmaps,
-							  stored->oid,
-							  &hash_ret);
-				kh_value(reused_bitmaps, hash_pos) =
-					bitmap_to_ewah(rebuild);
-			}
-			bitmap_reset(rebuild);
-			display_progress(progress, ++i);
-		}
-	});
-
-	stop_progress(&progress);
-
-	free(reposition);
-	bitmap_free(rebuild);
-	return 0;
-}
-
 void free_bitmap_index(struct bitmap_index *b)
 {
 	if (!b)
@@ -1127,7 +1309,7 @@ int bitmap_has_oid_in_uninteresting(struct bitmap_index *bitmap_git,
 	if (!bitmap_git->haves)
 		return 0; /* walk had no "haves" */
 
-	pos = bitmap_position_packfile(bitmap_git, oid);
+	pos = bitmap_position_indexed(bitmap_git, oid);
 	if (pos < 0)
 		return 0;
 
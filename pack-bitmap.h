@@ -47,11 +47,40 @@ void traverse_bitmap_commit_list(struct bitmap_index *,
 				 show_reachable_fn show_reachable);
 void test_bitmap_walk(struct rev_info *revs);
 struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs);
+
+/*
+ * Find the objects of the result of the walk that can be copied verbatim
+ * from the bitmapped pack (or the preferred pack of a multi-pack bitmap):
+ * on success, "*reuse" holds their positions in the pack, "*entries" their
+ * number, and they are removed from the result of the walk.
+ */
 int reuse_partial_packfile_from_bitmap(struct bitmap_index *,
 				       struct packed_git **packfile,
-				       uint32_t *entries, off_t *up_to);
-int rebuild_existing_bitmaps(struct bitmap_index *, struct packing_data *mapping,
-			     kh_oid_map_t *reused_bitmaps, int show_progress);
+				       uint32_t *entries,
+				       struct bitmap **reuse);
+
+/*
+ * Returns the bitmap stored for "commit" in the bitmap index, or NULL if
+ * it has none.
+ */
+struct ewah_bitmap *bitmap_for_commit(struct bitmap_index *, struct commit *commit);
+
+/*
+ * Returns an array that maps each bit position of the bitmap index to one
+ * plus the position of the same object in "mapping" (or zero if it is
+ * not in there), for use with rebuild_bitmap().
+ */
+uint32_t *create_bitmap_mapping(struct bitmap_index *, struct packing_data *mapping);
+
+/*
+ * Set the bits of "dest" for the objects of "source" after translating
+ * their positions with "reposition". Returns -1 if an object is missing
+ * from the new order. This only reads "reposition" and "source" and may be
+ * called from several threads at once.
+ */
+int rebuild_bitmap(const uint32_t *reposition, struct ewah_bitmap *source,
+		   struct bitmap *dest);
+
 void free_bitmap_index(struct bitmap_index *);
 
 /*
@@ -62,6 +91,7 @@ void free_bitmap_index(struct bitmap_index *);
 int bitmap_has_oid_in_uninteresting(struct bitmap_index *, const struct object_id *oid);
 
 void bitmap_writer_show_progress(int show);
+void bitmap_writer_set_threads(int nr_threads);
 void bitmap_writer_set_checksum(unsigned char *sha1);
 void bitmap_writer_build_type_index(struct packing_data *to_pack,
 				    struct pack_idx_entry **index,
@@ -15,6 +15,11 @@
  * ordered by offset, so if you know the offset of an object, next offset
  * is where its packed representation ends and the index_nr can be used to
  * get the object sha1 from the main index.
+ *
+ * When the pack comes with a "<pack>.rev" file (see the "pack-*.rev files"
+ * section of Documentation/technical/pack-format.txt), the same mapping is
+ * read from there instead of being computed, and only the index positions
+ * are looked up in it; the offsets then come from the pack index.
  */
 
 /*
@@ -159,27 +164,133 @@ static void create_pack_revindex(struct packed_git *p)
 	sort_revindex(p->revindex, num_ent, p->pack_size);
 }
 
+/*
+ * Map "<pack>.rev" if there is one that matches the pack index of "p".
+ * Returns 0 if it was loaded, 1 if there is no such file, and -1 (after
+ * reporting an error) if it is unusable; the caller falls back to
+ * computing the reverse index in memory in both of the latter cases.
+ */
+static int load_pack_revindex_from_disk(struct packed_git *p)
+{
+	const unsigned hashsz = the_hash_algo->rawsz;
+	struct strbuf rev_name = STRBUF_INIT;
+	const unsigned char *data;
+	void *rev_map;
+	size_t rev_size;
+	struct stat st;
+	size_t len;
+	int fd, ret = 1;
+
+	if (!strip_suffix(p->pack_name, ".pack", &len))
+		BUG("pack_name does not end in .pack");
+	strbuf_add(&rev_name, p->pack_name, len);
+	strbuf_addstr(&rev_name, ".rev");
+
+	fd = git_open(rev_name.buf);
+	if (fd < 0)
+		goto out;
+	if (fstat(fd, &st)) {
+		close(fd);
+		goto out;
+	}
+	rev_size = xsize_t(st.st_size);
+	if (rev_size != RIDX_HEADER_SIZE + st_mult(p->num_objects, 4) + 2 * hashsz) {
+		close(fd);
+		ret = error(_("reverse-index file %s has wrong size"), rev_name.buf);
+		goto out;
+	}
+	rev_map = xmmap(NULL, rev_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	data = rev_map;
+	if (get_be32(data) != RIDX_SIGNATURE)
+		ret = error(_("reverse-index file %s has unknown signature"),
+			    rev_name.buf);
+	else if (get_be32(data + 4) != RIDX_VERSION)
+		ret = error(_("reverse-index file %s has unsupported version %"PRIu32),
+			    rev_name.buf, get_be32(data + 4));
+	else if (get_be32(data + 8) != hash_algo_by_ptr(the_hash_algo))
+		ret = error(_("reverse-index file %s has unsupported hash id %"PRIu32),
+			    rev_name.buf, get_be32(data + 8));
+	else if (!hasheq(data + rev_size - 2 * hashsz,
+			 (const unsigned char *)p->index_data + p->index_size - 2 * hashsz))
+		ret = error(_("reverse-index file %s does not match its pack"),
+			    rev_name.buf);
+	else
+		ret = 0;
+
+	if (ret) {
+		munmap(rev_map, rev_size);
+		goto out;
+	}
+	p->revindex_map = rev_map;
+	p->revindex_size = rev_size;
+	p->revindex_data = (const uint32_t *)(data + RIDX_HEADER_SIZE);
+
+out:
+	strbuf_release(&rev_name);
+	return ret;
+}
+
 int load_pack_revindex(struct packed_git *p)
 {
-	if (!p->revindex) {
-		if (open_pack_index(p))
-			return -1;
+	if (p->revindex || p->revindex_data)
+		return 0;
+	if (open_pack_index(p))
+		return -1;
+	if (load_pack_revindex_from_disk(p))
 		create_pack_revindex(p);
-	}
 	return 0;
 }
 
+void close_pack_revindex(struct packed_git *p)
+{
+	if (p->revindex_map) {
+		munmap((void *)p->revindex_map, p->revindex_size);
+		p->revindex_map = NULL;
+		p->revindex_data = NULL;
+	}
+}
+
+uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos)
+{
+	if (pos >= p->num_objects)
+		BUG("pack position %"PRIu32" out of range", pos);
+	if (p->revindex_data)
+		return get_be32(p->revindex_data + pos);
+	return p->revindex[pos].nr;
+}
+
+off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos)
+{
+	if (pos > p->num_objects)
+		BUG("pack position %"PRIu32" out of range", pos);
+	if (!p->revindex_data)
+		return p->revindex[pos].offset;
+	/*
+	 * This knows the pack format -- the hash trailer
+	 * follows immediately after the last object data.
+	 */
+	if (pos == p->num_objects)
+		return p->pack_size - the_hash_algo->rawsz;
+	return nth_packed_object_offset(p, pack_pos_to_index(p, pos));
+}
+
 int find_revindex_position(struct packed_git *p, off_t ofs)
 {
 	int lo = 0;
 	int hi = p->num_objects + 1;
-	const struct revindex_entry *revindex = p->revindex;
+
+	if (load_pack_revindex(p))
+		return -1;
 
 	do {
 		const unsigned mi = lo + (hi - lo) / 2;
-		if (revindex[mi].offset == ofs) {
+		off_t mi_ofs = pack_pos_to_offset(p, mi);
+
+		if (mi_ofs == ofs) {
 			return mi;
-		} else if (ofs < revindex[mi].offset)
+		} else if (ofs < mi_ofs)
 			hi = mi;
 		else
 			lo = mi + 1;
@@ -188,18 +299,3 @@ int find_revindex_position(struct packed_git *p, off_t ofs)
 	error("bad offset for revindex");
 	return -1;
 }
-
-struct revindex_entry *find_pack_revindex(struct packed_git *p, off_t ofs)
-{
-	int pos;
-
-	if (load_pack_revindex(p))
-		return NULL;
-
-	pos = find_revindex_position(p, ofs);
-
-	if (pos < 0)
-		return NULL;
-
-	return p->revindex + pos;
-}
@@ -8,9 +8,37 @@ struct revindex_entry {
 	unsigned int nr;
 };
 
+/*
+ * An on-disk reverse index ("<pack>.rev") starts with a 4-byte signature,
+ * a 4-byte version and a 4-byte hash function id, followed by the index
+ * position of each object in pack order (as 4-byte network order
+ * integers), the checksum of the pack and its own checksum.
+ */
+#define RIDX_SIGNATURE 0x52494458 /* "RIDX" */
+#define RIDX_VERSION 1
+#define RIDX_HEADER_SIZE 12
+
+/*
+ * Make the reverse index of "p" available, by mapping its ".rev" file
+ * if it has one and by computing it otherwise. Returns 0 on success.
+ */
 int load_pack_revindex(struct packed_git *p);
+void close_pack_revindex(struct packed_git *p);
+
+/*
+ * Returns the position in pack order of the object at offset "ofs" of
+ * "p", loading the reverse index if needed, or -1 if there is no object
+ * there. The pack trailer counts as position "p->num_objects".
+ */
 int find_revindex_position(struct packed_git *p, off_t ofs);
 
-struct revindex_entry *find_pack_revindex(struct packed_git *p, off_t ofs);
+/*
+ * Translate the position "pos" in pack order into the position of the
+ * object in the pack index and into its offset in the pack. The reverse
+ * index must have been loaded; pack_pos_to_offset() also accepts the
+ * position of the pack trailer, which gives the end of the last object.
+ */
+uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos);
+off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos);
 
 #endif
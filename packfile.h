@@ -152,6 +152,15 @@ unsigned long unpack_object_header_buffer(const unsigned char *buf, unsigned lon
 unsigned long get_size_from_delta(struct packed_git *, struct pack_window **, off_t);
 int unpack_object_header(struct packed_git *, struct pack_window **, off_t *, unsigned long *);
 
+/*
+ * Parse the base of the delta object at "delta_obj_offset", whose header
+ * ends at "*curpos", and return its offset (or 0 if it is invalid),
+ * advancing "*curpos" past the base reference.
+ */
+off_t get_delta_base(struct packed_git *p, struct pack_window **w_curs,
+		     off_t *curpos, enum object_type type,
+		     off_t delta_obj_offset);
+
 void release_pack_memory(size_t);
 
 /* global flag to enable extra checks when accessing packed objects */
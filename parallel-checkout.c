@@ -0,0 +1,517 @@
+#include "cache.h"
+#include "config.h"
+#include "parallel-checkout.h"
+#include "pkt-line.h"
+#include "run-command.h"
+#include "streaming.h"
+#include "thread-utils.h"
+
+struct parallel_checkout {
+	enum pc_status status;
+	struct parallel_checkout_item *items;
+	size_t nr, alloc;
+};
+
+static struct parallel_checkout parallel_checkout;
+
+enum pc_status parallel_checkout_status(void)
+{
+	return parallel_checkout.status;
+}
+
+#define DEFAULT_THRESHOLD_FOR_PARALLELISM 100
+
+void get_parallel_checkout_configs(int *num_workers, int *threshold)
+{
+	char *env_workers = getenv("GIT_TEST_CHECKOUT_WORKERS");
+
+	if (env_workers && *env_workers) {
+		if (strtol_i(env_workers, 10, num_workers))
+			die(_("invalid value for GIT_TEST_CHECKOUT_WORKERS: '%s'"),
+			    env_workers);
+		if (*num_workers < 1)
+			*num_workers = online_cpus();
+		*threshold = 0;
+		return;
+	}
+
+	if (git_config_get_int("checkout.workers", num_workers))
+		*num_workers = 1;
+	else if (*num_workers < 1)
+		*num_workers = online_cpus();
+
+	if (git_config_get_int("checkout.thresholdForParallelism", threshold))
+		*threshold = DEFAULT_THRESHOLD_FOR_PARALLELISM;
+}
+
+void init_parallel_checkout(void)
+{
+	if (parallel_checkout.status != PC_UNINITIALIZED)
+		BUG("parallel checkout already initialized");
+
+	parallel_checkout.status = PC_ACCEPTING_ENTRIES;
+}
+
+static void finish_parallel_checkout(void)
+{
+	if (parallel_checkout.status == PC_UNINITIALIZED)
+		BUG("cannot finish parallel checkout: not initialized yet");
+
+	free(parallel_checkout.items);
+	memset(&parallel_checkout, 0, sizeof(parallel_checkout));
+}
+
+static int is_eligible_for_parallel_checkout(const struct cache_entry *ce,
+					     const struct conv_attrs *ca)
+{
+	size_t packed_len = sizeof(struct pc_item_fixed_portion) + ce->ce_namelen;
+
+	switch (ce->ce_mode & S_IFMT) {
+	case S_IFREG:
+		/*
+		 * Smudge filters may be delayed or run as long-running
+		 * processes, which are tied to the main process.
+		 */
+		if (!ca || ca->drv)
+			return 0;
+		if (ca->working_tree_encoding)
+			packed_len += strlen(ca->working_tree_encoding);
+		break;
+	case S_IFLNK:
+		break;
+	default:
+		return 0;
+	}
+
+	return packed_len <= LARGE_PACKET_DATA_MAX;
+}
+
+int enqueue_checkout(struct cache_entry *ce, const struct conv_attrs *ca)
+{
+	struct parallel_checkout_item *pc_item;
+
+	if (parallel_checkout.status != PC_ACCEPTING_ENTRIES ||
+	    !is_eligible_for_parallel_checkout(ce, ca))
+		return -1;
+
+	ALLOC_GROW(parallel_checkout.items, parallel_checkout.nr + 1,
+		   parallel_checkout.alloc);
+
+	pc_item = &parallel_checkout.items[parallel_checkout.nr];
+	memset(pc_item, 0, sizeof(*pc_item));
+	pc_item->id = parallel_checkout.nr++;
+	pc_item->ce = ce;
+	if (ca)
+		memcpy(&pc_item->ca, ca, sizeof(pc_item->ca));
+	pc_item->status = PC_ITEM_PENDING;
+
+	return 0;
+}
+
+static int reset_fd(int fd, const char *path)
+{
+	if (lseek(fd, 0, SEEK_SET) != 0)
+		return error_errno("failed to rewind descriptor of %s", path);
+	if (ftruncate(fd, 0))
+		return error_errno("failed to truncate file %s", path);
+	return 0;
+}
+
+static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd)
+{
+	struct cache_entry *ce = pc_item->ce;
+	struct stream_filter *filter = NULL;
+	struct strbuf buf = STRBUF_INIT;
+	unsigned long size;
+	size_t newsize;
+	void *blob;
+	ssize_t wrote;
+
+	if (S_ISREG(ce->ce_mode))
+		filter = get_stream_filter_ca(&pc_item->ca, &ce->oid);
+	if (filter) {
+		if (stream_blob_to_fd(fd, &ce->oid, filter, 1)) {
+			/* On error, reset fd to try writing without streaming */
+			if (reset_fd(fd, ce->name))
+				return -1;
+		} else {
+			return 0;
+		}
+	}
+
+	blob = read_blob_entry(ce, &size);
+	if (!blob)
+		return error("unable to read sha1 file of %s (%s)",
+			     ce->name, oid_to_hex(&ce->oid));
+
+	if (S_ISREG(ce->ce_mode) &&
+	    convert_to_working_tree_ca(&pc_item->ca, ce->name, blob, size, &buf)) {
+		free(blob);
+		blob = strbuf_detach(&buf, &newsize);
+		size = newsize;
+	}
+
+	wrote = write_in_full(fd, blob, size);
+	free(blob);
+	if (wrote < 0)
+		return error("unable to write file %s", ce->name);
+
+	return 0;
+}
+
+static int close_and_clear(int *fd)
+{
+	int ret = 0;
+
+	if (*fd >= 0) {
+		ret = close(*fd);
+		*fd = -1;
+	}
+
+	return ret;
+}
+
+static int write_pc_symlink(struct parallel_checkout_item *pc_item)
+{
+	struct cache_entry *ce = pc_item->ce;
+	unsigned long size;
+	char *target = read_blob_entry(ce, &size);
+
+	if (!target)
+		return error("unable to read sha1 file of %s (%s)",
+			     ce->name, oid_to_hex(&ce->oid));
+
+	if (symlink(target, ce->name)) {
+		free(target);
+		if (errno == EEXIST) {
+			pc_item->status = PC_ITEM_COLLIDED;
+			return 0;
+		}
+		return error_errno("unable to create symlink %s", ce->name);
+	}
+	free(target);
+
+	if (lstat(ce->name, &pc_item->st) < 0)
+		return error_errno("unable to stat just-written file %s",
+				   ce->name);
+	return 0;
+}
+
+void write_pc_item(struct parallel_checkout_item *pc_item)
+{
+	struct cache_entry *ce = pc_item->ce;
+	unsigned int mode;
+	int fd = -1, fstat_done = 0;
+
+	if (S_ISLNK(ce->ce_mode) && has_symlinks) {
+		if (write_pc_symlink(pc_item))
+			pc_item->status = PC_ITEM_FAILED;
+		else if (pc_item->status != PC_ITEM_COLLIDED)
+			pc_item->status = PC_ITEM_WRITTEN;
+		return;
+	}
+
+	/*
+	 * Without symlink support, a symlink is written out as a regular
+	 * file holding the symlink destination, as write_entry() does.
+	 */
+	mode = (S_ISREG(ce->ce_mode) && (ce->ce_mode & 0100)) ? 0777 : 0666;
+	fd = open(ce->name, O_WRONLY | O_CREAT | O_EXCL, mode);
+	if (fd < 0) {
+		if (errno == EEXIST || errno == EISDIR) {
+			pc_item->status = PC_ITEM_COLLIDED;
+			return;
+		}
+		error_errno("unable to create file %s", ce->name);
+		goto err;
+	}
+
+	if (write_pc_item_to_fd(pc_item, fd))
+		goto err_unlink;
+
+	if (fstat_is_reliable()) {
+		if (fstat(fd, &pc_item->st) < 0) {
+			error_errno("unable to stat just-written file %s",
+				    ce->name);
+			goto err_unlink;
+		}
+		fstat_done = 1;
+	}
+
+	if (close_and_clear(&fd)) {
+		error_errno("unable to close file %s", ce->name);
+		goto err_unlink;
+	}
+
+	if (!fstat_done && lstat(ce->name, &pc_item->st) < 0) {
+		error_errno("unable to stat just-written file %s", ce->name);
+		goto err;
+	}
+
+	pc_item->status = PC_ITEM_WRITTEN;
+	return;
+
+err_unlink:
+	close_and_clear(&fd);
+	unlink(ce->name);
+err:
+	pc_item->status = PC_ITEM_FAILED;
+}
+
+static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
+{
+	size_t len_data;
+	char *data, *variant;
+	struct pc_item_fixed_portion *fixed_portion;
+	const char *working_tree_encoding = pc_item->ca.working_tree_encoding;
+	size_t name_len = pc_item->ce->ce_namelen;
+	size_t working_tree_encoding_len = working_tree_encoding ?
+					   strlen(working_tree_encoding) : 0;
+
+	len_data = sizeof(struct pc_item_fixed_portion) + name_len +
+		   working_tree_encoding_len;
+
+	data = xcalloc(1, len_data);
+
+	fixed_portion = (struct pc_item_fixed_portion *)data;
+	fixed_portion->id = pc_item->id;
+	oidcpy(&fixed_portion->oid, &pc_item->ce->oid);
+	fixed_portion->ce_mode = pc_item->ce->ce_mode;
+	fixed_portion->crlf_action = pc_item->ca.crlf_action;
+	fixed_portion->ident = pc_item->ca.ident;
+	fixed_portion->name_len = name_len;
+	fixed_portion->working_tree_encoding_len = working_tree_encoding_len;
+
+	variant = data + sizeof(*fixed_portion);
+	if (working_tree_encoding_len) {
+		memcpy(variant, working_tree_encoding, working_tree_encoding_len);
+		variant += working_tree_encoding_len;
+	}
+	memcpy(variant, pc_item->ce->name, name_len);
+
+	packet_write(fd, data, len_data);
+
+	free(data);
+}
+
+struct pc_worker {
+	struct child_process cp;
+	size_t next_item_to_complete, nr_items_to_complete;
+};
+
+static void setup_workers(struct pc_worker *workers, int num_workers)
+{
+	size_t base_batch_size, batch_beginning = 0;
+	int i;
+
+	/* Distribute the items to the workers in contiguous chunks. */
+	base_batch_size = parallel_checkout.nr / num_workers;
+
+	for (i = 0; i < num_workers; i++) {
+		struct pc_worker *worker = &workers[i];
+		struct child_process *cp = &worker->cp;
+		size_t batch_size = base_batch_size, j;
+
+		/* distribute the remainder evenly */
+		if (i < parallel_checkout.nr % num_workers)
+			batch_size++;
+
+		child_process_init(cp);
+		cp->git_cmd = 1;
+		cp->in = -1;
+		cp->out = -1;
+		cp->clean_on_exit = 1;
+		argv_array_push(&cp->args, "checkout--worker");
+
+		if (start_command(cp))
+			die(_("failed to spawn checkout worker"));
+
+		worker->next_item_to_complete = batch_beginning;
+		worker->nr_items_to_complete = batch_size;
+
+		for (j = batch_beginning; j < batch_beginning + batch_size; j++)
+			send_one_item(cp->in, &parallel_checkout.items[j]);
+		packet_flush(cp->in);
+		close(cp->in);
+		cp->in = -1;
+
+		batch_beginning += batch_size;
+	}
+}
+
+static int finish_workers(struct pc_worker *workers, int num_workers)
+{
+	int i, errs = 0;
+
+	for (i = 0; i < num_workers; i++) {
+		struct child_process *cp = &workers[i].cp;
+		if (cp->out >= 0)
+			close(cp->out);
+		if (finish_command(cp))
+			errs = 1;
+	}
+
+	return errs;
+}
+
+static void parse_and_save_result(const char *buffer, int len,
+				  struct pc_worker *worker)
+{
+	struct pc_item_result *res;
+	struct parallel_checkout_item *pc_item;
+
+	if (len != sizeof(struct pc_item_result))
+		BUG("checkout worker sent a result of unexpected size %d", len);
+
+	res = (struct pc_item_result *)buffer;
+
+	/*
+	 * Worker's results come in the order in which its items were
+	 * sent.
+	 */
+	if (!worker->nr_items_to_complete ||
+	    res->id != worker->next_item_to_complete)
+		BUG("checkout worker sent an unexpected result for item %"PRIuMAX,
+		    (uintmax_t)res->id);
+	worker->next_item_to_complete++;
+	worker->nr_items_to_complete--;
+
+	pc_item = &parallel_checkout.items[res->id];
+	pc_item->status = res->status;
+	if (res->status == PC_ITEM_WRITTEN)
+		memcpy(&pc_item->st, &res->st, sizeof(pc_item->st));
+}
+
+static void gather_results_from_workers(struct pc_worker *workers,
+					int num_workers)
+{
+	int i, active_workers = num_workers;
+	struct pollfd *pfds;
+
+	pfds = xcalloc(num_workers, sizeof(*pfds));
+	for (i = 0; i < num_workers; i++) {
+		pfds[i].fd = workers[i].cp.out;
+		pfds[i].events = POLLIN;
+	}
+
+	while (active_workers) {
+		int nr = poll(pfds, num_workers, -1);
+
+		if (nr < 0) {
+			if (errno == EINTR)
+				continue;
+			die_errno(_("failed to poll checkout workers"));
+		}
+
+		for (i = 0; i < num_workers && nr > 0; i++) {
+			struct pc_worker *worker = &workers[i];
+			struct pollfd *pfd = &pfds[i];
+			char buffer[LARGE_PACKET_MAX];
+			int len;
+
+			if (!pfd->revents)
+				continue;
+			nr--;
+
+			if (pfd->revents & POLLNVAL)
+				BUG("invalid checkout worker file descriptor");
+
+			len = packet_read(pfd->fd, NULL, NULL, buffer,
+					  sizeof(buffer),
+					  PACKET_READ_GENTLE_ON_EOF);
+			if (len > 0) {
+				parse_and_save_result(buffer, len, worker);
+				continue;
+			}
+
+			/* The worker is done, or died. */
+			active_workers--;
+			close(pfd->fd);
+			worker->cp.out = -1;
+			pfd->fd = -1;
+		}
+	}
+
+	free(pfds);
+}
+
+static int run_workers(int num_workers)
+{
+	struct pc_worker *workers;
+	int errs;
+
+	ALLOC_ARRAY(workers, num_workers);
+
+	setup_workers(workers, num_workers);
+	gather_results_from_workers(workers, num_workers);
+	errs = finish_workers(workers, num_workers);
+
+	free(workers);
+	return errs;
+}
+
+static void write_items_sequentially(void)
+{
+	size_t i;
+
+	for (i = 0; i < parallel_checkout.nr; i++)
+		write_pc_item(&parallel_checkout.items[i]);
+}
+
+static int handle_results(struct checkout *state)
+{
+	int errs = 0;
+	size_t i;
+
+	for (i = 0; i < parallel_checkout.nr; i++) {
+		struct parallel_checkout_item *pc_item = &parallel_checkout.items[i];
+
+		switch (pc_item->status) {
+		case PC_ITEM_WRITTEN:
+			update_ce_after_write(state, pc_item->ce, &pc_item->st);
+			break;
+		case PC_ITEM_COLLIDED:
+			/*
+			 * Let checkout_entry() deal with whatever is in the
+			 * way, as it would have without parallel checkout.
+			 */
+			errs |= checkout_entry(pc_item->ce, state, NULL, NULL);
+			break;
+		case PC_ITEM_PENDING:
+			/* The worker died before reporting this item. */
+			errs |= error(_("checkout worker did not write '%s'"),
+				      pc_item->ce->name);
+			break;
+		case PC_ITEM_FAILED:
+			errs = 1;
+			break;
+		default:
+			BUG("unknown checkout item status in parallel checkout");
+		}
+	}
+
+	return errs;
+}
+
+int run_parallel_checkout(struct checkout *state, int num_workers, int threshold)
+{
+	int errs = 0;
+
+	if (parallel_checkout.status != PC_ACCEPTING_ENTRIES)
+		BUG("cannot run parallel checkout: uninitialized or already running");
+
+	parallel_checkout.status = PC_RUNNING;
+
+	if (parallel_checkout.nr < num_workers)
+		num_workers = parallel_checkout.nr;
+
+	if (num_workers <= 1 || parallel_checkout.nr < threshold)
+		write_items_sequentially();
+	else
+		errs |= run_workers(num_workers);
+
+	errs |= handle_results(state);
+
+	finish_parallel_checkout();
+	return errs;
+}
@@ -0,0 +1,111 @@
+#ifndef PARALLEL_CHECKOUT_H
+#define PARALLEL_CHECKOUT_H
+
+#include "cache.h"
+#include "convert.h"
+
+struct checkout;
+
+/*
+ * Parallel checkout writes out the entries queued by checkout_entry()
+ * using a pool of "git checkout--worker" processes, which read the
+ * blobs, convert them to their working tree form, write them out, and
+ * send the stat data of the resulting files back, so that the index can
+ * be updated.
+ *
+ * Only regular files (without smudge filters, so that no delayed or
+ * long-running filter process is involved) and symlinks are queued; all
+ * other entries keep being written out right away by checkout_entry().
+ */
+
+enum pc_status {
+	PC_UNINITIALIZED = 0,
+	PC_ACCEPTING_ENTRIES,
+	PC_RUNNING,
+};
+
+enum pc_status parallel_checkout_status(void);
+
+/*
+ * Read the number of workers to use and the minimum number of queued
+ * entries for which they are worth spawning, from "checkout.workers"
+ * and "checkout.thresholdForParallelism" (or GIT_TEST_CHECKOUT_WORKERS).
+ */
+void get_parallel_checkout_configs(int *num_workers, int *threshold);
+
+/* Start accepting entries from checkout_entry(). */
+void init_parallel_checkout(void);
+
+/*
+ * Queue the entry to be written out by run_parallel_checkout(), after
+ * the caller has made room for it in the working tree. The conversion
+ * attributes, which must have been looked up for regular files, are
+ * copied. Returns 0 if the entry was queued, and -1 if it must be
+ * written out right away instead.
+ */
+int enqueue_checkout(struct cache_entry *ce, const struct conv_attrs *ca);
+
+/*
+ * Write out all queued entries and update their index entries, and stop
+ * accepting entries. Workers are only spawned if there are at least
+ * "threshold" entries; otherwise (or if "num_workers" is at most 1)
+ * the entries are written out by the calling process. Entries whose
+ * path turned out to be taken, e.g. by another entry on a
+ * case-insensitive file system, are retried with checkout_entry().
+ * Returns 0 on success, non-zero if any entry could not be written.
+ */
+int run_parallel_checkout(struct checkout *state, int num_workers, int threshold);
+
+/*
+ * The following are shared with builtin/checkout--worker.c only.
+ */
+
+enum pc_item_status {
+	PC_ITEM_PENDING = 0,
+	PC_ITEM_WRITTEN,
+	/*
+	 * The path could not be created because something (presumably
+	 * another entry of the checkout) is already there.
+	 */
+	PC_ITEM_COLLIDED,
+	PC_ITEM_FAILED,
+};
+
+struct parallel_checkout_item {
+	/* Position of the item in the queue of the main process. */
+	size_t id;
+	struct cache_entry *ce;
+	struct conv_attrs ca;
+	enum pc_item_status status;
+	struct stat st;
+};
+
+/*
+ * An item is sent to a worker as a packet holding this struct, followed
+ * by the working tree encoding (without its terminating NUL) and the
+ * path of the entry.
+ */
+struct pc_item_fixed_portion {
+	size_t id;
+	struct object_id oid;
+	unsigned int ce_mode;
+	enum crlf_action crlf_action;
+	int ident;
+	size_t working_tree_encoding_len;
+	size_t name_len;
+};
+
+/* A worker answers each item with a packet holding this struct. */
+struct pc_item_result {
+	size_t id;
+	enum pc_item_status status;
+	struct stat st;
+};
+
+/*
+ * Write out the item to the working tree, and set its status and, if it
+ * was written, its stat data.
+ */
+void write_pc_item(struct parallel_checkout_item *pc_item);
+
+#endif /* PARALLEL_CHECKOUT_H */
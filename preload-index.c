@@ -8,16 +8,20 @@
 #include "config.h"
 #include "progress.h"
 #include "thread-utils.h"
+#include "task-pool.h"
 #include "repository.h"
 
 /*
  * Mostly randomly chosen maximum thread counts: we
  * cap the parallelism to 20 threads, and we want
  * to have at least 500 lstat's per thread for it to
- * be worth starting a thread.
+ * be worth starting a thread.  The work is handed out
+ * in smaller chunks, so that threads that are done early
+ * can help the others.
  */
 #define MAX_PARALLEL (20)
 #define THREAD_COST (500)
+#define CHUNK_SIZE (THREAD_COST / 4)
 
 struct progress_data {
 	unsigned long n;
@@ -25,29 +29,24 @@ struct progress_data {
 	pthread_mutex_t mutex;
 };
 
-struct thread_data {
-	pthread_t pthread;
+struct preload_data {
 	struct index_state *index;
-	struct pathspec pathspec;
 	struct progress_data *progress;
-	int offset, nr;
+	/* one of each for every thread */
+	struct pathspec *pathspec;
+	struct cache_def *cache;
 };
 
-static void *preload_thread(void *_data)
+static void preload_chunk(size_t begin, size_t end, int worker, void *_data)
 {
-	int nr, last_nr;
-	struct thread_data *p = _data;
+	struct preload_data *p = _data;
 	struct index_state *index = p->index;
-	struct cache_entry **cep = index->cache + p->offset;
-	struct cache_def cache = CACHE_DEF_INIT;
+	struct pathspec *pathspec = &p->pathspec[worker];
+	struct cache_def *cache = &p->cache[worker];
+	size_t i;
 
-	nr = p->nr;
-	if (nr + p->offset > index->cache_nr)
-		nr = index->cache_nr - p->offset;
-	last_nr = nr;
-
-	do {
-		struct cache_entry *ce = *cep++;
+	for (i = begin; i < end; i++) {
+		struct cache_entry *ce = index->cache[i];
 		struct stat st;
 
 		if (ce_stage(ce))
@@ -60,18 +59,9 @@ static void *preload_thread(void *_data)
 			continue;
 		if (ce->ce_flags & CE_FSMONITOR_VALID)
 			continue;
-		if (p->progress && !(nr & 31)) {
-			struct progress_data *pd = p->progress;
-
-			pthread_mutex_lock(&pd->mutex);
-			pd->n += last_nr - nr;
-			display_progress(pd->progress, pd->n);
-			pthread_mutex_unlock(&pd->mutex);
-			last_nr = nr;
-		}
-		if (!ce_path_match(index, ce, &p->pathspec, NULL))
+		if (!ce_path_match(index, ce, pathspec, NULL))
 			continue;
-		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
+		if (threaded_has_symlink_leading_path(cache, ce->name, ce_namelen(ce)))
 			continue;
 		if (lstat(ce->name, &st))
 			continue;
@@ -79,24 +69,23 @@ static void *preload_thread(void *_data)
 			continue;
 		ce_mark_uptodate(ce);
 		mark_fsmonitor_valid(index, ce);
-	} while (--nr > 0);
+	}
 	if (p->progress) {
 		struct progress_data *pd = p->progress;
 
 		pthread_mutex_lock(&pd->mutex);
-		display_progress(pd->progress, pd->n + last_nr);
+		pd->n += end - begin;
+		display_progress(pd->progress, pd->n);
 		pthread_mutex_unlock(&pd->mutex);
 	}
-	cache_def_clear(&cache);
-	return NULL;
 }
 
 void preload_index(struct index_state *index,
 		   const struct pathspec *pathspec,
 		   unsigned int refresh_flags)
 {
-	int threads, i, work, offset;
-	struct thread_data data[MAX_PARALLEL];
+	int threads, i;
+	struct preload_data data;
 	struct progress_data pd;
 
 	if (!HAVE_THREADS || !core_preload_index)
@@ -110,39 +99,36 @@ void preload_index(struct index_state *index,
 	trace_performance_enter();
 	if (threads > MAX_PARALLEL)
 		threads = MAX_PARALLEL;
-	offset = 0;
-	work = DIV_ROUND_UP(index->cache_nr, threads);
+
 	memset(&data, 0, sizeof(data));
+	data.index = index;
+	data.pathspec = xcalloc(threads, sizeof(*data.pathspec));
+	data.cache = xcalloc(threads, sizeof(*data.cache));
+	for (i = 0; i < threads; i++) {
+		struct cache_def cache = CACHE_DEF_INIT;
+
+		if (pathspec)
+			copy_pathspec(&data.pathspec[i], pathspec);
+		data.cache[i] = cache;
+	}
 
 	memset(&pd, 0, sizeof(pd));
 	if (refresh_flags & REFRESH_PROGRESS && isatty(2)) {
 		pd.progress = start_delayed_progress(_("Refreshing index"), index->cache_nr);
 		pthread_mutex_init(&pd.mutex, NULL);
+		data.progress = &pd;
 	}
 
-	for (i = 0; i < threads; i++) {
-		struct thread_data *p = data+i;
-		int err;
+	parallel_for("preload-index", threads, index->cache_nr, CHUNK_SIZE,
+		     preload_chunk, &data);
+	stop_progress(&pd.progress);
 
-		p->index = index;
-		if (pathspec)
-			copy_pathspec(&p->pathspec, pathspec);
-		p->offset = offset;
-		p->nr = work;
-		if (pd.progress)
-			p->progress = &pd;
-		offset += work;
-		err = pthread_create(&p->pthread, NULL, preload_thread, p);
-
-		if (err)
-			die(_("unable to create threaded lstat: %s"), strerror(err));
-	}
 	for (i = 0; i < threads; i++) {
-		struct thread_data *p = data+i;
-		if (pthread_join(p->pthread, NULL))
-			die("unable to join threaded lstat");
+		clear_pathspec(&data.pathspec[i]);
+		cache_def_clear(&data.cache[i]);
 	}
-	stop_progress(&pd.progress);
+	free(data.pathspec);
+	free(data.cache);
 
 	trace_performance_leave("preload index");
 }
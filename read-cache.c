@@ -23,7 +23,9 @@
 #include "split-index.h"
 #include "utf8.h"
 #include "fsmonitor.h"
+#include "sparse-index.h"
 #include "thread-utils.h"
+#include "task-pool.h"
 #include "progress.h"
 
 /* Mask for the name length in ce_flags in the on-disk index */
@@ -47,6 +49,7 @@
 #define CACHE_EXT_FSMONITOR 0x46534D4E	  /* "FSMN" */
 #define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
 #define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
+#define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972 /* "sdir" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
@@ -560,6 +563,24 @@ static int index_name_stage_pos(const struct index_state *istate, const char *na
 		}
 		first = next+1;
 	}
+
+	if (istate->sparse_index && first > 0) {
+		struct cache_entry *ce = istate->cache[first - 1];
+
+		/*
+		 * The path lies within a sparse directory entry, so it
+		 * has no entry of its own until the index is expanded.
+		 * This happens at most once, as the index is full after
+		 * that; the expansion does not change what the index
+		 * describes, hence the cast.
+		 */
+		if (S_ISSPARSEDIR(ce->ce_mode) &&
+		    ce_namelen(ce) < namelen &&
+		    !memcmp(name, ce->name, ce_namelen(ce))) {
+			ensure_full_index((struct index_state *)istate);
+			return index_name_stage_pos(istate, name, namelen, stage);
+		}
+	}
 	return -first-1;
 }
 
@@ -989,8 +1010,14 @@ int verify_path(const char *path, unsigned mode)
 
 			c = *path++;
 			if ((c == '.' && !verify_dotfile(path, mode)) ||
-			    is_dir_sep(c) || c == '\0')
+			    is_dir_sep(c))
 				return 0;
+			/*
+			 * Only the sparse directory entries of a sparse
+			 * index end with a directory separator.
+			 */
+			if (c == '\0')
+				return S_ISDIR(mode);
 		}
 		c = *path++;
 	}
@@ -1712,6 +1739,10 @@ static int read_index_extension(struct index_state *istate,
 	case CACHE_EXT_FSMONITOR:
 		read_fsmonitor_extension(istate, data, sz);
 		break;
+	case CACHE_EXT_SPARSE_DIRECTORIES:
+		/* no content, only an indication that this is a sparse index */
+		istate->sparse_index = 1;
+		break;
 	case CACHE_EXT_ENDOFINDEXENTRIES:
 	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
 		/* already handled in do_read_index() */
@@ -1880,6 +1911,10 @@ static void post_read_index_from(struct index_state *istate)
 	tweak_untracked_cache(istate);
 	tweak_split_index(istate);
 	tweak_fsmonitor(istate);
+
+	if (istate->sparse_index &&
+	    (command_requires_full_index || !sparse_index_enabled()))
+		ensure_full_index(istate);
 }
 
 static size_t estimate_cache_size_from_compressed(unsigned int entries)
@@ -1918,7 +1953,6 @@ static void write_eoie_extension(struct strbuf *sb, git_hash_ctx *eoie_context,
 
 struct load_index_extensions
 {
-	pthread_t pthread;
 	struct index_state *istate;
 	const char *mmap;
 	size_t mmap_size;
@@ -1952,6 +1986,11 @@ static void *load_index_extensions(void *_data)
 	return NULL;
 }
 
+static void load_index_extensions_task(void *data, int worker)
+{
+	load_index_extensions(data);
+}
+
 /*
  * A helper function that will load the specified range of cache entries
  * from the memory mapped file and add them to the given index.
@@ -2005,43 +2044,48 @@ static unsigned long load_all_cache_entries(struct index_state *istate,
 
 #define THREAD_COST		(10000)
 
-struct load_cache_entries_thread_data
+struct load_cache_entries_data
 {
-	pthread_t pthread;
 	struct index_state *istate;
-	struct mem_pool *ce_mem_pool;
-	int offset;
 	const char *mmap;
-	struct index_entry_offset_table *ieot;
-	int ieot_start;		/* starting index into the ieot array */
-	int ieot_blocks;	/* count of ieot entries to process */
-	unsigned long consumed;	/* return # of bytes in index file processed */
+	size_t pool_size;		/* initial size of each mem_pool */
+	struct mem_pool **ce_mem_pools;	/* one for each worker */
 };
 
-/*
- * A thread proc to run the load_cache_entries() computation
- * across multiple background threads.
- */
-static void *load_cache_entries_thread(void *_data)
+struct load_cache_entries_block
 {
-	struct load_cache_entries_thread_data *p = _data;
-	int i;
+	struct load_cache_entries_data *data;
+	int offset;			/* index of the first cache entry */
+	struct index_entry_offset *ieot_entry;
+	unsigned long consumed;		/* # of bytes in index file processed */
+};
 
-	/* iterate across all ieot blocks assigned to this thread */
-	for (i = p->ieot_start; i < p->ieot_start + p->ieot_blocks; i++) {
-		p->consumed += load_cache_entry_block(p->istate, p->ce_mem_pool,
-			p->offset, p->ieot->entries[i].nr, p->mmap, p->ieot->entries[i].offset, NULL);
-		p->offset += p->ieot->entries[i].nr;
-	}
-	return NULL;
+static void load_cache_entries_block_task(void *_block, int worker)
+{
+	struct load_cache_entries_block *b = _block;
+	struct load_cache_entries_data *d = b->data;
+
+	mem_pool_init(&d->ce_mem_pools[worker], d->pool_size);
+	b->consumed = load_cache_entry_block(d->istate, d->ce_mem_pools[worker],
+					     b->offset, b->ieot_entry->nr, d->mmap,
+					     b->ieot_entry->offset, NULL);
 }
 
+/*
+ * Load the ieot blocks as tasks of "pool", which has "nr_threads"
+ * workers, and wait for all tasks of the pool to finish.  Blocks take
+ * very different times to load when some of them hold much longer
+ * paths than others; idle workers steal the remaining blocks of busy
+ * ones.
+ */
 static unsigned long load_cache_entries_threaded(struct index_state *istate, const char *mmap, size_t mmap_size,
-						 int nr_threads, struct index_entry_offset_table *ieot)
+						 struct task_pool *pool, int nr_threads,
+						 struct index_entry_offset_table *ieot)
 {
-	int i, offset, ieot_blocks, ieot_start, err;
-	struct load_cache_entries_thread_data *data;
+	struct load_cache_entries_data data;
+	struct load_cache_entries_block *blocks;
 	unsigned long consumed = 0;
+	int i, offset = 0, nr = DIV_ROUND_UP(istate->cache_nr, nr_threads);
 
 	/* a little sanity checking */
 	if (istate->name_hash_initialized)
@@ -2049,60 +2093,34 @@ static unsigned long load_cache_entries_threaded(struct index_state *istate, con
 
 	mem_pool_init(&istate->ce_mem_pool, 0);
 
-	/* ensure we have no more threads than we have blocks to process */
-	if (nr_threads > ieot->nr)
-		nr_threads = ieot->nr;
-	data = xcalloc(nr_threads, sizeof(*data));
-
-	offset = ieot_start = 0;
-	ieot_blocks = DIV_ROUND_UP(ieot->nr, nr_threads);
-	for (i = 0; i < nr_threads; i++) {
-		struct load_cache_entries_thread_data *p = &data[i];
-		int nr, j;
-
-		if (ieot_start + ieot_blocks > ieot->nr)
-			ieot_blocks = ieot->nr - ieot_start;
-
-		p->istate = istate;
-		p->offset = offset;
-		p->mmap = mmap;
-		p->ieot = ieot;
-		p->ieot_start = ieot_start;
-		p->ieot_blocks = ieot_blocks;
-
-		/* create a mem_pool for each thread */
-		nr = 0;
-		for (j = p->ieot_start; j < p->ieot_start + p->ieot_blocks; j++)
-			nr += p->ieot->entries[j].nr;
-		if (istate->version == 4) {
-			mem_pool_init(&p->ce_mem_pool,
-				estimate_cache_size_from_compressed(nr));
-		} else {
-			mem_pool_init(&p->ce_mem_pool,
-				estimate_cache_size(mmap_size, nr));
-		}
+	data.istate = istate;
+	data.mmap = mmap;
+	if (istate->version == 4)
+		data.pool_size = estimate_cache_size_from_compressed(nr);
+	else
+		data.pool_size = estimate_cache_size(mmap_size, nr);
+	data.ce_mem_pools = xcalloc(nr_threads, sizeof(*data.ce_mem_pools));
 
-		err = pthread_create(&p->pthread, NULL, load_cache_entries_thread, p);
-		if (err)
-			die(_("unable to create load_cache_entries thread: %s"), strerror(err));
+	ALLOC_ARRAY(blocks, ieot->nr);
+	for (i = 0; i < ieot->nr; i++) {
+		struct load_cache_entries_block *b = &blocks[i];
 
-		/* increment by the number of cache entries in the ieot block being processed */
-		for (j = 0; j < ieot_blocks; j++)
-			offset += ieot->entries[ieot_start + j].nr;
-		ieot_start += ieot_blocks;
+		b->data = &data;
+		b->offset = offset;
+		b->ieot_entry = &ieot->entries[i];
+		task_pool_add(pool, load_cache_entries_block_task, b);
+		offset += ieot->entries[i].nr;
 	}
+	task_pool_finish(pool);
 
-	for (i = 0; i < nr_threads; i++) {
-		struct load_cache_entries_thread_data *p = &data[i];
+	for (i = 0; i < nr_threads; i++)
+		if (data.ce_mem_pools[i])
+			mem_pool_combine(istate->ce_mem_pool, data.ce_mem_pools[i]);
+	for (i = 0; i < ieot->nr; i++)
+		consumed += blocks[i].consumed;
 
-		err = pthread_join(p->pthread, NULL);
-		if (err)
-			die(_("unable to join load_cache_entries thread: %s"), strerror(err));
-		mem_pool_combine(istate->ce_mem_pool, p->ce_mem_pool);
-		consumed += p->consumed;
-	}
-
-	free(data);
+	free(data.ce_mem_pools);
+	free(blocks);
 
 	return consumed;
 }
@@ -2120,6 +2138,7 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	size_t extension_offset = 0;
 	int nr_threads, cpus;
 	struct index_entry_offset_table *ieot = NULL;
+	struct task_pool *pool = NULL;
 
 	if (istate->initialized)
 		return istate->cache_nr;
@@ -2179,14 +2198,9 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	if (nr_threads > 1) {
 		extension_offset = read_eoie_extension(mmap, mmap_size);
 		if (extension_offset) {
-			int err;
-
+			pool = task_pool_start("read-index", nr_threads);
 			p.src_offset = extension_offset;
-			err = pthread_create(&p.pthread, NULL, load_index_extensions, &p);
-			if (err)
-				die(_("unable to create load_index_extensions thread: %s"), strerror(err));
-
-			nr_threads--;
+			task_pool_add(pool, load_index_extensions_task, &p);
 		}
 	}
 
@@ -2194,25 +2208,25 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	 * Locate and read the index entry offset table so that we can use it
 	 * to multi-thread the reading of the cache entries.
 	 */
-	if (extension_offset && nr_threads > 1)
+	if (extension_offset)
 		ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
 
 	if (ieot) {
-		src_offset += load_cache_entries_threaded(istate, mmap, mmap_size, nr_threads, ieot);
+		/* this also waits for the extensions to be loaded */
+		src_offset += load_cache_entries_threaded(istate, mmap, mmap_size,
+							  pool, nr_threads, ieot);
 		free(ieot);
 	} else {
 		src_offset += load_all_cache_entries(istate, mmap, mmap_size, src_offset);
+		if (pool)
+			task_pool_finish(pool);
 	}
 
 	istate->timestamp.sec = st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
 
-	/* if we created a thread, join it otherwise load the extensions on the primary thread */
-	if (extension_offset) {
-		int ret = pthread_join(p.pthread, NULL);
-		if (ret)
-			die(_("unable to join load_index_extensions thread: %s"), strerror(ret));
-	} else {
+	/* if we did not load the extensions in the pool, load them now */
+	if (!extension_offset) {
 		p.src_offset = src_offset;
 		load_index_extensions(&p);
 	}
@@ -2327,6 +2341,7 @@ int discard_index(struct index_state *istate)
 	cache_tree_free(&(istate->cache_tree));
 	istate->initialized = 0;
 	istate->fsmonitor_has_run_once = 0;
+	istate->sparse_index = 0;
 	FREE_AND_NULL(istate->cache);
 	istate->cache_alloc = 0;
 	discard_split_index(istate);
@@ -2966,6 +2981,13 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 			return -1;
 	}
 
+	if (istate->sparse_index) {
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_SPARSE_DIRECTORIES, 0) < 0;
+		if (err)
+			return -1;
+	}
+
 	/*
 	 * CACHE_EXT_ENDOFINDEXENTRIES must be written as the last entry before the SHA1
 	 * so that it can be found and processed before all the index entries are
@@ -3185,7 +3207,7 @@ static int too_many_not_shared_entries(struct index_state *istate)
 int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		       unsigned flags)
 {
-	int new_shared_index, ret;
+	int new_shared_index, ret, was_full;
 	struct split_index *si = istate->split_index;
 
 	if (git_env_bool("GIT_TEST_CHECK_CACHE_TREE", 0))
@@ -3197,6 +3219,13 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		return 0;
 	}
 
+	/*
+	 * Write out a sparse index if it is enabled, but give the
+	 * caller its full index back afterwards.
+	 */
+	was_full = !istate->sparse_index;
+	convert_to_sparse(istate);
+
 	if (istate->fsmonitor_last_update)
 		fill_fsmonitor_bitmap(istate);
 
@@ -3250,6 +3279,8 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	}
 
 out:
+	if (was_full)
+		ensure_full_index(istate);
 	if (flags & COMMIT_LOCK)
 		rollback_lock_file(lock);
 	return ret;
@@ -0,0 +1,2135 @@
+#include "../cache.h"
+#include "../config.h"
+#include "../refs.h"
+#include "refs-internal.h"
+#include "reftable.h"
+#include "../iterator.h"
+#include "../lockfile.h"
+#include "../object.h"
+#include "../chdir-notify.h"
+#include "../dir.h"
+#include "../string-list.h"
+#include "worktree.h"
+
+/*
+ * This backend uses the following flags in `ref_update::flags` for
+ * internal bookkeeping purposes, with the same meaning as in the files
+ * backend. Their numerical values must not conflict with REF_NO_DEREF,
+ * REF_FORCE_CREATE_REFLOG, REF_HAVE_NEW or REF_HAVE_OLD, which are
+ * also stored in `ref_update::flags`.
+ */
+
+/* The reference is being deleted. */
+#define REF_DELETING (1 << 5)
+
+/* The new value of the reference needs to be written. */
+#define REF_NEEDS_COMMIT (1 << 6)
+
+/*
+ * We want to log a ref update but not actually perform it. This is
+ * used when a symbolic ref update is split up.
+ */
+#define REF_LOG_ONLY (1 << 7)
+
+/* The ref_update was via an update to HEAD. */
+#define REF_UPDATE_VIA_HEAD (1 << 8)
+
+/*
+ * All references live in reftable stacks: the shared references and
+ * the per-worktree references of the main worktree in
+ * `$GIT_COMMON_DIR/reftable`, and the per-worktree references of a
+ * linked worktree in `$GIT_DIR/reftable`. Pseudorefs like ORIG_HEAD
+ * are still written as files by refs.c, and read as such here.
+ */
+struct reftable_ref_store {
+	struct ref_store base;
+	unsigned int store_flags;
+
+	char *gitdir;
+	char *gitcommondir;
+
+	struct reftable_stack main_stack;
+
+	/* The stack of a linked worktree, or NULL. */
+	struct reftable_stack *worktree_stack;
+
+	/* Stacks of other worktrees, indexed by worktree id. */
+	struct string_list worktree_stacks;
+};
+
+static struct reftable_stack *reftable_stack_new(const char *dir)
+{
+	struct reftable_stack *st = xmalloc(sizeof(*st));
+
+	reftable_stack_init(st, dir);
+	chdir_notify_reparent("reftable-backend stack", &st->dir);
+	return st;
+}
+
+static struct ref_store *reftable_ref_store_create(const char *gitdir,
+						   unsigned int flags)
+{
+	struct reftable_ref_store *refs = xcalloc(1, sizeof(*refs));
+	struct ref_store *ref_store = (struct ref_store *)refs;
+	struct strbuf sb = STRBUF_INIT;
+
+	base_ref_store_init(ref_store, &refs_be_reftable);
+	refs->store_flags = flags;
+
+	refs->gitdir = xstrdup(gitdir);
+	get_common_dir_noenv(&sb, gitdir);
+	refs->gitcommondir = strbuf_detach(&sb, NULL);
+
+	strbuf_addf(&sb, "%s/reftable", refs->gitcommondir);
+	reftable_stack_init(&refs->main_stack, sb.buf);
+	if (strcmp(refs->gitdir, refs->gitcommondir)) {
+		strbuf_reset(&sb);
+		strbuf_addf(&sb, "%s/reftable", refs->gitdir);
+		refs->worktree_stack = reftable_stack_new(sb.buf);
+	}
+	string_list_init(&refs->worktree_stacks, 1);
+	strbuf_release(&sb);
+
+	chdir_notify_reparent("reftable-backend $GIT_DIR",
+			      &refs->gitdir);
+	chdir_notify_reparent("reftable-backend $GIT_COMMONDIR",
+			      &refs->gitcommondir);
+	chdir_notify_reparent("reftable-backend main stack",
+			      &refs->main_stack.dir);
+
+	return ref_store;
+}
+
+/*
+ * Downcast ref_store to reftable_ref_store. Die if ref_store is not a
+ * reftable_ref_store. required_flags is compared with ref_store's
+ * store_flags to ensure the ref_store has all required capabilities.
+ * "caller" is used in any necessary error messages.
+ */
+static struct reftable_ref_store *reftable_downcast(struct ref_store *ref_store,
+						    unsigned int required_flags,
+						    const char *caller)
+{
+	struct reftable_ref_store *refs;
+
+	if (ref_store->be != &refs_be_reftable)
+		BUG("ref_store is type \"%s\" not \"reftable\" in %s",
+		    ref_store->be->name, caller);
+
+	refs = (struct reftable_ref_store *)ref_store;
+
+	if ((refs->store_flags & required_flags) != required_flags)
+		BUG("operation %s requires abilities 0x%x, but only have 0x%x",
+		    caller, required_flags, refs->store_flags);
+
+	return refs;
+}
+
+static struct reftable_stack *other_worktree_stack(struct reftable_ref_store *refs,
+						   const char *id, int len)
+{
+	struct string_list_item *item;
+	char *key = xmemdupz(id, len);
+
+	item = string_list_insert(&refs->worktree_stacks, key);
+	if (!item->util) {
+		struct strbuf sb = STRBUF_INIT;
+
+		strbuf_addf(&sb, "%s/worktrees/%s/reftable",
+			    refs->gitcommondir, key);
+		item->util = reftable_stack_new(sb.buf);
+		strbuf_release(&sb);
+	}
+	free(key);
+	return item->util;
+}
+
+/*
+ * Return the stack holding refname, and set `*name` to the name of the
+ * reference within that stack, stripping any "main-worktree/" or
+ * "worktrees/<id>/" prefix.
+ */
+static struct reftable_stack *stack_for(struct reftable_ref_store *refs,
+					const char *refname,
+					const char **name)
+{
+	const char *id;
+	int len;
+
+	*name = refname;
+	switch (ref_type(refname)) {
+	case REF_TYPE_PER_WORKTREE:
+	case REF_TYPE_PSEUDOREF:
+		if (refs->worktree_stack)
+			return refs->worktree_stack;
+		return &refs->main_stack;
+	case REF_TYPE_MAIN_PSEUDOREF:
+	case REF_TYPE_OTHER_PSEUDOREF:
+		if (parse_worktree_ref(refname, &id, &len, name))
+			BUG("refname %s is not a other-worktree ref", refname);
+		if (!id)
+			return &refs->main_stack;
+		return other_worktree_stack(refs, id, len);
+	case REF_TYPE_NORMAL:
+		return &refs->main_stack;
+	default:
+		BUG("unknown ref type %d of ref %s",
+		    ref_type(refname), refname);
+	}
+}
+
+static void stack_reload_or_die(struct reftable_stack *st)
+{
+	if (reftable_stack_reload(st))
+		die(_("unable to read reftable stack '%s'"), st->dir);
+}
+
+/*
+ * Return the path of the file holding the pseudoref refname, or NULL
+ * if refname is not a pseudoref.
+ */
+static char *pseudoref_path(struct reftable_ref_store *refs,
+			    const char *refname)
+{
+	const char *id, *real;
+	int len;
+
+	switch (ref_type(refname)) {
+	case REF_TYPE_PSEUDOREF:
+		return xstrfmt("%s/%s", refs->gitdir, refname);
+	case REF_TYPE_MAIN_PSEUDOREF:
+	case REF_TYPE_OTHER_PSEUDOREF:
+		if (parse_worktree_ref(refname, &id, &len, &real) ||
+		    ref_type(real) != REF_TYPE_PSEUDOREF)
+			return NULL;
+		if (!id)
+			return xstrfmt("%s/%s", refs->gitcommondir, real);
+		return xstrfmt("%s/worktrees/%.*s/%s", refs->gitcommondir,
+			       len, id, real);
+	default:
+		return NULL;
+	}
+}
+
+static int read_pseudoref(const char *path, struct object_id *oid,
+			  struct strbuf *referent, unsigned int *type)
+{
+	struct strbuf sb = STRBUF_INIT;
+	const char *buf, *p;
+	int ret = -1;
+
+	if (strbuf_read_file(&sb, path, 256) < 0)
+		goto out;
+	strbuf_rtrim(&sb);
+	buf = sb.buf;
+	if (skip_prefix(buf, "ref:", &buf)) {
+		while (isspace(*buf))
+			buf++;
+		strbuf_reset(referent);
+		strbuf_addstr(referent, buf);
+		*type |= REF_ISSYMREF;
+		ret = 0;
+		goto out;
+	}
+
+	/* FETCH_HEAD has additional data after the object name. */
+	if (parse_oid_hex(buf, oid, &p) || (*p && !isspace(*p))) {
+		*type |= REF_ISBROKEN;
+		errno = EINVAL;
+		goto out;
+	}
+	ret = 0;
+out:
+	strbuf_release(&sb);
+	return ret;
+}
+
+static int reftable_read_raw_ref(struct ref_store *ref_store,
+				 const char *refname, struct object_id *oid,
+				 struct strbuf *referent, unsigned int *type)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
+	struct reftable_stack *st;
+	struct strbuf target = STRBUF_INIT;
+	const char *name;
+	char *path;
+	unsigned int value_type;
+	int ret;
+
+	*type = 0;
+
+	path = pseudoref_path(refs, refname);
+	if (path) {
+		ret = read_pseudoref(path, oid, referent, type);
+		free(path);
+		return ret;
+	}
+
+	st = stack_for(refs, refname, &name);
+	stack_reload_or_die(st);
+	ret = reftable_stack_read_ref(st, name, oid, &target, &value_type);
+	if (ret < 0) {
+		errno = EIO;
+	} else if (ret > 0) {
+		errno = ENOENT;
+		ret = -1;
+	} else if (value_type == REFTABLE_REF_SYMREF) {
+		strbuf_swap(referent, &target);
+		*type |= REF_ISSYMREF;
+	}
+	strbuf_release(&target);
+	return ret;
+}
+
+/* Which references of a stack a reftable_ref_iterator yields. */
+enum worktree_filter {
+	ALL_REFS,
+	PER_WORKTREE_REFS,
+	SHARED_REFS
+};
+
+struct reftable_ref_iterator {
+	struct ref_iterator base;
+
+	struct reftable_ref_store *refs;
+	struct reftable_iterator it;
+	char *prefix;
+	unsigned int flags;
+	enum worktree_filter filter;
+
+	unsigned int value_type;
+	struct object_id oid;
+	struct object_id peeled;
+};
+
+static int reftable_ref_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+	struct reftable_ref_record rec;
+	int ok = ITER_DONE, ret;
+
+	while (!(ret = reftable_iterator_next_ref(&iter->it, &rec))) {
+		int per_worktree, flags = 0;
+
+		if (!starts_with(rec.refname, iter->prefix))
+			break;
+		/* Names outside of "refs/" are handled by refs.c. */
+		if (!starts_with(rec.refname, "refs/"))
+			continue;
+
+		per_worktree = ref_type(rec.refname) == REF_TYPE_PER_WORKTREE;
+		if ((iter->filter == PER_WORKTREE_REFS && !per_worktree) ||
+		    (iter->filter == SHARED_REFS && per_worktree))
+			continue;
+
+		iter->value_type = rec.value_type;
+		if (rec.value_type == REFTABLE_REF_SYMREF) {
+			if (!refs_resolve_ref_unsafe(&iter->refs->base,
+						     rec.refname,
+						     RESOLVE_REF_READING,
+						     &iter->oid, &flags)) {
+				flags |= REF_ISBROKEN;
+				oidclr(&iter->oid);
+			}
+			flags |= REF_ISSYMREF;
+		} else {
+			oidcpy(&iter->oid, &rec.oid);
+			oidcpy(&iter->peeled, &rec.peeled);
+		}
+
+		if (check_refname_format(rec.refname, REFNAME_ALLOW_ONELEVEL)) {
+			if (!refname_is_safe(rec.refname))
+				continue;
+			flags |= REF_BAD_NAME | REF_ISBROKEN;
+			oidclr(&iter->oid);
+		}
+
+		if (!(iter->flags & DO_FOR_EACH_INCLUDE_BROKEN) &&
+		    !ref_resolves_to_object(rec.refname, &iter->oid, flags))
+			continue;
+
+		iter->base.refname = rec.refname;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ret < 0)
+		ok = ITER_ERROR;
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE)
+		ok = ITER_ERROR;
+	return ok;
+}
+
+static int reftable_ref_iterator_peel(struct ref_iterator *ref_iterator,
+				      struct object_id *peeled)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	switch (iter->value_type) {
+	case REFTABLE_REF_VAL2:
+		/* The peeled value was recorded when writing the ref. */
+		oidcpy(peeled, &iter->peeled);
+		return 0;
+	case REFTABLE_REF_SYMREF:
+		return peel_object(&iter->oid, peeled) ? -1 : 0;
+	default:
+		return -1;
+	}
+}
+
+static int reftable_ref_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	reftable_iterator_release(&iter->it);
+	free(iter->prefix);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_ref_iterator_vtable = {
+	reftable_ref_iterator_advance,
+	reftable_ref_iterator_peel,
+	reftable_ref_iterator_abort
+};
+
+static struct ref_iterator *stack_ref_iterator_begin(
+		struct reftable_ref_store *refs, struct reftable_stack *st,
+		const char *prefix, unsigned int flags,
+		enum worktree_filter filter)
+{
+	struct reftable_ref_iterator *iter = xcalloc(1, sizeof(*iter));
+	struct reftable_iterator blank = REFTABLE_ITERATOR_INIT;
+	struct ref_iterator *ref_iterator = &iter->base;
+
+	base_ref_iterator_init(ref_iterator, &reftable_ref_iterator_vtable, 1);
+	iter->refs = refs;
+	memcpy(&iter->it, &blank, sizeof(blank));
+	iter->prefix = xstrdup(prefix ? prefix : "");
+	iter->flags = flags;
+	iter->filter = filter;
+
+	stack_reload_or_die(st);
+	reftable_stack_seek_ref(st, &iter->it, iter->prefix);
+	return ref_iterator;
+}
+
+static struct ref_iterator *reftable_ref_iterator_begin(
+		struct ref_store *ref_store,
+		const char *prefix, unsigned int flags)
+{
+	struct reftable_ref_store *refs;
+	struct ref_iterator *worktree_iter, *main_iter;
+	unsigned int required_flags = REF_STORE_READ;
+
+	if (!(flags & DO_FOR_EACH_INCLUDE_BROKEN))
+		required_flags |= REF_STORE_ODB;
+
+	refs = reftable_downcast(ref_store, required_flags, "ref_iterator_begin");
+
+	if (!refs->worktree_stack)
+		return stack_ref_iterator_begin(refs, &refs->main_stack,
+						prefix, flags,
+						(flags & DO_FOR_EACH_PER_WORKTREE_ONLY) ?
+						PER_WORKTREE_REFS : ALL_REFS);
+
+	/*
+	 * The main stack also holds the per-worktree refs of the main
+	 * worktree, which must not show through in a linked worktree.
+	 */
+	worktree_iter = stack_ref_iterator_begin(refs, refs->worktree_stack,
+						 prefix, flags,
+						 PER_WORKTREE_REFS);
+	if (flags & DO_FOR_EACH_PER_WORKTREE_ONLY)
+		main_iter = empty_ref_iterator_begin();
+	else
+		main_iter = stack_ref_iterator_begin(refs, &refs->main_stack,
+						     prefix, flags,
+						     SHARED_REFS);
+	return overlay_ref_iterator_begin(worktree_iter, main_iter);
+}
+
+/*
+ * If update is a direct update of head_ref (the reference pointed to
+ * by HEAD), then add an extra REF_LOG_ONLY update for HEAD.
+ */
+static int split_head_update(struct ref_update *update,
+			     struct ref_transaction *transaction,
+			     const char *head_ref,
+			     struct string_list *affected_refnames,
+			     struct strbuf *err)
+{
+	struct string_list_item *item;
+	struct ref_update *new_update;
+
+	if ((update->flags & REF_LOG_ONLY) ||
+	    (update->flags & REF_UPDATE_VIA_HEAD))
+		return 0;
+
+	if (strcmp(update->refname, head_ref))
+		return 0;
+
+	/*
+	 * First make sure that HEAD is not already in the
+	 * transaction. This check is O(lg N) in the transaction
+	 * size, but it happens at most once per transaction.
+	 */
+	if (string_list_has_string(affected_refnames, "HEAD")) {
+		/* An entry already existed */
+		strbuf_addf(err,
+			    "multiple updates for 'HEAD' (including one "
+			    "via its referent '%s') are not allowed",
+			    update->refname);
+		return TRANSACTION_NAME_CONFLICT;
+	}
+
+	new_update = ref_transaction_add_update(
+			transaction, "HEAD",
+			update->flags | REF_LOG_ONLY | REF_NO_DEREF,
+			&update->new_oid, &update->old_oid,
+			update->msg);
+
+	item = string_list_insert(affected_refnames, new_update->refname);
+	item->util = new_update;
+
+	return 0;
+}
+
+/*
+ * update is for a symref that points at referent and doesn't have
+ * REF_NO_DEREF set. Split it into two updates:
+ * - The original update, but with REF_LOG_ONLY and REF_NO_DEREF set
+ * - A new, separate update for the referent reference
+ * Note that the new update will itself be subject to splitting when
+ * the iteration gets to it.
+ */
+static int split_symref_update(struct ref_update *update,
+			       const char *referent,
+			       struct ref_transaction *transaction,
+			       struct string_list *affected_refnames,
+			       struct strbuf *err)
+{
+	struct string_list_item *item;
+	struct ref_update *new_update;
+	unsigned int new_flags;
+
+	if (string_list_has_string(affected_refnames, referent)) {
+		/* An entry already exists */
+		strbuf_addf(err,
+			    "multiple updates for '%s' (including one "
+			    "via symref '%s') are not allowed",
+			    referent, update->refname);
+		return TRANSACTION_NAME_CONFLICT;
+	}
+
+	new_flags = update->flags;
+	if (!strcmp(update->refname, "HEAD")) {
+		/*
+		 * Record that the new update came via HEAD, so that
+		 * when we process it, split_head_update() doesn't try
+		 * to add another reflog update for HEAD.
+		 */
+		new_flags |= REF_UPDATE_VIA_HEAD;
+	}
+
+	new_update = ref_transaction_add_update(
+			transaction, referent, new_flags,
+			&update->new_oid, &update->old_oid,
+			update->msg);
+
+	new_update->parent_update = update;
+
+	/*
+	 * Change the symbolic ref update to log only. Also, it
+	 * doesn't need to check its old OID value, as that will be
+	 * done when new_update is processed.
+	 */
+	update->flags |= REF_LOG_ONLY | REF_NO_DEREF;
+	update->flags &= ~REF_HAVE_OLD;
+
+	item = string_list_insert(affected_refnames, new_update->refname);
+	if (item->util)
+		BUG("%s unexpectedly found in affected_refnames",
+		    new_update->refname);
+	item->util = new_update;
+
+	return 0;
+}
+
+/*
+ * Return the refname under which update was originally requested.
+ */
+static const char *original_update_refname(struct ref_update *update)
+{
+	while (update->parent_update)
+		update = update->parent_update;
+
+	return update->refname;
+}
+
+/*
+ * Check whether the REF_HAVE_OLD and old_oid values stored in update
+ * are consistent with oid, which is the reference's current value. If
+ * everything is OK, return 0; otherwise, write an error message to
+ * err and return -1.
+ */
+static int check_old_oid(struct ref_update *update, struct object_id *oid,
+			 struct strbuf *err)
+{
+	if (!(update->flags & REF_HAVE_OLD) ||
+		   oideq(oid, &update->old_oid))
+		return 0;
+
+	if (is_null_oid(&update->old_oid))
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "reference already exists",
+			    original_update_refname(update));
+	else if (is_null_oid(oid))
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "reference is missing but expected %s",
+			    original_update_refname(update),
+			    oid_to_hex(&update->old_oid));
+	else
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "is at %s but expected %s",
+			    original_update_refname(update),
+			    oid_to_hex(oid),
+			    oid_to_hex(&update->old_oid));
+
+	return -1;
+}
+
+/* What we know about a reference while it is being updated. */
+struct reftable_update_lock {
+	/* The stack holding the reference, or NULL for a pseudoref. */
+	struct reftable_stack *st;
+
+	/* The lock on the file of a pseudoref. */
+	struct lock_file pseudoref_lock;
+
+	/* The name of the reference within `st`. */
+	const char *name;
+
+	/* Whether the reference exists, and its (resolved) old value. */
+	int exists;
+	struct object_id old_oid;
+};
+
+struct reftable_transaction_backend_data {
+	/* The stacks locked by the transaction. */
+	struct reftable_stack **stacks;
+	size_t stacks_nr, stacks_alloc;
+
+	/*
+	 * Set for the initial transaction, which neither writes reflogs
+	 * nor checks the new objects, like the packed-refs backend.
+	 */
+	int initial;
+};
+
+static int lock_stack(struct reftable_transaction_backend_data *backend_data,
+		      struct reftable_stack *st, struct strbuf *err)
+{
+	size_t i;
+
+	for (i = 0; i < backend_data->stacks_nr; i++)
+		if (backend_data->stacks[i] == st)
+			return 0;
+
+	if (reftable_stack_lock(st, err))
+		return -1;
+	ALLOC_GROW(backend_data->stacks, backend_data->stacks_nr + 1,
+		   backend_data->stacks_alloc);
+	backend_data->stacks[backend_data->stacks_nr++] = st;
+	return 0;
+}
+
+/*
+ * Pseudorefs like ORIG_HEAD live in files next to the stacks, and are
+ * partly managed outside of the refs API; see write_pseudoref() in
+ * refs.c. Lock the file of the pseudoref, read its old value and
+ * check it.
+ */
+static int lock_pseudoref(struct reftable_ref_store *refs,
+			  struct ref_update *update, const char *path,
+			  struct strbuf *err)
+{
+	struct reftable_update_lock *lock = update->backend_data;
+	struct strbuf referent = STRBUF_INIT;
+	unsigned int type = 0;
+	int ret = TRANSACTION_GENERIC_ERROR;
+
+	if (hold_lock_file_for_update_timeout(&lock->pseudoref_lock, path, 0,
+					      get_files_ref_lock_timeout_ms()) < 0) {
+		struct strbuf reason = STRBUF_INIT;
+
+		unable_to_lock_message(path, errno, &reason);
+		strbuf_addf(err, "cannot lock ref '%s': %s",
+			    original_update_refname(update), reason.buf);
+		strbuf_release(&reason);
+		goto out;
+	}
+
+	if (read_pseudoref(path, &lock->old_oid, &referent, &type)) {
+		oidclr(&lock->old_oid);
+	} else {
+		lock->exists = 1;
+		if ((type & REF_ISSYMREF) &&
+		    refs_read_ref_full(&refs->base, referent.buf, 0,
+				       &lock->old_oid, NULL))
+			oidclr(&lock->old_oid);
+	}
+
+	if ((update->flags & REF_HAVE_OLD) && !is_null_oid(&update->old_oid) &&
+	    !lock->exists) {
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "unable to resolve reference '%s'",
+			    original_update_refname(update), update->refname);
+		goto out;
+	}
+	if (check_old_oid(update, &lock->old_oid, err))
+		goto out;
+
+	if ((update->flags & REF_HAVE_NEW) &&
+	    !(update->flags & REF_DELETING) &&
+	    !(update->flags & REF_LOG_ONLY))
+		update->flags |= REF_NEEDS_COMMIT;
+	ret = 0;
+out:
+	strbuf_release(&referent);
+	return ret;
+}
+
+/*
+ * Commit the update of a pseudoref locked by lock_pseudoref().
+ */
+static int commit_pseudoref(struct ref_update *update, struct strbuf *err)
+{
+	struct reftable_update_lock *lock = update->backend_data;
+
+	if ((update->flags & REF_DELETING) &&
+	    !(update->flags & REF_LOG_ONLY)) {
+		char *path = get_locked_file_path(&lock->pseudoref_lock);
+		int ret = 0;
+
+		if (lock->exists && unlink_or_msg(path, err))
+			ret = -1;
+		free(path);
+		rollback_lock_file(&lock->pseudoref_lock);
+		return ret;
+	}
+
+	if (update->flags & REF_NEEDS_COMMIT) {
+		int fd = get_lock_file_fd(&lock->pseudoref_lock);
+
+		if (write_in_full(fd, oid_to_hex(&update->new_oid),
+				  the_hash_algo->hexsz) < 0 ||
+		    write_str_in_full(fd, "\n") < 0 ||
+		    commit_lock_file(&lock->pseudoref_lock)) {
+			strbuf_addf(err, "couldn't set '%s'", update->refname);
+			return -1;
+		}
+	}
+	rollback_lock_file(&lock->pseudoref_lock);
+	return 0;
+}
+
+/*
+ * Prepare for carrying out update:
+ * - Lock the stack holding the reference.
+ * - Read the reference under lock.
+ * - Check that its old OID value (if specified) is correct, and in
+ *   any case record it in update->backend_data for later use when
+ *   writing the reflog.
+ * - If it is a symref update without REF_NO_DEREF, split it up into a
+ *   REF_LOG_ONLY update of the symref and add a separate update for
+ *   the referent to transaction.
+ * - If it is an update of head_ref, add a corresponding REF_LOG_ONLY
+ *   update of HEAD.
+ * - Check that the new value is a valid object to store in the
+ *   reference.
+ */
+static int lock_ref_for_update(struct reftable_ref_store *refs,
+			       struct ref_update *update,
+			       struct ref_transaction *transaction,
+			       const char *head_ref,
+			       struct string_list *affected_refnames,
+			       struct strbuf *err)
+{
+	struct reftable_transaction_backend_data *backend_data =
+		transaction->backend_data;
+	struct strbuf referent = STRBUF_INIT;
+	struct reftable_update_lock *lock;
+	unsigned int value_type;
+	char *path;
+	int mustexist = (update->flags & REF_HAVE_OLD) &&
+		!is_null_oid(&update->old_oid);
+	int ret = 0;
+
+	if ((update->flags & REF_HAVE_NEW) && is_null_oid(&update->new_oid))
+		update->flags |= REF_DELETING;
+
+	if (head_ref) {
+		ret = split_head_update(update, transaction, head_ref,
+					affected_refnames, err);
+		if (ret)
+			goto out;
+	}
+
+	lock = xcalloc(1, sizeof(*lock));
+	update->backend_data = lock;
+
+	path = pseudoref_path(refs, update->refname);
+	if (path) {
+		ret = lock_pseudoref(refs, update, path, err);
+		free(path);
+		goto out;
+	}
+
+	lock->st = stack_for(refs, update->refname, &lock->name);
+
+	if (lock_stack(backend_data, lock->st, err)) {
+		char *reason = strbuf_detach(err, NULL);
+
+		strbuf_addf(err, "cannot lock ref '%s': %s",
+			    original_update_refname(update), reason);
+		free(reason);
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto out;
+	}
+
+	update->type = 0;
+	ret = reftable_stack_read_ref(lock->st, lock->name, &lock->old_oid,
+				      &referent, &value_type);
+	if (ret < 0) {
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "unable to read reference '%s'",
+			    original_update_refname(update), update->refname);
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto out;
+	}
+	lock->exists = !ret;
+	ret = 0;
+
+	if (!lock->exists) {
+		oidclr(&lock->old_oid);
+		if (mustexist) {
+			strbuf_addf(err, "cannot lock ref '%s': "
+				    "unable to resolve reference '%s'",
+				    original_update_refname(update),
+				    update->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		if ((update->flags & REF_HAVE_NEW) &&
+		    !(update->flags & REF_DELETING) &&
+		    !(update->flags & REF_LOG_ONLY) &&
+		    refs_verify_refname_available(&refs->base,
+						  update->refname,
+						  affected_refnames, NULL,
+						  err)) {
+			char *reason = strbuf_detach(err, NULL);
+
+			strbuf_addf(err, "cannot lock ref '%s': %s",
+				    original_update_refname(update), reason);
+			free(reason);
+			ret = TRANSACTION_NAME_CONFLICT;
+			goto out;
+		}
+	} else if (value_type == REFTABLE_REF_SYMREF) {
+		update->type |= REF_ISSYMREF;
+	}
+
+	if (update->type & REF_ISSYMREF) {
+		if (update->flags & REF_NO_DEREF) {
+			/*
+			 * We won't be reading the referent as part of
+			 * the transaction, so we have to read it here
+			 * to record and possibly check old_oid:
+			 */
+			if (refs_read_ref_full(&refs->base,
+					       referent.buf, 0,
+					       &lock->old_oid, NULL)) {
+				oidclr(&lock->old_oid);
+				if (update->flags & REF_HAVE_OLD) {
+					strbuf_addf(err, "cannot lock ref '%s': "
+						    "error reading reference",
+						    original_update_refname(update));
+					ret = TRANSACTION_GENERIC_ERROR;
+					goto out;
+				}
+			} else if (check_old_oid(update, &lock->old_oid, err)) {
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto out;
+			}
+		} else {
+			/*
+			 * Create a new update for the reference this
+			 * symref is pointing at. Also, we will record
+			 * and verify old_oid for this update as part
+			 * of processing the split-off update, so we
+			 * don't have to do it here.
+			 */
+			ret = split_symref_update(update,
+						  referent.buf, transaction,
+						  affected_refnames, err);
+			if (ret)
+				goto out;
+		}
+	} else {
+		struct ref_update *parent_update;
+
+		if (check_old_oid(update, &lock->old_oid, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+
+		/*
+		 * If this update is happening indirectly because of a
+		 * symref update, record the old OID in the parent
+		 * update:
+		 */
+		for (parent_update = update->parent_update;
+		     parent_update;
+		     parent_update = parent_update->parent_update) {
+			struct reftable_update_lock *parent_lock =
+				parent_update->backend_data;
+			oidcpy(&parent_lock->old_oid, &lock->old_oid);
+		}
+	}
+
+	if ((update->flags & REF_HAVE_NEW) &&
+	    !(update->flags & REF_DELETING) &&
+	    !(update->flags & REF_LOG_ONLY)) {
+		struct object *o;
+
+		if (!(update->type & REF_ISSYMREF) &&
+		    oideq(&lock->old_oid, &update->new_oid)) {
+			/*
+			 * The reference already has the desired
+			 * value, so we don't need to write it.
+			 */
+			goto out;
+		}
+
+		update->flags |= REF_NEEDS_COMMIT;
+		if (backend_data->initial)
+			goto out;
+
+		o = parse_object(the_repository, &update->new_oid);
+		if (!o) {
+			strbuf_addf(err,
+				    "cannot update ref '%s': "
+				    "trying to write ref '%s' with nonexistent object %s",
+				    update->refname, update->refname,
+				    oid_to_hex(&update->new_oid));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		if (o->type != OBJ_COMMIT && is_branch(update->refname)) {
+			strbuf_addf(err,
+				    "cannot update ref '%s': "
+				    "trying to write non-commit object %s to branch '%s'",
+				    update->refname, oid_to_hex(&update->new_oid),
+				    update->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+	}
+
+out:
+	strbuf_release(&referent);
+	return ret;
+}
+
+/*
+ * Unlock the stacks locked by `transaction`, and mark the transaction
+ * closed.
+ */
+static void reftable_transaction_cleanup(struct ref_transaction *transaction)
+{
+	struct reftable_transaction_backend_data *backend_data =
+		transaction->backend_data;
+	size_t i;
+
+	for (i = 0; i < transaction->nr; i++) {
+		struct reftable_update_lock *lock =
+			transaction->updates[i]->backend_data;
+
+		if (lock)
+			rollback_lock_file(&lock->pseudoref_lock);
+		FREE_AND_NULL(transaction->updates[i]->backend_data);
+	}
+
+	if (backend_data) {
+		for (i = 0; i < backend_data->stacks_nr; i++)
+			reftable_stack_unlock(backend_data->stacks[i]);
+		free(backend_data->stacks);
+		free(backend_data);
+		transaction->backend_data = NULL;
+	}
+
+	transaction->state = REF_TRANSACTION_CLOSED;
+}
+
+static int reftable_transaction_prepare(struct ref_store *ref_store,
+					struct ref_transaction *transaction,
+					struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE,
+				  "ref_transaction_prepare");
+	size_t i;
+	int ret = 0;
+	struct string_list affected_refnames = STRING_LIST_INIT_NODUP;
+	char *head_ref = NULL;
+	int head_type;
+
+	assert(err);
+
+	if (!transaction->nr)
+		goto cleanup;
+
+	if (!transaction->backend_data)
+		transaction->backend_data =
+			xcalloc(1, sizeof(struct reftable_transaction_backend_data));
+
+	/*
+	 * Fail if a refname appears more than once in the
+	 * transaction. (If we end up splitting up any updates using
+	 * split_symref_update() or split_head_update(), those
+	 * functions will check that the new updates don't have the
+	 * same refname as any existing ones.)
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+		struct string_list_item *item =
+			string_list_append(&affected_refnames, update->refname);
+
+		item->util = update;
+	}
+	string_list_sort(&affected_refnames);
+	if (ref_update_reject_duplicates(&affected_refnames, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto cleanup;
+	}
+
+	/*
+	 * If HEAD is a symbolic reference, then record the name of
+	 * the reference that it points to, so that an update of that
+	 * reference is also logged in the reflog of HEAD; see the
+	 * files backend.
+	 */
+	head_ref = refs_resolve_refdup(ref_store, "HEAD",
+				       RESOLVE_REF_NO_RECURSE,
+				       NULL, &head_type);
+
+	if (head_ref && !(head_type & REF_ISSYMREF)) {
+		FREE_AND_NULL(head_ref);
+	}
+
+	/*
+	 * Lock the stacks, verify old values if provided and check
+	 * that new values are valid. Note that lock_ref_for_update()
+	 * might append more updates to the transaction.
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+
+		ret = lock_ref_for_update(refs, update, transaction,
+					  head_ref, &affected_refnames, err);
+		if (ret)
+			goto cleanup;
+	}
+
+cleanup:
+	free(head_ref);
+	string_list_clear(&affected_refnames, 0);
+
+	if (ret)
+		reftable_transaction_cleanup(transaction);
+	else
+		transaction->state = REF_TRANSACTION_PREPARED;
+
+	return ret;
+}
+
+/* The records to be added to one stack. */
+struct stack_records {
+	struct reftable_stack *st;
+	uint64_t update_index;
+
+	struct reftable_ref_record *refs;
+	size_t refs_nr, refs_alloc;
+	struct reftable_log_record *logs;
+	size_t logs_nr, logs_alloc;
+
+	/* Strings owned by the records. */
+	struct string_list strings;
+};
+
+static void stack_records_init(struct stack_records *sr,
+			       struct reftable_stack *st)
+{
+	memset(sr, 0, sizeof(*sr));
+	sr->st = st;
+	sr->update_index = reftable_stack_next_update_index(st);
+	string_list_init(&sr->strings, 1);
+}
+
+static void stack_records_release(struct stack_records *sr)
+{
+	free(sr->refs);
+	free(sr->logs);
+	string_list_clear(&sr->strings, 0);
+}
+
+static struct reftable_ref_record *add_ref_record(struct stack_records *sr,
+						  const char *name,
+						  unsigned int value_type)
+{
+	struct reftable_ref_record *rec;
+
+	ALLOC_GROW(sr->refs, sr->refs_nr + 1, sr->refs_alloc);
+	rec = &sr->refs[sr->refs_nr++];
+	memset(rec, 0, sizeof(*rec));
+	rec->refname = name;
+	rec->update_index = sr->update_index;
+	rec->value_type = value_type;
+	return rec;
+}
+
+static void add_ref_value(struct stack_records *sr, const char *name,
+			  const struct object_id *oid)
+{
+	struct object_id peeled;
+	struct reftable_ref_record *rec;
+
+	/* Record the peeled value of tags to save readers the work. */
+	if (peel_object(oid, &peeled) == PEEL_PEELED) {
+		rec = add_ref_record(sr, name, REFTABLE_REF_VAL2);
+		oidcpy(&rec->peeled, &peeled);
+	} else {
+		rec = add_ref_record(sr, name, REFTABLE_REF_VAL1);
+	}
+	oidcpy(&rec->oid, oid);
+}
+
+static struct reftable_log_record *add_log_record(struct stack_records *sr,
+						  const char *name,
+						  uint64_t update_index,
+						  unsigned int value_type)
+{
+	struct reftable_log_record *rec;
+
+	ALLOC_GROW(sr->logs, sr->logs_nr + 1, sr->logs_alloc);
+	rec = &sr->logs[sr->logs_nr++];
+	memset(rec, 0, sizeof(*rec));
+	rec->refname = name;
+	rec->update_index = update_index;
+	rec->value_type = value_type;
+	return rec;
+}
+
+/*
+ * Add a log entry for an update of refname from old_oid to new_oid,
+ * using the committer identity.
+ */
+static void add_log_entry(struct stack_records *sr, const char *name,
+			  const struct object_id *old_oid,
+			  const struct object_id *new_oid, const char *msg)
+{
+	const char *committer = git_committer_info(0);
+	struct reftable_log_record *rec;
+	struct ident_split ident;
+	struct strbuf sb = STRBUF_INIT;
+
+	rec = add_log_record(sr, name, sr->update_index, REFTABLE_LOG_UPDATE);
+	oidcpy(&rec->old_oid, old_oid);
+	oidcpy(&rec->new_oid, new_oid);
+
+	if (split_ident_line(&ident, committer, strlen(committer)) ||
+	    !ident.date_begin || !ident.tz_begin)
+		BUG("invalid committer ident '%s'", committer);
+	rec->name = string_list_append_nodup(&sr->strings,
+		xmemdupz(ident.name_begin,
+			 ident.name_end - ident.name_begin))->string;
+	rec->email = string_list_append_nodup(&sr->strings,
+		xmemdupz(ident.mail_begin,
+			 ident.mail_end - ident.mail_begin))->string;
+	rec->time = parse_timestamp(ident.date_begin, NULL, 10);
+	rec->tz = strtol(ident.tz_begin, NULL, 10);
+
+	if (msg && *msg) {
+		copy_reflog_msg(&sb, msg);
+		/* Drop the tab separating the message in reflog files. */
+		if (sb.len && sb.buf[0] == '\t')
+			strbuf_remove(&sb, 0, 1);
+	}
+	rec->message = string_list_append_nodup(&sr->strings,
+		strbuf_detach(&sb, NULL))->string;
+}
+
+/*
+ * Add deletion records for the log entries of name, except for those
+ * at the update indices in `keep` (sorted in decreasing order).
+ */
+static void add_log_tombstones(struct stack_records *sr, const char *name,
+			       const uint64_t *keep, size_t keep_nr)
+{
+	struct reftable_iterator it = REFTABLE_ITERATOR_INIT;
+	struct reftable_log_record rec;
+	size_t k = 0;
+
+	reftable_stack_seek_log(sr->st, &it, name);
+	while (!reftable_iterator_next_log(&it, &rec) &&
+	       !strcmp(rec.refname, name)) {
+		while (k < keep_nr && keep[k] > rec.update_index)
+			k++;
+		if (k < keep_nr && keep[k] == rec.update_index)
+			continue;
+		add_log_record(sr, name, rec.update_index,
+			       REFTABLE_LOG_DELETION);
+	}
+	reftable_iterator_release(&it);
+}
+
+static int stack_reflog_exists(struct reftable_stack *st, const char *name)
+{
+	struct reftable_iterator it = REFTABLE_ITERATOR_INIT;
+	struct reftable_log_record rec;
+	int ret;
+
+	reftable_stack_seek_log(st, &it, name);
+	ret = !reftable_iterator_next_log(&it, &rec) &&
+		!strcmp(rec.refname, name);
+	reftable_iterator_release(&it);
+	return ret;
+}
+
+static int should_write_log(struct reftable_stack *st, const char *name,
+			    unsigned int flags)
+{
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ? LOG_REFS_NONE : LOG_REFS_NORMAL;
+
+	return (flags & REF_FORCE_CREATE_REFLOG) ||
+		should_autocreate_reflog(name) ||
+		stack_reflog_exists(st, name);
+}
+
+static int reftable_transaction_finish(struct ref_store *ref_store,
+				       struct ref_transaction *transaction,
+				       struct strbuf *err)
+{
+	struct reftable_transaction_backend_data *backend_data;
+	struct stack_records *records;
+	size_t i, j;
+	int ret = 0;
+
+	reftable_downcast(ref_store, 0, "ref_transaction_finish");
+
+	assert(err);
+
+	if (!transaction->nr) {
+		transaction->state = REF_TRANSACTION_CLOSED;
+		return 0;
+	}
+
+	backend_data = transaction->backend_data;
+	records = xcalloc(backend_data->stacks_nr, sizeof(*records));
+	for (i = 0; i < backend_data->stacks_nr; i++)
+		stack_records_init(&records[i], backend_data->stacks[i]);
+
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+		struct reftable_update_lock *lock = update->backend_data;
+		struct stack_records *sr = NULL;
+
+		if (!lock->st) {
+			if (!ret && commit_pseudoref(update, err))
+				ret = TRANSACTION_GENERIC_ERROR;
+			continue;
+		}
+
+		for (j = 0; j < backend_data->stacks_nr; j++)
+			if (records[j].st == lock->st)
+				sr = &records[j];
+		if (!sr)
+			BUG("stack of ref '%s' is not locked", update->refname);
+
+		if ((update->flags & REF_DELETING) &&
+		    !(update->flags & REF_LOG_ONLY)) {
+			/* A deleted reference loses its reflog, too. */
+			if (lock->exists)
+				add_ref_record(sr, lock->name,
+					       REFTABLE_REF_DELETION);
+			add_log_tombstones(sr, lock->name, NULL, 0);
+			continue;
+		}
+
+		if (update->flags & REF_NEEDS_COMMIT)
+			add_ref_value(sr, lock->name, &update->new_oid);
+
+		if (((update->flags & REF_NEEDS_COMMIT) ||
+		     (update->flags & REF_LOG_ONLY)) &&
+		    !backend_data->initial &&
+		    should_write_log(sr->st, lock->name, update->flags))
+			add_log_entry(sr, lock->name, &lock->old_oid,
+				      &update->new_oid, update->msg);
+	}
+
+	for (i = 0; i < backend_data->stacks_nr; i++) {
+		struct stack_records *sr = &records[i];
+
+		if (!ret && reftable_stack_add(sr->st, sr->update_index,
+					       sr->refs, sr->refs_nr,
+					       sr->logs, sr->logs_nr, err))
+			ret = TRANSACTION_GENERIC_ERROR;
+		stack_records_release(sr);
+	}
+
+	/* Compact only once all locks have been released. */
+	for (i = 0; !ret && i < backend_data->stacks_nr; i++)
+		reftable_stack_auto_compact(backend_data->stacks[i]);
+
+	free(records);
+	reftable_transaction_cleanup(transaction);
+	return ret;
+}
+
+static int reftable_transaction_abort(struct ref_store *ref_store,
+				      struct ref_transaction *transaction,
+				      struct strbuf *err)
+{
+	reftable_downcast(ref_store, 0, "ref_transaction_abort");
+
+	reftable_transaction_cleanup(transaction);
+	return 0;
+}
+
+static int reftable_initial_transaction_commit(struct ref_store *ref_store,
+					       struct ref_transaction *transaction,
+					       struct strbuf *err)
+{
+	struct reftable_transaction_backend_data *backend_data;
+	int ret;
+
+	reftable_downcast(ref_store, REF_STORE_WRITE,
+			  "initial_ref_transaction_commit");
+
+	if (transaction->state != REF_TRANSACTION_OPEN)
+		BUG("commit called for transaction that is not open");
+
+	/*
+	 * Unlike the files backend, which has to bypass the loose refs,
+	 * we can simply run a regular transaction; only the reflogs are
+	 * not written, just like for the initial packed-refs file.
+	 */
+	backend_data = xcalloc(1, sizeof(*backend_data));
+	backend_data->initial = 1;
+	transaction->backend_data = backend_data;
+
+	ret = reftable_transaction_prepare(ref_store, transaction, err);
+	if (!ret)
+		ret = reftable_transaction_finish(ref_store, transaction, err);
+	if (transaction->backend_data)
+		reftable_transaction_cleanup(transaction);
+	transaction->state = REF_TRANSACTION_CLOSED;
+	return ret;
+}
+
+static int reftable_pack_refs(struct ref_store *ref_store, unsigned int flags)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE | REF_STORE_ODB,
+				  "pack_refs");
+	int ret = reftable_stack_compact_all(&refs->main_stack);
+
+	if (refs->worktree_stack)
+		ret |= reftable_stack_compact_all(refs->worktree_stack);
+	return ret;
+}
+
+static int create_pseudoref_symref(const char *path, const char *target)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf err = STRBUF_INIT;
+	int fd;
+
+	fd = hold_lock_file_for_update_timeout(&lock, path, 0,
+					       get_files_ref_lock_timeout_ms());
+	if (fd < 0) {
+		unable_to_lock_message(path, errno, &err);
+		error("%s", err.buf);
+		strbuf_release(&err);
+		return -1;
+	}
+	if (write_in_full(fd, "ref: ", 5) < 0 ||
+	    write_str_in_full(fd, target) < 0 ||
+	    write_str_in_full(fd, "\n") < 0 ||
+	    commit_lock_file(&lock)) {
+		error_errno(_("unable to write symref for %s"), path);
+		rollback_lock_file(&lock);
+		return -1;
+	}
+	return 0;
+}
+
+static int reftable_create_symref(struct ref_store *ref_store,
+				  const char *refname, const char *target,
+				  const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_symref");
+	struct reftable_stack *st;
+	struct stack_records sr;
+	struct reftable_ref_record *rec;
+	struct object_id old_oid, new_oid;
+	struct strbuf err = STRBUF_INIT;
+	const char *name;
+	char *path;
+	int ret = -1;
+
+	path = pseudoref_path(refs, refname);
+	if (path) {
+		ret = create_pseudoref_symref(path, target);
+		free(path);
+		return ret;
+	}
+
+	st = stack_for(refs, refname, &name);
+	if (reftable_stack_lock(st, &err)) {
+		error("%s", err.buf);
+		goto out;
+	}
+	if (refs_verify_refname_available(&refs->base, refname,
+					  NULL, NULL, &err)) {
+		error("%s", err.buf);
+		reftable_stack_unlock(st);
+		goto out;
+	}
+
+	if (refs_read_ref_full(&refs->base, refname, 0, &old_oid, NULL))
+		oidclr(&old_oid);
+
+	stack_records_init(&sr, st);
+	rec = add_ref_record(&sr, name, REFTABLE_REF_SYMREF);
+	rec->target = target;
+	if (logmsg &&
+	    !refs_read_ref_full(&refs->base, target,
+				RESOLVE_REF_READING, &new_oid, NULL) &&
+	    should_write_log(st, name, 0))
+		add_log_entry(&sr, name, &old_oid, &new_oid, logmsg);
+
+	ret = reftable_stack_add(st, sr.update_index, sr.refs, sr.refs_nr,
+				 sr.logs, sr.logs_nr, &err);
+	stack_records_release(&sr);
+	if (ret)
+		error("unable to write symref for %s: %s", refname, err.buf);
+	else
+		reftable_stack_auto_compact(st);
+out:
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_delete_refs(struct ref_store *ref_store, const char *msg,
+				struct string_list *refnames, unsigned int flags)
+{
+	struct ref_transaction *transaction;
+	struct strbuf err = STRBUF_INIT;
+	int i;
+
+	if (!refnames->nr)
+		return 0;
+
+	/* Unlike loose refs, any number of refs can be deleted at once. */
+	transaction = ref_store_transaction_begin(ref_store, &err);
+	if (!transaction)
+		goto error;
+
+	for (i = 0; i < refnames->nr; i++) {
+		const char *refname = refnames->items[i].string;
+
+		if (ref_transaction_delete(transaction, refname, NULL,
+					   flags, msg, &err))
+			goto error;
+	}
+
+	if (ref_transaction_commit(transaction, &err))
+		goto error;
+
+	ref_transaction_free(transaction);
+	strbuf_release(&err);
+	return 0;
+
+error:
+	if (refnames->nr == 1)
+		error(_("could not delete reference %s: %s"),
+		      refnames->items[0].string, err.buf);
+	else
+		error(_("could not delete references: %s"), err.buf);
+
+	ref_transaction_free(transaction);
+	strbuf_release(&err);
+	return -1;
+}
+
+/* Return whether HEAD is kept in `st` and is a symref to `refname`. */
+static int head_points_to(struct reftable_ref_store *refs,
+			  struct reftable_stack *st, const char *refname)
+{
+	const char *head_ref, *name;
+	int flag = 0;
+
+	if (stack_for(refs, "HEAD", &name) != st)
+		return 0;
+	head_ref = refs_resolve_ref_unsafe(&refs->base, "HEAD",
+					   RESOLVE_REF_NO_RECURSE, NULL, &flag);
+	return head_ref && (flag & REF_ISSYMREF) && !strcmp(head_ref, refname);
+}
+
+static int reftable_copy_or_rename_ref(struct ref_store *ref_store,
+				       const char *oldrefname,
+				       const char *newrefname,
+				       const char *logmsg, int copy)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "rename_ref");
+	struct reftable_iterator it = REFTABLE_ITERATOR_INIT;
+	struct reftable_log_record log;
+	struct reftable_stack *st, *new_st;
+	struct stack_records sr;
+	struct object_id orig_oid;
+	struct strbuf err = STRBUF_INIT;
+	const char *oldname, *newname;
+	uint64_t *copied = NULL;
+	size_t copied_nr = 0, copied_alloc = 0;
+	int flag = 0, same = !strcmp(oldrefname, newrefname);
+	int ret;
+
+	st = stack_for(refs, oldrefname, &oldname);
+	new_st = stack_for(refs, newrefname, &newname);
+	if (st != new_st)
+		return error("cannot move '%s' to '%s' across worktrees",
+			     oldrefname, newrefname);
+
+	if (!refs_resolve_ref_unsafe(&refs->base, oldrefname,
+				     RESOLVE_REF_READING | RESOLVE_REF_NO_RECURSE,
+				     &orig_oid, &flag))
+		return error("refname %s not found", oldrefname);
+
+	if (flag & REF_ISSYMREF) {
+		if (copy)
+			return error("refname %s is a symbolic ref, copying it is not supported",
+				     oldrefname);
+		else
+			return error("refname %s is a symbolic ref, renaming it is not supported",
+				     oldrefname);
+	}
+	if (!same && !copy &&
+	    !refs_rename_ref_available(&refs->base, oldrefname, newrefname))
+		return 1;
+	if (!same && copy &&
+	    refs_verify_refname_available(&refs->base, newrefname,
+					  NULL, NULL, &err)) {
+		error("%s", err.buf);
+		strbuf_release(&err);
+		return 1;
+	}
+
+	if (reftable_stack_lock(st, &err)) {
+		if (copy)
+			error("unable to copy '%s' to '%s': %s", oldrefname, newrefname, err.buf);
+		else
+			error("unable to rename '%s' to '%s': %s", oldrefname, newrefname, err.buf);
+		strbuf_release(&err);
+		return 1;
+	}
+
+	/*
+	 * All of this happens in a single table, so that there is no
+	 * need for a rollback if anything goes wrong.
+	 */
+	stack_records_init(&sr, st);
+	add_ref_value(&sr, newname, &orig_oid);
+	if (!same) {
+		if (!copy) {
+			add_ref_record(&sr, oldname, REFTABLE_REF_DELETION);
+
+			/*
+			 * Like the files backend, which deletes the old
+			 * name before creating the new one, record the
+			 * deletion in the reflog of HEAD if it points here.
+			 */
+			if (head_points_to(refs, st, oldrefname) &&
+			    should_write_log(st, "HEAD", 0))
+				add_log_entry(&sr, "HEAD", &orig_oid,
+					      &null_oid, logmsg);
+		}
+
+		/* The reflog moves along with the reference. */
+		reftable_stack_seek_log(st, &it, oldname);
+		while (!reftable_iterator_next_log(&it, &log) &&
+		       !strcmp(log.refname, oldname)) {
+			struct reftable_log_record *rec;
+
+			rec = add_log_record(&sr, newname, log.update_index,
+					     log.value_type);
+			oidcpy(&rec->old_oid, &log.old_oid);
+			oidcpy(&rec->new_oid, &log.new_oid);
+			if (log.value_type == REFTABLE_LOG_UPDATE) {
+				rec->name = string_list_append(&sr.strings, log.name)->string;
+				rec->email = string_list_append(&sr.strings, log.email)->string;
+				rec->message = string_list_append(&sr.strings, log.message)->string;
+			}
+			rec->time = log.time;
+			rec->tz = log.tz;
+			if (!copy)
+				add_log_record(&sr, oldname, log.update_index,
+					       REFTABLE_LOG_DELETION);
+
+			ALLOC_GROW(copied, copied_nr + 1, copied_alloc);
+			copied[copied_nr++] = log.update_index;
+		}
+		reftable_iterator_release(&it);
+
+		add_log_tombstones(&sr, newname, copied, copied_nr);
+	}
+	if (should_write_log(st, newname, 0) || copied_nr)
+		add_log_entry(&sr, newname, &orig_oid, &orig_oid, logmsg);
+
+	ret = reftable_stack_add(st, sr.update_index, sr.refs, sr.refs_nr,
+				 sr.logs, sr.logs_nr, &err);
+	if (ret) {
+		error("unable to write current sha1 into %s: %s", newrefname, err.buf);
+		ret = 1;
+	} else {
+		reftable_stack_auto_compact(st);
+	}
+
+	stack_records_release(&sr);
+	free(copied);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_rename_ref(struct ref_store *ref_store,
+			       const char *oldrefname, const char *newrefname,
+			       const char *logmsg)
+{
+	return reftable_copy_or_rename_ref(ref_store, oldrefname,
+					   newrefname, logmsg, 0);
+}
+
+static int reftable_copy_ref(struct ref_store *ref_store,
+			     const char *oldrefname, const char *newrefname,
+			     const char *logmsg)
+{
+	return reftable_copy_or_rename_ref(ref_store, oldrefname,
+					   newrefname, logmsg, 1);
+}
+
+struct reftable_reflog_iterator {
+	struct ref_iterator base;
+
+	struct ref_store *ref_store;
+	struct reftable_stack *st;
+	struct reftable_iterator it;
+	struct strbuf refname;
+	struct object_id oid;
+};
+
+static int reftable_reflog_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+	struct reftable_log_record rec;
+	int ok = ITER_DONE, ret;
+
+	while (!(ret = reftable_iterator_next_log(&iter->it, &rec))) {
+		int flags;
+
+		strbuf_reset(&iter->refname);
+		strbuf_addstr(&iter->refname, rec.refname);
+
+		/*
+		 * Skip the remaining entries of this reflog: the keys
+		 * of its entries are "<refname>\0<update index>".
+		 */
+		strbuf_addch(&iter->refname, '\1');
+		reftable_stack_seek_log(iter->st, &iter->it, iter->refname.buf);
+		strbuf_setlen(&iter->refname, iter->refname.len - 1);
+
+		if (refs_read_ref_full(iter->ref_store, iter->refname.buf, 0,
+				       &iter->oid, &flags)) {
+			error("bad ref for %s", iter->refname.buf);
+			continue;
+		}
+
+		iter->base.refname = iter->refname.buf;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ret < 0)
+		ok = ITER_ERROR;
+	if (ref_iterator_abort(ref_iterator) == ITER_ERROR)
+		ok = ITER_ERROR;
+	return ok;
+}
+
+static int reftable_reflog_iterator_peel(struct ref_iterator *ref_iterator,
+					 struct object_id *peeled)
+{
+	BUG("ref_iterator_peel() called for reflog_iterator");
+}
+
+static int reftable_reflog_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	reftable_iterator_release(&iter->it);
+	strbuf_release(&iter->refname);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_reflog_iterator_vtable = {
+	reftable_reflog_iterator_advance,
+	reftable_reflog_iterator_peel,
+	reftable_reflog_iterator_abort
+};
+
+static struct ref_iterator *reflog_iterator_begin(struct ref_store *ref_store,
+						  struct reftable_stack *st)
+{
+	struct reftable_reflog_iterator *iter = xcalloc(1, sizeof(*iter));
+	struct reftable_iterator blank = REFTABLE_ITERATOR_INIT;
+	struct ref_iterator *ref_iterator = &iter->base;
+
+	base_ref_iterator_init(ref_iterator, &reftable_reflog_iterator_vtable, 1);
+	iter->ref_store = ref_store;
+	iter->st = st;
+	memcpy(&iter->it, &blank, sizeof(blank));
+	strbuf_init(&iter->refname, 0);
+
+	stack_reload_or_die(st);
+	reftable_stack_seek_log(st, &iter->it, "");
+	return ref_iterator;
+}
+
+static enum iterator_selection reflog_iterator_select(
+	struct ref_iterator *iter_worktree,
+	struct ref_iterator *iter_common,
+	void *cb_data)
+{
+	if (iter_worktree) {
+		/*
+		 * We're a bit loose here. We probably should ignore
+		 * common refs if they are accidentally added as
+		 * per-worktree refs.
+		 */
+		return ITER_SELECT_0;
+	} else if (iter_common) {
+		if (ref_type(iter_common->refname) == REF_TYPE_NORMAL)
+			return ITER_SELECT_1;
+
+		/*
+		 * The main ref store may contain main worktree's
+		 * per-worktree refs, which should be ignored
+		 */
+		return ITER_SKIP_1;
+	} else
+		return ITER_DONE;
+}
+
+static struct ref_iterator *reftable_reflog_iterator_begin(struct ref_store *ref_store)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "reflog_iterator_begin");
+
+	if (!refs->worktree_stack)
+		return reflog_iterator_begin(ref_store, &refs->main_stack);
+
+	return merge_ref_iterator_begin(
+		0,
+		reflog_iterator_begin(ref_store, refs->worktree_stack),
+		reflog_iterator_begin(ref_store, &refs->main_stack),
+		reflog_iterator_select, refs);
+}
+
+static int reftable_for_each_reflog_ent_reverse(struct ref_store *ref_store,
+						const char *refname,
+						each_reflog_ent_fn fn,
+						void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "for_each_reflog_ent_reverse");
+	struct reftable_iterator it = REFTABLE_ITERATOR_INIT;
+	struct reftable_log_record rec;
+	struct reftable_stack *st;
+	struct strbuf email = STRBUF_INIT;
+	struct strbuf message = STRBUF_INIT;
+	const char *name;
+	int ret = 0;
+
+	st = stack_for(refs, refname, &name);
+	stack_reload_or_die(st);
+
+	/* Entries are sorted from the newest to the oldest. */
+	reftable_stack_seek_log(st, &it, name);
+	while (!ret && !reftable_iterator_next_log(&it, &rec) &&
+	       !strcmp(rec.refname, name)) {
+		if (rec.value_type != REFTABLE_LOG_UPDATE)
+			continue;
+		strbuf_reset(&email);
+		strbuf_addf(&email, "%s <%s>", rec.name, rec.email);
+		strbuf_reset(&message);
+		strbuf_addf(&message, "%s\n", rec.message);
+		ret = fn(&rec.old_oid, &rec.new_oid, email.buf,
+			 rec.time, rec.tz, message.buf, cb_data);
+	}
+
+	reftable_iterator_release(&it);
+	strbuf_release(&email);
+	strbuf_release(&message);
+	return ret;
+}
+
+struct reflog_ent {
+	struct object_id old_oid, new_oid;
+	char *email;
+	timestamp_t time;
+	int tz;
+	char *message;
+};
+
+struct reflog_ents {
+	struct reflog_ent *ents;
+	size_t nr, alloc;
+};
+
+static int collect_reflog_ent(struct object_id *old_oid,
+			      struct object_id *new_oid,
+			      const char *email, timestamp_t time, int tz,
+			      const char *message, void *cb_data)
+{
+	struct reflog_ents *ents = cb_data;
+	struct reflog_ent *ent;
+
+	ALLOC_GROW(ents->ents, ents->nr + 1, ents->alloc);
+	ent = &ents->ents[ents->nr++];
+	oidcpy(&ent->old_oid, old_oid);
+	oidcpy(&ent->new_oid, new_oid);
+	ent->email = xstrdup(email);
+	ent->time = time;
+	ent->tz = tz;
+	ent->message = xstrdup(message);
+	return 0;
+}
+
+static int reftable_for_each_reflog_ent(struct ref_store *ref_store,
+					const char *refname,
+					each_reflog_ent_fn fn,
+					void *cb_data)
+{
+	struct reflog_ents ents = { NULL };
+	size_t i;
+	int ret = 0;
+
+	reftable_for_each_reflog_ent_reverse(ref_store, refname,
+					     collect_reflog_ent, &ents);
+	for (i = ents.nr; i--; ) {
+		struct reflog_ent *ent = &ents.ents[i];
+
+		if (!ret)
+			ret = fn(&ent->old_oid, &ent->new_oid, ent->email,
+				 ent->time, ent->tz, ent->message, cb_data);
+		free(ent->email);
+		free(ent->message);
+	}
+	free(ents.ents);
+	return ret;
+}
+
+static int reftable_reflog_exists(struct ref_store *ref_store,
+				  const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "reflog_exists");
+	struct reftable_stack *st;
+	const char *name;
+
+	st = stack_for(refs, refname, &name);
+	stack_reload_or_die(st);
+	return stack_reflog_exists(st, name);
+}
+
+static int reftable_create_reflog(struct ref_store *ref_store,
+				  const char *refname, int force_create,
+				  struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_reflog");
+	struct reftable_stack *st;
+	struct stack_records sr;
+	const char *name;
+	int ret;
+
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ? LOG_REFS_NONE : LOG_REFS_NORMAL;
+	if (!force_create && !should_autocreate_reflog(refname))
+		return 0;
+
+	st = stack_for(refs, refname, &name);
+	if (reftable_stack_lock(st, err))
+		return -1;
+
+	stack_records_init(&sr, st);
+	if (!stack_reflog_exists(st, name))
+		add_log_record(&sr, name, sr.update_index,
+			       REFTABLE_LOG_EXISTENCE);
+	ret = reftable_stack_add(st, sr.update_index, sr.refs, sr.refs_nr,
+				 sr.logs, sr.logs_nr, err);
+	stack_records_release(&sr);
+	return ret;
+}
+
+static int reftable_delete_reflog(struct ref_store *ref_store,
+				  const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "delete_reflog");
+	struct reftable_stack *st;
+	struct stack_records sr;
+	struct strbuf err = STRBUF_INIT;
+	const char *name;
+	int ret;
+
+	st = stack_for(refs, refname, &name);
+	if (reftable_stack_lock(st, &err)) {
+		ret = error("%s", err.buf);
+		strbuf_release(&err);
+		return ret;
+	}
+
+	stack_records_init(&sr, st);
+	add_log_tombstones(&sr, name, NULL, 0);
+	ret = reftable_stack_add(st, sr.update_index, sr.refs, sr.refs_nr,
+				 sr.logs, sr.logs_nr, &err);
+	if (ret)
+		error("%s", err.buf);
+	stack_records_release(&sr);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_reflog_expire(struct ref_store *ref_store,
+				  const char *refname, const struct object_id *oid,
+				  unsigned int flags,
+				  reflog_expiry_prepare_fn prepare_fn,
+				  reflog_expiry_should_prune_fn should_prune_fn,
+				  reflog_expiry_cleanup_fn cleanup_fn,
+				  void *policy_cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "reflog_expire");
+	struct reftable_iterator it = REFTABLE_ITERATOR_INIT;
+	struct reftable_log_record rec;
+	struct reftable_log_record *entries = NULL;
+	size_t entries_nr = 0, entries_alloc = 0, i;
+	struct reftable_stack *st;
+	struct stack_records sr;
+	struct object_id last_kept_oid, ref_oid;
+	struct strbuf referent = STRBUF_INIT;
+	struct strbuf email = STRBUF_INIT;
+	struct strbuf message = STRBUF_INIT;
+	struct strbuf err = STRBUF_INIT;
+	unsigned int value_type = REFTABLE_REF_DELETION;
+	const char *name;
+	int dry_run = flags & EXPIRE_REFLOGS_DRY_RUN;
+	int status = 0, kept = 0;
+
+	/*
+	 * The reflog is locked by holding the lock on the stack, which
+	 * also allows us to update the reference if --updateref was
+	 * specified.
+	 */
+	st = stack_for(refs, refname, &name);
+	if (reftable_stack_lock(st, &err)) {
+		error("cannot lock ref '%s': %s", refname, err.buf);
+		strbuf_release(&err);
+		return -1;
+	}
+	if (!stack_reflog_exists(st, name)) {
+		reftable_stack_unlock(st);
+		return 0;
+	}
+	oidclr(&ref_oid);
+	if (reftable_stack_read_ref(st, name, &ref_oid, &referent,
+				    &value_type) < 0)
+		value_type = REFTABLE_REF_DELETION;
+
+	stack_records_init(&sr, st);
+
+	/* Collect the entries, which are stored newest first. */
+	reftable_stack_seek_log(st, &it, name);
+	while (!reftable_iterator_next_log(&it, &rec) &&
+	       !strcmp(rec.refname, name)) {
+		struct reftable_log_record *e;
+
+		if (rec.value_type != REFTABLE_LOG_UPDATE)
+			continue;
+		ALLOC_GROW(entries, entries_nr + 1, entries_alloc);
+		e = &entries[entries_nr++];
+		*e = rec;
+		e->refname = name;
+		e->name = string_list_append(&sr.strings, rec.name)->string;
+		e->email = string_list_append(&sr.strings, rec.email)->string;
+		e->message = string_list_append(&sr.strings, rec.message)->string;
+	}
+	reftable_iterator_release(&it);
+
+	(*prepare_fn)(refname, oid, policy_cb_data);
+	oidclr(&last_kept_oid);
+	for (i = entries_nr; i--; ) {
+		struct reftable_log_record *e = &entries[i];
+		struct object_id *ooid = &e->old_oid;
+
+		if (flags & EXPIRE_REFLOGS_REWRITE)
+			ooid = &last_kept_oid;
+
+		strbuf_reset(&email);
+		strbuf_addf(&email, "%s <%s>", e->name, e->email);
+		strbuf_reset(&message);
+		strbuf_addf(&message, "%s\n", e->message);
+
+		if ((*should_prune_fn)(ooid, &e->new_oid, email.buf,
+				       e->time, e->tz, message.buf,
+				       policy_cb_data)) {
+			if (dry_run)
+				printf("would prune %s", message.buf);
+			else if (flags & EXPIRE_REFLOGS_VERBOSE)
+				printf("prune %s", message.buf);
+			add_log_record(&sr, name, e->update_index,
+				       REFTABLE_LOG_DELETION);
+		} else {
+			if (!dry_run) {
+				if (!oideq(ooid, &e->old_oid)) {
+					struct reftable_log_record *n;
+
+					n = add_log_record(&sr, name,
+							   e->update_index,
+							   REFTABLE_LOG_UPDATE);
+					*n = *e;
+					oidcpy(&n->old_oid, ooid);
+				}
+				oidcpy(&last_kept_oid, &e->new_oid);
+				kept++;
+			}
+			if (flags & EXPIRE_REFLOGS_VERBOSE)
+				printf("keep %s", message.buf);
+		}
+	}
+	(*cleanup_fn)(policy_cb_data);
+
+	if (dry_run) {
+		reftable_stack_unlock(st);
+	} else {
+		/*
+		 * It doesn't make sense to adjust a reference pointed
+		 * to by a symbolic ref based on expiring entries in
+		 * the symbolic reference's reflog. Nor can we update
+		 * a reference if there are no remaining reflog
+		 * entries.
+		 */
+		int update = (flags & EXPIRE_REFLOGS_UPDATE_REF) &&
+			value_type != REFTABLE_REF_SYMREF &&
+			!is_null_oid(&last_kept_oid);
+
+		if (update && !oideq(&ref_oid, &last_kept_oid))
+			add_ref_value(&sr, name, &last_kept_oid);
+		/* Like an emptied reflog file, an emptied reflog stays. */
+		if (!kept)
+			add_log_record(&sr, name, sr.update_index,
+				       REFTABLE_LOG_EXISTENCE);
+		if (reftable_stack_add(st, sr.update_index,
+				       sr.refs, sr.refs_nr,
+				       sr.logs, sr.logs_nr, &err))
+			status |= error("unable to write reflog '%s' (%s)",
+					refname, err.buf);
+	}
+
+	stack_records_release(&sr);
+	free(entries);
+	strbuf_release(&referent);
+	strbuf_release(&email);
+	strbuf_release(&message);
+	strbuf_release(&err);
+	return status;
+}
+
+static int reftable_init_db(struct ref_store *ref_store, struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "init_db");
+	struct strbuf sb = STRBUF_INIT;
+
+	safe_create_dir(refs->main_stack.dir, 1);
+
+	/*
+	 * Older versions of Git only recognize a repository by its
+	 * "refs" directory and a valid HEAD file. Keep these around, with
+	 * a HEAD that points nowhere, so that they at least fail
+	 * gracefully.
+	 */
+	strbuf_addf(&sb, "%s/refs", refs->gitcommondir);
+	safe_create_dir(sb.buf, 1);
+
+	strbuf_reset(&sb);
+	strbuf_addf(&sb, "%s/HEAD", refs->gitdir);
+	if (!file_exists(sb.buf))
+		write_file(sb.buf, "ref: refs/heads/.invalid");
+
+	strbuf_release(&sb);
+	return 0;
+}
+
+struct ref_storage_be refs_be_reftable = {
+	&refs_be_files,
+	"reftable",
+	reftable_ref_store_create,
+	reftable_init_db,
+	reftable_transaction_prepare,
+	reftable_transaction_finish,
+	reftable_transaction_abort,
+	reftable_initial_transaction_commit,
+
+	reftable_pack_refs,
+	reftable_create_symref,
+	reftable_delete_refs,
+	reftable_rename_ref,
+	reftable_copy_ref,
+
+	reftable_ref_iterator_begin,
+	reftable_read_raw_ref,
+
+	reftable_reflog_iterator_begin,
+	reftable_for_each_reflog_ent,
+	reftable_for_each_reflog_ent_reverse,
+	reftable_reflog_exists,
+	reftable_create_reflog,
+	reftable_delete_reflog,
+	reftable_reflog_expire
+};
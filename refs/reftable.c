@@ -0,0 +1,1665 @@
+#include "../cache.h"
+#include "../lockfile.h"
+#include "../tempfile.h"
+#include "../string-list.h"
+#include "../varint.h"
+#include "reftable.h"
+
+/*
+ * A reftable consists of a header, the ref blocks followed by their
+ * (optional) index block, the log blocks followed by their (optional)
+ * index block, and a footer. All integers are in network byte order.
+ *
+ *   header: "REFT", uint32 version, uint32 hash function id,
+ *           uint64 min_update_index, uint64 max_update_index
+ *   footer: a copy of the header,
+ *           uint64 offset of the ref index block (0 if none),
+ *           uint64 offset of the first log block (0 if none),
+ *           uint64 offset of the log index block (0 if none),
+ *           uint32 CRC-32 of the preceding footer bytes
+ */
+#define REFTABLE_SIGNATURE 0x52454654 /* "REFT" */
+#define REFTABLE_VERSION 1
+#define REFTABLE_HEADER_SIZE 28
+#define REFTABLE_FOOTER_SIZE (REFTABLE_HEADER_SIZE + 28)
+
+/*
+ * A block starts with its type and its total length as a uint32,
+ * followed by its records and the restart table: the uint32 offsets
+ * (relative to the block start) of the records storing their key in
+ * full, and the number of these offsets as a uint32.
+ *
+ * A record is varint(prefix_length), varint(suffix_length << 3 |
+ * value_type), the suffix of its key that follows the prefix shared
+ * with the key of the previous record, and its value. The keys of an
+ * index block are the last keys of the blocks of its section, and its
+ * values the varint offsets of these blocks.
+ */
+#define BLOCK_TYPE_REF 'r'
+#define BLOCK_TYPE_LOG 'g'
+#define BLOCK_TYPE_INDEX 'i'
+#define BLOCK_HEADER_SIZE 5
+
+/* The size above which ref and log blocks are not extended. */
+#define REFTABLE_BLOCK_SIZE 4096
+
+/* Every REFTABLE_RESTART_INTERVAL-th record of a block is a restart point. */
+#define REFTABLE_RESTART_INTERVAL 16
+
+/* How long to retry acquiring the lock on `tables.list`. */
+#define REFTABLE_LOCK_TIMEOUT_MS 1000
+
+struct reftable_table {
+	/* The file name of the table within the stack directory. */
+	char *name;
+	int refcount;
+
+	const unsigned char *map;
+	size_t size;
+
+	uint64_t min_update_index;
+	uint64_t max_update_index;
+	size_t ref_index_offset;
+	size_t log_offset;
+	size_t log_index_offset;
+
+	/* The offset of the footer, at which the blocks end. */
+	size_t blocks_end;
+};
+
+struct reftable_table_iter {
+	struct reftable_table *t;
+	unsigned char block_type;
+
+	/* The extent of the current block. */
+	size_t block_start;
+	size_t block_end;
+
+	/* The next record to decode, and where the records end. */
+	const unsigned char *next;
+	const unsigned char *records_end;
+
+	/* The key, value type and value of the current record. */
+	struct strbuf key;
+	unsigned int value_type;
+	const unsigned char *value;
+
+	unsigned int done : 1,
+		     corrupt : 1;
+};
+
+/*
+ * Like decode_varint(), but do not read beyond `end`. Return 0 on
+ * success or -1 if the varint is truncated or overflows.
+ */
+static int get_varint(const unsigned char **bufp, const unsigned char *end,
+		      uint64_t *out)
+{
+	const unsigned char *buf = *bufp;
+	unsigned char c;
+	uint64_t val;
+
+	if (buf >= end)
+		return -1;
+	c = *buf++;
+	val = c & 127;
+	while (c & 128) {
+		val += 1;
+		if (!val || (val >> 57) || buf >= end)
+			return -1;
+		c = *buf++;
+		val = (val << 7) + (c & 127);
+	}
+	*bufp = buf;
+	*out = val;
+	return 0;
+}
+
+static void put_varint(struct strbuf *sb, uint64_t value)
+{
+	unsigned char buf[16];
+
+	strbuf_add(sb, buf, encode_varint(value, buf));
+}
+
+static int get_string(const unsigned char **bufp, const unsigned char *end,
+		      struct strbuf *out)
+{
+	uint64_t len;
+
+	if (get_varint(bufp, end, &len) || len > end - *bufp)
+		return -1;
+	if (out) {
+		strbuf_reset(out);
+		strbuf_add(out, *bufp, len);
+	}
+	*bufp += len;
+	return 0;
+}
+
+static void put_string(struct strbuf *sb, const char *s)
+{
+	size_t len = s ? strlen(s) : 0;
+
+	put_varint(sb, len);
+	strbuf_add(sb, s, len);
+}
+
+static void table_unref(struct reftable_table *t)
+{
+	if (!t || --t->refcount)
+		return;
+	if (t->map)
+		munmap((void *)t->map, t->size);
+	free(t->name);
+	free(t);
+}
+
+static int parse_footer(struct reftable_table *t)
+{
+	const unsigned char *header = t->map;
+	const unsigned char *footer;
+
+	if (t->size < REFTABLE_HEADER_SIZE + REFTABLE_FOOTER_SIZE)
+		return -1;
+	footer = t->map + t->size - REFTABLE_FOOTER_SIZE;
+
+	if (get_be32(header) != REFTABLE_SIGNATURE ||
+	    get_be32(header + 4) != REFTABLE_VERSION ||
+	    get_be32(header + 8) != the_hash_algo->format_id ||
+	    memcmp(header, footer, REFTABLE_HEADER_SIZE) ||
+	    get_be32(footer + REFTABLE_FOOTER_SIZE - 4) !=
+	    (uint32_t)crc32(0, footer, REFTABLE_FOOTER_SIZE - 4))
+		return -1;
+
+	t->min_update_index = get_be64(header + 12);
+	t->max_update_index = get_be64(header + 20);
+	t->ref_index_offset = get_be64(footer + REFTABLE_HEADER_SIZE);
+	t->log_offset = get_be64(footer + REFTABLE_HEADER_SIZE + 8);
+	t->log_index_offset = get_be64(footer + REFTABLE_HEADER_SIZE + 16);
+	t->blocks_end = t->size - REFTABLE_FOOTER_SIZE;
+
+	if (t->min_update_index > t->max_update_index ||
+	    t->ref_index_offset >= t->blocks_end ||
+	    t->log_offset >= t->blocks_end ||
+	    t->log_index_offset >= t->blocks_end)
+		return -1;
+	return 0;
+}
+
+/*
+ * Open and map the table `name` in `dir`. Return NULL and set errno if
+ * it cannot be opened or is corrupt.
+ */
+static struct reftable_table *table_open(const char *dir, const char *name)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct reftable_table *t = NULL;
+	struct stat st;
+	int fd;
+
+	strbuf_addf(&path, "%s/%s", dir, name);
+	fd = git_open(path.buf);
+	if (fd < 0)
+		goto out;
+	if (fstat(fd, &st)) {
+		close(fd);
+		goto out;
+	}
+
+	t = xcalloc(1, sizeof(*t));
+	t->name = xstrdup(name);
+	t->refcount = 1;
+	t->size = xsize_t(st.st_size);
+	if (t->size)
+		t->map = xmmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (parse_footer(t)) {
+		error(_("reftable '%s' is corrupt"), path.buf);
+		table_unref(t);
+		t = NULL;
+		errno = EINVAL;
+	}
+out:
+	strbuf_release(&path);
+	return t;
+}
+
+static int parse_ref_value(const struct reftable_table *t,
+			   unsigned int value_type,
+			   const unsigned char **bufp, const unsigned char *end,
+			   struct reftable_ref_record *rec, struct strbuf *target)
+{
+	const unsigned char *p = *bufp;
+	size_t rawsz = the_hash_algo->rawsz;
+	uint64_t delta;
+
+	if (get_varint(&p, end, &delta) ||
+	    delta > t->max_update_index - t->min_update_index)
+		return -1;
+	if (rec) {
+		rec->update_index = t->min_update_index + delta;
+		rec->value_type = value_type;
+		rec->target = NULL;
+	}
+
+	switch (value_type) {
+	case REFTABLE_REF_DELETION:
+		break;
+	case REFTABLE_REF_VAL1:
+	case REFTABLE_REF_VAL2:
+		if (end - p < (value_type == REFTABLE_REF_VAL1 ? 1 : 2) * rawsz)
+			return -1;
+		if (rec) {
+			hashcpy(rec->oid.hash, p);
+			if (value_type == REFTABLE_REF_VAL2)
+				hashcpy(rec->peeled.hash, p + rawsz);
+			else
+				oidclr(&rec->peeled);
+		}
+		p += (value_type == REFTABLE_REF_VAL1 ? 1 : 2) * rawsz;
+		break;
+	case REFTABLE_REF_SYMREF:
+		if (get_string(&p, end, target))
+			return -1;
+		if (rec)
+			rec->target = target->buf;
+		break;
+	default:
+		return -1;
+	}
+
+	*bufp = p;
+	return 0;
+}
+
+static int parse_log_value(unsigned int value_type,
+			   const unsigned char **bufp, const unsigned char *end,
+			   struct reftable_log_record *rec,
+			   struct reftable_iterator *it)
+{
+	const unsigned char *p = *bufp;
+	size_t rawsz = the_hash_algo->rawsz;
+	uint64_t time;
+
+	if (rec) {
+		rec->value_type = value_type;
+		rec->name = rec->email = rec->message = NULL;
+	}
+
+	switch (value_type) {
+	case REFTABLE_LOG_DELETION:
+	case REFTABLE_LOG_EXISTENCE:
+		break;
+	case REFTABLE_LOG_UPDATE:
+		if (end - p < 2 * rawsz)
+			return -1;
+		if (rec) {
+			hashcpy(rec->old_oid.hash, p);
+			hashcpy(rec->new_oid.hash, p + rawsz);
+		}
+		p += 2 * rawsz;
+		if (get_string(&p, end, it ? &it->name : NULL) ||
+		    get_string(&p, end, it ? &it->email : NULL) ||
+		    get_varint(&p, end, &time) ||
+		    end - p < 2)
+			return -1;
+		if (rec) {
+			rec->time = time;
+			rec->tz = (int16_t)get_be16(p);
+		}
+		p += 2;
+		if (get_string(&p, end, it ? &it->message : NULL))
+			return -1;
+		if (rec) {
+			rec->name = it->name.buf;
+			rec->email = it->email.buf;
+			rec->message = it->message.buf;
+		}
+		break;
+	default:
+		return -1;
+	}
+
+	*bufp = p;
+	return 0;
+}
+
+/*
+ * Start reading the block of the given type at `off`. Return 0 on
+ * success, 1 if there is no block of that type at `off`, or -1 if the
+ * block is corrupt.
+ */
+static int open_block(struct reftable_table_iter *ti, unsigned char type,
+		      size_t off)
+{
+	const unsigned char *block = ti->t->map + off;
+	uint32_t len, restarts;
+
+	if (off + BLOCK_HEADER_SIZE > ti->t->blocks_end || *block != type)
+		return 1;
+	len = get_be32(block + 1);
+	if (len < BLOCK_HEADER_SIZE + 4 || len > ti->t->blocks_end - off)
+		return -1;
+	restarts = get_be32(block + len - 4);
+	if (!restarts || restarts > (len - BLOCK_HEADER_SIZE - 4) / 4)
+		return -1;
+
+	ti->block_start = off;
+	ti->block_end = off + len;
+	ti->next = block + BLOCK_HEADER_SIZE;
+	ti->records_end = block + len - 4 - 4 * restarts;
+	strbuf_reset(&ti->key);
+	return 0;
+}
+
+/*
+ * Decode the record at `ti->next`, moving on to the next block of the
+ * same type once the current one is exhausted. Return 0 on success, 1
+ * at the end of the section, or -1 if the table is corrupt.
+ */
+static int table_iter_next(struct reftable_table_iter *ti)
+{
+	const unsigned char *p, *end;
+	uint64_t prefix_len, suffix_type, suffix_len;
+	int ret;
+
+	if (ti->corrupt)
+		return -1;
+	if (ti->done)
+		return 1;
+
+	if (ti->next >= ti->records_end) {
+		ret = open_block(ti, ti->block_type, ti->block_end);
+		if (ret)
+			goto stop;
+	}
+	p = ti->next;
+	end = ti->records_end;
+
+	ret = -1;
+	if (get_varint(&p, end, &prefix_len) ||
+	    get_varint(&p, end, &suffix_type))
+		goto stop;
+	suffix_len = suffix_type >> 3;
+	if (prefix_len > ti->key.len || suffix_len > end - p)
+		goto stop;
+	strbuf_setlen(&ti->key, prefix_len);
+	strbuf_add(&ti->key, p, suffix_len);
+	p += suffix_len;
+
+	ti->value_type = suffix_type & 7;
+	ti->value = p;
+	switch (ti->block_type) {
+	case BLOCK_TYPE_REF:
+		if (parse_ref_value(ti->t, ti->value_type, &p, end, NULL, NULL))
+			goto stop;
+		break;
+	case BLOCK_TYPE_LOG:
+		if (parse_log_value(ti->value_type, &p, end, NULL, NULL))
+			goto stop;
+		break;
+	default:
+		if (get_varint(&p, end, &prefix_len))
+			goto stop;
+		break;
+	}
+	ti->next = p;
+	return 0;
+
+stop:
+	ti->done = 1;
+	if (ret < 0)
+		ti->corrupt = 1;
+	return ret;
+}
+
+/*
+ * Position `ti`, whose current block has just been opened, at the
+ * first record whose key is not less than `want`. Return 0 on success,
+ * 1 if there is no such record, or -1 if the table is corrupt.
+ */
+static int table_iter_seek_key(struct reftable_table_iter *ti,
+			       const struct strbuf *want)
+{
+	const unsigned char *block = ti->t->map + ti->block_start;
+	const unsigned char *restarts = ti->records_end;
+	size_t lo = 0, hi = get_be32(ti->t->map + ti->block_end - 4);
+	uint32_t off;
+	int ret;
+
+	/* Find the first restart point whose key is greater than `want`. */
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+
+		off = get_be32(restarts + 4 * mi);
+		if (off < BLOCK_HEADER_SIZE || block + off >= ti->records_end)
+			return -1;
+		ti->next = block + off;
+		strbuf_reset(&ti->key);
+		if (table_iter_next(ti))
+			return -1;
+		if (strbuf_cmp(&ti->key, want) > 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+
+	/* The record we look for follows the restart point before it. */
+	off = lo ? get_be32(restarts + 4 * (lo - 1)) : BLOCK_HEADER_SIZE;
+	ti->next = block + off;
+	strbuf_reset(&ti->key);
+	do {
+		ret = table_iter_next(ti);
+		if (ret)
+			return ret;
+	} while (strbuf_cmp(&ti->key, want) < 0);
+	return 0;
+}
+
+/*
+ * Position `ti` at the first record of the given section of `t` whose
+ * key is not less than `want`, using the index of the section if there
+ * is one. Return 0 on success, 1 if there is no such record, or -1 if
+ * the table is corrupt.
+ */
+static int table_iter_seek(struct reftable_table_iter *ti,
+			   struct reftable_table *t, unsigned char type,
+			   const struct strbuf *want)
+{
+	size_t off, index_off;
+	int ret;
+
+	ti->t = t;
+	ti->done = ti->corrupt = 0;
+	if (type == BLOCK_TYPE_REF) {
+		off = REFTABLE_HEADER_SIZE;
+		index_off = t->ref_index_offset;
+	} else {
+		off = t->log_offset;
+		index_off = t->log_index_offset;
+		if (!off)
+			goto done;
+	}
+
+	if (index_off) {
+		const unsigned char *p;
+		uint64_t block_off;
+
+		ti->block_type = BLOCK_TYPE_INDEX;
+		if (open_block(ti, BLOCK_TYPE_INDEX, index_off))
+			goto corrupt;
+		ret = table_iter_seek_key(ti, want);
+		if (ret < 0)
+			goto corrupt;
+		if (ret > 0)
+			goto done;
+		p = ti->value;
+		if (get_varint(&p, ti->next, &block_off) ||
+		    block_off >= t->blocks_end)
+			goto corrupt;
+		off = block_off;
+	}
+
+	ti->done = ti->corrupt = 0;
+	ti->block_type = type;
+	ret = open_block(ti, type, off);
+	if (ret < 0)
+		goto corrupt;
+	if (ret > 0)
+		goto done;
+	ret = table_iter_seek_key(ti, want);
+	if (ret < 0)
+		goto corrupt;
+	if (ret > 0)
+		goto done;
+	return 0;
+
+done:
+	ti->block_type = type;
+	ti->done = 1;
+	return 1;
+corrupt:
+	ti->block_type = type;
+	ti->done = ti->corrupt = 1;
+	return -1;
+}
+
+static void iterator_release_subs(struct reftable_iterator *it)
+{
+	size_t i;
+
+	for (i = 0; i < it->nr; i++) {
+		strbuf_release(&it->subs[i].key);
+		table_unref(it->subs[i].t);
+	}
+	FREE_AND_NULL(it->subs);
+	it->nr = 0;
+}
+
+void reftable_iterator_release(struct reftable_iterator *it)
+{
+	iterator_release_subs(it);
+	strbuf_release(&it->key);
+	strbuf_release(&it->refname);
+	strbuf_release(&it->target);
+	strbuf_release(&it->name);
+	strbuf_release(&it->email);
+	strbuf_release(&it->message);
+}
+
+static void iterator_seek(struct reftable_iterator *it,
+			  struct reftable_table **tables, size_t nr,
+			  unsigned char type, const struct strbuf *want)
+{
+	size_t i;
+
+	iterator_release_subs(it);
+	it->block_type = type;
+	it->subs = xcalloc(nr, sizeof(*it->subs));
+	it->nr = nr;
+	for (i = 0; i < nr; i++) {
+		struct reftable_table_iter *ti = &it->subs[i];
+
+		strbuf_init(&ti->key, 0);
+		tables[i]->refcount++;
+		table_iter_seek(ti, tables[i], type, want);
+	}
+}
+
+/*
+ * Find the table holding the next record of the merged iteration,
+ * preferring newer tables for equal keys. Return 0 on success, 1 at
+ * the end of the iteration, or -1 if a table is corrupt.
+ */
+static int iterator_peek(struct reftable_iterator *it,
+			 struct reftable_table_iter **best)
+{
+	size_t i;
+
+	*best = NULL;
+	for (i = 0; i < it->nr; i++) {
+		struct reftable_table_iter *ti = &it->subs[i];
+
+		if (ti->corrupt)
+			return -1;
+		if (ti->done)
+			continue;
+		if (!*best || strbuf_cmp(&ti->key, &(*best)->key) <= 0)
+			*best = ti;
+	}
+	return *best ? 0 : 1;
+}
+
+/* Skip the records with the key `it->key` in all tables. */
+static int iterator_advance(struct reftable_iterator *it)
+{
+	size_t i;
+
+	for (i = 0; i < it->nr; i++) {
+		struct reftable_table_iter *ti = &it->subs[i];
+
+		if (!ti->done && !strbuf_cmp(&ti->key, &it->key) &&
+		    table_iter_next(ti) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+int reftable_iterator_next_ref(struct reftable_iterator *it,
+			       struct reftable_ref_record *rec)
+{
+	if (it->block_type != BLOCK_TYPE_REF)
+		BUG("reftable iterator is not positioned at refs");
+
+	for (;;) {
+		struct reftable_table_iter *best;
+		const unsigned char *p;
+		int ret = iterator_peek(it, &best);
+
+		if (ret)
+			return ret;
+		strbuf_reset(&it->key);
+		strbuf_addbuf(&it->key, &best->key);
+		p = best->value;
+		if (parse_ref_value(best->t, best->value_type, &p, best->next,
+				    rec, &it->target) ||
+		    iterator_advance(it))
+			return -1;
+		rec->refname = it->key.buf;
+
+		if (rec->value_type != REFTABLE_REF_DELETION ||
+		    it->include_deletions)
+			return 0;
+	}
+}
+
+int reftable_iterator_next_log(struct reftable_iterator *it,
+			       struct reftable_log_record *rec)
+{
+	if (it->block_type != BLOCK_TYPE_LOG)
+		BUG("reftable iterator is not positioned at logs");
+
+	for (;;) {
+		struct reftable_table_iter *best;
+		const unsigned char *p;
+		int ret = iterator_peek(it, &best);
+
+		if (ret)
+			return ret;
+		strbuf_reset(&it->key);
+		strbuf_addbuf(&it->key, &best->key);
+		if (it->key.len < 9 || it->key.buf[it->key.len - 9])
+			return -1;
+		p = best->value;
+		if (parse_log_value(best->value_type, &p, best->next,
+				    rec, it) ||
+		    iterator_advance(it))
+			return -1;
+
+		strbuf_reset(&it->refname);
+		strbuf_add(&it->refname, it->key.buf, it->key.len - 9);
+		rec->refname = it->refname.buf;
+		rec->update_index = ~get_be64(it->key.buf + it->key.len - 8);
+
+		if (rec->value_type != REFTABLE_LOG_DELETION ||
+		    it->include_deletions)
+			return 0;
+	}
+}
+
+struct writer_index_entry {
+	struct strbuf last_key;
+	uint64_t offset;
+};
+
+struct reftable_writer {
+	int fd;
+	unsigned char header[REFTABLE_HEADER_SIZE];
+	uint64_t min_update_index;
+	uint64_t max_update_index;
+
+	/* The number of bytes written so far. */
+	uint64_t offset;
+
+	/* The type of the current section, or 0 before the first record. */
+	unsigned char block_type;
+
+	/* The block being built, and its restart points. */
+	struct strbuf block;
+	uint32_t *restarts;
+	size_t restarts_nr, restarts_alloc;
+	size_t entries;
+	struct strbuf last_key;
+
+	/* The blocks of the current section, for its index. */
+	struct writer_index_entry *index;
+	size_t index_nr, index_alloc;
+
+	uint64_t ref_index_offset;
+	uint64_t log_offset;
+	uint64_t log_index_offset;
+
+	struct strbuf key;
+	struct strbuf value;
+	struct strbuf scratch;
+};
+
+static int writer_init(struct reftable_writer *w, int fd,
+		       uint64_t min_update_index, uint64_t max_update_index)
+{
+	memset(w, 0, sizeof(*w));
+	w->fd = fd;
+	w->min_update_index = min_update_index;
+	w->max_update_index = max_update_index;
+	strbuf_init(&w->block, REFTABLE_BLOCK_SIZE);
+	strbuf_init(&w->last_key, 0);
+	strbuf_init(&w->key, 0);
+	strbuf_init(&w->value, 0);
+	strbuf_init(&w->scratch, 0);
+
+	put_be32(w->header, REFTABLE_SIGNATURE);
+	put_be32(w->header + 4, REFTABLE_VERSION);
+	put_be32(w->header + 8, the_hash_algo->format_id);
+	put_be64(w->header + 12, min_update_index);
+	put_be64(w->header + 20, max_update_index);
+	if (write_in_full(fd, w->header, REFTABLE_HEADER_SIZE) < 0)
+		return -1;
+	w->offset = REFTABLE_HEADER_SIZE;
+	return 0;
+}
+
+static void writer_release(struct reftable_writer *w)
+{
+	size_t i;
+
+	for (i = 0; i < w->index_nr; i++)
+		strbuf_release(&w->index[i].last_key);
+	free(w->index);
+	free(w->restarts);
+	strbuf_release(&w->block);
+	strbuf_release(&w->last_key);
+	strbuf_release(&w->key);
+	strbuf_release(&w->value);
+	strbuf_release(&w->scratch);
+}
+
+static void block_start(struct reftable_writer *w, unsigned char type)
+{
+	strbuf_reset(&w->block);
+	strbuf_addch(&w->block, type);
+	strbuf_addchars(&w->block, 0, 4);
+	strbuf_reset(&w->last_key);
+	w->restarts_nr = 0;
+	w->entries = 0;
+}
+
+/*
+ * Append a record to the current block. If `limit` is non-zero, refuse
+ * to grow a non-empty block beyond that size and return -1 instead.
+ */
+static int block_add(struct reftable_writer *w, const struct strbuf *key,
+		     unsigned int value_type, const struct strbuf *value,
+		     size_t limit)
+{
+	int restart = !(w->entries % REFTABLE_RESTART_INTERVAL);
+	size_t prefix = 0;
+	struct strbuf *rec = &w->scratch;
+
+	if (!restart)
+		while (prefix < key->len && prefix < w->last_key.len &&
+		       key->buf[prefix] == w->last_key.buf[prefix])
+			prefix++;
+
+	strbuf_reset(rec);
+	put_varint(rec, prefix);
+	put_varint(rec, ((uint64_t)(key->len - prefix) << 3) | value_type);
+	strbuf_add(rec, key->buf + prefix, key->len - prefix);
+	strbuf_addbuf(rec, value);
+
+	if (limit && w->entries &&
+	    w->block.len + rec->len + 4 * (w->restarts_nr + restart + 1) > limit)
+		return -1;
+
+	if (restart) {
+		ALLOC_GROW(w->restarts, w->restarts_nr + 1, w->restarts_alloc);
+		w->restarts[w->restarts_nr++] = w->block.len;
+	}
+	strbuf_addbuf(&w->block, rec);
+	strbuf_reset(&w->last_key);
+	strbuf_addbuf(&w->last_key, key);
+	w->entries++;
+	return 0;
+}
+
+/*
+ * Write out the current block, if it has any records, remembering it
+ * for the index of its section if `indexed` is set.
+ */
+static int block_flush(struct reftable_writer *w, int indexed)
+{
+	unsigned char buf[4];
+	size_t i;
+
+	if (!w->entries)
+		return 0;
+
+	for (i = 0; i < w->restarts_nr; i++) {
+		put_be32(buf, w->restarts[i]);
+		strbuf_add(&w->block, buf, 4);
+	}
+	put_be32(buf, w->restarts_nr);
+	strbuf_add(&w->block, buf, 4);
+	put_be32(w->block.buf + 1, w->block.len);
+
+	if (write_in_full(w->fd, w->block.buf, w->block.len) < 0)
+		return -1;
+
+	if (indexed) {
+		struct writer_index_entry *e;
+
+		ALLOC_GROW(w->index, w->index_nr + 1, w->index_alloc);
+		e = &w->index[w->index_nr++];
+		strbuf_init(&e->last_key, 0);
+		strbuf_addbuf(&e->last_key, &w->last_key);
+		e->offset = w->offset;
+	}
+	w->offset += w->block.len;
+	w->entries = 0;
+	return 0;
+}
+
+/*
+ * Flush the last block of the current section, followed by an index
+ * block if the section has more than one block.
+ */
+static int writer_finish_section(struct reftable_writer *w)
+{
+	struct strbuf value = STRBUF_INIT;
+	size_t i;
+	int ret = 0;
+
+	if (!w->block_type)
+		return 0;
+	if (block_flush(w, 1))
+		return -1;
+
+	if (w->index_nr > 1) {
+		if (w->block_type == BLOCK_TYPE_REF)
+			w->ref_index_offset = w->offset;
+		else
+			w->log_index_offset = w->offset;
+
+		block_start(w, BLOCK_TYPE_INDEX);
+		for (i = 0; i < w->index_nr; i++) {
+			strbuf_reset(&value);
+			put_varint(&value, w->index[i].offset);
+			block_add(w, &w->index[i].last_key, 0, &value, 0);
+		}
+		ret = block_flush(w, 0);
+	}
+	strbuf_release(&value);
+
+	for (i = 0; i < w->index_nr; i++)
+		strbuf_release(&w->index[i].last_key);
+	w->index_nr = 0;
+	return ret;
+}
+
+static int writer_add(struct reftable_writer *w, unsigned char type,
+		      const struct strbuf *key, unsigned int value_type,
+		      const struct strbuf *value)
+{
+	if (w->block_type != type) {
+		if (w->block_type == BLOCK_TYPE_LOG)
+			BUG("reftable refs must be written before logs");
+		if (writer_finish_section(w))
+			return -1;
+		if (type == BLOCK_TYPE_LOG)
+			w->log_offset = w->offset;
+		w->block_type = type;
+		block_start(w, type);
+	}
+
+	if (block_add(w, key, value_type, value, REFTABLE_BLOCK_SIZE)) {
+		if (block_flush(w, 1))
+			return -1;
+		block_start(w, type);
+		block_add(w, key, value_type, value, 0);
+	}
+	return 0;
+}
+
+static int writer_add_ref(struct reftable_writer *w,
+			  const struct reftable_ref_record *rec)
+{
+	if (rec->update_index < w->min_update_index ||
+	    rec->update_index > w->max_update_index)
+		BUG("update index %"PRIu64" of ref '%s' is outside of the table",
+		    rec->update_index, rec->refname);
+
+	strbuf_reset(&w->key);
+	strbuf_addstr(&w->key, rec->refname);
+
+	strbuf_reset(&w->value);
+	put_varint(&w->value, rec->update_index - w->min_update_index);
+	switch (rec->value_type) {
+	case REFTABLE_REF_DELETION:
+		break;
+	case REFTABLE_REF_VAL2:
+		strbuf_add(&w->value, rec->oid.hash, the_hash_algo->rawsz);
+		strbuf_add(&w->value, rec->peeled.hash, the_hash_algo->rawsz);
+		break;
+	case REFTABLE_REF_VAL1:
+		strbuf_add(&w->value, rec->oid.hash, the_hash_algo->rawsz);
+		break;
+	case REFTABLE_REF_SYMREF:
+		put_string(&w->value, rec->target);
+		break;
+	default:
+		BUG("unknown ref value type %u", rec->value_type);
+	}
+
+	return writer_add(w, BLOCK_TYPE_REF, &w->key, rec->value_type,
+			  &w->value);
+}
+
+static int writer_add_log(struct reftable_writer *w,
+			  const struct reftable_log_record *rec)
+{
+	unsigned char buf[8];
+
+	strbuf_reset(&w->key);
+	strbuf_addstr(&w->key, rec->refname);
+	strbuf_addch(&w->key, '\0');
+	put_be64(buf, ~rec->update_index);
+	strbuf_add(&w->key, buf, 8);
+
+	strbuf_reset(&w->value);
+	switch (rec->value_type) {
+	case REFTABLE_LOG_DELETION:
+	case REFTABLE_LOG_EXISTENCE:
+		break;
+	case REFTABLE_LOG_UPDATE:
+		strbuf_add(&w->value, rec->old_oid.hash, the_hash_algo->rawsz);
+		strbuf_add(&w->value, rec->new_oid.hash, the_hash_algo->rawsz);
+		put_string(&w->value, rec->name);
+		put_string(&w->value, rec->email);
+		put_varint(&w->value, rec->time);
+		buf[0] = (rec->tz >> 8) & 0xff;
+		buf[1] = rec->tz & 0xff;
+		strbuf_add(&w->value, buf, 2);
+		put_string(&w->value, rec->message);
+		break;
+	default:
+		BUG("unknown log value type %u", rec->value_type);
+	}
+
+	return writer_add(w, BLOCK_TYPE_LOG, &w->key, rec->value_type,
+			  &w->value);
+}
+
+static int writer_finish(struct reftable_writer *w)
+{
+	unsigned char footer[REFTABLE_FOOTER_SIZE];
+
+	if (writer_finish_section(w))
+		return -1;
+
+	memcpy(footer, w->header, REFTABLE_HEADER_SIZE);
+	put_be64(footer + REFTABLE_HEADER_SIZE, w->ref_index_offset);
+	put_be64(footer + REFTABLE_HEADER_SIZE + 8, w->log_offset);
+	put_be64(footer + REFTABLE_HEADER_SIZE + 16, w->log_index_offset);
+	put_be32(footer + REFTABLE_FOOTER_SIZE - 4,
+		 crc32(0, footer, REFTABLE_FOOTER_SIZE - 4));
+	if (write_in_full(w->fd, footer, REFTABLE_FOOTER_SIZE) < 0)
+		return -1;
+	return 0;
+}
+
+void reftable_stack_init(struct reftable_stack *st, const char *dir)
+{
+	struct reftable_stack blank = REFTABLE_STACK_INIT;
+
+	memcpy(st, &blank, sizeof(*st));
+	st->dir = xstrdup(dir);
+}
+
+static void stack_clear_tables(struct reftable_stack *st)
+{
+	size_t i;
+
+	for (i = 0; i < st->nr; i++)
+		table_unref(st->tables[i]);
+	FREE_AND_NULL(st->tables);
+	st->nr = st->alloc = 0;
+}
+
+void reftable_stack_release(struct reftable_stack *st)
+{
+	if (is_lock_file_locked(&st->lock))
+		rollback_lock_file(&st->lock);
+	stack_clear_tables(st);
+	strbuf_release(&st->list);
+	FREE_AND_NULL(st->dir);
+}
+
+static struct reftable_table *stack_find_table(struct reftable_stack *st,
+					       const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < st->nr; i++)
+		if (!strcmp(st->tables[i]->name, name))
+			return st->tables[i];
+	return NULL;
+}
+
+/*
+ * Read `tables.list` and open the tables it names, reusing the ones
+ * that are already open.
+ *
+ * The list is read again every time, as its stat data cannot tell
+ * whether it changed: it is replaced by renaming a file of usually the
+ * same size over it, which may even get the same inode number.
+ */
+static int stack_reload(struct reftable_stack *st)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf list = STRBUF_INIT;
+	struct string_list names = STRING_LIST_INIT_DUP;
+	int tries, saved_errno, ret = -1;
+
+	strbuf_addf(&path, "%s/tables.list", st->dir);
+
+	/*
+	 * A concurrent compaction may remove tables between our reading
+	 * the list and opening them, in which case we read it again.
+	 */
+	for (tries = 0; tries < 16; tries++) {
+		struct reftable_table **tables;
+		size_t i, nr = 0;
+
+		strbuf_reset(&list);
+		string_list_clear(&names, 0);
+		if (strbuf_read_file(&list, path.buf, 0) < 0 &&
+		    errno != ENOENT) {
+			error_errno(_("could not read '%s'"), path.buf);
+			break;
+		}
+		if (!strbuf_cmp(&list, &st->list)) {
+			ret = 0;
+			goto out;
+		}
+
+		string_list_split(&names, list.buf, '\n', -1);
+		tables = xcalloc(names.nr, sizeof(*tables));
+		for (i = 0; i < names.nr; i++) {
+			const char *name = names.items[i].string;
+			struct reftable_table *t;
+
+			if (!*name)
+				continue;
+			t = stack_find_table(st, name);
+			if (t)
+				t->refcount++;
+			else
+				t = table_open(st->dir, name);
+			if (!t)
+				break;
+			tables[nr++] = t;
+		}
+
+		if (i == names.nr) {
+			stack_clear_tables(st);
+			st->tables = tables;
+			st->nr = st->alloc = nr;
+			strbuf_swap(&st->list, &list);
+			ret = 0;
+			goto out;
+		}
+
+		saved_errno = errno;
+		for (i = 0; i < nr; i++)
+			table_unref(tables[i]);
+		free(tables);
+		if (saved_errno != ENOENT)
+			break;
+	}
+
+	error(_("unable to read reftable stack '%s'"), st->dir);
+out:
+	string_list_clear(&names, 0);
+	strbuf_release(&list);
+	strbuf_release(&path);
+	return ret;
+}
+
+int reftable_stack_reload(struct reftable_stack *st)
+{
+	/* Nobody else can change the list while we hold the lock. */
+	if (is_lock_file_locked(&st->lock))
+		return 0;
+	return stack_reload(st);
+}
+
+static int stack_lock(struct reftable_stack *st, long timeout_ms,
+		      struct strbuf *err)
+{
+	struct strbuf path = STRBUF_INIT;
+	int ret = -1;
+
+	if (mkdir(st->dir, 0777)) {
+		if (errno != EEXIST) {
+			strbuf_addf(err, "unable to create directory '%s': %s",
+				    st->dir, strerror(errno));
+			goto out;
+		}
+	} else if (adjust_shared_perm(st->dir)) {
+		strbuf_addf(err, "unable to set permissions of '%s'", st->dir);
+		goto out;
+	}
+
+	strbuf_addf(&path, "%s/tables.list", st->dir);
+	if (hold_lock_file_for_update_timeout(&st->lock, path.buf, 0,
+					      timeout_ms) < 0) {
+		unable_to_lock_message(path.buf, errno, err);
+		goto out;
+	}
+
+	/*
+	 * Always re-read the list: it might have been replaced within
+	 * the granularity of the file timestamps.
+	 */
+	if (stack_reload(st)) {
+		strbuf_addf(err, "unable to read reftable stack '%s'", st->dir);
+		rollback_lock_file(&st->lock);
+		goto out;
+	}
+	ret = 0;
+out:
+	strbuf_release(&path);
+	return ret;
+}
+
+int reftable_stack_lock(struct reftable_stack *st, struct strbuf *err)
+{
+	return stack_lock(st, REFTABLE_LOCK_TIMEOUT_MS, err);
+}
+
+void reftable_stack_unlock(struct reftable_stack *st)
+{
+	rollback_lock_file(&st->lock);
+}
+
+uint64_t reftable_stack_next_update_index(struct reftable_stack *st)
+{
+	if (!st->nr)
+		return 1;
+	return st->tables[st->nr - 1]->max_update_index + 1;
+}
+
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct object_id *oid, struct strbuf *referent,
+			    unsigned int *value_type)
+{
+	struct reftable_table_iter ti = { NULL };
+	struct strbuf want = STRBUF_INIT;
+	size_t i = st->nr;
+	int ret = 1;
+
+	strbuf_init(&ti.key, 0);
+	strbuf_addstr(&want, refname);
+
+	/* The newest table that knows about refname decides. */
+	while (i--) {
+		struct reftable_ref_record rec;
+		const unsigned char *p;
+		int r = table_iter_seek(&ti, st->tables[i], BLOCK_TYPE_REF,
+					&want);
+
+		if (r < 0) {
+			ret = -1;
+			break;
+		}
+		if (r > 0 || strbuf_cmp(&ti.key, &want))
+			continue;
+
+		p = ti.value;
+		if (parse_ref_value(ti.t, ti.value_type, &p, ti.next,
+				    &rec, referent)) {
+			ret = -1;
+			break;
+		}
+		if (rec.value_type != REFTABLE_REF_DELETION) {
+			oidcpy(oid, &rec.oid);
+			*value_type = rec.value_type;
+			ret = 0;
+		}
+		break;
+	}
+
+	if (ret < 0)
+		error(_("reftable stack '%s' is corrupt"), st->dir);
+	strbuf_release(&ti.key);
+	strbuf_release(&want);
+	return ret;
+}
+
+void reftable_stack_seek_ref(struct reftable_stack *st,
+			     struct reftable_iterator *it, const char *prefix)
+{
+	struct strbuf want = STRBUF_INIT;
+
+	strbuf_addstr(&want, prefix);
+	iterator_seek(it, st->tables, st->nr, BLOCK_TYPE_REF, &want);
+	strbuf_release(&want);
+}
+
+void reftable_stack_seek_log(struct reftable_stack *st,
+			     struct reftable_iterator *it, const char *refname)
+{
+	struct strbuf want = STRBUF_INIT;
+
+	/* "refname" sorts before all keys "refname\0<update index>". */
+	strbuf_addstr(&want, refname);
+	iterator_seek(it, st->tables, st->nr, BLOCK_TYPE_LOG, &want);
+	strbuf_release(&want);
+}
+
+typedef int write_records_fn(struct reftable_writer *w, void *data);
+
+/*
+ * Write a table covering the given update indices to the stack
+ * directory, filling it using `fn`, and store its name in `name`.
+ */
+static int stack_write_table(struct reftable_stack *st,
+			     uint64_t min_update_index,
+			     uint64_t max_update_index,
+			     write_records_fn *fn, void *data,
+			     struct strbuf *name, struct strbuf *err)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct reftable_writer w;
+	struct tempfile *tmp;
+	const char *suffix;
+	int ret = -1;
+
+	strbuf_addf(&path, "%s/tmp_table_XXXXXX", st->dir);
+	tmp = mks_tempfile_m(path.buf, 0666);
+	if (!tmp) {
+		strbuf_addf(err, "unable to create '%s': %s",
+			    path.buf, strerror(errno));
+		goto out;
+	}
+
+	if (writer_init(&w, get_tempfile_fd(tmp),
+			min_update_index, max_update_index) ||
+	    fn(&w, data) || writer_finish(&w)) {
+		strbuf_addf(err, "unable to write '%s': %s",
+			    get_tempfile_path(tmp), strerror(errno));
+		writer_release(&w);
+		delete_tempfile(&tmp);
+		goto out;
+	}
+	writer_release(&w);
+
+	/* Reuse the random part of the temporary name to keep it unique. */
+	suffix = get_tempfile_path(tmp);
+	suffix += strlen(suffix) - 6;
+	strbuf_reset(name);
+	strbuf_addf(name, "%012"PRIx64"-%012"PRIx64"-%s.ref",
+		    min_update_index, max_update_index, suffix);
+	strbuf_reset(&path);
+	strbuf_addf(&path, "%s/%s", st->dir, name->buf);
+
+	if (adjust_shared_perm(get_tempfile_path(tmp))) {
+		strbuf_addf(err, "unable to set permissions of '%s'",
+			    get_tempfile_path(tmp));
+		delete_tempfile(&tmp);
+		goto out;
+	}
+	if (rename_tempfile(&tmp, path.buf)) {
+		strbuf_addf(err, "unable to write '%s': %s",
+			    path.buf, strerror(errno));
+		goto out;
+	}
+	ret = 0;
+out:
+	strbuf_release(&path);
+	return ret;
+}
+
+/*
+ * Replace `tables.list` by `list` and unlock the stack. On errors,
+ * write a message to `err` and return -1.
+ */
+static int stack_commit_list(struct reftable_stack *st, struct strbuf *list,
+			     struct strbuf *err)
+{
+	if (write_in_full(get_lock_file_fd(&st->lock), list->buf, list->len) < 0 ||
+	    adjust_shared_perm(get_lock_file_path(&st->lock)) ||
+	    commit_lock_file(&st->lock)) {
+		strbuf_addf(err, "unable to write '%s/tables.list': %s",
+			    st->dir, strerror(errno));
+		rollback_lock_file(&st->lock);
+		return -1;
+	}
+	return 0;
+}
+
+static void stack_remove_table(struct reftable_stack *st, const char *name)
+{
+	struct strbuf path = STRBUF_INIT;
+
+	strbuf_addf(&path, "%s/%s", st->dir, name);
+	unlink_or_warn(path.buf);
+	strbuf_release(&path);
+}
+
+static int ref_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_ref_record *a = va, *b = vb;
+
+	return strcmp(a->refname, b->refname);
+}
+
+static int log_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_log_record *a = va, *b = vb;
+	int cmp = strcmp(a->refname, b->refname);
+
+	if (cmp)
+		return cmp;
+	/* Newer entries come first. */
+	if (a->update_index != b->update_index)
+		return a->update_index > b->update_index ? -1 : 1;
+	return 0;
+}
+
+struct added_records {
+	struct reftable_ref_record *refs;
+	size_t refs_nr;
+	struct reftable_log_record *logs;
+	size_t logs_nr;
+};
+
+static int write_added_records(struct reftable_writer *w, void *data)
+{
+	struct added_records *added = data;
+	size_t i;
+
+	for (i = 0; i < added->refs_nr; i++)
+		if (writer_add_ref(w, &added->refs[i]))
+			return -1;
+	for (i = 0; i < added->logs_nr; i++)
+		if (writer_add_log(w, &added->logs[i]))
+			return -1;
+	return 0;
+}
+
+int reftable_stack_add(struct reftable_stack *st, uint64_t update_index,
+		       struct reftable_ref_record *refs, size_t refs_nr,
+		       struct reftable_log_record *logs, size_t logs_nr,
+		       struct strbuf *err)
+{
+	struct added_records added = { refs, refs_nr, logs, logs_nr };
+	struct strbuf name = STRBUF_INIT;
+	struct strbuf list = STRBUF_INIT;
+	size_t i;
+	int ret = -1;
+
+	if (!is_lock_file_locked(&st->lock))
+		BUG("reftable stack '%s' is not locked", st->dir);
+	if (update_index < reftable_stack_next_update_index(st))
+		BUG("update index %"PRIu64" already used in '%s'",
+		    update_index, st->dir);
+
+	if (!refs_nr && !logs_nr) {
+		reftable_stack_unlock(st);
+		return 0;
+	}
+
+	QSORT(refs, refs_nr, ref_record_cmp);
+	QSORT(logs, logs_nr, log_record_cmp);
+	for (i = 1; i < refs_nr; i++)
+		if (!ref_record_cmp(&refs[i - 1], &refs[i]))
+			BUG("duplicate ref record for '%s'", refs[i].refname);
+	for (i = 1; i < logs_nr; i++)
+		if (!log_record_cmp(&logs[i - 1], &logs[i]))
+			BUG("duplicate log record for '%s'", logs[i].refname);
+
+	if (stack_write_table(st, update_index, update_index,
+			      write_added_records, &added, &name, err)) {
+		reftable_stack_unlock(st);
+		goto out;
+	}
+
+	for (i = 0; i < st->nr; i++)
+		strbuf_addf(&list, "%s\n", st->tables[i]->name);
+	strbuf_addf(&list, "%s\n", name.buf);
+	if (stack_commit_list(st, &list, err)) {
+		stack_remove_table(st, name.buf);
+		goto out;
+	}
+
+	stack_reload(st);
+	ret = 0;
+out:
+	strbuf_release(&name);
+	strbuf_release(&list);
+	return ret;
+}
+
+struct compacted_tables {
+	struct reftable_table **tables;
+	size_t nr;
+	int bottom;
+};
+
+static int write_compacted_records(struct reftable_writer *w, void *data)
+{
+	struct compacted_tables *c = data;
+	struct reftable_iterator it = REFTABLE_ITERATOR_INIT;
+	struct reftable_ref_record ref;
+	struct reftable_log_record log;
+	struct strbuf start = STRBUF_INIT;
+	int ret;
+
+	/*
+	 * Deletions shadow records in the tables below the compacted
+	 * ones, and only there; at the bottom of the stack they can go.
+	 */
+	it.include_deletions = !c->bottom;
+
+	iterator_seek(&it, c->tables, c->nr, BLOCK_TYPE_REF, &start);
+	while (!(ret = reftable_iterator_next_ref(&it, &ref)))
+		if (writer_add_ref(w, &ref)) {
+			ret = -1;
+			break;
+		}
+	if (ret < 0)
+		goto out;
+
+	iterator_seek(&it, c->tables, c->nr, BLOCK_TYPE_LOG, &start);
+	while (!(ret = reftable_iterator_next_log(&it, &log)))
+		if (writer_add_log(w, &log)) {
+			ret = -1;
+			break;
+		}
+out:
+	reftable_iterator_release(&it);
+	return ret < 0 ? -1 : 0;
+}
+
+/*
+ * Merge the tables first..last of the locked stack into one, and
+ * unlock it.
+ */
+static int stack_compact_range(struct reftable_stack *st,
+			       size_t first, size_t last, struct strbuf *err)
+{
+	struct compacted_tables c;
+	struct strbuf name = STRBUF_INIT;
+	struct strbuf list = STRBUF_INIT;
+	size_t i;
+	int ret = -1;
+
+	if (first >= last) {
+		reftable_stack_unlock(st);
+		return 0;
+	}
+
+	c.tables = st->tables + first;
+	c.nr = last - first + 1;
+	c.bottom = !first;
+	if (stack_write_table(st, st->tables[first]->min_update_index,
+			      st->tables[last]->max_update_index,
+			      write_compacted_records, &c, &name, err)) {
+		reftable_stack_unlock(st);
+		goto out;
+	}
+
+	for (i = 0; i < first; i++)
+		strbuf_addf(&list, "%s\n", st->tables[i]->name);
+	strbuf_addf(&list, "%s\n", name.buf);
+	for (i = last + 1; i < st->nr; i++)
+		strbuf_addf(&list, "%s\n", st->tables[i]->name);
+	if (stack_commit_list(st, &list, err)) {
+		stack_remove_table(st, name.buf);
+		goto out;
+	}
+
+	/*
+	 * Readers that still use the old tables keep them mapped; new
+	 * readers will not find them in the list anymore.
+	 */
+	for (i = first; i <= last; i++)
+		stack_remove_table(st, st->tables[i]->name);
+
+	stack_reload(st);
+	ret = 0;
+out:
+	strbuf_release(&name);
+	strbuf_release(&list);
+	return ret;
+}
+
+static size_t table_payload(const struct reftable_table *t)
+{
+	return t->size - REFTABLE_HEADER_SIZE - REFTABLE_FOOTER_SIZE;
+}
+
+int reftable_stack_auto_compact(struct reftable_stack *st)
+{
+	struct strbuf err = STRBUF_INIT;
+	size_t first, last, bytes;
+	int ret = 0;
+
+	/* Leave the compaction to whoever else is writing. */
+	if (stack_lock(st, 0, &err))
+		goto out;
+
+	/*
+	 * The sizes of the tables should decrease at least geometrically
+	 * from the bottom to the top of the stack. Find the topmost table
+	 * violating that, and merge it with the tables below it until the
+	 * result is small enough compared to the next one.
+	 */
+	for (last = st->nr ? st->nr - 1 : 0; last > 0; last--)
+		if (table_payload(st->tables[last - 1]) <
+		    2 * table_payload(st->tables[last]))
+			break;
+	if (!last) {
+		reftable_stack_unlock(st);
+		goto out;
+	}
+
+	first = last;
+	bytes = table_payload(st->tables[last]);
+	while (first > 0 && table_payload(st->tables[first - 1]) < 2 * bytes) {
+		first--;
+		bytes += table_payload(st->tables[first]);
+	}
+
+	ret = stack_compact_range(st, first, last, &err);
+	if (ret)
+		error("%s", err.buf);
+out:
+	strbuf_release(&err);
+	return ret;
+}
+
+int reftable_stack_compact_all(struct reftable_stack *st)
+{
+	struct strbuf err = STRBUF_INIT;
+	int ret;
+
+	ret = reftable_stack_lock(st, &err);
+	if (!ret)
+		ret = stack_compact_range(st, 0, st->nr ? st->nr - 1 : 0, &err);
+	if (ret)
+		error("%s", err.buf);
+	strbuf_release(&err);
+	return ret;
+}
+
+static const char *ref_value_type_name(unsigned int value_type)
+{
+	switch (value_type) {
+	case REFTABLE_REF_DELETION:
+		return "deletion";
+	case REFTABLE_REF_VAL1:
+		return "val1";
+	case REFTABLE_REF_VAL2:
+		return "val2";
+	default:
+		return "symref";
+	}
+}
+
+static const char *log_value_type_name(unsigned int value_type)
+{
+	switch (value_type) {
+	case REFTABLE_LOG_DELETION:
+		return "deletion";
+	case REFTABLE_LOG_UPDATE:
+		return "update";
+	default:
+		return "existence";
+	}
+}
+
+static int dump_table(struct reftable_table *t)
+{
+	struct reftable_iterator it = REFTABLE_ITERATOR_INIT;
+	struct reftable_ref_record ref;
+	struct reftable_log_record log;
+	struct strbuf start = STRBUF_INIT;
+	int ret;
+
+	printf("table %s %"PRIu64"-%"PRIu64"\n", t->name,
+	       t->min_update_index, t->max_update_index);
+
+	it.include_deletions = 1;
+	iterator_seek(&it, &t, 1, BLOCK_TYPE_REF, &start);
+	while (!(ret = reftable_iterator_next_ref(&it, &ref))) {
+		printf("ref %s %"PRIu64" %s", ref.refname, ref.update_index,
+		       ref_value_type_name(ref.value_type));
+		if (ref.value_type == REFTABLE_REF_SYMREF)
+			printf(" %s", ref.target);
+		else if (ref.value_type != REFTABLE_REF_DELETION)
+			printf(" %s", oid_to_hex(&ref.oid));
+		if (ref.value_type == REFTABLE_REF_VAL2)
+			printf(" %s", oid_to_hex(&ref.peeled));
+		putchar('\n');
+	}
+	if (ret < 0)
+		goto out;
+
+	iterator_seek(&it, &t, 1, BLOCK_TYPE_LOG, &start);
+	while (!(ret = reftable_iterator_next_log(&it, &log))) {
+		printf("log %s %"PRIu64" %s", log.refname, log.update_index,
+		       log_value_type_name(log.value_type));
+		if (log.value_type == REFTABLE_LOG_UPDATE) {
+			printf(" %s", oid_to_hex(&log.old_oid));
+			printf(" %s %s <%s> %"PRItime" %+05d\t%s",
+			       oid_to_hex(&log.new_oid), log.name, log.email,
+			       log.time, log.tz, log.message);
+		}
+		putchar('\n');
+	}
+out:
+	reftable_iterator_release(&it);
+	return ret < 0 ? -1 : 0;
+}
+
+int reftable_dump(const char *path)
+{
+	struct reftable_stack st = REFTABLE_STACK_INIT;
+	struct reftable_table *t;
+	const char *slash;
+	char *dir;
+	size_t i;
+	int ret = 0;
+
+	if (is_directory(path)) {
+		reftable_stack_init(&st, path);
+		ret = reftable_stack_reload(&st);
+		for (i = 0; !ret && i < st.nr; i++)
+			ret = dump_table(st.tables[i]);
+		reftable_stack_release(&st);
+		return ret;
+	}
+
+	slash = strrchr(path, '/');
+	dir = slash ? xstrndup(path, slash - path) : xstrdup(".");
+	t = table_open(dir, slash ? slash + 1 : path);
+	free(dir);
+	if (!t)
+		return error_errno(_("could not open reftable '%s'"), path);
+	ret = dump_table(t);
+	table_unref(t);
+	return ret;
+}
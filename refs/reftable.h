@@ -0,0 +1,201 @@
+#ifndef REFS_REFTABLE_H
+#define REFS_REFTABLE_H
+
+#include "../lockfile.h"
+
+/*
+ * Reading and writing of reftables, the on-disk format used by the
+ * reftable ref storage backend, and of stacks of them.
+ *
+ * A reftable is an immutable file that stores references and their
+ * reflog entries sorted by name in prefix-compressed blocks, with an
+ * index that allows any reference to be looked up in O(log n). Every
+ * table covers a range of "update indices", which serve as logical
+ * timestamps: each transaction writes a new table using the next
+ * update index.
+ *
+ * A stack is a directory holding tables plus a file `tables.list`
+ * naming them from the oldest to the newest. Records in newer tables
+ * shadow those with the same key in older ones, so that deletions are
+ * written as "deletion" records. Tables are merged ("compacted") as
+ * the stack grows, so that the number of tables stays logarithmic in
+ * the number of updates.
+ *
+ * See Documentation/technical/reftable.txt for details.
+ */
+
+struct strbuf;
+
+/* Values of `reftable_ref_record.value_type`: */
+#define REFTABLE_REF_DELETION	0
+#define REFTABLE_REF_VAL1	1 /* object name */
+#define REFTABLE_REF_VAL2	2 /* object name and its peeled value */
+#define REFTABLE_REF_SYMREF	3
+
+/* Values of `reftable_log_record.value_type`: */
+#define REFTABLE_LOG_DELETION	0
+#define REFTABLE_LOG_UPDATE	1
+#define REFTABLE_LOG_EXISTENCE	2 /* the (possibly empty) reflog exists */
+
+/*
+ * The string members of records returned by an iterator point into
+ * memory owned by the iterator and are only valid until the iterator
+ * is advanced or released. Records passed to reftable_stack_add() are
+ * owned by the caller.
+ */
+struct reftable_ref_record {
+	const char *refname;
+	uint64_t update_index;
+	unsigned int value_type;
+	struct object_id oid;
+	struct object_id peeled;
+	const char *target;
+};
+
+struct reftable_log_record {
+	const char *refname;
+	uint64_t update_index;
+	unsigned int value_type;
+	struct object_id old_oid;
+	struct object_id new_oid;
+	const char *name;
+	const char *email;
+	timestamp_t time;
+	int tz;
+	const char *message;
+};
+
+/* A single mmapped table; see refs/reftable.c. */
+struct reftable_table;
+
+/* The state of an iteration over one table; see refs/reftable.c. */
+struct reftable_table_iter;
+
+/*
+ * An iterator yielding the records of a set of tables in key order,
+ * where a record from a newer table replaces those with the same key
+ * from older ones.
+ */
+struct reftable_iterator {
+	struct reftable_table_iter *subs;
+	size_t nr;
+	unsigned char block_type;
+
+	/*
+	 * If set, deletion records are returned from the iteration
+	 * instead of being skipped.
+	 */
+	unsigned int include_deletions : 1;
+
+	/* Buffers holding the strings of the current record. */
+	struct strbuf key;
+	struct strbuf refname;
+	struct strbuf target;
+	struct strbuf name;
+	struct strbuf email;
+	struct strbuf message;
+};
+
+#define REFTABLE_ITERATOR_INIT { NULL, 0, 0, 0, STRBUF_INIT, STRBUF_INIT, \
+		STRBUF_INIT, STRBUF_INIT, STRBUF_INIT, STRBUF_INIT }
+
+struct reftable_stack {
+	/* The directory holding the tables and `tables.list`. */
+	char *dir;
+
+	/* The tables of the stack, from the oldest to the newest. */
+	struct reftable_table **tables;
+	size_t nr, alloc;
+
+	/* The contents of `tables.list` when it was last read. */
+	struct strbuf list;
+
+	struct lock_file lock;
+};
+
+#define REFTABLE_STACK_INIT { NULL, NULL, 0, 0, STRBUF_INIT, LOCK_INIT }
+
+void reftable_stack_init(struct reftable_stack *st, const char *dir);
+void reftable_stack_release(struct reftable_stack *st);
+
+/*
+ * Bring the in-memory view of the stack up to date with `tables.list`,
+ * unless we hold its lock. Return 0 on success, or -1 with an error
+ * message on failure.
+ */
+int reftable_stack_reload(struct reftable_stack *st);
+
+/*
+ * Lock the stack against concurrent writers, creating its directory if
+ * needed, and reload it. Return 0 on success. On errors, write an error
+ * message to `err` and return -1.
+ */
+int reftable_stack_lock(struct reftable_stack *st, struct strbuf *err);
+void reftable_stack_unlock(struct reftable_stack *st);
+
+/* Return the update index to be used by the next table added to `st`. */
+uint64_t reftable_stack_next_update_index(struct reftable_stack *st);
+
+/*
+ * Look up refname in the (already loaded) stack. Return 0 and fill in
+ * `oid`, `referent` and `value_type` if it exists, or 1 if it does not.
+ * Return -1 if the stack is corrupt.
+ */
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct object_id *oid, struct strbuf *referent,
+			    unsigned int *value_type);
+
+/*
+ * Write a new table holding the given records to the locked stack,
+ * append it to the stack and unlock it. All ref records must use
+ * `update_index`; log records may also shadow older entries. The
+ * arrays are sorted in place. Return 0 on success, or -1 with an error
+ * message in `err`.
+ */
+int reftable_stack_add(struct reftable_stack *st, uint64_t update_index,
+		       struct reftable_ref_record *refs, size_t refs_nr,
+		       struct reftable_log_record *logs, size_t logs_nr,
+		       struct strbuf *err);
+
+/*
+ * Merge the topmost tables of the stack as long as a table is no more
+ * than twice as large as the ones above it together, which keeps the
+ * number of tables logarithmic in the number of updates. The stack is
+ * left alone if it is locked by another process.
+ */
+int reftable_stack_auto_compact(struct reftable_stack *st);
+
+/*
+ * Merge all tables of the stack into one, dropping deletion records
+ * and the records they shadow.
+ */
+int reftable_stack_compact_all(struct reftable_stack *st);
+
+/*
+ * Position `it` at the first ref record of the stack whose name is not
+ * less than `prefix`, or at the first log record of `refname`. The
+ * stack must stay loaded while `it` is in use, but may be reloaded.
+ */
+void reftable_stack_seek_ref(struct reftable_stack *st,
+			     struct reftable_iterator *it, const char *prefix);
+void reftable_stack_seek_log(struct reftable_stack *st,
+			     struct reftable_iterator *it, const char *refname);
+
+/*
+ * Return the next record of the iteration in `rec`. Return 0 on
+ * success, 1 at the end of the iteration, or -1 if a table is corrupt.
+ */
+int reftable_iterator_next_ref(struct reftable_iterator *it,
+			       struct reftable_ref_record *rec);
+int reftable_iterator_next_log(struct reftable_iterator *it,
+			       struct reftable_log_record *rec);
+
+void reftable_iterator_release(struct reftable_iterator *it);
+
+/*
+ * Print the records of the table at `path`, or of all tables of the
+ * stack if `path` is a directory, to stdout. For test-tool.
+ */
+int reftable_dump(const char *path);
+
+#endif /* REFS_REFTABLE_H */
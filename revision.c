@@ -28,6 +28,8 @@
 #include "commit-graph.h"
 #include "prio-queue.h"
 #include "hashmap.h"
+#include "bloom.h"
+#include "json-writer.h"
 
 volatile show_early_output_fn_t show_early_output;
 
@@ -621,11 +623,147 @@ static void file_change(struct diff_options *options,
 	options->flags.has_changes = 1;
 }
 
+static int bloom_filter_atexit_registered;
+static unsigned int count_bloom_filter_maybe;
+static unsigned int count_bloom_filter_definitely_not;
+static unsigned int count_bloom_filter_false_positive;
+static unsigned int count_bloom_filter_not_present;
+
+static void trace2_bloom_filter_statistics_atexit(void)
+{
+	struct json_writer jw = JSON_WRITER_INIT;
+
+	jw_object_begin(&jw, 0);
+	jw_object_intmax(&jw, "filter_not_present", count_bloom_filter_not_present);
+	jw_object_intmax(&jw, "maybe", count_bloom_filter_maybe);
+	jw_object_intmax(&jw, "definitely_not", count_bloom_filter_definitely_not);
+	jw_object_intmax(&jw, "false_positive", count_bloom_filter_false_positive);
+	jw_end(&jw);
+
+	trace2_data_json("bloom", the_repository, "statistics", &jw);
+
+	jw_release(&jw);
+}
+
+static int forbid_bloom_filters(struct pathspec *spec)
+{
+	int i;
+
+	if (spec->has_wildcard)
+		return 1;
+	if (spec->magic & ~PATHSPEC_LITERAL)
+		return 1;
+
+	for (i = 0; i < spec->nr; i++) {
+		if (spec->items[i].magic & ~PATHSPEC_LITERAL)
+			return 1;
+		if (!spec->items[i].len)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void add_bloom_key(struct rev_info *revs, const char *path, size_t len)
+{
+	ALLOC_GROW(revs->bloom_keys, revs->bloom_keys_nr + 1,
+		   revs->bloom_keys_alloc);
+	fill_bloom_key(path, len, &revs->bloom_keys[revs->bloom_keys_nr++],
+		       revs->bloom_filter_settings);
+}
+
+static void prepare_to_use_bloom_filter(struct rev_info *revs)
+{
+	int i;
+
+	if (!revs->commits || !revs->prune_data.nr)
+		return;
+
+	if (forbid_bloom_filters(&revs->prune_data))
+		return;
+
+	revs->bloom_filter_settings = get_bloom_filter_settings(revs->repo);
+	if (!revs->bloom_filter_settings)
+		return;
+
+	ALLOC_ARRAY(revs->bloom_key_groups, revs->prune_data.nr);
+	for (i = 0; i < revs->prune_data.nr; i++) {
+		const char *path = revs->prune_data.items[i].match;
+		size_t len = revs->prune_data.items[i].len;
+
+		/* remove single trailing slash from path, if needed */
+		if (path[len - 1] == '/')
+			len--;
+
+		/*
+		 * A filter holds each changed path along with all of its
+		 * leading directories, so we can require every one of them
+		 * to be present.
+		 */
+		while (len) {
+			add_bloom_key(revs, path, len);
+			while (len && path[len - 1] != '/')
+				len--;
+			if (len)
+				len--;
+		}
+		revs->bloom_key_groups[revs->bloom_key_groups_nr++] = revs->bloom_keys_nr;
+	}
+
+	if (trace2_is_enabled() && !bloom_filter_atexit_registered) {
+		atexit(trace2_bloom_filter_statistics_atexit);
+		bloom_filter_atexit_registered = 1;
+	}
+}
+
+/*
+ * Return 0 if the changed-path filter of 'commit' proves that none of
+ * the paths in the pathspec changed with respect to its first parent,
+ * 1 if they may have, and -1 if no filter is available.
+ */
+static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
+						 struct commit *commit)
+{
+	struct bloom_filter *filter;
+	int i, j = 0;
+
+	if (commit->generation == GENERATION_NUMBER_INFINITY)
+		return -1;
+
+	filter = get_bloom_filter(revs->repo, commit, 0);
+
+	if (!filter) {
+		count_bloom_filter_not_present++;
+		return -1;
+	}
+
+	for (i = 0; i < revs->bloom_key_groups_nr; i++) {
+		int maybe = 1;
+
+		for (; j < revs->bloom_key_groups[i]; j++) {
+			if (maybe &&
+			    !bloom_filter_contains(filter, &revs->bloom_keys[j],
+						   revs->bloom_filter_settings))
+				maybe = 0;
+		}
+
+		if (maybe) {
+			count_bloom_filter_maybe++;
+			return 1;
+		}
+	}
+
+	count_bloom_filter_definitely_not++;
+	return 0;
+}
+
 static int rev_compare_tree(struct rev_info *revs,
-			    struct commit *parent, struct commit *commit)
+			    struct commit *parent, struct commit *commit,
+			    int nth_parent)
 {
 	struct tree *t1 = get_commit_tree(parent);
 	struct tree *t2 = get_commit_tree(commit);
+	int bloom_ret = 1;
 
 	if (!t1)
 		return REV_TREE_NEW;
@@ -650,11 +788,26 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
+	/*
+	 * Changed-path filters are computed against the first parent
+	 * only, so they cannot tell us anything about other parents.
+	 */
+	if (revs->bloom_keys_nr && !nth_parent) {
+		bloom_ret = check_maybe_different_in_bloom_filter(revs, commit);
+
+		if (bloom_ret == 0)
+			return REV_TREE_SAME;
+	}
+
 	tree_difference = REV_TREE_SAME;
 	revs->pruning.flags.has_changes = 0;
 	if (diff_tree_oid(&t1->object.oid, &t2->object.oid, "",
 			   &revs->pruning) < 0)
 		return REV_TREE_DIFFERENT;
+
+	if (!nth_parent && bloom_ret == 1 && tree_difference == REV_TREE_SAME)
+		count_bloom_filter_false_positive++;
+
 	return tree_difference;
 }
 
@@ -852,7 +1005,7 @@ static void try_to_simplify_commit(struct rev_info *revs, struct commit *commit)
 			die("cannot simplify commit %s (because of %s)",
 			    oid_to_hex(&commit->object.oid),
 			    oid_to_hex(&p->object.oid));
-		switch (rev_compare_tree(revs, p, commit)) {
+		switch (rev_compare_tree(revs, p, commit, nth_parent)) {
 		case REV_TREE_SAME:
 			if (!revs->simplify_history || !relevant_commit(p)) {
 				/* Even if a merge with an uninteresting
@@ -2169,6 +2322,10 @@ static int handle_revision_opt(struct rev_info *revs, int argc, const char **arg
 		revs->diff = 1;
 		revs->dense_combined_merges = 0;
 		revs->combine_merges = 1;
+	} else if (!strcmp(arg, "--remerge-diff")) {
+		revs->diff = 1;
+		revs->remerge_diff = 1;
+		revs->ignore_merges = 0;
 	} else if (!strcmp(arg, "--combined-all-paths")) {
 		revs->diff = 1;
 		revs->combined_all_paths = 1;
@@ -3106,7 +3263,7 @@ define_commit_slab(indegree_slab, int);
 define_commit_slab(author_date_slab, timestamp_t);
 
 struct topo_walk_info {
-	uint32_t min_generation;
+	timestamp_t min_generation;
 	struct prio_queue explore_queue;
 	struct prio_queue indegree_queue;
 	struct prio_queue topo_queue;
@@ -3152,7 +3309,7 @@ static void explore_walk_step(struct rev_info *revs)
 }
 
 static void explore_to_depth(struct rev_info *revs,
-			     uint32_t gen_cutoff)
+			     timestamp_t gen_cutoff)
 {
 	struct topo_walk_info *info = revs->topo_walk_info;
 	struct commit *c;
@@ -3192,7 +3349,7 @@ static void indegree_walk_step(struct rev_info *revs)
 }
 
 static void compute_indegrees_to_depth(struct rev_info *revs,
-				       uint32_t gen_cutoff)
+				       timestamp_t gen_cutoff)
 {
 	struct topo_walk_info *info = revs->topo_walk_info;
 	struct commit *c;
@@ -3352,6 +3509,8 @@ int prepare_revision_walk(struct rev_info *revs)
 		commit_list_sort_by_date(&revs->commits);
 	if (revs->no_walk)
 		return 0;
+	if (revs->prune && !revs->tree_objects)
+		prepare_to_use_bloom_filter(revs);
 	if (revs->limited) {
 		if (limit_list(revs) < 0)
 			return -1;
@@ -43,6 +43,7 @@ struct repository;
 struct rev_info;
 struct string_list;
 struct saved_parents;
+struct tmp_objdir;
 define_shared_commit_slab(revision_sources, char *);
 
 struct rev_cmdline_info {
@@ -69,6 +70,8 @@ struct rev_cmdline_info {
 
 struct oidset;
 struct topo_walk_info;
+struct bloom_key;
+struct bloom_filter_settings;
 
 struct rev_info {
 	/* Starting list */
@@ -174,6 +177,7 @@ struct rev_info {
 			combine_merges:1,
 			combined_all_paths:1,
 			dense_combined_merges:1,
+			remerge_diff:1,
 			always_show_header:1;
 
 	/* Format info */
@@ -242,6 +246,9 @@ struct rev_info {
 	struct diff_options diffopt;
 	struct diff_options pruning;
 
+	/* where --remerge-diff writes the objects of its merges */
+	struct tmp_objdir *remerge_objdir;
+
 	struct reflog_walk_info *reflog_info;
 	struct decoration children;
 	struct decoration merge_simplification;
@@ -278,6 +285,19 @@ struct rev_info {
 	struct revision_sources *sources;
 
 	struct topo_walk_info *topo_walk_info;
+
+	/*
+	 * Changed-path Bloom filter keys for the pathspec. The keys of
+	 * the i-th pathspec item (its path and each of its leading
+	 * directories) end just before bloom_key_groups[i].
+	 */
+	struct bloom_key *bloom_keys;
+	int bloom_keys_nr, bloom_keys_alloc;
+	int *bloom_key_groups;
+	int bloom_key_groups_nr;
+
+	/* The Bloom filter settings used to generate the keys. */
+	struct bloom_filter_settings *bloom_filter_settings;
 };
 
 int ref_excluded(struct string_list *, const char *path);
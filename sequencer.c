@@ -15,6 +15,7 @@
 #include "revision.h"
 #include "rerere.h"
 #include "merge-recursive.h"
+#include "merge-ort.h"
 #include "refs.h"
 #include "argv-array.h"
 #include "quote.h"
@@ -304,6 +305,10 @@ int sequencer_remove_state(struct replay_opts *opts)
 		free(opts->xopts[i]);
 	free(opts->xopts);
 	strbuf_release(&opts->current_fixups);
+	if (opts->rename_cache) {
+		clear_rename_cache(opts->rename_cache);
+		FREE_AND_NULL(opts->rename_cache);
+	}
 
 	strbuf_reset(&buf);
 	strbuf_addstr(&buf, get_dir(opts));
@@ -611,9 +616,19 @@ static int do_recursive_merge(struct repository *r,
 	for (xopt = opts->xopts; xopt != opts->xopts + opts->xopts_nr; xopt++)
 		parse_merge_opt(&o, *xopt);
 
-	clean = merge_trees(&o,
-			    head_tree,
-			    next_tree, base_tree, &result);
+	if (opts->strategy && !strcmp(opts->strategy, "ort"))
+		clean = merge_ort_nonrecursive(&o, head_tree, next_tree,
+					       base_tree);
+	else {
+		if (!opts->rename_cache) {
+			opts->rename_cache = xmalloc(sizeof(*opts->rename_cache));
+			init_rename_cache(opts->rename_cache);
+		}
+		o.rename_cache = opts->rename_cache;
+		clean = merge_trees(&o,
+				    head_tree,
+				    next_tree, base_tree, &result);
+	}
 	if (is_rebase_i(opts) && clean <= 0)
 		fputs(o.obuf.buf, stdout);
 	strbuf_release(&o.obuf);
@@ -1940,7 +1955,8 @@ static int do_pick_commit(struct repository *r,
 
 	if (is_rebase_i(opts) && write_author_script(msg.message) < 0)
 		res = -1;
-	else if (!opts->strategy || !strcmp(opts->strategy, "recursive") || command == TODO_REVERT) {
+	else if (!opts->strategy || !strcmp(opts->strategy, "recursive") ||
+		 !strcmp(opts->strategy, "ort") || command == TODO_REVERT) {
 		res = do_recursive_merge(r, base, next, base_label, next_label,
 					 &head, &msgbuf, opts);
 		if (res < 0)
@@ -3582,7 +3598,12 @@ static int do_merge(struct repository *r,
 	o.branch2 = ref_name.buf;
 	o.buffer_output = 2;
 
-	ret = merge_recursive(&o, head_commit, merge_commit, reversed, &i);
+	if (opts->strategy && !strcmp(opts->strategy, "ort"))
+		ret = merge_ort_recursive(&o, head_commit, merge_commit,
+					  reversed, &i);
+	else
+		ret = merge_recursive(&o, head_commit, merge_commit,
+				      reversed, &i);
 	if (ret <= 0)
 		fputs(o.obuf.buf, stdout);
 	strbuf_release(&o.obuf);
@@ -5,6 +5,7 @@
 #include "strbuf.h"
 
 struct commit;
+struct rename_cache;
 struct repository;
 
 const char *git_path_commit_editmsg(void);
@@ -65,6 +66,9 @@ struct replay_opts {
 
 	/* Only used by REPLAY_NONE */
 	struct rev_info *revs;
+
+	/* Renames found by one pick, to be reused by the next one */
+	struct rename_cache *rename_cache;
 };
 #define REPLAY_OPTS_INIT { .action = -1, .current_fixups = STRBUF_INIT }
 
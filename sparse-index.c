@@ -0,0 +1,395 @@
+#include "cache.h"
+#include "config.h"
+#include "cache-tree.h"
+#include "dir.h"
+#include "pathspec.h"
+#include "string-list.h"
+#include "tree.h"
+#include "sparse-index.h"
+
+int command_requires_full_index = 1;
+
+/*
+ * The directories named by cone-mode sparse-checkout patterns, without
+ * leading or trailing slashes. A "/dir/" pattern includes "dir"
+ * recursively, and a "!/dir/<star>/" pattern excludes its subdirectories
+ * (but not the files directly in it) again.
+ */
+struct sparse_cone {
+	struct string_list recursive;
+	struct string_list parents;
+};
+
+#define SPARSE_CONE_INIT { STRING_LIST_INIT_DUP, STRING_LIST_INIT_DUP }
+
+static void clear_sparse_cone(struct sparse_cone *cone)
+{
+	string_list_clear(&cone->recursive, 0);
+	string_list_clear(&cone->parents, 0);
+}
+
+static int has_glob_chars(const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (strchr("*?[\\!", s[i]))
+			return 1;
+	return 0;
+}
+
+/*
+ * Read $GIT_DIR/info/sparse-checkout into "cone". Returns -1 if the file
+ * cannot be read, or if it holds patterns that are not in cone mode.
+ */
+static int load_sparse_cone(struct sparse_cone *cone)
+{
+	char *path = git_pathdup("info/sparse-checkout");
+	FILE *fp = fopen_or_warn(path, "r");
+	struct strbuf line = STRBUF_INIT;
+	int ret = 0;
+
+	free(path);
+	if (!fp)
+		return -1;
+
+	while (strbuf_getline(&line, fp) != EOF) {
+		struct string_list *list = &cone->recursive;
+		char *p = line.buf;
+		size_t len;
+
+		strbuf_rtrim(&line);
+		if (!line.len || line.buf[0] == '#')
+			continue;
+		if (!strcmp(line.buf, "/*") || !strcmp(line.buf, "!/*/"))
+			continue;
+
+		if (*p == '!') {
+			list = &cone->parents;
+			p++;
+		}
+		len = strlen(p);
+		if (len < 3 || p[0] != '/' || p[len - 1] != '/')
+			goto not_cone;
+		p++;
+		len -= 2;
+		if (list == &cone->parents) {
+			if (len < 3 || !ends_with(p, "/*/"))
+				goto not_cone;
+			len -= 2;
+		}
+		if (has_glob_chars(p, len))
+			goto not_cone;
+		p[len] = '\0';
+		string_list_append(list, p);
+	}
+	string_list_sort(&cone->recursive);
+	string_list_sort(&cone->parents);
+	goto out;
+
+not_cone:
+	warning(_("unrecognized pattern: '%s'"), line.buf);
+	warning(_("disabling cone pattern matching"));
+	ret = -1;
+out:
+	strbuf_release(&line);
+	fclose(fp);
+	return ret;
+}
+
+/*
+ * Returns 1 if no path in the directory "dir" (of length "len", with a
+ * trailing slash) is matched by the cone patterns.
+ */
+static int dir_outside_cone(struct sparse_cone *cone, const char *dir, size_t len)
+{
+	enum { OUTSIDE, PARENT, RECURSIVE } state = PARENT;
+	struct strbuf prefix = STRBUF_INIT;
+	const char *slash;
+	int pos;
+
+	for (slash = dir; (slash = strchr(slash, '/')) && slash < dir + len; slash++) {
+		strbuf_reset(&prefix);
+		strbuf_add(&prefix, dir, slash - dir);
+		if (string_list_has_string(&cone->recursive, prefix.buf))
+			state = string_list_has_string(&cone->parents, prefix.buf) ?
+				PARENT : RECURSIVE;
+		else if (state != RECURSIVE)
+			state = OUTSIDE;
+	}
+
+	if (state == OUTSIDE) {
+		/* a directory below it may still be included */
+		strbuf_addch(&prefix, '/');
+		pos = string_list_find_insert_index(&cone->recursive, prefix.buf, 1);
+		if (pos < cone->recursive.nr &&
+		    starts_with(cone->recursive.items[pos].string, prefix.buf))
+			state = PARENT;
+	}
+	strbuf_release(&prefix);
+	return state == OUTSIDE;
+}
+
+/*
+ * Entries are about to be added or removed behind the back of the name
+ * hash, so drop it; it is rebuilt when it is needed next.
+ */
+static void reset_name_hash(struct index_state *istate)
+{
+	int i;
+
+	if (!istate->name_hash_initialized)
+		return;
+	free_name_hash(istate);
+	for (i = 0; i < istate->cache_nr; i++)
+		istate->cache[i]->ce_flags &= ~CE_HASHED;
+}
+
+static struct cache_entry *construct_sparse_dir_entry(struct index_state *istate,
+						      const char *path,
+						      size_t len,
+						      struct cache_tree *ct)
+{
+	struct cache_entry *ce = make_empty_cache_entry(istate, len);
+
+	ce->ce_mode = S_IFDIR;
+	ce->ce_namelen = len;
+	ce->ce_flags = create_ce_flags(0) | CE_SKIP_WORKTREE;
+	oidcpy(&ce->oid, &ct->oid);
+	memcpy(ce->name, path, len);
+	return ce;
+}
+
+/*
+ * Move the entries [start, end) of the directory "path", whose cache
+ * tree is "ct", to the positions starting at "nr", collapsing the
+ * directories outside of the cone on the way. Returns the position
+ * following the last entry moved.
+ */
+static int convert_to_sparse_rec(struct index_state *istate, int nr,
+				 int start, int end,
+				 const char *path, size_t len,
+				 struct cache_tree *ct,
+				 struct sparse_cone *cone)
+{
+	int i, first = nr;
+	struct strbuf child = STRBUF_INIT;
+
+	if (len && dir_outside_cone(cone, path, len)) {
+		int can_convert = 1;
+
+		for (i = start; i < end; i++) {
+			const struct cache_entry *ce = istate->cache[i];
+
+			if (ce_stage(ce) || S_ISGITLINK(ce->ce_mode) ||
+			    !(ce->ce_flags & CE_SKIP_WORKTREE)) {
+				can_convert = 0;
+				break;
+			}
+		}
+
+		if (can_convert) {
+			for (i = start; i < end; i++)
+				discard_cache_entry(istate->cache[i]);
+			istate->cache[nr++] = construct_sparse_dir_entry(istate, path, len, ct);
+
+			for (i = 0; i < ct->subtree_nr; i++) {
+				cache_tree_free(&ct->down[i]->cache_tree);
+				free(ct->down[i]);
+			}
+			ct->subtree_nr = 0;
+			ct->entry_count = 1;
+			return nr;
+		}
+	}
+
+	for (i = start; i < end; ) {
+		struct cache_entry *ce = istate->cache[i];
+		const char *base = ce->name + len;
+		const char *slash = strchr(base, '/');
+		struct cache_tree *sub;
+		int pos, span;
+
+		if (!slash) {
+			istate->cache[nr++] = ce;
+			i++;
+			continue;
+		}
+
+		pos = cache_tree_subtree_pos(ct, base, slash - base);
+		if (pos < 0)
+			BUG("no cache tree for directory '%.*s'",
+			    (int)(slash - ce->name), ce->name);
+		sub = ct->down[pos]->cache_tree;
+		span = sub->entry_count;
+
+		strbuf_reset(&child);
+		strbuf_add(&child, ce->name, slash - ce->name + 1);
+		nr = convert_to_sparse_rec(istate, nr, i, i + span,
+					   child.buf, child.len, sub, cone);
+		i += span;
+	}
+
+	strbuf_release(&child);
+	ct->entry_count = nr - first;
+	return nr;
+}
+
+int sparse_dirs_outside_cone(struct index_state *istate)
+{
+	struct sparse_cone cone = SPARSE_CONE_INIT;
+	int i, ret = 1;
+
+	if (load_sparse_cone(&cone) < 0)
+		return 0;
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (S_ISSPARSEDIR(ce->ce_mode) &&
+		    !dir_outside_cone(&cone, ce->name, ce_namelen(ce))) {
+			ret = 0;
+			break;
+		}
+	}
+	clear_sparse_cone(&cone);
+	return ret;
+}
+
+int sparse_index_enabled(void)
+{
+	int enabled;
+
+	if (!core_apply_sparse_checkout || !core_sparse_checkout_cone)
+		return 0;
+	return !git_config_get_bool("index.sparse", &enabled) && enabled;
+}
+
+int convert_to_sparse(struct index_state *istate)
+{
+	struct sparse_cone cone = SPARSE_CONE_INIT;
+	int i;
+
+	if (istate->split_index || istate->sparse_index || !istate->cache_nr ||
+	    !sparse_index_enabled())
+		return 0;
+
+	/*
+	 * Unmerged entries, intent-to-add entries and entries that are
+	 * about to be removed cannot be part of a tree.
+	 */
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (ce_stage(ce) ||
+		    (ce->ce_flags & (CE_INTENT_TO_ADD | CE_REMOVE)))
+			return 0;
+	}
+
+	if (load_sparse_cone(&cone) < 0)
+		return 0;
+
+	trace2_region_enter("index", "convert_to_sparse", the_repository);
+
+	if (!istate->cache_tree)
+		istate->cache_tree = cache_tree();
+	if (!cache_tree_fully_valid(istate->cache_tree) &&
+	    cache_tree_update(istate, WRITE_TREE_SILENT)) {
+		/* stay with a full index if the trees cannot be written */
+		trace2_region_leave("index", "convert_to_sparse", the_repository);
+		clear_sparse_cone(&cone);
+		return 0;
+	}
+
+	reset_name_hash(istate);
+
+	istate->cache_nr = convert_to_sparse_rec(istate, 0, 0, istate->cache_nr,
+						 "", 0, istate->cache_tree,
+						 &cone);
+	istate->sparse_index = 1;
+
+	trace2_region_leave("index", "convert_to_sparse", the_repository);
+	clear_sparse_cone(&cone);
+	return 0;
+}
+
+struct expand_context {
+	struct index_state *istate;
+	struct cache_entry **cache;
+	unsigned int nr, alloc;
+};
+
+static void append_entry(struct expand_context *ctx, struct cache_entry *ce)
+{
+	ALLOC_GROW(ctx->cache, ctx->nr + 1, ctx->alloc);
+	ctx->cache[ctx->nr++] = ce;
+}
+
+static int add_path_to_index(const struct object_id *oid,
+			     struct strbuf *base, const char *path,
+			     unsigned int mode, int stage, void *context)
+{
+	struct expand_context *ctx = context;
+	struct cache_entry *ce;
+	size_t len;
+
+	if (S_ISDIR(mode))
+		return READ_TREE_RECURSIVE;
+
+	len = base->len + strlen(path);
+	ce = make_empty_cache_entry(ctx->istate, len);
+	memcpy(ce->name, base->buf, base->len);
+	memcpy(ce->name + base->len, path, len - base->len);
+	ce->ce_namelen = len;
+	ce->ce_mode = create_ce_mode(mode);
+	ce->ce_flags = create_ce_flags(stage) | CE_SKIP_WORKTREE;
+	oidcpy(&ce->oid, oid);
+	append_entry(ctx, ce);
+	return 0;
+}
+
+void ensure_full_index(struct index_state *istate)
+{
+	struct expand_context ctx = { istate };
+	struct pathspec ps;
+	unsigned int changed;
+	int i;
+
+	if (!istate->sparse_index)
+		return;
+
+	trace2_region_enter("index", "ensure_full_index", the_repository);
+	reset_name_hash(istate);
+
+	/* expanding the index does not make it need to be written out */
+	changed = istate->cache_changed;
+	memset(&ps, 0, sizeof(ps));
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+		struct tree *tree;
+
+		if (!S_ISSPARSEDIR(ce->ce_mode)) {
+			append_entry(&ctx, ce);
+			continue;
+		}
+
+		tree = lookup_tree(the_repository, &ce->oid);
+		if (!tree ||
+		    read_tree_recursive(the_repository, tree, ce->name,
+					ce->ce_namelen, 0, &ps,
+					add_path_to_index, &ctx))
+			die(_("unable to expand sparse directory '%s'"), ce->name);
+
+		cache_tree_invalidate_path(istate, ce->name);
+		discard_cache_entry(ce);
+	}
+
+	free(istate->cache);
+	istate->cache = ctx.cache;
+	istate->cache_nr = ctx.nr;
+	istate->cache_alloc = ctx.alloc;
+	istate->sparse_index = 0;
+	istate->cache_changed = changed;
+
+	trace2_region_leave("index", "ensure_full_index", the_repository);
+}
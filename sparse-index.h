@@ -0,0 +1,53 @@
+#ifndef SPARSE_INDEX_H
+#define SPARSE_INDEX_H
+
+struct index_state;
+
+/*
+ * A sparse index stores each directory that lies entirely outside of the
+ * cone-mode sparse-checkout patterns as a single "sparse directory"
+ * entry, instead of one entry per file. Such an entry has mode S_IFDIR,
+ * a name ending with a slash, the object name of the tree of the
+ * directory, and the skip-worktree bit set. The index file records that
+ * it may hold such entries with the required "sdir" extension.
+ *
+ * The sparse index is used when "core.sparseCheckout",
+ * "core.sparseCheckoutCone" and "index.sparse" are all enabled.
+ */
+
+/* Whether the configuration asks for a sparse index. */
+int sparse_index_enabled(void);
+
+/*
+ * Most commands expect every path to have its own index entry, so the
+ * index is expanded to a full one as soon as it is read. Commands that
+ * know how to deal with sparse directory entries clear this flag before
+ * reading the index.
+ */
+extern int command_requires_full_index;
+
+/*
+ * Collapse the directories of the index that are outside of the sparse
+ * cone into sparse directory entries, if the sparse index is enabled.
+ * The index is left untouched when it cannot be made sparse (e.g. when
+ * it has unmerged entries or is split). Returns 0, even then, unless
+ * an error occurred.
+ */
+int convert_to_sparse(struct index_state *istate);
+
+/*
+ * Returns 1 if every sparse directory entry of the index still lies
+ * entirely outside of the cone of $GIT_DIR/info/sparse-checkout, and 0
+ * if some of them must be expanded (or the patterns are not in cone
+ * mode).
+ */
+int sparse_dirs_outside_cone(struct index_state *istate);
+
+/*
+ * Replace each sparse directory entry by the entries of the files of
+ * its tree, with the skip-worktree bit set, so that the index is a full
+ * one again. Does nothing if the index is not sparse.
+ */
+void ensure_full_index(struct index_state *istate);
+
+#endif /* SPARSE_INDEX_H */
@@ -0,0 +1,123 @@
+#include "git-compat-util.h"
+#include "strmap.h"
+#include "mem-pool.h"
+
+static int cmp_strmap_entry(const void *hashmap_cmp_fn_data,
+			    const void *entry,
+			    const void *entry_or_key,
+			    const void *keydata)
+{
+	const struct strmap_entry *e1 = entry;
+	const struct strmap_entry *e2 = entry_or_key;
+
+	return strcmp(e1->key, keydata ? (const char *)keydata : e2->key);
+}
+
+static struct strmap_entry *find_strmap_entry(struct strmap *map,
+					      const char *str)
+{
+	struct strmap_entry entry;
+
+	if (!map->map.tablesize)
+		return NULL;
+	hashmap_entry_init(&entry, strhash(str));
+	return hashmap_get(&map->map, &entry, str);
+}
+
+void strmap_init(struct strmap *map)
+{
+	strmap_init_with_options(map, NULL, 1);
+}
+
+void strmap_init_with_options(struct strmap *map,
+			      struct mem_pool *pool,
+			      int strdup_strings)
+{
+	hashmap_init(&map->map, cmp_strmap_entry, NULL, 0);
+	map->pool = pool;
+	map->strdup_strings = strdup_strings;
+}
+
+static void free_strmap_entry(struct strmap *map, struct strmap_entry *e,
+			      int free_value)
+{
+	if (free_value)
+		free(e->value);
+	if (map->pool)
+		return;
+	if (map->strdup_strings)
+		free((char *)e->key);
+	free(e);
+}
+
+void strmap_clear(struct strmap *map, int free_values)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	if (!map->map.tablesize)
+		return;
+
+	strmap_for_each_entry(map, &iter, e)
+		free_strmap_entry(map, e, free_values);
+	hashmap_free(&map->map, 0);
+}
+
+void *strmap_put(struct strmap *map, const char *str, void *data)
+{
+	struct strmap_entry *entry = find_strmap_entry(map, str);
+	void *old = NULL;
+
+	if (entry) {
+		old = entry->value;
+		entry->value = data;
+		return old;
+	}
+
+	if (map->pool) {
+		entry = mem_pool_alloc(map->pool, sizeof(*entry));
+		if (map->strdup_strings) {
+			size_t len = strlen(str);
+			char *key = mem_pool_alloc(map->pool, len + 1);
+			memcpy(key, str, len + 1);
+			str = key;
+		}
+	} else {
+		entry = xmalloc(sizeof(*entry));
+		if (map->strdup_strings)
+			str = xstrdup(str);
+	}
+	hashmap_entry_init(entry, strhash(str));
+	entry->key = str;
+	entry->value = data;
+	hashmap_add(&map->map, entry);
+	return old;
+}
+
+struct strmap_entry *strmap_get_entry(struct strmap *map, const char *str)
+{
+	return find_strmap_entry(map, str);
+}
+
+void *strmap_get(struct strmap *map, const char *str)
+{
+	struct strmap_entry *entry = find_strmap_entry(map, str);
+	return entry ? entry->value : NULL;
+}
+
+int strmap_contains(struct strmap *map, const char *str)
+{
+	return find_strmap_entry(map, str) != NULL;
+}
+
+void strmap_remove(struct strmap *map, const char *str, int free_value)
+{
+	struct strmap_entry entry, *ret;
+
+	if (!map->map.tablesize)
+		return;
+	hashmap_entry_init(&entry, strhash(str));
+	ret = hashmap_remove(&map->map, &entry, str);
+	if (ret)
+		free_strmap_entry(map, ret, free_value);
+}
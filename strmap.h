@@ -0,0 +1,105 @@
+#ifndef STRMAP_H
+#define STRMAP_H
+
+#include "hashmap.h"
+
+struct mem_pool;
+
+/*
+ * A map from strings to arbitrary pointers.  It is a thin wrapper around
+ * hashmap that saves callers from having to embed a hashmap_entry and
+ * write their own comparison function for the common case of a
+ * path-keyed lookup table.
+ */
+struct strmap {
+	struct hashmap map;
+	struct mem_pool *pool;
+	unsigned int strdup_strings:1;
+};
+
+struct strmap_entry {
+	struct hashmap_entry ent; /* must be the first member! */
+	const char *key;
+	void *value;
+};
+
+/*
+ * Initialize the members of the strmap.  Any keys added to the strmap will
+ * be strdup'ed with their memory managed by the strmap.
+ */
+void strmap_init(struct strmap *map);
+
+/*
+ * Same as strmap_init, but for those who want to control the memory
+ * management carefully instead of using the default of strdup_strings=1
+ * and pool=NULL.
+ *
+ * If pool is non-NULL, the entries (and the key copies, if strdup_strings
+ * is set) are allocated from it, and are only released when the pool is
+ * discarded; strmap_clear() and strmap_remove() then only forget about
+ * them.  If strdup_strings is not set, the caller guarantees that the
+ * keys outlive the map.
+ */
+void strmap_init_with_options(struct strmap *map,
+			      struct mem_pool *pool,
+			      int strdup_strings);
+
+/*
+ * Remove all entries from the map, releasing any allocated resources.
+ * The values are free()d too if free_values is set.
+ */
+void strmap_clear(struct strmap *map, int free_values);
+
+/*
+ * Insert "str" into the map, pointing to "data".
+ *
+ * If an entry for "str" already exists, its data pointer is overwritten,
+ * and the original data pointer returned. Otherwise, returns NULL.
+ */
+void *strmap_put(struct strmap *map, const char *str, void *data);
+
+/*
+ * Return the strmap_entry mapped by "str", or NULL if there is not such
+ * an item in map.
+ */
+struct strmap_entry *strmap_get_entry(struct strmap *map, const char *str);
+
+/*
+ * Return the data pointer mapped by "str", or NULL if the entry does not
+ * exist.
+ */
+void *strmap_get(struct strmap *map, const char *str);
+
+/*
+ * Return non-zero iff "str" is present in the map. This differs from
+ * strmap_get() in that it can distinguish entries with a NULL data pointer.
+ */
+int strmap_contains(struct strmap *map, const char *str);
+
+/*
+ * Remove the given entry from the strmap.  If the string isn't in the
+ * strmap, the map is not altered.  The value is free()d if free_value
+ * is set.
+ */
+void strmap_remove(struct strmap *map, const char *str, int free_value);
+
+static inline unsigned int strmap_get_size(struct strmap *map)
+{
+	return hashmap_get_size(&map->map);
+}
+
+static inline int strmap_empty(struct strmap *map)
+{
+	return strmap_get_size(map) == 0;
+}
+
+/*
+ * Iterate over all entries of a strmap in no particular order.  It is not
+ * safe to add or remove entries while iterating.
+ */
+#define strmap_for_each_entry(mystrmap, iter, var)	\
+	for (var = hashmap_iter_first(&(mystrmap)->map, iter); \
+	     var; \
+	     var = hashmap_iter_next(iter))
+
+#endif /* STRMAP_H */
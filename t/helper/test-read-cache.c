@@ -1,24 +1,61 @@
 #include "test-tool.h"
 #include "cache.h"
 #include "config.h"
+#include "sparse-index.h"
+
+static void print_cache_entry(struct cache_entry *ce)
+{
+	const char *type;
+
+	if (S_ISSPARSEDIR(ce->ce_mode))
+		type = "tree";
+	else if (S_ISGITLINK(ce->ce_mode))
+		type = "commit";
+	else
+		type = "blob";
+
+	printf("%06o %s %s\t%s\n", ce->ce_mode, type,
+	       oid_to_hex(&ce->oid), ce->name);
+}
+
+static void print_cache(struct index_state *istate)
+{
+	int i;
+
+	for (i = 0; i < istate->cache_nr; i++)
+		print_cache_entry(istate->cache[i]);
+}
 
 int cmd__read_cache(int argc, const char **argv)
 {
 	int i, cnt = 1, namelen;
 	const char *name = NULL;
+	int table = 0, expand = 0;
 
-	if (argc > 1 && skip_prefix(argv[1], "--print-and-refresh=", &name)) {
-		namelen = strlen(name);
-		argc--;
-		argv++;
+	for (++argv, --argc; argc && starts_with(*argv, "--"); ++argv, --argc) {
+		if (skip_prefix(*argv, "--print-and-refresh=", &name))
+			namelen = strlen(name);
+		else if (!strcmp(*argv, "--table"))
+			table = 1;
+		else if (!strcmp(*argv, "--expand"))
+			expand = 1;
+		else
+			die("unknown option '%s'", *argv);
 	}
 
-	if (argc == 2)
-		cnt = strtol(argv[1], NULL, 0);
+	if (argc == 1)
+		cnt = strtol(argv[0], NULL, 0);
 	setup_git_directory();
 	git_config(git_default_config, NULL);
+
+	/* show the index the way it is stored, unless asked to expand it */
+	if (table)
+		command_requires_full_index = 0;
+
 	for (i = 0; i < cnt; i++) {
 		read_cache();
+		if (expand)
+			ensure_full_index(&the_index);
 		if (name) {
 			int pos;
 
@@ -31,6 +68,8 @@ int cmd__read_cache(int argc, const char **argv)
 			       ce_uptodate(the_index.cache[pos]) ? "" : " not");
 			write_file(name, "%d\n", i);
 		}
+		if (table)
+			print_cache(&the_index);
 		discard_cache();
 	}
 	return 0;
@@ -0,0 +1,16 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "refs/reftable.h"
+
+static const char *usage_str = "test-tool reftable dump (<table> | <stack-dir>)";
+
+int cmd__reftable(int argc, const char **argv)
+{
+	int nongit;
+
+	if (argc != 3 || strcmp(argv[1], "dump"))
+		usage(usage_str);
+
+	setup_git_directory_gently(&nongit);
+	return !!reftable_dump(argv[2]);
+}
@@ -64,4 +64,20 @@ test_perf "switch between aliases ($nr_files)" '
 	git checkout -q br_ballast
 '
 
+# Repeat the switches that write out files with parallel checkout.
+# Set GIT_PERF_CHECKOUT_WORKERS to change the numbers of workers
+# (default "2 4 8"); 0 means one per logical core.
+for workers in ${GIT_PERF_CHECKOUT_WORKERS:-2 4 8}
+do
+	test_perf "switch between br_base br_ballast, $workers workers ($nr_files)" "
+		git -c checkout.workers=$workers checkout -q br_base &&
+		git -c checkout.workers=$workers checkout -q br_ballast
+	"
+
+	test_perf "switch between br_ballast br_ballast_plus_1, $workers workers ($nr_files)" "
+		git -c checkout.workers=$workers checkout -q br_ballast_plus_1 &&
+		git -c checkout.workers=$workers checkout -q br_ballast
+	"
+done
+
 test_done
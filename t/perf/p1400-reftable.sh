@@ -0,0 +1,61 @@
+#!/bin/sh
+
+test_description='Test ref storage performance of the files and reftable backends
+
+Set GIT_PERF_REFTABLE_REFS to change the number of refs (default 1000000).
+'
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+n=${GIT_PERF_REFTABLE_REFS:-1000000}
+
+test_expect_success "setup $n refs" '
+	test_commit base &&
+	test_commit next &&
+	base=$(git rev-parse base) &&
+	test_seq $n |
+	sed "s|.*|update refs/heads/branch-&/tip $base|" >update-all &&
+	split -l 1000 update-all batch- &&
+	echo "update refs/heads/branch-1/tip $(git rev-parse next)" >update-one
+'
+
+for format in files reftable
+do
+	test_expect_success "init $format repository" '
+		git init --bare --ref-format=$format $format.git &&
+		git push -q $format.git HEAD:refs/heads/master
+	'
+
+	# The files backend keeps a lock file open for each ref it updates.
+	test_perf "create $n refs in batches of 1000 ($format)" '
+		for batch in batch-*
+		do
+			git -C $format.git update-ref --stdin <$batch || return 1
+		done
+	'
+
+	test_perf "pack-refs ($format)" '
+		git -C $format.git pack-refs --all
+	'
+
+	test_perf "rev-parse one ref ($format)" '
+		git -C $format.git rev-parse --verify refs/heads/branch-1/tip
+	'
+
+	test_perf "update one ref ($format)" '
+		git -C $format.git update-ref --stdin <update-one &&
+		git -C $format.git update-ref refs/heads/branch-1/tip base
+	'
+
+	test_perf "for-each-ref ($format)" '
+		git -C $format.git for-each-ref >/dev/null
+	'
+
+	test_perf "for-each-ref with prefix ($format)" '
+		git -C $format.git for-each-ref refs/heads/branch-12345/ >/dev/null
+	'
+done
+
+test_done
@@ -0,0 +1,103 @@
+#!/bin/sh
+
+test_description="test performance of Git operations using the sparse index
+
+Builds a wide history by nesting copies of the tree of the test repository
+$SPARSE_INDEX_DEPTH levels deep (default: 3; each level multiplies the
+number of files by four), and compares a cone-mode sparse checkout of a
+single directory with a full index against the same checkout with a sparse
+index."
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+SPARSE_INDEX_DEPTH=${SPARSE_INDEX_DEPTH:-3}
+SPARSE_CONE=f2/f4
+
+test_expect_success 'setup repo and indexes' '
+	git reset --hard HEAD &&
+
+	# Remove submodules from the example repo, because our
+	# duplication of the entire repo creates an unlikely data shape.
+	if git config --file .gitmodules --get-regexp "submodule.*.path" >modules
+	then
+		git rm $(awk "{print \$2}" <modules) &&
+		git commit -m "remove submodules" || return 1
+	fi &&
+
+	echo bogus >a &&
+	git add a &&
+	git commit -m "level 0" &&
+	BLOB=$(git rev-parse HEAD:a) &&
+	OLD_COMMIT=$(git rev-parse HEAD) &&
+	OLD_TREE=$(git rev-parse HEAD^{tree}) &&
+
+	for i in $(test_seq 1 $SPARSE_INDEX_DEPTH)
+	do
+		cat >in <<-EOF &&
+		100644 blob $BLOB	a
+		040000 tree $OLD_TREE	f1
+		040000 tree $OLD_TREE	f2
+		040000 tree $OLD_TREE	f3
+		040000 tree $OLD_TREE	f4
+		EOF
+		NEW_TREE=$(git mktree <in) &&
+		NEW_COMMIT=$(git commit-tree $NEW_TREE -p $OLD_COMMIT -m "level $i") &&
+		OLD_TREE=$NEW_TREE &&
+		OLD_COMMIT=$NEW_COMMIT || return 1
+	done &&
+	git branch -f wide $OLD_COMMIT &&
+
+	for repo in full-index sparse-index
+	do
+		git clone --no-checkout . $repo &&
+		git -C $repo config core.sparseCheckout true &&
+		git -C $repo config core.sparseCheckoutCone true &&
+		cat >$repo/.git/info/sparse-checkout <<-EOF &&
+		/*
+		!/*/
+		/f2/
+		!/f2/*/
+		/$SPARSE_CONE/
+		EOF
+		git -C $repo checkout -q -b wide origin/wide &&
+		echo more >>$repo/$SPARSE_CONE/a &&
+		git -C $repo commit -q -a -m "cone change" &&
+		git -C $repo branch other &&
+		git -C $repo reset -q --hard wide@{1} || return 1
+	done &&
+
+	git -C sparse-index config index.sparse true &&
+	git -C sparse-index read-tree -mu HEAD
+'
+
+test_size 'index size (full-index)' '
+	wc -c <full-index/.git/index
+'
+
+test_size 'index size (sparse-index)' '
+	wc -c <sparse-index/.git/index
+'
+
+test_perf_on_all () {
+	command="$*"
+	for repo in full-index sparse-index
+	do
+		test_perf "$command ($repo)" "
+			(
+				cd $repo &&
+				echo >>$SPARSE_CONE/a &&
+				$command
+			)
+		"
+	done
+}
+
+test_perf_on_all git status
+test_perf_on_all git add -A
+test_perf_on_all git add .
+test_perf_on_all git commit -q -a -m A
+test_perf_on_all 'git checkout -q -f other && git checkout -q -f wide'
+
+test_done
@@ -53,4 +53,40 @@ test_perf 'rebase a lot of unrelated changes with split-index' '
 	git rebase --onto base upstream2
 '
 
+for renames in 100 1000
+do
+	test_expect_success "setup rebasing onto $renames upstream renames" '
+		git checkout -f -B renames-base$renames base &&
+		mkdir -p renames$renames &&
+		for i in $(test_seq $renames)
+		do
+			seq $i $((i + 100)) >renames$renames/file$i || return 1
+		done &&
+		git add renames$renames &&
+		test_tick &&
+		git commit -q -m "add $renames files" &&
+		git checkout -B renames-upstream$renames &&
+		git mv renames$renames renamed$renames &&
+		for i in $(test_seq $renames)
+		do
+			echo upstream >>renamed$renames/file$i || return 1
+		done &&
+		git add renamed$renames &&
+		test_tick &&
+		git commit -q -m "rename $renames files" &&
+		git checkout -B renames-topic$renames renames-base$renames &&
+		for i in $(test_seq 20)
+		do
+			sed -e "1s/^/picked/" renames$renames/file$i >tmp &&
+			mv tmp renames$renames/file$i &&
+			git commit -q -a -m "pick $i" || return 1
+		done
+	'
+
+	test_perf "rebase 20 picks onto $renames upstream renames" "
+		git checkout -f -B renames-rebased$renames renames-topic$renames &&
+		git rebase -m renames-upstream$renames
+	"
+done
+
 test_done
@@ -0,0 +1,68 @@
+#!/bin/sh
+
+test_description='Test rename detection performance on a large directory move'
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+dirs=1000
+files=100
+
+# Each file gets a few lines that are unique to it, so that the moved
+# and edited files can only be paired up by inexact rename detection.
+# Only the README has a unique basename.
+write_tree () {
+	top=$1 &&
+	edit=$2 &&
+	echo "M 100644 inline $top/README" &&
+	echo "data <<EOF" &&
+	echo "what is in this directory" &&
+	echo "and how it is laid out" &&
+	echo "$edit" &&
+	echo "EOF" &&
+	for d in $(test_seq $dirs)
+	do
+		for f in $(test_seq $files)
+		do
+			echo "M 100644 inline $top/dir$d/file$f" &&
+			echo "data <<EOF" &&
+			echo "directory $d" &&
+			echo "file $f" &&
+			echo "some content that is the same for all files" &&
+			echo "and a few more lines of it" &&
+			echo "so that one edited line keeps them similar" &&
+			echo "$edit" &&
+			echo "EOF"
+		done
+	done
+}
+
+test_expect_success "setup moving $((dirs * files)) files to another directory" '
+	{
+		echo "commit refs/heads/master" &&
+		echo "committer C <c@example.com> 1234567890 +0000" &&
+		echo "data <<EOF" &&
+		echo "add files" &&
+		echo "EOF" &&
+		write_tree src original &&
+		echo &&
+		echo "commit refs/heads/master" &&
+		echo "committer C <c@example.com> 1234567890 +0000" &&
+		echo "data <<EOF" &&
+		echo "move and edit files" &&
+		echo "EOF" &&
+		echo "D src" &&
+		write_tree lib edited
+	} | git fast-import
+'
+
+test_perf 'detect renames of a moved directory' '
+	git diff-tree -r -M --name-status HEAD^ HEAD >renames
+'
+
+test_expect_success 'all moved files were detected as renames' '
+	test $(grep -c "^R" renames) = $((dirs * files + 1))
+'
+
+test_done
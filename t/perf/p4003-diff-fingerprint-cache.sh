@@ -0,0 +1,63 @@
+#!/bin/sh
+
+test_description='Test rename detection over history with the fingerprint cache'
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+commits=50
+files=200
+
+# Every commit moves all files to a new directory and edits them, with
+# names that do not allow pairing them up by basename.
+write_generation () {
+	gen=$1 &&
+	echo "commit refs/heads/master" &&
+	echo "committer C <c@example.com> 1234567890 +0000" &&
+	echo "data <<EOF" &&
+	echo "generation $gen" &&
+	echo "EOF" &&
+	if test $gen -gt 1
+	then
+		echo "D gen$(($gen - 1))"
+	fi &&
+	for f in $(test_seq $files)
+	do
+		echo "M 100644 inline gen$gen/file$f-$gen" &&
+		echo "data <<EOF" &&
+		echo "file $f" &&
+		echo "some content that is the same for all files" &&
+		echo "and a few more lines of it" &&
+		echo "so that one edited line keeps them similar" &&
+		echo "generation $gen" &&
+		echo "EOF"
+	done &&
+	echo
+}
+
+test_expect_success "setup $commits commits moving $files files each" '
+	for c in $(test_seq $commits)
+	do
+		write_generation $c || return 1
+	done | git fast-import
+'
+
+test_perf 'log -M without fingerprint cache' '
+	git -c diff.fingerprintCache=false log -M --raw >expect
+'
+
+test_expect_success 'fill the fingerprint cache' '
+	git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual
+'
+
+test_perf 'log -M with fingerprint cache' '
+	git -c diff.fingerprintCache=true log -M --raw >actual
+'
+
+test_expect_success 'the cache does not change the result' '
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,43 @@
+#!/bin/sh
+
+test_description='Tests performance of path-limited history with changed-path Bloom filters'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+# Pick a file to log pseudo-randomly.  The sort key is the blob hash,
+# so it is stable.
+test_expect_success 'select a file' '
+	git ls-tree HEAD | grep ^100644 |
+	sort -k 3 | head -1 | cut -f 2 >filelist
+'
+
+file=$(cat filelist)
+export file
+
+test_expect_success 'setup' '
+	git config core.commitGraph true &&
+	git commit-graph write --reachable --no-changed-paths
+'
+
+test_perf 'git log -- <path> (no Bloom filters)' '
+	git log --oneline -- "$file" >/dev/null
+'
+
+test_perf 'git blame <path> (no Bloom filters)' '
+	git blame -- "$file" >/dev/null
+'
+
+test_perf 'git commit-graph write --changed-paths' '
+	git commit-graph write --reachable --changed-paths
+'
+
+test_perf 'git log -- <path> (Bloom filters)' '
+	git log --oneline -- "$file" >/dev/null
+'
+
+test_perf 'git blame <path> (Bloom filters)' '
+	git blame -- "$file" >/dev/null
+'
+
+test_done
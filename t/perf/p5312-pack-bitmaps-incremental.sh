@@ -0,0 +1,33 @@
+#!/bin/sh
+
+test_description='Tests bitmap generation on repeated repacks'
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'setup bitmap config' '
+	git config pack.writebitmaps true
+'
+
+test_perf 'repack without existing bitmaps' '
+	rm -f .git/objects/pack/*.bitmap &&
+	git repack -adf
+'
+
+test_perf 'repack on top of existing bitmaps' '
+	git repack -ad
+'
+
+test_expect_success 'create a few new commits' '
+	test_commit_bulk --id=p5312 10
+'
+
+test_perf 'repack with new commits on top of existing bitmaps' '
+	git repack -ad
+'
+
+test_perf 'repack with new commits on top of existing bitmaps (1 thread)' '
+	git -c pack.threads=1 repack -ad
+'
+
+test_done
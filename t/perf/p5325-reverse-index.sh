@@ -0,0 +1,47 @@
+#!/bin/sh
+
+test_description='Tests pack performance with and without on-disk reverse indexes'
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'repack without a reverse index' '
+	git -c pack.writeReverseIndex=false repack -adf &&
+	PACK=$(ls .git/objects/pack/pack-*.pack) &&
+	REV=${PACK%.pack}.rev &&
+	test_path_is_missing $REV
+'
+
+# Every invocation is a fresh process, so each has to load the reverse
+# index from scratch.
+test_perf 'cat-file %(objectsize:disk) (in-memory revindex)' '
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectsize:disk)" >/dev/null
+'
+
+test_perf 'pack-objects --all (in-memory revindex)' '
+	git pack-objects --all --stdout --delta-base-offset </dev/null >/dev/null
+'
+
+test_expect_success 'write the reverse index' '
+	git -c pack.writeReverseIndex=true index-pack $PACK &&
+	test_path_is_file $REV
+'
+
+test_perf 'cat-file %(objectsize:disk) (.rev)' '
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectsize:disk)" >/dev/null
+'
+
+test_perf 'pack-objects --all (.rev)' '
+	git pack-objects --all --stdout --delta-base-offset </dev/null >/dev/null
+'
+
+test_perf 'index-pack with pack.writeReverseIndex' '
+	rm -rf repo.git &&
+	git init --bare repo.git &&
+	GIT_DIR=repo.git git -c pack.writeReverseIndex=true \
+		index-pack --stdin <$PACK
+'
+
+test_done
@@ -17,6 +17,11 @@ test_description="Test core.fsmonitor"
 # The performance test will also use the untracked cache feature if it is
 # available as fsmonitor uses it to speed up scanning for untracked files.
 #
+# Where it is available (on Linux), the built-in fsmonitor--daemon is
+# compared with the integration script. The difference is best seen on a
+# large work tree (e.g. 500k files, with GIT_PERF_LARGE_REPO), where the
+# daemon may need a larger fs.inotify.max_user_watches.
+#
 # There are 3 environment variables that can be used to alter the default
 # behavior of the performance test:
 #
@@ -43,6 +48,10 @@ test_lazy_prereq WATCHMAN '
 	command -v watchman
 '
 
+test_lazy_prereq FSMONITOR_DAEMON '
+	test -n "$HAVE_INOTIFY" && test -z "$NO_UNIX_SOCKETS"
+'
+
 if test_have_prereq WATCHMAN
 then
 	# Convert unix style paths to escaped Windows style paths for Watchman
@@ -141,6 +150,42 @@ test_perf "status -uall (fsmonitor=$INTEGRATION_SCRIPT)" '
 	git status -uall
 '
 
+test_expect_success FSMONITOR_DAEMON "setup for fsmonitor--daemon" '
+	git config core.useBuiltinFSMonitor true &&
+	git fsmonitor--daemon start &&
+	git update-index --fsmonitor &&
+	git status
+'
+
+if test -n "$GIT_PERF_7519_DROP_CACHE"; then
+	test-tool drop-caches
+fi
+
+test_perf FSMONITOR_DAEMON "status (fsmonitor--daemon)" '
+	git status
+'
+
+if test -n "$GIT_PERF_7519_DROP_CACHE"; then
+	test-tool drop-caches
+fi
+
+test_perf FSMONITOR_DAEMON "status -uno (fsmonitor--daemon)" '
+	git status -uno
+'
+
+if test -n "$GIT_PERF_7519_DROP_CACHE"; then
+	test-tool drop-caches
+fi
+
+test_perf FSMONITOR_DAEMON "status -uall (fsmonitor--daemon)" '
+	git status -uall
+'
+
+test_expect_success FSMONITOR_DAEMON "stop fsmonitor--daemon" '
+	git fsmonitor--daemon stop &&
+	git config --unset core.useBuiltinFSMonitor
+'
+
 test_expect_success "setup without fsmonitor" '
 	unset INTEGRATION_SCRIPT &&
 	git config --unset core.fsmonitor &&
@@ -20,4 +20,12 @@ test_perf 'grep --cached, expensive regex' '
 	git grep --cached "^.* *some_nonexistent_string$" || :
 '
 
+for threads in 1 2 4 8 16
+do
+	test_perf "grep HEAD, $threads threads" "
+		git -c grep.trigramIndex=false grep --threads=$threads \
+			-e some_nonexistent_string HEAD || :
+	"
+done
+
 test_done
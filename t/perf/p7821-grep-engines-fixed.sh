@@ -21,7 +21,7 @@ then
 	test_set_prereq PERF_GREP_ENGINES_THREADS
 fi
 
-for pattern in 'int' 'uncommon' 'æ'
+for pattern in 'int' 'uncommon' 'æ' 'strbuf_addf'
 do
 	for engine in fixed basic extended perl
 	do
@@ -71,4 +71,20 @@ do
 	fi
 done
 
+# Case-insensitive ASCII patterns are still searched for as fixed
+# strings, while the other engines need a case-folding regex.
+for pattern in 'INT' 'UnCommon' 'STRBUF_ADDF'
+do
+	for engine in fixed basic
+	do
+		test_perf "$engine grep -i$GIT_PERF_7821_GREP_OPTS $pattern" "
+			git -c grep.patternType=$engine grep -i$GIT_PERF_7821_GREP_OPTS $pattern >'out.$engine' || :
+		"
+	done
+
+	test_expect_success "assert that all engines found the same for -i$GIT_PERF_7821_GREP_OPTS $pattern" '
+		test_cmp out.fixed out.basic
+	'
+done
+
 test_done
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+test_description="git-grep of trees with and without the trigram index"
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_perf 'write trigram index' '
+	rm -f .git/objects/info/trigrams &&
+	git -c gc.writeTrigramIndex=true gc --quiet
+'
+
+for index in false true
+do
+	for pattern in some_nonexistent_string strbuf_addf "str[a-z]*_release"
+	do
+		test_perf "grep HEAD $pattern (trigramIndex=$index)" "
+			git -c grep.trigramIndex=$index grep -e '$pattern' HEAD || :
+		"
+	done
+
+	test_perf "grep -i HEAD (trigramIndex=$index)" "
+		git -c grep.trigramIndex=$index grep -i -e Strbuf_Addf HEAD || :
+	"
+done
+
+test_done
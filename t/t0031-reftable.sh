@@ -0,0 +1,250 @@
+#!/bin/sh
+
+test_description='reftable ref storage backend'
+
+. ./test-lib.sh
+
+INVALID_SHA1=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa
+
+test_expect_success 'init --ref-format=reftable' '
+	git init --ref-format=reftable repo &&
+	test_path_is_dir repo/.git/reftable &&
+	test_path_is_file repo/.git/reftable/tables.list &&
+	echo 1 >expect &&
+	git -C repo config core.repositoryformatversion >actual &&
+	test_cmp expect actual &&
+	echo reftable >expect &&
+	git -C repo config extensions.refStorage >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'init rejects unknown ref formats' '
+	test_must_fail git init --ref-format=nonsense bogus 2>err &&
+	test_i18ngrep "unknown ref storage format" err &&
+	test_path_is_missing bogus
+'
+
+test_expect_success 'reinit keeps the ref format' '
+	git init repo &&
+	test_path_is_dir repo/.git/reftable &&
+	test_must_fail git init --ref-format=files repo 2>err &&
+	test_i18ngrep "different ref storage format" err
+'
+
+test_expect_success 'unborn HEAD points to master' '
+	echo refs/heads/master >expect &&
+	git -C repo symbolic-ref HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'commit and read back refs' '
+	test_commit -C repo one &&
+	test_commit -C repo two &&
+	git -C repo rev-parse two >expect &&
+	git -C repo rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	test_path_is_missing repo/.git/refs/heads/master
+'
+
+test_expect_success 'annotated tags are peeled' '
+	git -C repo tag -a -m msg annotated one &&
+	git -C repo rev-parse one >expect &&
+	git -C repo show-ref -s -d annotated >actual &&
+	tail -n 1 actual | cut -d" " -f1 >peeled &&
+	test_cmp expect peeled
+'
+
+test_expect_success 'update-ref with old value' '
+	git -C repo update-ref refs/heads/side one &&
+	test_must_fail git -C repo update-ref refs/heads/side two two &&
+	git -C repo update-ref refs/heads/side two one &&
+	git -C repo rev-parse two >expect &&
+	git -C repo rev-parse side >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'refuse to write a nonexistent object' '
+	test_must_fail git -C repo update-ref refs/heads/bad $INVALID_SHA1 &&
+	test_must_fail git -C repo rev-parse --verify -q refs/heads/bad
+'
+
+test_expect_success 'directory/file conflicts are detected' '
+	test_must_fail git -C repo update-ref refs/heads/side/sub one &&
+	test_must_fail git -C repo update-ref refs/heads/side/sub one 2>err &&
+	test_i18ngrep "refs/heads/side" err &&
+	git -C repo update-ref refs/heads/dir/sub one &&
+	test_must_fail git -C repo update-ref refs/heads/dir one
+'
+
+test_expect_success 'transactions are atomic' '
+	git -C repo rev-parse side >expect &&
+	test_must_fail git -C repo update-ref --stdin <<-EOF &&
+	update refs/heads/side $(git -C repo rev-parse one)
+	create refs/heads/new $(git -C repo rev-parse one)
+	verify refs/heads/dir $(git -C repo rev-parse one)
+	EOF
+	git -C repo rev-parse side >actual &&
+	test_cmp expect actual &&
+	test_must_fail git -C repo rev-parse --verify -q refs/heads/new &&
+	git -C repo update-ref --stdin <<-EOF &&
+	update refs/heads/side $(git -C repo rev-parse one)
+	create refs/heads/new $(git -C repo rev-parse one)
+	delete refs/heads/dir/sub
+	EOF
+	git -C repo rev-parse one >expect &&
+	git -C repo rev-parse side >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse new >actual &&
+	test_cmp expect actual &&
+	test_must_fail git -C repo rev-parse --verify -q refs/heads/dir/sub
+'
+
+test_expect_success 'symbolic refs' '
+	git -C repo symbolic-ref refs/heads/sym refs/heads/side &&
+	echo refs/heads/side >expect &&
+	git -C repo symbolic-ref refs/heads/sym >actual &&
+	test_cmp expect actual &&
+	git -C repo update-ref refs/heads/sym two &&
+	git -C repo rev-parse two >expect &&
+	git -C repo rev-parse side >actual &&
+	test_cmp expect actual &&
+	git -C repo update-ref --no-deref -d refs/heads/sym &&
+	git -C repo rev-parse --verify -q side
+'
+
+test_expect_success 'for-each-ref lists refs in order' '
+	cat >expect <<-\EOF &&
+	refs/heads/master
+	refs/heads/new
+	refs/heads/side
+	refs/tags/annotated
+	refs/tags/one
+	refs/tags/two
+	EOF
+	git -C repo for-each-ref --format="%(refname)" >actual &&
+	test_cmp expect actual &&
+	git -C repo for-each-ref --format="%(refname)" refs/tags/ >actual &&
+	grep refs/tags/ expect >expect.tags &&
+	test_cmp expect.tags actual
+'
+
+test_expect_success 'reflogs are kept in the tables' '
+	git -C repo reflog show --format=%gs master >actual &&
+	cat >expect <<-\EOF &&
+	commit: two
+	commit (initial): one
+	EOF
+	test_cmp expect actual &&
+	test_path_is_missing repo/.git/logs/refs/heads/master
+'
+
+test_expect_success 'deleting a ref deletes its reflog' '
+	git -C repo branch doomed &&
+	git -C repo reflog exists refs/heads/doomed &&
+	git -C repo branch -D doomed &&
+	test_must_fail git -C repo reflog exists refs/heads/doomed
+'
+
+test_expect_success 'rename and copy branches with their reflogs' '
+	git -C repo branch -m side renamed &&
+	test_must_fail git -C repo rev-parse --verify -q side &&
+	git -C repo branch -c renamed copied &&
+	git -C repo rev-parse renamed >expect &&
+	git -C repo rev-parse copied >actual &&
+	test_cmp expect actual &&
+	git -C repo reflog show --format=%gs copied >actual &&
+	head -n 2 actual >top &&
+	cat >expect <<-\EOF &&
+	Branch: copied refs/heads/renamed to refs/heads/copied
+	Branch: renamed refs/heads/side to refs/heads/renamed
+	EOF
+	test_cmp expect top
+'
+
+test_expect_success 'reflog expire' '
+	git -C repo reflog expire --expire=all refs/heads/master &&
+	git -C repo reflog show master >actual &&
+	test_must_be_empty actual &&
+	git -C repo reflog exists refs/heads/master
+'
+
+test_expect_success 'pseudorefs are stored in files' '
+	git -C repo update-ref ORIG_HEAD HEAD &&
+	git -C repo rev-parse HEAD >expect &&
+	test_cmp expect repo/.git/ORIG_HEAD &&
+	git -C repo update-ref -d ORIG_HEAD &&
+	test_path_is_missing repo/.git/ORIG_HEAD
+'
+
+test_expect_success 'tables are compacted automatically' '
+	for i in $(test_seq 20)
+	do
+		git -C repo update-ref refs/heads/auto-$i HEAD || return 1
+	done &&
+	test_line_count -lt 10 repo/.git/reftable/tables.list
+'
+
+test_expect_success 'pack-refs compacts all tables' '
+	git -C repo for-each-ref >expect &&
+	git -C repo pack-refs &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+	git -C repo for-each-ref >actual &&
+	test_cmp expect actual &&
+	test_path_is_missing repo/.git/packed-refs
+'
+
+test_expect_success 'dump tables' '
+	test-tool -C repo reftable dump .git/reftable >dump &&
+	grep "^ref HEAD [0-9]* symref refs/heads/master$" dump &&
+	grep "^ref refs/tags/annotated [0-9]* val2 $(git -C repo rev-parse annotated) $(git -C repo rev-parse one)$" dump &&
+	! grep "^ref refs/heads/side " dump
+'
+
+test_expect_success 'many refs are indexed' '
+	test_seq 2000 | sed "s|.*|create refs/heads/many/& $(git -C repo rev-parse HEAD)|" >input &&
+	git -C repo update-ref --stdin <input &&
+	git -C repo pack-refs &&
+	git -C repo rev-parse many/1234 &&
+	git -C repo for-each-ref refs/heads/many/ >refs &&
+	test_line_count = 2000 refs
+'
+
+test_expect_success 'clone from and fetch into reftable repositories' '
+	git clone repo clone &&
+	git -C repo for-each-ref --format="%(refname:strip=2)" refs/heads/ >expect &&
+	git -C clone for-each-ref --format="%(refname:strip=3)" \
+		refs/remotes/origin/ >actual.all &&
+	grep -v "^HEAD$" actual.all >actual &&
+	test_cmp expect actual &&
+	git init --bare --ref-format=reftable fetched &&
+	git -C fetched fetch ../repo "refs/heads/*:refs/heads/*" &&
+	git -C repo for-each-ref refs/heads/ >expect &&
+	git -C fetched for-each-ref refs/heads/ >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'worktrees have their own HEAD' '
+	git -C repo worktree add ../wt renamed &&
+	test_path_is_dir repo/.git/worktrees/wt/reftable &&
+	echo refs/heads/renamed >expect &&
+	git -C wt symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	echo refs/heads/master >expect &&
+	git -C repo symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	test_commit -C wt in-worktree &&
+	git -C wt rev-parse HEAD >expect &&
+	git -C repo rev-parse renamed >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse worktrees/wt/HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'fsck and gc' '
+	git -C repo fsck &&
+	git -C repo gc &&
+	test_path_is_missing repo/.git/packed-refs &&
+	git -C repo rev-parse many/1 in-worktree
+'
+
+test_done
@@ -0,0 +1,271 @@
+#!/bin/sh
+
+test_description='sparse index
+
+Compare the behavior of commands in a full checkout, in a cone-mode
+sparse checkout with a full index, and in the same sparse checkout with
+a sparse index, where the directories outside of the cone are collapsed
+into sparse directory entries.
+'
+
+. ./test-lib.sh
+
+# A split index is never made sparse.
+GIT_TEST_SPLIT_INDEX=0
+export GIT_TEST_SPLIT_INDEX
+
+test_expect_success 'setup' '
+	git init initial-repo &&
+	(
+		cd initial-repo &&
+		mkdir -p deep/deeper1/deepest deep/deeper2 folder1/sub folder2 x &&
+		for f in a deep/a deep/deeper1/a deep/deeper1/deepest/a \
+			 deep/deeper2/a folder1/a folder1/sub/a folder2/a x/a
+		do
+			echo $f >$f || return 1
+		done &&
+		git add . &&
+		git commit -m initial &&
+
+		git checkout -b update-deep &&
+		echo more >>deep/a &&
+		git commit -a -m update-deep &&
+
+		git checkout -b update-folder1 master &&
+		echo more >>folder1/a &&
+		echo new >folder1/sub/b &&
+		git add folder1 &&
+		git commit -m update-folder1 &&
+
+		git checkout -b update-both master &&
+		echo more >>deep/deeper1/a &&
+		echo more >>folder2/a &&
+		git commit -a -m update-both &&
+
+		git checkout master
+	)
+'
+
+init_repos () {
+	rm -rf full-checkout sparse-checkout sparse-index &&
+
+	git clone -q initial-repo full-checkout &&
+	git clone -q initial-repo sparse-checkout &&
+	git clone -q initial-repo sparse-index &&
+
+	for repo in sparse-checkout sparse-index
+	do
+		git -C $repo config core.sparseCheckout true &&
+		git -C $repo config core.sparseCheckoutCone true &&
+		cat >$repo/.git/info/sparse-checkout <<-\EOF &&
+		/*
+		!/*/
+		/deep/
+		EOF
+		git -C $repo read-tree -mu HEAD || return 1
+	done &&
+
+	git -C sparse-index config index.sparse true &&
+	git -C sparse-index read-tree -mu HEAD &&
+
+	# commit at the same time in every repository
+	test_tick
+}
+
+run_on_sparse () {
+	(
+		cd sparse-checkout &&
+		"$@" >../sparse-checkout-out 2>../sparse-checkout-err
+	) &&
+	(
+		cd sparse-index &&
+		"$@" >../sparse-index-out 2>../sparse-index-err
+	)
+}
+
+run_on_all () {
+	(
+		cd full-checkout &&
+		"$@" >../full-checkout-out 2>../full-checkout-err
+	) &&
+	run_on_sparse "$@"
+}
+
+test_all_match () {
+	run_on_all "$@" &&
+	test_cmp full-checkout-out sparse-checkout-out &&
+	test_cmp full-checkout-out sparse-index-out &&
+	test_cmp full-checkout-err sparse-checkout-err &&
+	test_cmp full-checkout-err sparse-index-err
+}
+
+test_sparse_match () {
+	run_on_sparse "$@" &&
+	test_cmp sparse-checkout-out sparse-index-out &&
+	test_cmp sparse-checkout-err sparse-index-err
+}
+
+# Checks that the index of <repo> is stored with the given sparse
+# directory entries (and no others).
+test_sparse_dirs () {
+	repo=$1 &&
+	shift &&
+	test-tool -C $repo read-cache --table >cache &&
+	grep "^040000 tree" cache | cut -f2 >actual &&
+	if test $# = 0
+	then
+		test_must_be_empty actual
+	else
+		test_write_lines "$@" >expect &&
+		test_cmp expect actual
+	fi
+}
+
+test_expect_success 'sparse-index contents' '
+	init_repos &&
+	test_sparse_dirs sparse-index folder1/ folder2/ x/ &&
+	test_sparse_dirs sparse-checkout
+'
+
+test_expect_success 'expanded in-memory index matches full index' '
+	init_repos &&
+	test_sparse_match git ls-files --stage &&
+	test_sparse_match git ls-files -t &&
+	test_sparse_match test-tool read-cache --expand --table
+'
+
+test_expect_success 'status with options' '
+	init_repos &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git status --porcelain=v2 -z -u &&
+	test_all_match git status --porcelain=v2 -uno &&
+	run_on_all touch README.md &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git status --porcelain=v2 -z -u &&
+	test_all_match git status --porcelain=v2 -uno &&
+	run_on_all git add README.md &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git status --porcelain=v2 -- deep
+'
+
+test_expect_success 'add, commit, checkout' '
+	init_repos &&
+
+	write_script edit-contents <<-\EOF &&
+	echo text >>$1
+	EOF
+	run_on_all ../edit-contents README.md &&
+
+	test_all_match git add README.md &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git commit -m "Add README.md" &&
+
+	test_all_match git checkout HEAD~1 &&
+	test_all_match git checkout - &&
+
+	run_on_all ../edit-contents deep/newfile &&
+
+	test_all_match git status --porcelain=v2 -uno &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git add -A &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git commit -m "Extend README.md" &&
+
+	test_all_match git checkout HEAD~1 &&
+	test_all_match git checkout - &&
+	test_all_match git log --stat -2 &&
+	test_sparse_dirs sparse-index folder1/ folder2/ x/
+'
+
+test_expect_success 'checkout and status across branches' '
+	init_repos &&
+
+	for branch in update-deep update-folder1 update-both master
+	do
+		test_all_match git checkout $branch &&
+		test_all_match git status --porcelain=v2 &&
+		test_all_match git diff --cached --stat master &&
+		test_sparse_match git ls-files --stage &&
+		test_sparse_dirs sparse-index folder1/ folder2/ x/ || return 1
+	done
+'
+
+test_expect_success 'status shows changes in sparse directories' '
+	init_repos &&
+
+	# stage changes outside of the cone, without the working tree
+	write_script stage-outside <<-\EOF &&
+	blob=$(echo changed | git hash-object -w --stdin) &&
+	git update-index --add --cacheinfo 100644,$blob,folder1/sub/c &&
+	git update-index --cacheinfo 100644,$blob,folder2/a &&
+	git update-index --skip-worktree folder1/sub/c folder2/a
+	EOF
+	run_on_all ../stage-outside &&
+	test_sparse_dirs sparse-index folder1/ folder2/ x/ &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git diff --cached --name-status &&
+	test_all_match git commit -m outside &&
+	test_all_match git show --stat &&
+	test_all_match git status --porcelain=v2
+'
+
+test_expect_success 'commands that need a full index expand it' '
+	init_repos &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+		git -C sparse-index ls-files >actual &&
+	grep "\"ensure_full_index\"" trace2.txt >/dev/null &&
+	git -C full-checkout ls-files >expect &&
+	test_cmp expect actual &&
+
+	# ... but write it sparse again
+	git -C sparse-index reset --hard origin/update-folder1 &&
+	test_sparse_dirs sparse-index folder1/ folder2/ x/
+'
+
+test_expect_success 'native commands do not expand the index' '
+	init_repos &&
+
+	rm -f trace2.txt &&
+	echo text >>sparse-index/deep/a &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index status &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index add deep/a &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index commit -m change &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index checkout update-both &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index checkout - &&
+	test_i18ngrep ! "\"ensure_full_index\"" trace2.txt
+'
+
+test_expect_success 'changing the cone expands what is needed' '
+	init_repos &&
+	for repo in sparse-checkout sparse-index
+	do
+		echo "/folder1/" >>$repo/.git/info/sparse-checkout &&
+		git -C $repo read-tree -mu HEAD || return 1
+	done &&
+	test_sparse_match git ls-files -t &&
+	test_path_is_file sparse-index/folder1/sub/a &&
+	test_sparse_dirs sparse-index folder2/ x/
+'
+
+test_expect_success 'index.sparse=false writes a full index' '
+	init_repos &&
+	git -C sparse-index -c index.sparse=false read-tree -mu HEAD &&
+	test_sparse_dirs sparse-index &&
+	test_sparse_match git ls-files --stage
+'
+
+test_expect_success 'non-cone patterns keep the index full' '
+	init_repos &&
+	echo "*.txt" >>sparse-index/.git/info/sparse-checkout &&
+	git -C sparse-index read-tree -mu HEAD 2>err &&
+	test_i18ngrep "disabling cone pattern matching" err &&
+	test_sparse_dirs sparse-index
+'
+
+test_done
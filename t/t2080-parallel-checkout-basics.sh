@@ -0,0 +1,177 @@
+#!/bin/sh
+
+test_description='parallel checkout basics
+
+Check that writing out the working tree with parallel workers gives the
+same result as the sequential checkout, and that the index is left with
+clean stat data.
+'
+
+. ./test-lib.sh
+
+sane_unset GIT_TEST_CHECKOUT_WORKERS
+
+# Runs "git <args>" with parallel checkout, using <workers> workers,
+# and checks that exactly that many workers were spawned.
+test_checkout_workers () {
+	workers=$1 &&
+	shift &&
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git \
+		-c checkout.workers=$workers \
+		-c checkout.thresholdForParallelism=0 "$@" &&
+	grep "built-in: git checkout--worker" trace >workers &&
+	test_line_count = $workers workers
+}
+
+# Checks that the working trees <a> and <b> have the same contents.
+test_cmp_worktrees () {
+	(cd "$1" && git ls-files -s && find . -path ./.git -prune -o -print |
+		sort && git ls-files -z | xargs -0 cat) >worktree.a &&
+	(cd "$2" && git ls-files -s && find . -path ./.git -prune -o -print |
+		sort && git ls-files -z | xargs -0 cat) >worktree.b &&
+	test_cmp worktree.a worktree.b
+}
+
+test_expect_success 'setup' '
+	git init src &&
+	(
+		cd src &&
+		for i in $(test_seq 50)
+		do
+			mkdir -p dir$(($i % 5))/sub &&
+			echo "file $i" >dir$(($i % 5))/sub/file$i &&
+			echo "file $i" >file$i || return 1
+		done &&
+		test_write_lines a b c >crlf.txt &&
+		test_write_lines "\$Id\$" >ident.txt &&
+		cat >.gitattributes <<-\EOF &&
+		crlf.txt text eol=crlf
+		ident.txt ident
+		EOF
+		echo "#!/bin/sh" >exec.sh &&
+		chmod +x exec.sh &&
+		git add . &&
+		git update-index --chmod=+x exec.sh &&
+		test_ln_s_add file1 link &&
+		git commit -m first &&
+		git rm -r -q dir0 &&
+		echo changed >file1 &&
+		echo new >dir1/new &&
+		git add . &&
+		git commit -m second
+	)
+'
+
+test_expect_success 'parallel clone matches sequential clone' '
+	git clone src sequential &&
+	test_checkout_workers 2 clone src parallel &&
+	test_cmp_worktrees sequential parallel &&
+	(
+		cd parallel &&
+		git diff-files --exit-code &&
+		git status --porcelain >../actual &&
+		test_must_be_empty ../actual
+	)
+'
+
+test_expect_success 'conversions are applied by the workers' '
+	printf "a\r\nb\r\nc\r\n" >expect &&
+	test_cmp expect parallel/crlf.txt &&
+	echo "\$Id: $(git -C src rev-parse HEAD:ident.txt) \$" >expect &&
+	test_cmp expect parallel/ident.txt
+'
+
+test_expect_success POSIXPERM 'executable bit is kept' '
+	test -x parallel/exec.sh
+'
+
+test_expect_success SYMLINKS 'symlinks are written as symlinks' '
+	test -h parallel/link &&
+	echo file1 >expect &&
+	readlink parallel/link >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'parallel branch switching' '
+	git -C sequential checkout -q HEAD~ &&
+	test_checkout_workers 2 -C parallel checkout -q HEAD~ &&
+	test_cmp_worktrees sequential parallel &&
+	git -C parallel diff-files --exit-code &&
+	git -C sequential checkout -q - &&
+	test_checkout_workers 2 -C parallel checkout -q - &&
+	test_cmp_worktrees sequential parallel &&
+	git -C parallel diff-files --exit-code
+'
+
+test_expect_success 'no more workers than entries' '
+	git -C src checkout -b few &&
+	test_commit -C src one file1 &&
+	echo two >src/file2 &&
+	echo three >src/file3 &&
+	git -C src commit -a -m three &&
+	git -C parallel fetch -q origin few &&
+	git -C sequential fetch -q origin few &&
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git -c checkout.workers=2 \
+		-c checkout.thresholdForParallelism=0 \
+		-C parallel checkout -q FETCH_HEAD~ &&
+	! grep "checkout--worker" trace &&
+	git -C sequential checkout -q FETCH_HEAD~ &&
+	test_cmp_worktrees sequential parallel &&
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git -c checkout.workers=4 \
+		-c checkout.thresholdForParallelism=0 \
+		-C parallel checkout -q FETCH_HEAD &&
+	grep "built-in: git checkout--worker" trace >workers &&
+	test_line_count = 2 workers &&
+	git -C sequential checkout -q FETCH_HEAD &&
+	test_cmp_worktrees sequential parallel &&
+	git -C parallel diff-files --exit-code
+'
+
+test_expect_success 'no workers are spawned below the threshold' '
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git -c checkout.workers=2 clone src below &&
+	! grep "checkout--worker" trace &&
+	test_cmp_worktrees sequential below
+'
+
+test_expect_success 'sequential checkout by default' '
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git -c checkout.thresholdForParallelism=0 \
+		clone src default &&
+	! grep "checkout--worker" trace
+'
+
+test_expect_success 'files with smudge filters are written out sequentially' '
+	test_config_global filter.upper.smudge "tr a-z A-Z" &&
+	test_config_global filter.upper.clean "tr A-Z a-z" &&
+	echo "file? filter=upper" >>src/.gitattributes &&
+	git -C src add .gitattributes &&
+	git -C src commit -m filtered &&
+	test_checkout_workers 2 clone src filtered &&
+	echo "FILE 4" >expect &&
+	test_cmp expect filtered/file4 &&
+	echo "file 10" >expect &&
+	test_cmp expect filtered/file10 &&
+	git -C filtered diff-files --exit-code
+'
+
+test_expect_success CASE_INSENSITIVE_FS 'colliding paths are retried' '
+	git init collide &&
+	(
+		cd collide &&
+		echo upper >File &&
+		git add File &&
+		echo lower >file &&
+		git update-index --add --cacheinfo \
+			100644 $(git hash-object -w file) file &&
+		rm -f File file &&
+		git commit -m collide
+	) &&
+	test_checkout_workers 2 clone collide collided 2>err &&
+	test_i18ngrep "the following paths have collided" err
+'
+
+test_done
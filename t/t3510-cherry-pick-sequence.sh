@@ -657,4 +657,51 @@ test_expect_success 'commit descriptions in insn sheet are optional' '
 	test_line_count = 4 commits
 '
 
+test_expect_success 'cherry-pick a series across upstream renames' '
+	pristine_detach initial &&
+	for i in 1 2 3 4 5
+	do
+		test_write_lines $i 1 2 3 4 5 6 7 8 9 >renamee$i || return 1
+	done &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 >gone &&
+	git add renamee? gone &&
+	test_tick &&
+	git commit -m "add renamees" &&
+	git tag renamees &&
+	mkdir renamed &&
+	for i in 1 2 3 4 5
+	do
+		git mv renamee$i renamed/$i &&
+		echo upstream >>renamed/$i || return 1
+	done &&
+	git rm -q gone &&
+	git add renamed &&
+	test_tick &&
+	git commit -m "rename renamees" &&
+	git tag renamed-upstream &&
+	git checkout renamees &&
+	for i in 1 2 3 4 5
+	do
+		sed -e "1s/.*/picked/" renamee$i >tmp &&
+		mv tmp renamee$i &&
+		git commit -q -a -m "pick $i" || return 1
+	done &&
+	git tag picks &&
+
+	git checkout renamed-upstream &&
+	git cherry-pick renamees..picks &&
+	test_path_is_missing renamee1 &&
+	test_write_lines picked 1 2 3 4 5 6 7 8 9 upstream >expect &&
+	test_cmp expect renamed/1 &&
+	git rev-parse HEAD^{tree} >expect &&
+
+	git checkout renamed-upstream &&
+	for c in $(git rev-list --reverse renamees..picks)
+	do
+		git cherry-pick $c || return 1
+	done &&
+	git rev-parse HEAD^{tree} >actual &&
+	test_cmp expect actual
+'
+
 test_done
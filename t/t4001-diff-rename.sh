@@ -262,4 +262,67 @@ test_expect_success 'diff-tree -l0 defaults to a big rename limit, not zero' '
 	grep "myotherfile.*myfile" actual
 '
 
+test_expect_success 'files moved with their directory are found past the rename limit' '
+	mkdir -p olddir/one olddir/two &&
+	for i in 1 2 3 4 5 6
+	do
+		test_write_lines a$i b$i c$i d$i e$i f$i g$i h$i >olddir/one/file$i &&
+		test_write_lines 1$i 2$i 3$i 4$i 5$i 6$i 7$i 8$i >olddir/two/file$i ||
+		return 1
+	done &&
+	test_write_lines unique lines in this file >olddir/two/unique &&
+	git add olddir &&
+	git commit -m "add olddir" &&
+
+	git mv olddir newdir &&
+	for f in newdir/one/* newdir/two/*
+	do
+		echo more >>$f || return 1
+	done &&
+	git commit -a -m "move and modify" &&
+
+	git diff-tree -r -M -l1 --name-status HEAD^ HEAD >actual &&
+	cat >expect <<-\EOF &&
+	olddir/one/file1 newdir/one/file1
+	olddir/one/file2 newdir/one/file2
+	olddir/one/file3 newdir/one/file3
+	olddir/one/file4 newdir/one/file4
+	olddir/one/file5 newdir/one/file5
+	olddir/one/file6 newdir/one/file6
+	olddir/two/file1 newdir/two/file1
+	olddir/two/file2 newdir/two/file2
+	olddir/two/file3 newdir/two/file3
+	olddir/two/file4 newdir/two/file4
+	olddir/two/file5 newdir/two/file5
+	olddir/two/file6 newdir/two/file6
+	olddir/two/unique newdir/two/unique
+	EOF
+	sed -n -e "s/^R[0-9]*	\([^	]*\)	/\1 /p" actual | sort >renames &&
+	test_cmp expect renames
+'
+
+test_expect_success 'threaded rename detection finds the same pairs' '
+	mkdir threads &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		test_write_lines 1$i 2$i 3$i 4$i 5$i 6$i 7$i 8$i >threads/src$i ||
+		return 1
+	done &&
+	git add threads &&
+	git commit -m "add threads" &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		git mv threads/src$i threads/dst$((9 - $i)) &&
+		test_seq $i >>threads/dst$((9 - $i)) ||
+		return 1
+	done &&
+	cp threads/dst1 threads/copy &&
+	git add threads &&
+	git commit -m "rename threads" &&
+	git -c diff.renameThreads=1 diff-tree -r -C -C HEAD^ HEAD >expect &&
+	git -c diff.renameThreads=4 diff-tree -r -C -C HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	grep " R[0-9]*	threads/src7	threads/dst2$" actual
+'
+
 test_done
@@ -0,0 +1,110 @@
+#!/bin/sh
+
+test_description='remerge-diff handling'
+
+. ./test-lib.sh
+
+test_expect_success 'setup basic merges' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 >numbers &&
+	git add numbers &&
+	git commit -m base &&
+
+	git branch feature_a &&
+	git branch feature_b &&
+	git branch feature_c &&
+
+	git branch ab_resolution &&
+
+	git checkout feature_a &&
+	test_write_lines 1 2 three 4 5 6 7 eight 9 >numbers &&
+	git commit -a -m change_a &&
+
+	git checkout feature_b &&
+	test_write_lines 1 2 tres 4 5 6 7 8 9 >numbers &&
+	git commit -a -m change_b &&
+
+	git checkout feature_c &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 >numbers &&
+	git commit -a -m change_c &&
+
+	git checkout feature_a &&
+	git merge -m "clean merge" feature_c &&
+
+	git checkout ab_resolution &&
+	git merge --ff-only feature_a &&
+	test_must_fail git merge -m "conflicted merge" feature_b &&
+	test_write_lines 1 2 drei 4 5 6 7 acht 9 10 >numbers &&
+	git add numbers &&
+	git commit --no-edit
+'
+
+test_expect_success 'remerge-diff on a clean merge' '
+	git log -1 --oneline --remerge-diff feature_a >actual &&
+	echo "$(git rev-parse --short feature_a) clean merge" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'remerge-diff with both a resolved conflict and an unrelated change' '
+	git log -1 --format="%s" --remerge-diff ab_resolution >tmp &&
+	sed -e "s/^index .*/index/" -e "s/[0-9a-f]\{7,\} (/HASH (/" tmp >actual &&
+	cat <<-EOF >expect &&
+	conflicted merge
+
+	diff --git a/numbers b/numbers
+	index
+	--- a/numbers
+	+++ b/numbers
+	@@ -1,14 +1,10 @@
+	 1
+	 2
+	-<<<<<<< HASH (clean merge)
+	-three
+	-=======
+	-tres
+	->>>>>>> HASH (change_b)
+	+drei
+	 4
+	 5
+	 6
+	 7
+	-eight
+	+acht
+	 9
+	 10
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'remerge-diff leaves no objects behind' '
+	find .git/objects -type f | sort >before &&
+	git log --remerge-diff --all >/dev/null &&
+	find .git/objects -type f | sort >after &&
+	test_cmp before after &&
+	! ls -d .git/objects/incoming-*
+'
+
+test_expect_success 'remerge-diff works with git show and --stat' '
+	git show --remerge-diff --stat --format=%s ab_resolution >actual &&
+	cat <<-\EOF >expect &&
+	conflicted merge
+
+	 numbers | 8 ++------
+	 1 file changed, 2 insertions(+), 6 deletions(-)
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'octopus merges are not re-merged' '
+	git checkout -b octopus feature_c &&
+	git checkout -b o1 &&
+	test_commit o1-file &&
+	git checkout -b o2 feature_c &&
+	test_commit o2-file &&
+	git checkout octopus &&
+	git merge -m octopus o1 o2 &&
+	git log -1 --format=%s --remerge-diff octopus >actual &&
+	echo octopus >expect &&
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,76 @@
+#!/bin/sh
+
+test_description='rename detection with the blob fingerprint cache'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	for i in 1 2 3 4 5
+	do
+		test_write_lines a$i b$i c$i d$i e$i f$i g$i h$i >file$i ||
+		return 1
+	done &&
+	printf "one\r\ntwo\r\nthree\r\nfour\r\nfive\r\n" >crlf &&
+	git add . &&
+	git commit -m initial &&
+	for i in 1 2 3 4 5
+	do
+		git mv file$i moved$i &&
+		echo more >>moved$i ||
+		return 1
+	done &&
+	git mv crlf crlf-moved &&
+	printf "six\r\n" >>crlf-moved &&
+	git commit -a -m "move files" &&
+	git -c diff.fingerprintCache=false log -M --raw >expect
+'
+
+test_expect_success 'fingerprints are appended to the journal' '
+	git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual &&
+	test_path_is_file .git/objects/info/fingerprints-journal &&
+	test_path_is_missing .git/objects/info/fingerprints
+'
+
+test_expect_success 'cached fingerprints are not added again' '
+	cp .git/objects/info/fingerprints-journal journal.before &&
+	git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual &&
+	test_cmp_bin journal.before .git/objects/info/fingerprints-journal
+'
+
+test_expect_success 'journal is folded into the table' '
+	echo again >>moved1 &&
+	git commit -a -m "modify again" &&
+	git mv moved1 again1 &&
+	echo more >>again1 &&
+	git commit -a -m "move again" &&
+	git -c diff.fingerprintCache=false log -M --raw >expect &&
+	GIT_TEST_FINGERPRINT_COMPACT=1 \
+		git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual &&
+	test_path_is_file .git/objects/info/fingerprints &&
+	test_path_is_missing .git/objects/info/fingerprints-journal &&
+	git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual &&
+	test_path_is_missing .git/objects/info/fingerprints-journal
+'
+
+test_expect_success 'a truncated journal is ignored' '
+	printf "FPJN" >.git/objects/info/fingerprints-journal &&
+	git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'fingerprints of CRLF blobs depend on attributes' '
+	echo "crlf* -diff" >.gitattributes &&
+	git -c diff.fingerprintCache=false log -M --raw >expect &&
+	git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual &&
+	rm .gitattributes &&
+	git -c diff.fingerprintCache=false log -M --raw >expect &&
+	git -c diff.fingerprintCache=true log -M --raw >actual &&
+	test_cmp expect actual
+'
+
+test_done
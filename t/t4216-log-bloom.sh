@@ -0,0 +1,204 @@
+#!/bin/sh
+
+test_description='git log for a path with Bloom filters'
+. ./test-lib.sh
+
+GIT_TEST_COMMIT_GRAPH=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+
+test_expect_success 'setup test - repo, commits, commit graph, log outputs' '
+	git init &&
+	git config core.commitGraph true &&
+	mkdir A A/B A/B/C &&
+	test_commit c1 A/file1 &&
+	test_commit c2 A/B/file2 &&
+	test_commit c3 A/B/C/file3 &&
+	test_commit c4 A/file1 &&
+	test_commit c5 A/B/file2 &&
+	test_commit c6 A/B/C/file3 &&
+	test_commit c7 A/file1 &&
+	test_commit c8 A/B/file2 &&
+	test_commit c9 A/B/C/file3 &&
+	test_commit c10 file_to_be_deleted &&
+	git checkout -b side HEAD~4 &&
+	test_commit side-1 file4 &&
+	git checkout master &&
+	git merge side &&
+	test_commit c11 file5 &&
+	mv file5 file5_renamed &&
+	git add file5_renamed &&
+	git commit -m "rename" &&
+	rm file_to_be_deleted &&
+	git add . &&
+	git commit -m "file removed" &&
+	git commit-graph write --reachable --changed-paths
+'
+
+graph_read_expect () {
+	NUM_CHUNKS=6
+	cat >expect <<- EOF
+	header: 43475048 1 1 $NUM_CHUNKS 0
+	num_commits: $1
+	chunks: oid_fanout oid_lookup commit_metadata generation_data bloom_indexes bloom_data
+	EOF
+	git commit-graph read >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'commit-graph write wrote out the bloom chunks' '
+	graph_read_expect 15
+'
+
+# Turn off any inherited trace2 settings for this test.
+sane_unset GIT_TRACE2 GIT_TRACE2_PERF GIT_TRACE2_EVENT
+sane_unset GIT_TRACE2_PERF_BRIEF
+sane_unset GIT_TRACE2_CONFIG_PARAMS
+
+setup () {
+	rm -f "$TRASH_DIRECTORY/trace.perf" &&
+	git -c core.commitGraph=false log --pretty="format:%s" "$@" >log_wo_bloom &&
+	GIT_TRACE2_PERF="$TRASH_DIRECTORY/trace.perf" git -c core.commitGraph=true log --pretty="format:%s" "$@" >log_w_bloom
+}
+
+test_bloom_filters_used () {
+	bloom_trace_prefix="statistics:{\"filter_not_present\":0,\"maybe\""
+	setup "$@" &&
+	grep -q "$bloom_trace_prefix" "$TRASH_DIRECTORY/trace.perf" &&
+	test_cmp log_wo_bloom log_w_bloom &&
+	test_path_is_file "$TRASH_DIRECTORY/trace.perf"
+}
+
+test_bloom_filters_not_used () {
+	setup "$@" &&
+	! grep -q "statistics:{\"filter_not_present\":" "$TRASH_DIRECTORY/trace.perf" &&
+	test_cmp log_wo_bloom log_w_bloom
+}
+
+for path in A A/B A/B/C A/file1 A/B/file2 A/B/C/file3 file4 file5 file5_renamed file_to_be_deleted
+do
+	for option in "" \
+		      "--all" \
+		      "--full-history" \
+		      "--full-history --simplify-merges" \
+		      "--simplify-merges" \
+		      "--simplify-by-decoration" \
+		      "--first-parent" \
+		      "--topo-order" \
+		      "--date-order" \
+		      "--author-date-order" \
+		      "--ancestry-path side..master"
+	do
+		test_expect_success "git log option: $option for path: $path" '
+			test_bloom_filters_used $option -- $path
+		'
+	done
+done
+
+test_expect_success 'git log -- folder works with and without the trailing slash' '
+	test_bloom_filters_used -- A &&
+	test_bloom_filters_used -- A/
+'
+
+test_expect_success 'git log for path that does not exist' '
+	test_bloom_filters_used -- path_does_not_exist
+'
+
+test_expect_success 'git log with multiple literal paths' '
+	test_bloom_filters_used -- A/file1 file4 &&
+	test_bloom_filters_used -- A/B/C file_to_be_deleted
+'
+
+test_expect_success 'git log with --walk-reflogs does not use Bloom filters' '
+	test_bloom_filters_not_used --walk-reflogs -- A
+'
+
+test_expect_success 'git log -- multiple path specs does not use Bloom filters when one has a wildcard' '
+	test_bloom_filters_not_used -- file4 "A/file*"
+'
+
+test_expect_success 'git log -- "." pathspec at root does not use Bloom filters' '
+	test_bloom_filters_not_used -- .
+'
+
+test_expect_success 'git log with --follow does not use Bloom filters' '
+	test_bloom_filters_not_used --follow -- file5_renamed
+'
+
+test_expect_success 'git log with wildcard that resolves to a single path does not use Bloom filters' '
+	test_bloom_filters_not_used -- "*4" &&
+	test_bloom_filters_not_used -- "*renamed"
+'
+
+test_expect_success 'git log with wildcard that resolves to a multiple paths does not use Bloom filters' '
+	test_bloom_filters_not_used -- "*" &&
+	test_bloom_filters_not_used -- "file*"
+'
+
+test_expect_success 'setup - add commit-graph to the chain without Bloom filters' '
+	test_commit c14 A/anotherFile2 &&
+	test_commit c15 A/B/anotherFile2 &&
+	test_commit c16 A/B/C/anotherFile2 &&
+	git commit-graph write --reachable --split --no-changed-paths &&
+	test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain
+'
+
+test_expect_success 'Do not use Bloom filters if the latest graph does not have Bloom filters.' '
+	setup -- A/B &&
+	grep -q "\"filter_not_present\":3" "$TRASH_DIRECTORY/trace.perf" &&
+	test_cmp log_wo_bloom log_w_bloom
+'
+
+test_expect_success 'setup - add commit-graph to the chain with Bloom filters' '
+	test_commit c17 A/anotherFile3 &&
+	git commit-graph write --reachable --changed-paths --split &&
+	test_line_count = 3 .git/objects/info/commit-graphs/commit-graph-chain
+'
+
+test_bloom_filters_used_when_some_filters_are_missing () {
+	bloom_trace_prefix="statistics:{\"filter_not_present\":3,\"maybe\":"
+	setup "$@" &&
+	grep -q "$bloom_trace_prefix" "$TRASH_DIRECTORY/trace.perf" &&
+	test_cmp log_wo_bloom log_w_bloom
+}
+
+test_expect_success 'Use Bloom filters if they exist in the latest but not all commit graphs in the chain.' '
+	test_bloom_filters_used_when_some_filters_are_missing -- A/B
+'
+
+test_expect_success 'split commit-graph writes keep writing filters by default' '
+	test_commit c18 A/anotherFile4 &&
+	git commit-graph write --reachable --split &&
+	# the two tip layers are merged, computing the missing filters
+	test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain &&
+	test_bloom_filters_used -- A
+'
+
+test_expect_success 'merging split layers reuses and computes filters' '
+	test_commit c19 A/B/anotherFile4 &&
+	git commit-graph write --reachable --split --size-multiple=100 &&
+	test_line_count = 1 .git/objects/info/commit-graphs/commit-graph-chain &&
+	test_bloom_filters_used -- A/B &&
+	git commit-graph verify
+'
+
+test_expect_success 'commitGraph.changedPaths enables filters for non-split writes' '
+	rm -rf .git/objects/info/commit-graph* &&
+	git commit-graph write --reachable &&
+	test_bloom_filters_not_used -- A &&
+	git -c commitGraph.changedPaths=true commit-graph write --reachable &&
+	test_bloom_filters_used -- A
+'
+
+test_expect_success 'blame with and without Bloom filters' '
+	git -c core.commitGraph=false blame A/B/file2 >expect &&
+	git -c core.commitGraph=true blame A/B/file2 >actual &&
+	test_cmp expect actual &&
+	git -c core.commitGraph=false blame -M A/B/C/file3 >expect &&
+	git -c core.commitGraph=true blame -M A/B/C/file3 >actual &&
+	test_cmp expect actual &&
+	git -c core.commitGraph=false blame file5_renamed >expect &&
+	git -c core.commitGraph=true blame file5_renamed >actual &&
+	test_cmp expect actual
+'
+
+test_done
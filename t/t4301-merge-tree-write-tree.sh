@@ -0,0 +1,154 @@
+#!/bin/sh
+
+test_description='git merge-tree --write-tree'
+
+. ./test-lib.sh
+
+test_expect_success setup '
+	test_write_lines 1 2 3 4 5 >numbers &&
+	echo hello >greeting &&
+	echo foo >whatever &&
+	git add numbers greeting whatever &&
+	test_tick &&
+	git commit -m initial &&
+
+	git branch side1 &&
+	git branch side2 &&
+	git branch side3 &&
+
+	git checkout side1 &&
+	test_write_lines 1 2 3 4 5 6 >numbers &&
+	echo hi >greeting &&
+	echo bar >whatever &&
+	git add numbers greeting whatever &&
+	test_tick &&
+	git commit -m modify-stuff &&
+
+	git checkout side2 &&
+	test_write_lines 0 1 2 3 4 5 >numbers &&
+	echo yo >greeting &&
+	git rm whatever &&
+	mkdir whatever &&
+	>whatever/empty &&
+	git add numbers greeting whatever/empty &&
+	test_tick &&
+	git commit -m other-modifications &&
+
+	git checkout side3 &&
+	git mv numbers sequence &&
+	test_tick &&
+	git commit -m rename-numbers &&
+
+	git checkout --orphan unrelated &&
+	git rm -rf . &&
+	>something-else &&
+	git add something-else &&
+	test_tick &&
+	git commit -m first-commit
+'
+
+test_expect_success 'clean merge' '
+	TREE_OID=$(git merge-tree --write-tree side1 side3) &&
+	q_to_tab <<-EOF >expect &&
+	100644 blob $(git rev-parse side1:greeting)Qgreeting
+	100644 blob $(git rev-parse side1:numbers)Qsequence
+	100644 blob $(git rev-parse side1:whatever)Qwhatever
+	EOF
+	git ls-tree $TREE_OID >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'content merge and a few conflicts' '
+	test_expect_code 1 git merge-tree --write-tree side1 side2 >out &&
+	TREE_OID=$(head -n 1 out) &&
+	git ls-tree -r $TREE_OID >tree &&
+	grep "	numbers$" tree &&
+	grep "	whatever/empty$" tree &&
+	git cat-file -p $TREE_OID:greeting >merged-greeting &&
+	grep "^<<<<<<< side1$" merged-greeting &&
+	grep "^>>>>>>> side2$" merged-greeting &&
+	git cat-file -p $TREE_OID:numbers >merged-numbers &&
+	test_write_lines 0 1 2 3 4 5 6 >expect &&
+	test_cmp expect merged-numbers &&
+
+	sed -e 1d -e "/^$/,\$d" out >conflicts &&
+	cat <<-EOF >expect &&
+	100644 $(git rev-parse side1~1:greeting) 1	greeting
+	100644 $(git rev-parse side1:greeting) 2	greeting
+	100644 $(git rev-parse side2:greeting) 3	greeting
+	100644 $(git rev-parse side1~1:whatever) 1	whatever~side1
+	100644 $(git rev-parse side1:whatever) 2	whatever~side1
+	EOF
+	test_cmp expect conflicts &&
+	sed -e "1,/^$/d" out >messages &&
+	grep "CONFLICT (content): Merge conflict in greeting" messages
+'
+
+test_expect_success '--name-only and --no-messages' '
+	test_expect_code 1 git merge-tree --write-tree --name-only --no-messages side1 side2 >out &&
+	cat <<-EOF >expect &&
+	$(head -n 1 out)
+	greeting
+	whatever~side1
+	EOF
+	test_cmp expect out
+'
+
+test_expect_success '-z separates with NUL' '
+	test_expect_code 1 git merge-tree --write-tree -z --name-only side1 side2 >out &&
+	tr "\000" "\n" <out >actual &&
+	sed -n -e 2,3p actual >names &&
+	test_write_lines greeting whatever~side1 >expect &&
+	test_cmp expect names
+'
+
+test_expect_success 'unrelated histories are refused by default' '
+	test_must_fail git merge-tree --write-tree side1 unrelated 2>err &&
+	test_i18ngrep "refusing to merge unrelated histories" err &&
+	TREE_OID=$(git merge-tree --write-tree --allow-unrelated-histories side1 unrelated) &&
+	git ls-tree --name-only $TREE_OID >actual &&
+	test_write_lines greeting numbers something-else whatever >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the index and working tree are not touched' '
+	git checkout side1 &&
+	echo dirty >>numbers &&
+	git status --porcelain >expect &&
+	test_expect_code 1 git merge-tree --write-tree side1 side2 >/dev/null &&
+	git status --porcelain >actual &&
+	test_cmp expect actual &&
+	git checkout numbers
+'
+
+test_expect_success '--stdin merges many pairs in one process' '
+	git merge-tree --write-tree side1 side3 >clean &&
+	test_expect_code 1 git merge-tree --write-tree --no-messages \
+		side1 side2 >conflicted &&
+	git merge-tree --write-tree side3 side1 >reversed &&
+	{
+		echo 1 && cat clean && echo &&
+		echo 0 && cat conflicted && echo &&
+		echo 1 && cat reversed && echo
+	} >expect &&
+
+	printf "side1 side3\nside1 side2\nside3 side1\n" >input &&
+	git merge-tree --stdin <input >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success '--stdin rejects malformed input' '
+	echo "side1" | test_must_fail git merge-tree --stdin 2>err &&
+	test_i18ngrep "malformed input line" err
+'
+
+test_expect_success 'trivial merge still works' '
+	git merge-tree side1~1 side1 side2 >expect &&
+	grep "^changed in both" expect &&
+	git merge-tree --trivial-merge side1~1 side1 side2 >actual &&
+	test_cmp expect actual &&
+	test_must_fail git merge-tree --trivial-merge --name-only \
+		side1~1 side1 side2
+'
+
+test_done
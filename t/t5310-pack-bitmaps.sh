@@ -284,6 +284,21 @@ test_expect_success 'splitting packs does not generate bogus bitmaps' '
 	git -C no-bitmaps.git fetch .. HEAD
 '
 
+test_expect_success 'repacking on top of existing bitmaps keeps them valid' '
+	test_commit_bulk --id=incremental 20 &&
+	git repack -adb &&
+	git rev-list --test-bitmap HEAD &&
+	git rev-list --test-bitmap HEAD~10 &&
+	git rev-list --test-bitmap other
+'
+
+test_expect_success 'bitmaps do not depend on the number of threads' '
+	git -c pack.threads=1 repack -adb &&
+	cp .git/objects/pack/pack-*.bitmap one-thread.bitmap &&
+	git -c pack.threads=4 repack -adb &&
+	test_cmp_bin one-thread.bitmap .git/objects/pack/pack-*.bitmap
+'
+
 test_expect_success 'set up reusable pack' '
 	rm -f .git/objects/pack/*.keep &&
 	git repack -adb &&
@@ -321,6 +336,19 @@ test_expect_success 'pack reuse respects --incremental' '
 	test_must_be_empty actual
 '
 
+test_expect_success 'partial pack reuse skips objects that are not wanted' '
+	git rev-list --objects other >wanted &&
+	echo other |
+	git pack-objects --delta-base-offset --revs --stdout \
+		--progress >partial.pack 2>err &&
+	grep "pack-reused [1-9]" err &&
+	git index-pack --strict -o partial.idx partial.pack &&
+	git show-index <partial.idx >index &&
+	cut -d" " -f2 index | sort >actual &&
+	cut -d" " -f1 wanted | sort >expect &&
+	test_cmp expect actual
+'
+
 test_expect_success 'truncated bitmap fails gracefully' '
 	git repack -ad &&
 	git rev-list --use-bitmap-index --count --all >expect &&
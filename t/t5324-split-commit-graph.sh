@@ -4,6 +4,7 @@ test_description='split commit graph'
 . ./test-lib.sh
 
 GIT_TEST_COMMIT_GRAPH=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
 
 test_expect_success 'setup repo' '
 	git init &&
@@ -20,9 +21,9 @@ graph_read_expect() {
 		NUM_BASE=$2
 	fi
 	cat >expect <<- EOF
-	header: 43475048 1 1 3 $NUM_BASE
+	header: 43475048 1 1 4 $NUM_BASE
 	num_commits: $1
-	chunks: oid_fanout oid_lookup commit_metadata
+	chunks: oid_fanout oid_lookup commit_metadata generation_data
 	EOF
 	git commit-graph read >output &&
 	test_cmp expect output
@@ -247,7 +248,7 @@ test_expect_success 'verify hashes along chain, even in shallow' '
 		cd verify &&
 		git commit-graph verify &&
 		base_file=$graphdir/graph-$(head -n 1 $graphdir/commit-graph-chain).graph &&
-		corrupt_file "$base_file" 1760 "\01" &&
+		corrupt_file "$base_file" 1820 "\01" &&
 		test_must_fail git commit-graph verify --shallow 2>test_err &&
 		grep -v "^+" test_err >err &&
 		test_i18ngrep "incorrect checksum" err
@@ -274,7 +275,7 @@ test_expect_success 'warn on base graph chunk incorrect' '
 		cd base-chunk &&
 		git commit-graph verify &&
 		base_file=$graphdir/graph-$(tail -n 1 $graphdir/commit-graph-chain).graph &&
-		corrupt_file "$base_file" 1376 "\01" &&
+		corrupt_file "$base_file" 1408 "\01" &&
 		git commit-graph verify --shallow 2>test_err &&
 		grep -v "^+" test_err >err &&
 		test_i18ngrep "commit-graph chain does not match" err
@@ -342,4 +343,28 @@ test_expect_success 'split across alternate where alternate is not split' '
 	test_cmp commit-graph .git/objects/info/commit-graph
 '
 
+test_expect_success 'no generation data on top of a chain without it' '
+	git clone --no-hardlinks . mixed &&
+	(
+		cd mixed &&
+		git config core.commitGraph true &&
+		rm -rf $graphdir .git/objects/info/commit-graph &&
+		git rev-parse HEAD >base &&
+		GIT_TEST_COMMIT_GRAPH_NO_GDAT=1 \
+			git commit-graph write --stdin-commits --split <base &&
+		test_commit mixed &&
+		git rev-parse HEAD >tip &&
+		git commit-graph write --stdin-commits --split <tip &&
+		test_line_count = 2 $graphdir/commit-graph-chain &&
+		tip=$(tail -n 1 $graphdir/commit-graph-chain) &&
+		! grep GDAT $graphdir/graph-$tip.graph &&
+		git commit-graph verify &&
+		git commit-graph write --reachable --split --size-multiple=100 &&
+		test_line_count = 1 $graphdir/commit-graph-chain &&
+		tip=$(tail -n 1 $graphdir/commit-graph-chain) &&
+		grep GDAT $graphdir/graph-$tip.graph &&
+		git commit-graph verify
+	)
+'
+
 test_done
@@ -0,0 +1,101 @@
+#!/bin/sh
+
+test_description='on-disk reverse index'
+. ./test-lib.sh
+
+# The tests below decide for themselves whether to write reverse indexes.
+sane_unset GIT_TEST_WRITE_REV_INDEX
+
+packdir=.git/objects/pack
+
+test_expect_success 'setup' '
+	test_oid_init &&
+	test_commit_bulk 10 &&
+	git repack -ad &&
+	pack=$(ls $packdir/pack-*.pack) &&
+	rev=${pack%.pack}.rev &&
+	test_path_is_missing $rev
+'
+
+test_expect_success 'index-pack writes a reverse index with pack.writeReverseIndex' '
+	git -c pack.writeReverseIndex=true index-pack $pack &&
+	test_path_is_file $rev
+'
+
+test_expect_success 'index-pack -o names the reverse index after the index' '
+	git -c pack.writeReverseIndex=true \
+		index-pack -o other.idx $pack &&
+	test_path_is_file other.rev &&
+	test_cmp $rev other.rev
+'
+
+test_expect_success 'index-pack --verify does not write a reverse index' '
+	rm -f $rev &&
+	git -c pack.writeReverseIndex=true index-pack --verify $pack &&
+	test_path_is_missing $rev
+'
+
+test_expect_success 'GIT_TEST_WRITE_REV_INDEX enables the reverse index' '
+	GIT_TEST_WRITE_REV_INDEX=1 git index-pack $pack &&
+	test_path_is_file $rev
+'
+
+test_expect_success 'pack-objects writes a reverse index' '
+	git -c pack.writeReverseIndex=true repack -ad &&
+	pack=$(ls $packdir/pack-*.pack) &&
+	rev=${pack%.pack}.rev &&
+	test_path_is_file $rev
+'
+
+test_expect_success 'reading with and without the reverse index agrees' '
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk) %(deltabase)" \
+		>with-rev &&
+	mv $rev saved.rev &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk) %(deltabase)" \
+		>without-rev &&
+	mv saved.rev $rev &&
+	test_cmp without-rev with-rev
+'
+
+test_expect_success 'pack-objects reuses data through the reverse index' '
+	git pack-objects --all --stdout </dev/null >reused.pack &&
+	git index-pack -o reused.idx reused.pack &&
+	git verify-pack reused.idx
+'
+
+test_expect_success 'a corrupt reverse index is ignored' '
+	cp $rev saved.rev &&
+	test_when_finished "mv saved.rev $rev" &&
+	chmod u+w $rev &&
+	printf "XXXX" | dd of=$rev bs=1 seek=0 conv=notrunc &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk) %(deltabase)" \
+		>actual 2>err &&
+	test_cmp without-rev actual &&
+	test_i18ngrep "unknown signature" err
+'
+
+test_expect_success 'a reverse index for another pack is ignored' '
+	cp $rev saved.rev &&
+	test_when_finished "mv saved.rev $rev" &&
+	chmod u+w $rev &&
+	size=$(wc -c <$rev) &&
+	rawsz=$(test_oid rawsz) &&
+	printf "\377" | dd of=$rev bs=1 seek=$(($size - 2 * $rawsz)) conv=notrunc &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk) %(deltabase)" \
+		>actual 2>err &&
+	test_cmp without-rev actual &&
+	test_i18ngrep "does not match its pack" err
+'
+
+test_expect_success 'repack removes the reverse index of replaced packs' '
+	git repack -ad &&
+	test_path_is_missing $rev &&
+	ls $packdir >actual &&
+	! grep "\.rev$" actual
+'
+
+test_done
@@ -0,0 +1,118 @@
+#!/bin/sh
+
+test_description='exercise reachability bitmaps over a multi-pack-index'
+. ./test-lib.sh
+
+midx_bitmaps () {
+	ls .git/objects/pack/ | sed -n "/^multi-pack-index-.*\.bitmap$/p"
+}
+
+test_expect_success 'setup repo with history in several packs' '
+	test_commit_bulk --id=file 100 &&
+	git repack -d &&
+	git checkout -b other HEAD~5 &&
+	test_commit_bulk --id=side 10 &&
+	git repack -d &&
+	git checkout master &&
+	test_commit_bulk --id=more 10 &&
+	git repack -d &&
+	blob=$(echo tagged-blob | git hash-object -w --stdin) &&
+	git tag tagged-blob $blob &&
+	git repack -d &&
+	ls .git/objects/pack/*.pack >packs &&
+	test_line_count = 4 packs &&
+	git config core.multiPackIndex true
+'
+
+test_expect_success 'write a multi-pack-index with a bitmap' '
+	git multi-pack-index write --bitmap &&
+	midx_bitmaps >bitmaps &&
+	test_line_count = 1 bitmaps &&
+	test-tool read-midx .git/objects >midx &&
+	grep "^chunks: .* revindex$" midx
+'
+
+test_expect_success 'rev-list --test-bitmap verifies multi-pack bitmaps' '
+	git rev-list --test-bitmap HEAD 2>err &&
+	grep "^OK!$" err
+'
+
+test_expect_success 'counting and enumerating objects via bitmap' '
+	for range in HEAD HEAD~5..HEAD other...master "HEAD ^other"
+	do
+		git rev-list --count $range >expect &&
+		git rev-list --use-bitmap-index --count $range >actual &&
+		test_cmp expect actual &&
+
+		git rev-list --objects $range >tmp &&
+		cut -d" " -f1 tmp | sort >expect &&
+		git rev-list --objects --use-bitmap-index $range >tmp &&
+		cut -d" " -f1 tmp | sort >actual &&
+		test_cmp expect actual || return 1
+	done &&
+	git rev-list --objects --use-bitmap-index HEAD tagged-blob >actual &&
+	grep $blob actual
+'
+
+test_expect_success 'pack-objects packs all objects from multi-pack bitmaps' '
+	git rev-list --objects --all >tmp &&
+	cut -d" " -f1 tmp | sort >expect &&
+	git pack-objects --stdout --all --use-bitmap-index \
+		--delta-base-offset </dev/null >all.pack &&
+	git index-pack -o all.idx all.pack &&
+	git show-index <all.idx >tmp &&
+	cut -d" " -f2 tmp | sort >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clone and fetch from a repository with a multi-pack bitmap' '
+	git clone --no-local --bare . clone.git &&
+	git rev-parse HEAD >expect &&
+	git --git-dir=clone.git rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+
+	test_commit_bulk --id=further 10 &&
+	git --git-dir=clone.git fetch origin master:master &&
+	git rev-parse HEAD >expect &&
+	git --git-dir=clone.git rev-parse HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'unpacked reachable objects prevent writing a bitmap' '
+	test_commit loose &&
+	test_must_fail git multi-pack-index write --bitmap 2>err &&
+	test_i18ngrep "is reachable, but not in the multi-pack-index" err &&
+	midx_bitmaps >bitmaps &&
+	test_must_be_empty bitmaps
+'
+
+test_expect_success 'rewriting the multi-pack-index removes stale bitmaps' '
+	git repack -d &&
+	git multi-pack-index write --bitmap &&
+	midx_bitmaps >before &&
+	test_line_count = 1 before &&
+	git rev-list --test-bitmap HEAD &&
+
+	test_commit one-more &&
+	git repack -d &&
+	git multi-pack-index write &&
+	midx_bitmaps >after &&
+	test_must_be_empty after &&
+	test_must_fail git rev-list --test-bitmap HEAD
+'
+
+test_expect_success 'the preferred pack can be chosen' '
+	largest=$(ls -S .git/objects/pack/pack-*.pack | head -n 1) &&
+	smallest=$(ls -S .git/objects/pack/pack-*.pack | tail -n 1) &&
+	git multi-pack-index write --bitmap \
+		--preferred-pack=$(basename $smallest) &&
+	git rev-list --test-bitmap HEAD &&
+	git multi-pack-index write --bitmap \
+		--preferred-pack=$(basename $largest) &&
+	git rev-list --test-bitmap HEAD &&
+	test_must_fail git multi-pack-index write \
+		--preferred-pack=pack-does-not-exist.pack 2>err &&
+	test_i18ngrep "unknown preferred pack" err
+'
+
+test_done
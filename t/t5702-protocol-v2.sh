@@ -557,6 +557,82 @@ test_expect_success 'deepen-relative' '
 	test_cmp expected actual
 '
 
+# The trash directory has a space in its name, which URIs cannot have.
+cdn_url="file://$(pwd | sed "s/ /%20/g")/cdn"
+
+test_expect_success 'setup cached pack' '
+	rm -rf server cdn &&
+	mkdir cdn &&
+
+	test_create_repo server &&
+	test_commit -C server one &&
+	test_commit -C server two &&
+	tip=$(git -C server rev-parse two) &&
+	packhash=$(echo $tip | git -C server pack-objects --revs ../cdn/pack) &&
+	test_commit -C server three &&
+	git -C server config uploadpack.cachedPack \
+		"$packhash $cdn_url/pack-$packhash.pack $tip"
+'
+
+test_expect_success 'clone downloads cached pack from packfile uri' '
+	rm -rf client trace &&
+
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -c protocol.version=2 -c fetch.uriProtocols=file \
+		clone "file://$(pwd)/server" client &&
+	grep "clone< packfile-uris" trace &&
+
+	# The cached pack is installed as it is, and the server only sent
+	# the objects after it.
+	test_path_is_file client/.git/objects/pack/pack-$packhash.pack &&
+	find client/.git/objects/pack -name "*.keep" >keep &&
+	test_must_be_empty keep &&
+	ls client/.git/objects/pack/*.idx | grep -v $packhash >idx &&
+	git show-index <$(cat idx) >received &&
+	git -C client rev-list --objects two..three >expect &&
+	test_line_count = $(wc -l <expect) received &&
+	git -C client fsck &&
+	git -C client log --pretty=tformat:%s origin/master >actual &&
+	test_write_lines three two one >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'packfile uris are only used when requested' '
+	rm -rf client trace &&
+
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -c protocol.version=2 -c fetch.uriProtocols=https \
+		clone "file://$(pwd)/server" client &&
+	! grep "clone< packfile-uris" trace &&
+	test_path_is_missing client/.git/objects/pack/pack-$packhash.pack &&
+	git -C client fsck
+'
+
+test_expect_success 'cached pack is not used for fetches with common commits' '
+	rm -rf client trace &&
+
+	git clone --no-local -b one server client &&
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -C client -c protocol.version=2 -c fetch.uriProtocols=file \
+		fetch origin master &&
+	! grep "fetch< packfile-uris" trace &&
+	git -C client fsck
+'
+
+test_expect_success 'fetch fails if cached pack does not match its hash' '
+	rm -rf client &&
+	test_when_finished "git -C server config uploadpack.cachedPack \
+		\"$packhash $cdn_url/pack-$packhash.pack $tip\"" &&
+
+	other=$(git -C server rev-parse one) &&
+	otherhash=$(echo $other | git -C server pack-objects --revs ../cdn/other) &&
+	git -C server config uploadpack.cachedPack \
+		"$packhash $cdn_url/other-$otherhash.pack $other" &&
+	test_must_fail git -c protocol.version=2 -c fetch.uriProtocols=file \
+		clone "file://$(pwd)/server" client 2>err &&
+	test_i18ngrep "does not match expected hash" err
+'
+
 # Test protocol v2 with 'http://' transport
 #
 . "$TEST_DIRECTORY"/lib-httpd.sh
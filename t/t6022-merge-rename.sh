@@ -896,4 +896,30 @@ test_expect_success 'do not follow renames for empty files' '
 	test_must_be_empty empty2
 '
 
+test_expect_success 'renames the other side did not touch do not count against the limit' '
+	git checkout -f --orphan limit-base &&
+	git rm -rf -q . &&
+	for i in 1 2 3 4 5
+	do
+		test_write_lines $i 1 2 3 4 5 6 7 8 9 >limit$i || return 1
+	done &&
+	git add limit? &&
+	git commit -m base &&
+	git checkout -b limit-renamed &&
+	mkdir sub &&
+	for i in 1 2 3 4 5
+	do
+		git mv limit$i sub/ &&
+		echo more >>sub/limit$i || return 1
+	done &&
+	git commit -a -m "rename and modify" &&
+	git checkout -b limit-modified limit-base &&
+	test_write_lines changed 1 2 3 4 5 6 7 8 9 >limit1 &&
+	git commit -a -m modify &&
+	git -c merge.renamelimit=3 merge limit-renamed &&
+	test_path_is_missing limit1 &&
+	test_write_lines changed 1 2 3 4 5 6 7 8 9 more >expect &&
+	test_cmp expect sub/limit1
+'
+
 test_done
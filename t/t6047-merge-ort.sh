@@ -0,0 +1,132 @@
+#!/bin/sh
+
+test_description='merge using the ort strategy'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 >file &&
+	test_write_lines a b c d e f g h i >renamed &&
+	test_write_lines x y z >gone &&
+	echo unchanged >keep &&
+	git add file renamed gone keep &&
+	test_tick &&
+	git commit -m initial &&
+	git tag initial &&
+
+	git checkout -b side &&
+	git mv renamed moved &&
+	test_write_lines a b c d e f g h i j >moved &&
+	test_write_lines 1 2 3 4 5 6 7 8 nine >file &&
+	git add moved file &&
+	test_tick &&
+	git commit -m side &&
+
+	git checkout master &&
+	test_write_lines A b c d e f g h i >renamed &&
+	test_write_lines one 2 3 4 5 6 7 8 9 >file &&
+	git add renamed file &&
+	test_tick &&
+	git commit -m master
+'
+
+test_expect_success 'clean merge follows renames' '
+	git checkout -b clean master &&
+	git merge -s ort side &&
+	test_path_is_missing renamed &&
+	test_write_lines A b c d e f g h i j >expect &&
+	test_cmp expect moved &&
+	test_write_lines one 2 3 4 5 6 7 8 nine >expect &&
+	test_cmp expect file &&
+	git diff --exit-code HEAD &&
+	test_must_fail git rev-parse --verify -q HEAD^2:renamed &&
+	git rev-parse HEAD^2 >actual &&
+	git rev-parse side >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'content conflict records all stages' '
+	git reset --hard initial &&
+	git checkout -b conflict-a &&
+	test_write_lines 1 2 3 4 five 6 7 8 9 >file &&
+	git commit -a -m a &&
+	git checkout -b conflict-b initial &&
+	test_write_lines 1 2 3 4 FIVE 6 7 8 9 >file &&
+	git commit -a -m b &&
+	test_must_fail git merge -s ort conflict-a &&
+	git ls-files -u file >actual &&
+	test_line_count = 3 actual &&
+	grep "^<<<<<<< HEAD" file &&
+	grep "^>>>>>>> conflict-a" file &&
+	git rev-parse initial:file conflict-b:file conflict-a:file >expect &&
+	git rev-parse :1:file :2:file :3:file >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rename/delete conflict' '
+	git reset --hard &&
+	git checkout -b rd-a initial &&
+	git rm -q renamed &&
+	git commit -m delete &&
+	test_must_fail git merge -s ort side >out &&
+	test_i18ngrep "CONFLICT (rename/delete)" out &&
+	git ls-files -s moved >actual &&
+	test_line_count = 1 actual &&
+	grep " 3	moved" actual
+'
+
+test_expect_success 'file/directory conflict' '
+	git reset --hard &&
+	git checkout -b df-a initial &&
+	mkdir dir &&
+	echo sub >dir/file &&
+	git add dir &&
+	git commit -m dir &&
+	git checkout -b df-b initial &&
+	echo plain >dir &&
+	git add dir &&
+	git commit -m file &&
+	test_must_fail git merge -s ort df-a >out &&
+	test_i18ngrep "CONFLICT (file/directory)" out &&
+	test_path_is_file dir/file &&
+	test_path_is_file "dir~HEAD" &&
+	echo plain >expect &&
+	test_cmp expect "dir~HEAD"
+'
+
+test_expect_success 'local changes to untouched paths are kept' '
+	git reset --hard &&
+	git checkout -b dirty master &&
+	echo dirty >keep &&
+	git merge -s ort side &&
+	echo dirty >expect &&
+	test_cmp expect keep
+'
+
+test_expect_success 'refuse to merge with changes in the index' '
+	git reset --hard master &&
+	echo staged >keep &&
+	git add keep &&
+	test_must_fail git merge -s ort side &&
+	git reset --hard
+'
+
+test_expect_success 'cherry-pick with the ort strategy' '
+	git checkout -b pick master &&
+	git cherry-pick --strategy=ort side &&
+	test_path_is_missing renamed &&
+	test_write_lines A b c d e f g h i j >expect &&
+	test_cmp expect moved
+'
+
+test_expect_success 'rebase with the ort strategy' '
+	git checkout -b rebased side &&
+	git rebase -s ort master &&
+	test_write_lines A b c d e f g h i j >expect &&
+	test_cmp expect moved &&
+	git rev-parse master >expect &&
+	git rev-parse HEAD^ >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,163 @@
+#!/bin/sh
+
+test_description='git status with the built-in file system monitor daemon'
+
+. ./test-lib.sh
+
+test -n "$HAVE_INOTIFY" && test -z "$NO_UNIX_SOCKETS" || {
+	skip_all='skipping fsmonitor--daemon tests, inotify or unix sockets not available'
+	test_done
+}
+
+# don't leave a stale daemon running
+test_atexit 'git -C "$TRASH_DIRECTORY" fsmonitor--daemon stop 2>/dev/null || :'
+
+test_lazy_prereq UNTRACKED_CACHE '
+	{ git update-index --test-untracked-cache; ret=$?; } &&
+	test $ret -ne 1
+'
+
+# Compare the output of "git status" with the daemon with its output
+# without any file system monitor (on a copy of the index).
+test_status_matches () {
+	cp .git/index .git/index.nofsmonitor &&
+	GIT_INDEX_FILE=.git/index.nofsmonitor \
+		git -c core.useBuiltinFSMonitor=false status --porcelain "$@" >expect &&
+	git status --porcelain "$@" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	mkdir dir1 dir2 &&
+	for f in tracked modified dir1/tracked dir1/modified \
+		 dir2/tracked dir2/modified
+	do
+		echo $f >$f || return 1
+	done &&
+	cat >.gitignore <<-\EOF &&
+	.gitignore
+	expect*
+	err
+	actual*
+	trace*
+	EOF
+	git add . &&
+	git commit -m initial &&
+	if test_have_prereq UNTRACKED_CACHE
+	then
+		git config core.untrackedCache true
+	fi &&
+	git config core.useBuiltinFSMonitor true
+'
+
+test_expect_success 'start the daemon' '
+	test_must_fail git fsmonitor--daemon status &&
+	git fsmonitor--daemon start &&
+	git fsmonitor--daemon status >actual &&
+	test_i18ngrep "is watching" actual &&
+	test -S .git/fsmonitor--daemon.ipc &&
+	test_must_fail git fsmonitor--daemon start 2>err &&
+	test_i18ngrep "already running" err
+'
+
+test_expect_success 'the first query makes everything dirty' '
+	git update-index --fsmonitor &&
+	git status &&
+	test_status_matches
+'
+
+test_expect_success 'modified files are reported' '
+	echo more >>dir1/modified &&
+	GIT_TRACE_FSMONITOR="$(pwd)/trace" git status --porcelain >actual &&
+	grep "fsmonitor_refresh_callback .dir1/modified." trace &&
+	echo " M dir1/modified" >expect &&
+	test_cmp expect actual &&
+
+	git add dir1/modified &&
+	rm trace &&
+	GIT_TRACE_FSMONITOR="$(pwd)/trace" git status --porcelain >actual &&
+	! grep "fsmonitor_refresh_callback .dir1/modified." trace &&
+	echo "M  dir1/modified" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'new, removed and renamed files are reported' '
+	echo new >new &&
+	rm dir2/tracked &&
+	mv tracked dir1/renamed &&
+	test_status_matches &&
+	test_status_matches -uall
+'
+
+test_expect_success 'new directories are reported' '
+	mkdir -p dir3/sub &&
+	echo new >dir3/sub/file &&
+	GIT_TRACE_FSMONITOR="$(pwd)/trace" git status >/dev/null &&
+	grep "fsmonitor_refresh_callback .dir3/." trace &&
+	test_status_matches &&
+	test_status_matches -uall &&
+
+	# files in directories created after the daemon started
+	echo more >>dir3/sub/file &&
+	echo new >dir3/sub/other &&
+	test_status_matches -uall
+'
+
+test_expect_success 'renamed and removed directories are reported' '
+	git add dir3 &&
+	git commit -m "add dir3" &&
+	mv dir2 dir4 &&
+	test_status_matches &&
+	test_status_matches -uall &&
+	rm -r dir3 &&
+	test_status_matches &&
+	mv dir4 dir2 &&
+	echo more >>dir2/modified &&
+	test_status_matches -uall
+'
+
+test_expect_success 'daemon tokens are not passed to a hook' '
+	write_script .git/fsmonitor-test <<-\EOF &&
+	echo "$@" >>.git/hook-args
+	EOF
+	git -c core.useBuiltinFSMonitor=false \
+	    -c core.fsmonitor=.git/fsmonitor-test status &&
+	test_path_is_missing .git/hook-args
+'
+
+test_expect_success PERL 'clients that do not read the answer are ignored' '
+	for i in $(test_seq 100)
+	do
+		echo $i >dir1/file$i || return 1
+	done &&
+	git status &&
+	token=$(test-tool dump-fsmonitor | sed -n "s/^fsmonitor last update //p") &&
+	for i in $(test_seq 100)
+	do
+		echo more >>dir1/file$i || return 1
+	done &&
+	cat >disconnect.perl <<-\EOF &&
+	use IO::Socket::UNIX;
+	for (1..5) {
+		my $s = IO::Socket::UNIX->new(Type => SOCK_STREAM(),
+					      Peer => $ARGV[0])
+			or die "connect: $!";
+		print $s $ARGV[1];
+		close $s;
+	}
+	EOF
+	"$PERL_PATH" disconnect.perl .git/fsmonitor--daemon.ipc "query $token" &&
+	git fsmonitor--daemon status &&
+	test_status_matches -uall
+'
+
+test_expect_success 'status works after the daemon is stopped' '
+	git fsmonitor--daemon stop &&
+	test_path_is_missing .git/fsmonitor--daemon.ipc &&
+	test_must_fail git fsmonitor--daemon status &&
+	echo changed >>dir1/tracked &&
+	test_status_matches &&
+	test_must_fail git fsmonitor--daemon stop
+'
+
+test_done
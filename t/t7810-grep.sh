@@ -974,6 +974,29 @@ test_expect_success 'grep -Fi' '
 	test_cmp expected actual
 '
 
+test_expect_success 'grep -F finds patterns at any offset' '
+	for i in $(test_seq 0 40)
+	do
+		pad=$(printf "%${i}s" "" | tr " " x) &&
+		echo "${pad}needle$pad" || return 1
+	done >offsets &&
+	printf "xxxxxxxxxxxxxxxxxxxxxxxneedle" >>offsets &&
+	echo offsets:42 >expect &&
+	git grep --no-index -c -F needle offsets >actual &&
+	test_cmp expect actual &&
+	git grep --no-index -c -F -i nEEDLe offsets >actual &&
+	test_cmp expect actual &&
+	git grep --no-index -c -F xneedlex offsets >actual &&
+	echo offsets:40 >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'grep -Fi only folds the case of letters' '
+	printf "a\140b\n" >punct &&
+	test_must_fail git grep --no-index -F -i "A@B" punct &&
+	git grep --no-index -F -i "A\`B" punct
+'
+
 test_expect_success 'outside of git repository' '
 	rm -fr non &&
 	mkdir -p non/git/sub &&
@@ -0,0 +1,150 @@
+#!/bin/sh
+
+test_description='git grep with the trigram index
+
+The index only lets git grep skip blobs, so every search must give the
+same result with and without it.
+'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir dir &&
+	cat >file.c <<-\EOF &&
+	int main(void)
+	{
+		return strbuf_addf(&sb, "%d", 1);
+	}
+	EOF
+	cat >dir/other.c <<-\EOF &&
+	static void StrBuf_Release(void)
+	{
+		free(buffer);
+	}
+	EOF
+	printf "caf\303\251 au lait\n" >utf8.txt &&
+	echo "foo bar baz" >words &&
+	git add . &&
+	git commit -m initial &&
+	git config gc.writeTrigramIndex true &&
+	git gc --quiet &&
+	test_path_is_file .git/objects/info/trigrams
+'
+
+test_grep () {
+	grep_args=$1
+	test_expect_success "grep $grep_args" '
+		test_might_fail eval "git -c grep.trigramIndex=false grep $grep_args HEAD" >expect &&
+		test_might_fail eval "git grep $grep_args HEAD" >actual &&
+		test_cmp expect actual
+	'
+}
+
+test_grep '-e strbuf_addf'
+test_grep '-F -e "strbuf_addf(&sb"'
+test_grep '-e nonexistent_string'
+test_grep '-i -e STRBUF_RELEASE'
+test_grep '-F -i -e "CAFÉ"'
+test_grep '-e "str[a-z]*_add" -e buffer'
+test_grep '-e "strbuf_.*(&sb"'
+test_grep '-e "return *strbuf"'
+test_grep '-E -e "strbuf_(addf|release)"'
+test_grep '-E -e "fo+ bar"'
+test_grep '-E -e "foo|xyz"'
+test_grep '-e "foo\|xyz"'
+test_grep '-E -e "ba{1,2}r baz"'
+test_grep '-e "ba\{1,2\}r baz"'
+test_grep '-w -e "bar"'
+test_grep '-v -e strbuf'
+test_grep '-L -e strbuf'
+test_grep '--not -e strbuf'
+test_grep '-e foo --and -e xyz'
+
+test_expect_success 'the index lets grep skip blobs without reading them' '
+	git init skip &&
+	(
+		cd skip &&
+		echo "needle in here" >found &&
+		echo "nothing to see" >skipped &&
+		git add . &&
+		git commit -m initial &&
+		git -c gc.writeTrigramIndex=true gc --quiet &&
+		# keep everything but the blob of "skipped"
+		mv .git/objects/pack/pack-*.pack pack &&
+		rm .git/objects/pack/pack-*.idx &&
+		git unpack-objects <pack &&
+		blob=$(git rev-parse HEAD:skipped) &&
+		rm .git/objects/$(test_oid_to_path $blob) &&
+		echo "HEAD:found:needle in here" >expect &&
+		git grep -e needle HEAD >actual 2>err &&
+		test_cmp expect actual &&
+		test_must_be_empty err &&
+		git -c grep.trigramIndex=false grep -e needle HEAD 2>err &&
+		test_i18ngrep "unable to read $blob" err
+	)
+'
+
+test_expect_success 'blobs that are not in the index are searched' '
+	echo "strbuf_addf in a new file" >new &&
+	git add new &&
+	git commit -m new &&
+	git grep -l -e strbuf_addf HEAD >actual &&
+	cat >expect <<-\EOF &&
+	HEAD:file.c
+	HEAD:new
+	EOF
+	test_cmp expect actual &&
+	git grep -l --cached -e strbuf_addf >actual &&
+	sed -e "s/^HEAD://" expect >expect.cached &&
+	test_cmp expect.cached actual
+'
+
+test_expect_success 'rewriting the index adds the new blobs' '
+	git gc --quiet &&
+	git grep -l -e strbuf_addf HEAD >actual &&
+	test_cmp expect actual &&
+	git grep -l -e "in a new file" HEAD >actual &&
+	echo HEAD:new >expect.new &&
+	test_cmp expect.new actual
+'
+
+test_expect_success 'a corrupt index is ignored' '
+	cp .git/objects/info/trigrams trigrams.good &&
+	chmod +w .git/objects/info/trigrams &&
+	{
+		printf JUNK &&
+		tail -c +5 trigrams.good
+	} >.git/objects/info/trigrams &&
+	git grep -l -e strbuf_addf HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep "ignoring corrupt trigram index" err &&
+	git gc --quiet 2>err &&
+	git grep -l -e strbuf_addf HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_must_be_empty err
+'
+
+test_expect_success 'a posting list running past its end is ignored' '
+	test_oid_init &&
+	git init overrun &&
+	(
+		cd overrun &&
+		echo abc >file &&
+		git add file &&
+		git commit -m initial &&
+		git -c gc.writeTrigramIndex=true gc --quiet &&
+		# the only posting list is the last byte before the checksum
+		idx=.git/objects/info/trigrams &&
+		size=$(wc -c <$idx) &&
+		chmod +w $idx &&
+		printf "\200" |
+		dd of=$idx bs=1 seek=$(($size - $(test_oid rawsz) - 1)) \
+			conv=notrunc 2>/dev/null &&
+		echo HEAD:file:abc >expect &&
+		git grep -e abc HEAD >actual 2>err &&
+		test_cmp expect actual &&
+		test_i18ngrep "ignoring corrupt trigram index" err
+	)
+'
+
+test_done
@@ -0,0 +1,106 @@
+#!/bin/sh
+
+test_description='git blame --batch'
+. ./test-lib.sh
+
+# blame each path in "paths" separately the way --batch is expected to
+blame_each () {
+	while read path
+	do
+		git blame "$@" -- "$path" 2>/dev/null ||
+		echo "$path missing"
+		echo
+	done <paths
+}
+
+test_expect_success 'setup' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 >one &&
+	test_write_lines a b c d e f g h i >two &&
+	git add one two &&
+	test_tick &&
+	git commit -m initial &&
+	git tag initial &&
+
+	test_write_lines 1 2 three 4 5 6 7 8 9 >one &&
+	test_write_lines a b c D e f g h i >two &&
+	git commit -a -m "change both" &&
+
+	git mv two renamed &&
+	test_write_lines a b c D e f g h i j >renamed &&
+	{
+		sed -n 1,6p one &&
+		echo "a line copied from one and some more"
+	} >copied &&
+	mkdir dir &&
+	echo "with space" >"dir/with space" &&
+	echo "with tab" >"$(printf "dir/with\ttab")" &&
+	git add . &&
+	test_tick &&
+	git commit -m "rename and copy" &&
+
+	test_write_lines 1 2 three 4 5 six 7 8 9 >one &&
+	test_tick &&
+	git commit -a -m "change one" &&
+
+	cat >paths <<-\EOF
+	one
+	renamed
+	copied
+	dir/with space
+	no-such-file
+	dir
+	EOF
+'
+
+test_expect_success '--batch output matches separate porcelain blames' '
+	blame_each -p >expect &&
+	git blame --batch <paths >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success '--batch with -C -C and a bottom commit' '
+	blame_each -p -C -C initial..HEAD >expect &&
+	git blame --batch -C -C initial..HEAD <paths >actual &&
+	test_cmp expect actual &&
+	grep "^boundary$" actual
+'
+
+test_expect_success '--batch --line-porcelain' '
+	blame_each --line-porcelain HEAD^ >expect &&
+	git blame --batch --line-porcelain HEAD^ <paths >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success '--batch reports missing paths' '
+	printf "one\nno-such-file\n" | git blame --batch >actual &&
+	{
+		git blame -p one &&
+		echo &&
+		echo "no-such-file missing" &&
+		echo
+	} >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success '--batch unquotes C-style quoted paths' '
+	printf "\"dir/with\\\\ttab\"\n" | git blame --batch >actual &&
+	git blame -p "$(printf "dir/with\ttab")" >expect &&
+	echo >>expect &&
+	test_cmp expect actual
+'
+
+test_expect_success '--batch paths are relative to the current directory' '
+	echo "with space" | (cd dir && git blame --batch) >actual &&
+	git blame -p "dir/with space" >expect &&
+	echo >>expect &&
+	test_cmp expect actual
+'
+
+test_expect_success '--batch rejects incompatible options' '
+	test_must_fail git blame --batch -L 1,2 </dev/null &&
+	test_must_fail git blame --batch --incremental </dev/null &&
+	test_must_fail git blame --batch --reverse initial </dev/null &&
+	test_must_fail git blame --batch -- one </dev/null
+'
+
+test_done
@@ -0,0 +1,124 @@
+#!/bin/sh
+
+test_description='git blame with blame.cache'
+. ./test-lib.sh
+
+# compare blame with and without the cache; the cached run goes first
+# so that it can use what earlier cached runs left behind
+check_cached () {
+	git -c blame.cache=true blame "$@" >actual &&
+	git blame "$@" >expect &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 >file &&
+	git add file &&
+	test_tick &&
+	git commit -m initial &&
+
+	for i in 2 4 6
+	do
+		sed "s/^$i\$/$i changed/" file >tmp &&
+		mv tmp file &&
+		test_tick &&
+		git commit -a -m "change $i" || return 1
+	done &&
+
+	git mv file renamed &&
+	test_tick &&
+	git commit -m rename &&
+
+	git checkout -b side HEAD~2 &&
+	sed "s/^9\$/9 on side/" file >tmp &&
+	mv tmp file &&
+	test_tick &&
+	git commit -a -m "side change" &&
+
+	git checkout - &&
+	test_write_lines 0 >>renamed &&
+	test_tick &&
+	git commit -a -m "append" &&
+	git merge -m merge side &&
+
+	sed "s/^1\$/1 changed/" renamed >tmp &&
+	mv tmp renamed &&
+	test_tick &&
+	git commit -a -m "change 1"
+'
+
+test_expect_success 'cached blame matches uncached blame' '
+	check_cached -p HEAD~3 -- renamed &&
+	test_path_is_dir .git/blame-cache &&
+	check_cached -p HEAD -- renamed &&
+	check_cached --line-porcelain HEAD -- renamed &&
+	check_cached -p HEAD -- renamed
+'
+
+test_expect_success 'later runs stop at cached commits' '
+	git -c blame.cache=true blame --show-stats HEAD -- renamed >stats &&
+	grep "^num commits: 0$" stats
+'
+
+test_expect_success 'boundary and --root are kept apart' '
+	check_cached HEAD -- renamed &&
+	check_cached --root HEAD -- renamed &&
+	check_cached -b HEAD -- renamed
+'
+
+test_expect_success 'working tree changes are blamed on top of the cache' '
+	test_when_finished "git checkout renamed" &&
+	echo uncommitted >>renamed &&
+	check_cached -p renamed
+'
+
+test_expect_success 'cache is not written for partial or limited blames' '
+	rm -rf .git/blame-cache &&
+	check_cached -p -L 2,4 HEAD -- renamed &&
+	check_cached -p HEAD~2..HEAD -- renamed &&
+	check_cached -p -M HEAD -- renamed &&
+	check_cached -p --since=2005-04-07T22:16:13 HEAD -- renamed &&
+	test_path_is_missing .git/blame-cache
+'
+
+test_expect_success 'corrupt cache entries are ignored' '
+	check_cached -p HEAD~1 -- renamed &&
+	for f in .git/blame-cache/*/*
+	do
+		echo garbage >"$f" || return 1
+	done &&
+	check_cached -p HEAD -- renamed
+'
+
+test_expect_success 'git blame --batch uses the cache' '
+	rm -rf .git/blame-cache &&
+	echo renamed >paths &&
+	git -c blame.cache=true blame --batch HEAD~1 <paths >actual &&
+	git blame --batch HEAD~1 <paths >expect &&
+	test_cmp expect actual &&
+	test_path_is_dir .git/blame-cache &&
+	git -c blame.cache=true blame --batch <paths >actual &&
+	git blame --batch <paths >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'gc removes the blames that were not used recently' '
+	rm -rf .git/blame-cache &&
+	git -c blame.cache=true blame HEAD~1 -- renamed >/dev/null &&
+	git -c blame.cache=true blame HEAD -- renamed >/dev/null &&
+	git -c blame.cache=true blame HEAD~2 -- renamed >/dev/null &&
+	ls .git/blame-cache/*/* >before &&
+	test_line_count = 3 before &&
+	test-tool chmtime =-5184000 .git/blame-cache/*/* &&
+	git -c blame.cache=true blame HEAD~2 -- renamed >/dev/null &&
+	git -c gc.blameCacheExpire=never gc --quiet &&
+	ls .git/blame-cache/*/* >actual &&
+	test_cmp before actual &&
+	git gc --quiet &&
+	ls .git/blame-cache/*/* >actual &&
+	test_line_count = 1 actual &&
+	git -c gc.blameCacheExpire=now gc --quiet &&
+	test_path_is_missing .git/blame-cache
+'
+
+test_done
@@ -0,0 +1,316 @@
+#include "cache.h"
+#include "thread-utils.h"
+#include "trace2.h"
+#include "task-pool.h"
+
+struct task {
+	task_fn fn;
+	void *data;
+};
+
+/*
+ * A queue of tasks in a ring buffer, protected by the mutex of the
+ * pool.  Its worker takes tasks from the front, so that they run in the
+ * order they were queued, and thieves take them from the back, away
+ * from where the worker is busy.
+ */
+struct task_deque {
+	struct task *tasks;
+	size_t first, nr, alloc;
+};
+
+struct task_worker {
+	struct task_pool *pool;
+	int id;
+	pthread_t thread;
+	struct task_deque deque;
+
+	/* only touched by the worker itself */
+	intmax_t nr_tasks;
+	intmax_t nr_stolen;
+	uint64_t busy_ns;
+	uint64_t max_task_ns;
+};
+
+struct task_pool {
+	const char *label;
+	int nr_workers;
+	struct task_worker *workers;
+	pthread_key_t current;
+
+	/* protects the queues of the workers and the fields below */
+	pthread_mutex_t mutex;
+	/* signalled when tasks are queued or the pool is stopped */
+	pthread_cond_t cond_work;
+	/* signalled when no task is queued or running anymore */
+	pthread_cond_t cond_idle;
+	unsigned long queued, running;
+	int next_worker;
+	int stopping;
+};
+
+static void deque_push(struct task_deque *d, const struct task *t)
+{
+	if (d->nr == d->alloc) {
+		size_t alloc = alloc_nr(d->alloc);
+		struct task *tasks;
+		size_t i;
+
+		ALLOC_ARRAY(tasks, alloc);
+		for (i = 0; i < d->nr; i++)
+			tasks[i] = d->tasks[(d->first + i) % d->alloc];
+		free(d->tasks);
+		d->tasks = tasks;
+		d->first = 0;
+		d->alloc = alloc;
+	}
+	d->tasks[(d->first + d->nr) % d->alloc] = *t;
+	d->nr++;
+}
+
+static int deque_take(struct task_deque *d, struct task *t, int from_back)
+{
+	if (!d->nr)
+		return 0;
+	if (from_back) {
+		*t = d->tasks[(d->first + d->nr - 1) % d->alloc];
+	} else {
+		*t = d->tasks[d->first];
+		d->first = (d->first + 1) % d->alloc;
+	}
+	d->nr--;
+	return 1;
+}
+
+static void run_task(struct task_worker *w, const struct task *t)
+{
+	uint64_t start = getnanotime(), elapsed;
+
+	t->fn(t->data, w->id);
+
+	elapsed = getnanotime() - start;
+	w->nr_tasks++;
+	w->busy_ns += elapsed;
+	if (w->max_task_ns < elapsed)
+		w->max_task_ns = elapsed;
+}
+
+static void report_worker(const struct task_worker *w)
+{
+	trace2_data_intmax("task-pool", NULL, "tasks", w->nr_tasks);
+	trace2_data_intmax("task-pool", NULL, "stolen", w->nr_stolen);
+	trace2_data_intmax("task-pool", NULL, "busy_us", w->busy_ns / 1000);
+	trace2_data_intmax("task-pool", NULL, "max_task_us",
+			   w->max_task_ns / 1000);
+}
+
+/*
+ * Take a task from our own queue, or else steal one.  Called with the
+ * mutex of the pool held.
+ */
+static int find_task(struct task_worker *me, struct task *t)
+{
+	struct task_pool *pool = me->pool;
+	int i;
+
+	if (deque_take(&me->deque, t, 0))
+		return 1;
+	for (i = 1; i < pool->nr_workers; i++) {
+		struct task_worker *victim =
+			&pool->workers[(me->id + i) % pool->nr_workers];
+
+		if (deque_take(&victim->deque, t, 1)) {
+			me->nr_stolen++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void *worker_main(void *arg)
+{
+	struct task_worker *me = arg;
+	struct task_pool *pool = me->pool;
+	struct task t;
+
+	trace2_thread_start(pool->label);
+	pthread_setspecific(pool->current, me);
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		/*
+		 * Tasks are taken and counted under the same lock, so
+		 * finding none means that none is queued.
+		 */
+		if (!find_task(me, &t)) {
+			if (pool->stopping)
+				break;
+			pthread_cond_wait(&pool->cond_work, &pool->mutex);
+			continue;
+		}
+		pool->queued--;
+		pool->running++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		run_task(me, &t);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (!--pool->running && !pool->queued)
+			pthread_cond_broadcast(&pool->cond_idle);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	report_worker(me);
+	trace2_thread_exit();
+	return NULL;
+}
+
+struct task_pool *task_pool_start(const char *label, int nr_workers)
+{
+	struct task_pool *pool = xcalloc(1, sizeof(*pool));
+	int i;
+
+	if (!HAVE_THREADS || nr_workers < 1)
+		nr_workers = 1;
+	pool->label = label;
+	pool->nr_workers = nr_workers;
+	pool->workers = xcalloc(nr_workers, sizeof(*pool->workers));
+	trace2_region_enter("task-pool", label, NULL);
+
+	if (!HAVE_THREADS) {
+		pool->workers[0].pool = pool;
+		return pool;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond_work, NULL);
+	pthread_cond_init(&pool->cond_idle, NULL);
+	pthread_key_create(&pool->current, NULL);
+	for (i = 0; i < nr_workers; i++) {
+		struct task_worker *w = &pool->workers[i];
+
+		w->pool = pool;
+		w->id = i;
+	}
+	for (i = 0; i < nr_workers; i++) {
+		struct task_worker *w = &pool->workers[i];
+		int err = pthread_create(&w->thread, NULL, worker_main, w);
+
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	return pool;
+}
+
+static void queue_task(struct task_pool *pool, struct task_worker *w,
+		       const struct task *t)
+{
+	pthread_mutex_lock(&pool->mutex);
+	deque_push(&w->deque, t);
+	pool->queued++;
+	pthread_cond_signal(&pool->cond_work);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void task_pool_add(struct task_pool *pool, task_fn fn, void *data)
+{
+	struct task t = { fn, data };
+	struct task_worker *w;
+
+	if (!HAVE_THREADS) {
+		run_task(&pool->workers[0], &t);
+		return;
+	}
+
+	w = pthread_getspecific(pool->current);
+	if (!w || w->pool != pool) {
+		pthread_mutex_lock(&pool->mutex);
+		w = &pool->workers[pool->next_worker];
+		pool->next_worker = (pool->next_worker + 1) % pool->nr_workers;
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	queue_task(pool, w, &t);
+}
+
+void task_pool_finish(struct task_pool *pool)
+{
+	int i;
+
+	if (!HAVE_THREADS) {
+		report_worker(&pool->workers[0]);
+		goto out;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->queued || pool->running)
+		pthread_cond_wait(&pool->cond_idle, &pool->mutex);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->cond_work);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		struct task_worker *w = &pool->workers[i];
+		int err = pthread_join(w->thread, NULL);
+
+		if (err)
+			die(_("unable to join thread: %s"), strerror(err));
+		free(w->deque.tasks);
+	}
+	pthread_key_delete(pool->current);
+	pthread_cond_destroy(&pool->cond_idle);
+	pthread_cond_destroy(&pool->cond_work);
+	pthread_mutex_destroy(&pool->mutex);
+
+out:
+	trace2_region_leave("task-pool", pool->label, NULL);
+	free(pool->workers);
+	free(pool);
+}
+
+struct parallel_for_range {
+	parallel_for_fn fn;
+	void *data;
+	size_t begin, end;
+};
+
+static void run_range(void *data, int worker)
+{
+	struct parallel_for_range *r = data;
+
+	r->fn(r->begin, r->end, worker, r->data);
+}
+
+void parallel_for(const char *label, int nr_workers, size_t nr, size_t chunk,
+		  parallel_for_fn fn, void *data)
+{
+	struct task_pool *pool;
+	struct parallel_for_range *ranges;
+	size_t nr_ranges, i;
+
+	if (!nr)
+		return;
+	if (!chunk)
+		chunk = 1;
+	nr_ranges = DIV_ROUND_UP(nr, chunk);
+	ALLOC_ARRAY(ranges, nr_ranges);
+
+	pool = task_pool_start(label, nr_workers);
+	for (i = 0; i < nr_ranges; i++) {
+		struct parallel_for_range *r = &ranges[i];
+		struct task t = { run_range, r };
+
+		r->fn = fn;
+		r->data = data;
+		r->begin = i * chunk;
+		r->end = r->begin + chunk < nr ? r->begin + chunk : nr;
+
+		if (!HAVE_THREADS)
+			run_task(&pool->workers[0], &t);
+		else
+			queue_task(pool,
+				   &pool->workers[st_mult(i, pool->nr_workers) / nr_ranges],
+				   &t);
+	}
+	task_pool_finish(pool);
+	free(ranges);
+}
@@ -0,0 +1,52 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+/*
+ * A pool of worker threads that run tasks, balancing the load by work
+ * stealing: every worker has its own queue of tasks and runs them from
+ * the front, and a worker whose queue is empty takes the task at the
+ * back of the queue of another worker.
+ *
+ * Workers are numbered from 0 to nr_workers - 1 and tasks are told the
+ * number of the worker running them, so that callers can keep per-worker
+ * state (buffers, caches, file descriptors) in an array without locking.
+ *
+ * Each worker reports the number of tasks it ran, how many of them it
+ * stole, and the time spent in tasks through trace2, in the "task-pool"
+ * category.
+ *
+ * Without thread support, tasks run right away in the calling thread.
+ */
+
+struct task_pool;
+
+typedef void (*task_fn)(void *data, int worker);
+
+/*
+ * Start "nr_workers" threads; "label" names them and the trace2 region
+ * covering the life of the pool.
+ */
+struct task_pool *task_pool_start(const char *label, int nr_workers);
+
+/*
+ * Queue a task.  Tasks added by the main thread are spread over the
+ * workers in turn; tasks added by a running task go to the queue of
+ * the worker running it.
+ */
+void task_pool_add(struct task_pool *pool, task_fn fn, void *data);
+
+/* Wait for all tasks to finish, stop the workers and free the pool. */
+void task_pool_finish(struct task_pool *pool);
+
+typedef void (*parallel_for_fn)(size_t begin, size_t end, int worker,
+				void *data);
+
+/*
+ * Call fn() on consecutive ranges of at most "chunk" of the integers in
+ * [0, nr) using "nr_workers" threads, and return when all are done.
+ * Each worker starts with an equal share of neighbouring ranges.
+ */
+void parallel_for(const char *label, int nr_workers, size_t nr, size_t chunk,
+		  parallel_for_fn fn, void *data);
+
+#endif
@@ -11,6 +11,7 @@
 struct tmp_objdir {
 	struct strbuf path;
 	struct argv_array env;
+	struct object_directory *odb; /* if primary, see replace_primary_odb */
 };
 
 /*
@@ -38,6 +39,11 @@ static int tmp_objdir_destroy_1(struct tmp_objdir *t, int on_signal)
 	if (t == the_tmp_objdir)
 		the_tmp_objdir = NULL;
 
+	if (!on_signal && t->odb) {
+		restore_primary_odb(t->odb);
+		t->odb = NULL;
+	}
+
 	/*
 	 * This may use malloc via strbuf_grow(), but we should
 	 * have pre-grown t->path sufficiently so that this
@@ -130,6 +136,7 @@ struct tmp_objdir *tmp_objdir_create(void)
 		BUG("only one tmp_objdir can be used at a time");
 
 	t = xmalloc(sizeof(*t));
+	t->odb = NULL;
 	strbuf_init(&t->path, 0);
 	argv_array_init(&t->env);
 
@@ -267,6 +274,11 @@ int tmp_objdir_migrate(struct tmp_objdir *t)
 	if (!t)
 		return 0;
 
+	if (t->odb) {
+		restore_primary_odb(t->odb);
+		t->odb = NULL;
+	}
+
 	strbuf_addbuf(&src, &t->path);
 	strbuf_addstr(&dst, get_object_directory());
 
@@ -290,3 +302,17 @@ void tmp_objdir_add_as_alternate(const struct tmp_objdir *t)
 {
 	add_to_alternates_memory(t->path.buf);
 }
+
+void tmp_objdir_replace_primary_odb(struct tmp_objdir *t)
+{
+	if (t->odb)
+		BUG("the tmp_objdir is already the primary object directory");
+	t->odb = set_temporary_primary_odb(t->path.buf);
+}
+
+void tmp_objdir_discard_objects(struct tmp_objdir *t)
+{
+	remove_dir_recursively(&t->path, REMOVE_DIR_KEEP_TOPLEVEL);
+	if (t->odb)
+		odb_clear_loose_cache(t->odb);
+}
@@ -51,4 +51,17 @@ int tmp_objdir_destroy(struct tmp_objdir *);
  */
 void tmp_objdir_add_as_alternate(const struct tmp_objdir *);
 
+/*
+ * Write new objects of this process to the tmp_objdir instead of the
+ * repository, while still reading the objects of the repository.  This
+ * is undone when the tmp_objdir is destroyed or migrated.
+ */
+void tmp_objdir_replace_primary_odb(struct tmp_objdir *);
+
+/*
+ * Remove all objects written to the tmp_objdir so far, e.g. once they
+ * are no longer needed by a caller that only uses them temporarily.
+ */
+void tmp_objdir_discard_objects(struct tmp_objdir *);
+
 #endif /* TMP_OBJDIR_H */
@@ -5,6 +5,7 @@
 #include "run-command.h"
 #include "remote.h"
 #include "list-objects-filter-options.h"
+#include "string-list.h"
 
 struct string_list;
 
@@ -98,7 +99,7 @@ struct transport {
 	 */
 	const struct string_list *server_options;
 
-	char *pack_lockfile;
+	struct string_list pack_lockfiles;
 	signed verbose : 3;
 	/**
 	 * Transports should not set this directly, and should use this
@@ -0,0 +1,701 @@
+#include "cache.h"
+#include "repository.h"
+#include "object-store.h"
+#include "refs.h"
+#include "tag.h"
+#include "commit.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "oidset.h"
+#include "sha1-array.h"
+#include "string-list.h"
+#include "lockfile.h"
+#include "csum-file.h"
+#include "progress.h"
+#include "varint.h"
+#include "ewah/ewok.h"
+#include "trigram-index.h"
+
+#define TRIGRAM_SIGNATURE 0x5452474d /* "TRGM" */
+#define TRIGRAM_VERSION 1
+
+/*
+ * The file starts with the signature, the version, the hash algorithm,
+ * the number of blobs and the number of trigrams, followed by a
+ * 256-entry fanout of the first byte of the object names of the blobs
+ * and the sorted object names themselves.
+ *
+ * Then comes a table of the sorted trigrams, each with the offset of
+ * its posting list, followed by one more entry whose offset is the
+ * total size of the posting lists.  A posting list holds the positions
+ * of the blobs that contain the trigram in the list of object names,
+ * in increasing order, each stored as a varint of its distance from
+ * the previous one minus one.  The file ends with a checksum.
+ *
+ * All fixed-size numbers are in network byte order.
+ */
+#define HEADER_SIZE 20
+#define FANOUT_SIZE (256 * 4)
+#define TABLE_ENTRY_SIZE 8
+
+/*
+ * Larger blobs are left out of the index; collecting their trigrams
+ * would take a lot of memory, and they are few.
+ */
+#define TRIGRAM_MAX_BLOB_SIZE (16 * 1024 * 1024)
+
+struct trigram_index {
+	const unsigned char *map;
+	size_t size;
+	uint32_t nr_blobs;
+	uint32_t nr_trigrams;
+	const unsigned char *fanout;
+	const unsigned char *oids;
+	const unsigned char *table;
+	const unsigned char *postings;
+	size_t postings_size;
+};
+
+static char *trigram_index_path(struct repository *r)
+{
+	return xstrfmt("%s/info/trigrams", r->objects->odb->path);
+}
+
+static void unmap_index(struct trigram_index *idx)
+{
+	if (idx->map)
+		munmap((void *)idx->map, idx->size);
+	memset(idx, 0, sizeof(*idx));
+}
+
+static int map_index(struct trigram_index *idx, const char *path)
+{
+	size_t hashsz = the_hash_algo->rawsz;
+	size_t avail, need;
+	struct stat st;
+	int fd = git_open(path);
+	uint32_t i;
+
+	memset(idx, 0, sizeof(*idx));
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) ||
+	    st.st_size < HEADER_SIZE + FANOUT_SIZE + hashsz) {
+		close(fd);
+		return -1;
+	}
+	idx->size = xsize_t(st.st_size);
+	idx->map = xmmap(NULL, idx->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (get_be32(idx->map) != TRIGRAM_SIGNATURE ||
+	    get_be32(idx->map + 4) != TRIGRAM_VERSION ||
+	    get_be32(idx->map + 8) != the_hash_algo->format_id)
+		goto corrupt;
+	idx->nr_blobs = get_be32(idx->map + 12);
+	idx->nr_trigrams = get_be32(idx->map + 16);
+	idx->fanout = idx->map + HEADER_SIZE;
+	if (get_be32(idx->fanout + 255 * 4) != idx->nr_blobs)
+		goto corrupt;
+
+	avail = idx->size - HEADER_SIZE - FANOUT_SIZE - hashsz;
+	need = st_add(st_mult(idx->nr_blobs, hashsz),
+		      st_mult(st_add(idx->nr_trigrams, 1), TABLE_ENTRY_SIZE));
+	if (avail < need)
+		goto corrupt;
+	idx->oids = idx->fanout + FANOUT_SIZE;
+	idx->table = idx->oids + (size_t)idx->nr_blobs * hashsz;
+	idx->postings = idx->table +
+		((size_t)idx->nr_trigrams + 1) * TABLE_ENTRY_SIZE;
+	idx->postings_size = get_be32(idx->table +
+				      (size_t)idx->nr_trigrams * TABLE_ENTRY_SIZE + 4);
+	if (avail - need != idx->postings_size)
+		goto corrupt;
+	for (i = 0; i < idx->nr_trigrams; i++)
+		if (get_be32(idx->table + (size_t)i * TABLE_ENTRY_SIZE + 4) >
+		    get_be32(idx->table + (size_t)(i + 1) * TABLE_ENTRY_SIZE + 4))
+			goto corrupt;
+	return 0;
+
+corrupt:
+	warning(_("ignoring corrupt trigram index '%s'"), path);
+	unmap_index(idx);
+	return -1;
+}
+
+static int index_lookup_blob(const struct trigram_index *idx,
+			     const struct object_id *oid, uint32_t *pos)
+{
+	size_t hashsz = the_hash_algo->rawsz;
+	int first = oid->hash[0];
+	uint32_t lo, hi;
+
+	lo = first ? get_be32(idx->fanout + (first - 1) * 4) : 0;
+	hi = get_be32(idx->fanout + first * 4);
+	if (hi > idx->nr_blobs)
+		return 0;
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = hashcmp(oid->hash, idx->oids + (size_t)mi * hashsz);
+
+		if (!cmp) {
+			*pos = mi;
+			return 1;
+		}
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+/*
+ * Find the posting list of "trigram", returning its bounds in "start"
+ * and "end", or 0 if no blob contains it.
+ */
+static int index_lookup_trigram(const struct trigram_index *idx,
+				uint32_t trigram,
+				const unsigned char **start,
+				const unsigned char **end)
+{
+	uint32_t lo = 0, hi = idx->nr_trigrams;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		const unsigned char *ent = idx->table + (size_t)mi * TABLE_ENTRY_SIZE;
+		uint32_t t = get_be32(ent);
+
+		if (t == trigram) {
+			*start = idx->postings + get_be32(ent + 4);
+			*end = idx->postings + get_be32(ent + TABLE_ENTRY_SIZE + 4);
+			return 1;
+		}
+		if (trigram < t)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+/*
+ * Like decode_varint(), but returns -1 instead of reading past "end",
+ * which a corrupt posting list could make it do.
+ */
+static int decode_posting_gap(const unsigned char **p,
+			      const unsigned char *end, uint64_t *gap)
+{
+	const unsigned char *buf = *p;
+	unsigned char c;
+	uint64_t val;
+
+	if (buf >= end)
+		return -1;
+	c = *buf++;
+	val = c & 127;
+	while (c & 128) {
+		val += 1;
+		if (!val || MSB(val, 7) || buf >= end)
+			return -1;
+		c = *buf++;
+		val = (val << 7) + (c & 127);
+	}
+	*p = buf;
+	*gap = val;
+	return 0;
+}
+
+/*
+ * Decode the posting list between "p" and "end" into "out", which must
+ * have room for one position per byte.  Returns the number of positions,
+ * or -1 if the list is corrupt or points outside of the index.
+ */
+static int decode_postings(const struct trigram_index *idx,
+			   const unsigned char *p, const unsigned char *end,
+			   uint32_t *out)
+{
+	uint64_t pos = 0, gap;
+	int nr = 0;
+
+	while (p < end) {
+		if (decode_posting_gap(&p, end, &gap))
+			return -1;
+		pos += gap + (nr ? 1 : 0);
+		if (pos >= idx->nr_blobs)
+			return -1;
+		out[nr++] = pos;
+	}
+	return nr;
+}
+
+static inline unsigned char fold_byte(unsigned char c)
+{
+	return tolower(c);
+}
+
+static inline uint32_t make_trigram(const unsigned char *s)
+{
+	return (fold_byte(s[0]) << 16) | (fold_byte(s[1]) << 8) | fold_byte(s[2]);
+}
+
+static int cmp_u32(const void *a_, const void *b_)
+{
+	uint32_t a = *(const uint32_t *)a_, b = *(const uint32_t *)b_;
+
+	return a < b ? -1 : a > b;
+}
+
+static int cmp_u64(const void *a_, const void *b_)
+{
+	uint64_t a = *(const uint64_t *)a_, b = *(const uint64_t *)b_;
+
+	return a < b ? -1 : a > b;
+}
+
+/*
+ * Collect the distinct trigrams of "buf" into "out", which must have
+ * room for "len" entries, and return their number.
+ */
+static size_t blob_trigrams(const unsigned char *buf, size_t len,
+			    uint32_t *out)
+{
+	size_t i, nr = 0, unique = 0;
+
+	for (i = 0; i + 2 < len; i++) {
+		if (buf[i] == '\n' || buf[i + 1] == '\n' || buf[i + 2] == '\n')
+			continue;
+		out[nr++] = make_trigram(buf + i);
+	}
+	QSORT(out, nr, cmp_u32);
+	for (i = 0; i < nr; i++)
+		if (!unique || out[unique - 1] != out[i])
+			out[unique++] = out[i];
+	return unique;
+}
+
+struct blob_walk {
+	struct repository *repo;
+	struct oidset trees;
+	struct oidset blobs;
+};
+
+static void walk_tree(struct blob_walk *w, const struct object_id *oid)
+{
+	struct tree_desc desc;
+	struct name_entry entry;
+	enum object_type type;
+	unsigned long size;
+	void *buf;
+
+	if (oidset_insert(&w->trees, oid))
+		return;
+	buf = read_object_file(oid, &type, &size);
+	if (!buf || type != OBJ_TREE) {
+		free(buf);
+		return;
+	}
+	init_tree_desc(&desc, buf, size);
+	while (tree_entry(&desc, &entry)) {
+		if (S_ISDIR(entry.mode))
+			walk_tree(w, &entry.oid);
+		else if (S_ISREG(entry.mode))
+			oidset_insert(&w->blobs, &entry.oid);
+	}
+	free(buf);
+}
+
+static int add_ref_blobs(const char *refname, const struct object_id *oid,
+			 int flags, void *cb_data)
+{
+	struct blob_walk *w = cb_data;
+	struct object *obj = parse_object(w->repo, oid);
+
+	obj = deref_tag(w->repo, obj, refname, 0);
+	if (!obj)
+		return 0;
+	if (obj->type == OBJ_COMMIT) {
+		struct tree *tree = get_commit_tree((struct commit *)obj);
+		if (tree)
+			walk_tree(w, &tree->object.oid);
+	} else if (obj->type == OBJ_TREE) {
+		walk_tree(w, &obj->oid);
+	} else if (obj->type == OBJ_BLOB) {
+		oidset_insert(&w->blobs, &obj->oid);
+	}
+	return 0;
+}
+
+static int cmp_oid(const void *a, const void *b)
+{
+	return oidcmp(a, b);
+}
+
+/* The posting lists of the index being written, in trigram order. */
+struct postings_writer {
+	struct strbuf postings;
+	uint32_t *trigrams, *offsets;
+	size_t nr_trigrams, alloc;
+	uint32_t last;
+};
+
+static void add_posting(struct postings_writer *pw,
+			uint32_t trigram, uint32_t pos)
+{
+	unsigned char varint[16];
+
+	if (!pw->nr_trigrams || pw->trigrams[pw->nr_trigrams - 1] != trigram) {
+		ALLOC_GROW(pw->trigrams, pw->nr_trigrams + 1, pw->alloc);
+		REALLOC_ARRAY(pw->offsets, pw->alloc);
+		pw->trigrams[pw->nr_trigrams] = trigram;
+		pw->offsets[pw->nr_trigrams] = pw->postings.len;
+		pw->nr_trigrams++;
+		strbuf_add(&pw->postings, varint, encode_varint(pos, varint));
+	} else {
+		strbuf_add(&pw->postings, varint,
+			   encode_varint(pos - pw->last - 1, varint));
+	}
+	pw->last = pos;
+}
+
+/*
+ * Merge the posting lists of "old", whose positions "old_final" maps
+ * to positions in the new index (or UINT32_MAX for blobs that are no
+ * longer wanted), with the sorted (trigram, position) pairs of the
+ * blobs that were read, one trigram at a time.  Returns -1 if "old" is
+ * corrupt.
+ */
+static int merge_postings(struct postings_writer *pw,
+			  const struct trigram_index *old,
+			  const uint32_t *old_final,
+			  const uint64_t *pairs, size_t nr_pairs)
+{
+	uint32_t *positions = NULL;
+	size_t positions_alloc = 0, k = 0;
+	uint32_t i = 0;
+	int j, nr;
+
+	while (i < old->nr_trigrams || k < nr_pairs) {
+		const unsigned char *ent = old->table + (size_t)i * TABLE_ENTRY_SIZE;
+		const unsigned char *start, *end;
+		uint32_t trigram;
+
+		if (i == old->nr_trigrams ||
+		    (k < nr_pairs && pairs[k] >> 32 < get_be32(ent))) {
+			trigram = pairs[k] >> 32;
+			while (k < nr_pairs && pairs[k] >> 32 == trigram)
+				add_posting(pw, trigram, pairs[k++] & 0xffffffff);
+			continue;
+		}
+
+		trigram = get_be32(ent);
+		start = old->postings + get_be32(ent + 4);
+		end = old->postings + get_be32(ent + TABLE_ENTRY_SIZE + 4);
+		ALLOC_GROW(positions, end - start, positions_alloc);
+		nr = decode_postings(old, start, end, positions);
+		if (nr < 0) {
+			free(positions);
+			return -1;
+		}
+		/* both lists are sorted, as blobs are ordered by name */
+		for (j = 0; j < nr; j++) {
+			uint32_t pos = old_final[positions[j]];
+
+			if (pos == UINT32_MAX)
+				continue;
+			while (k < nr_pairs && pairs[k] >> 32 == trigram &&
+			       (pairs[k] & 0xffffffff) < pos)
+				add_posting(pw, trigram, pairs[k++] & 0xffffffff);
+			add_posting(pw, trigram, pos);
+		}
+		while (k < nr_pairs && pairs[k] >> 32 == trigram)
+			add_posting(pw, trigram, pairs[k++] & 0xffffffff);
+		i++;
+	}
+	free(positions);
+	return 0;
+}
+
+static void write_index_file(struct repository *r, const char *path,
+			     const struct oid_array *blobs,
+			     const unsigned char *indexed,
+			     const struct postings_writer *pw)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct hashfile *f;
+	uint32_t fanout[256] = { 0 };
+	uint32_t nr_blobs = 0;
+	size_t i;
+
+	for (i = 0; i < blobs->nr; i++) {
+		if (!indexed[i])
+			continue;
+		fanout[blobs->oid[i].hash[0]]++;
+		nr_blobs++;
+	}
+	for (i = 1; i < 256; i++)
+		fanout[i] += fanout[i - 1];
+
+	if (pw->postings.len > 0xffffffff)
+		die(_("trigram index is too large"));
+
+	if (safe_create_leading_directories_const(path))
+		die_errno(_("unable to create leading directories of %s"), path);
+	hold_lock_file_for_update(&lk, path, LOCK_DIE_ON_ERROR);
+	f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+
+	hashwrite_be32(f, TRIGRAM_SIGNATURE);
+	hashwrite_be32(f, TRIGRAM_VERSION);
+	hashwrite_be32(f, the_hash_algo->format_id);
+	hashwrite_be32(f, nr_blobs);
+	hashwrite_be32(f, pw->nr_trigrams);
+	for (i = 0; i < 256; i++)
+		hashwrite_be32(f, fanout[i]);
+	for (i = 0; i < blobs->nr; i++)
+		if (indexed[i])
+			hashwrite(f, blobs->oid[i].hash, the_hash_algo->rawsz);
+	for (i = 0; i < pw->nr_trigrams; i++) {
+		hashwrite_be32(f, pw->trigrams[i]);
+		hashwrite_be32(f, pw->offsets[i]);
+	}
+	hashwrite_be32(f, 0xffffffff);
+	hashwrite_be32(f, pw->postings.len);
+	hashwrite(f, pw->postings.buf, pw->postings.len);
+
+	finalize_hashfile(f, NULL, CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	commit_lock_file(&lk);
+}
+
+int write_trigram_index(struct repository *r, unsigned flags)
+{
+	struct blob_walk w = { r, OIDSET_INIT, OIDSET_INIT };
+	struct oidset_iter iter;
+	const struct object_id *oid;
+	struct oid_array blobs = OID_ARRAY_INIT;
+	struct trigram_index old;
+	struct progress *progress = NULL;
+	struct postings_writer pw = { STRBUF_INIT };
+	unsigned char *indexed;
+	uint32_t *old_to_pos = NULL, *trigrams = NULL, *final_pos;
+	uint64_t *pairs = NULL;
+	size_t nr_pairs = 0, alloc_pairs = 0, trigrams_alloc = 0, i, j;
+	uint32_t nr_indexed = 0;
+	int ret;
+	char *path = trigram_index_path(r);
+
+	head_ref(add_ref_blobs, &w);
+	for_each_ref(add_ref_blobs, &w);
+	oidset_iter_init(&w.blobs, &iter);
+	while ((oid = oidset_iter_next(&iter)))
+		oid_array_append(&blobs, oid);
+	QSORT(blobs.oid, blobs.nr, cmp_oid);
+	oidset_clear(&w.trees);
+	oidset_clear(&w.blobs);
+
+	if (!map_index(&old, path)) {
+		ALLOC_ARRAY(old_to_pos, old.nr_blobs);
+		for (i = 0; i < old.nr_blobs; i++)
+			old_to_pos[i] = UINT32_MAX;
+	}
+
+	indexed = xcalloc(blobs.nr, 1);
+	if (flags & TRIGRAM_INDEX_PROGRESS)
+		progress = start_delayed_progress(_("Indexing blobs for grep"),
+						  blobs.nr);
+	for (i = 0; i < blobs.nr; i++) {
+		enum object_type type;
+		unsigned long size;
+		uint32_t pos;
+		size_t nr;
+		void *buf;
+
+		display_progress(progress, i + 1);
+		if (old.map && index_lookup_blob(&old, &blobs.oid[i], &pos)) {
+			old_to_pos[pos] = i;
+			indexed[i] = 1;
+			continue;
+		}
+		if (oid_object_info(r, &blobs.oid[i], &size) != OBJ_BLOB ||
+		    size > TRIGRAM_MAX_BLOB_SIZE)
+			continue;
+		buf = read_object_file(&blobs.oid[i], &type, &size);
+		if (!buf)
+			continue;
+		ALLOC_GROW(trigrams, size, trigrams_alloc);
+		nr = blob_trigrams(buf, size, trigrams);
+		ALLOC_GROW(pairs, nr_pairs + nr, alloc_pairs);
+		for (j = 0; j < nr; j++)
+			pairs[nr_pairs++] = ((uint64_t)trigrams[j] << 32) | i;
+		indexed[i] = 1;
+		free(buf);
+	}
+	stop_progress(&progress);
+	free(trigrams);
+
+	ALLOC_ARRAY(final_pos, blobs.nr);
+	for (i = 0; i < blobs.nr; i++)
+		final_pos[i] = indexed[i] ? nr_indexed++ : UINT32_MAX;
+	for (i = 0; i < nr_pairs; i++)
+		pairs[i] = (pairs[i] & ~(uint64_t)0xffffffff) |
+			final_pos[pairs[i] & 0xffffffff];
+	QSORT(pairs, nr_pairs, cmp_u64);
+	for (i = 0; i < old.nr_blobs; i++)
+		if (old_to_pos[i] != UINT32_MAX)
+			old_to_pos[i] = final_pos[old_to_pos[i]];
+
+	ret = merge_postings(&pw, &old, old_to_pos, pairs, nr_pairs);
+	unmap_index(&old);
+	free(old_to_pos);
+	free(final_pos);
+	free(pairs);
+	if (ret < 0) {
+		/* start over without the corrupt index */
+		warning(_("rewriting corrupt trigram index '%s'"), path);
+		unlink(path);
+		strbuf_release(&pw.postings);
+		free(pw.trigrams);
+		free(pw.offsets);
+		free(indexed);
+		oid_array_clear(&blobs);
+		free(path);
+		return write_trigram_index(r, flags);
+	}
+
+	write_index_file(r, path, &blobs, indexed, &pw);
+
+	strbuf_release(&pw.postings);
+	free(pw.trigrams);
+	free(pw.offsets);
+	free(indexed);
+	oid_array_clear(&blobs);
+	free(path);
+	return 0;
+}
+
+struct trigram_filter {
+	struct trigram_index index;
+	struct bitmap *candidates;
+};
+
+struct trigram_filter *trigram_filter_new(struct repository *r)
+{
+	struct trigram_filter *f = xcalloc(1, sizeof(*f));
+	char *path = trigram_index_path(r);
+
+	if (map_index(&f->index, path)) {
+		free(path);
+		free(f);
+		return NULL;
+	}
+	free(path);
+	f->candidates = bitmap_new();
+	return f;
+}
+
+struct trigram_posting {
+	const unsigned char *start, *end;
+};
+
+static int cmp_posting_size(const void *a_, const void *b_)
+{
+	const struct trigram_posting *a = a_, *b = b_;
+	ptrdiff_t la = a->end - a->start, lb = b->end - b->start;
+
+	return la < lb ? -1 : la > lb;
+}
+
+int trigram_filter_add(struct trigram_filter *f,
+		       const struct string_list *literals,
+		       int ignore_case)
+{
+	struct trigram_posting *postings = NULL;
+	size_t nr = 0, alloc = 0, i;
+	uint32_t *result = NULL, *next = NULL;
+	int result_nr = 0;
+	const struct string_list_item *item;
+
+	for_each_string_list_item(item, literals) {
+		const unsigned char *s = (const unsigned char *)item->string;
+		size_t len = strlen(item->string);
+
+		for (i = 0; i + 2 < len; i++) {
+			if (s[i] == '\n' || s[i + 1] == '\n' || s[i + 2] == '\n')
+				continue;
+			if (ignore_case &&
+			    ((s[i] | s[i + 1] | s[i + 2]) & 0x80))
+				continue;
+			ALLOC_GROW(postings, nr + 1, alloc);
+			if (!index_lookup_trigram(&f->index, make_trigram(s + i),
+						  &postings[nr].start,
+						  &postings[nr].end)) {
+				/* no blob in the index contains this one */
+				free(postings);
+				return 0;
+			}
+			nr++;
+		}
+	}
+	if (!nr) {
+		free(postings);
+		return -1;
+	}
+
+	/* intersect the posting lists, the shortest first */
+	QSORT(postings, nr, cmp_posting_size);
+	ALLOC_ARRAY(result, postings[0].end - postings[0].start);
+	result_nr = decode_postings(&f->index, postings[0].start,
+				    postings[0].end, result);
+	ALLOC_ARRAY(next, postings[0].end - postings[0].start);
+	for (i = 1; i < nr && result_nr > 0; i++) {
+		const unsigned char *p = postings[i].start;
+		uint64_t pos = 0, gap;
+		int first = 1, kept = 0, k = 0;
+
+		while (p < postings[i].end && k < result_nr) {
+			if (decode_posting_gap(&p, postings[i].end, &gap)) {
+				result_nr = -1;
+				break;
+			}
+			pos += gap + (first ? 0 : 1);
+			first = 0;
+			while (k < result_nr && result[k] < pos)
+				k++;
+			if (k < result_nr && result[k] == pos)
+				next[kept++] = result[k++];
+		}
+		if (result_nr < 0)
+			break;
+		SWAP(result, next);
+		result_nr = kept;
+	}
+	for (i = 0; result_nr > 0 && i < result_nr; i++)
+		bitmap_set(f->candidates, result[i]);
+
+	free(result);
+	free(next);
+	free(postings);
+	if (result_nr < 0) {
+		warning(_("ignoring corrupt trigram index"));
+		return -1;
+	}
+	return 0;
+}
+
+int trigram_filter_may_match(struct trigram_filter *f,
+			     const struct object_id *oid)
+{
+	uint32_t pos;
+
+	if (!index_lookup_blob(&f->index, oid, &pos))
+		return 1;
+	return bitmap_get(f->candidates, pos);
+}
+
+void trigram_filter_free(struct trigram_filter *f)
+{
+	if (!f)
+		return;
+	unmap_index(&f->index);
+	bitmap_free(f->candidates);
+	free(f);
+}
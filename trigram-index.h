@@ -0,0 +1,58 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+struct repository;
+struct object_id;
+struct string_list;
+
+/*
+ * An index of the three-byte sequences (trigrams) that the blobs in
+ * the trees of the refs contain, stored in
+ * "$GIT_OBJECT_DIRECTORY/info/trigrams".  "git grep <tree>" uses it
+ * to skip the blobs that cannot match, without reading them.
+ *
+ * ASCII letters are folded to lowercase and trigrams containing a
+ * newline are left out, as no match crosses a line boundary.  Blobs
+ * that are not in the index, e.g. because they were added after it
+ * was written, are never skipped.
+ */
+
+#define TRIGRAM_INDEX_PROGRESS (1 << 0)
+
+/*
+ * Write the index for the blobs in the trees of all refs and HEAD.
+ * Blobs that are already in the existing index are not read again;
+ * their posting lists are merged with those of the new blobs one
+ * trigram at a time.  Memory use grows with the number of distinct
+ * trigrams of the new blobs, plus the size of the compressed posting
+ * lists of the whole index.
+ */
+int write_trigram_index(struct repository *r, unsigned flags);
+
+struct trigram_filter;
+
+/*
+ * Start a filter that rejects every blob in the index, or return NULL
+ * if there is no index.  Use trigram_filter_add() to let blobs
+ * through.
+ */
+struct trigram_filter *trigram_filter_new(struct repository *r);
+
+/*
+ * Let the blobs through that contain all of the "literals".  Returns
+ * -1 if the literals have no usable trigram, in which case the filter
+ * cannot reject anything and should not be used.  When "ignore_case"
+ * is set, trigrams with non-ASCII bytes are not used, as their case
+ * cannot be folded here.
+ */
+int trigram_filter_add(struct trigram_filter *f,
+		       const struct string_list *literals,
+		       int ignore_case);
+
+/* Return 0 if the blob "oid" is known not to pass the filter. */
+int trigram_filter_may_match(struct trigram_filter *f,
+			     const struct object_id *oid);
+
+void trigram_filter_free(struct trigram_filter *f);
+
+#endif
@@ -15,8 +15,10 @@
 #include "submodule.h"
 #include "submodule-config.h"
 #include "fsmonitor.h"
+#include "sparse-index.h"
 #include "object-store.h"
 #include "fetch-object.h"
+#include "parallel-checkout.h"
 
 /*
  * Error messages expected by scripts out of plumbing commands such as
@@ -365,7 +367,7 @@ static int check_updates(struct unpack_trees_options *o)
 	struct progress *progress;
 	struct index_state *index = &o->result;
 	struct checkout state = CHECKOUT_INIT;
-	int i;
+	int i, pc_workers, pc_threshold;
 
 	trace_performance_enter();
 	state.force = 1;
@@ -423,6 +425,10 @@ static int check_updates(struct unpack_trees_options *o)
 				      to_fetch.oid, to_fetch.nr);
 		oid_array_clear(&to_fetch);
 	}
+
+	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
+	if (pc_workers > 1 && o->update && !o->dry_run)
+		init_parallel_checkout();
 	for (i = 0; i < index->cache_nr; i++) {
 		struct cache_entry *ce = index->cache[i];
 
@@ -437,6 +443,8 @@ static int check_updates(struct unpack_trees_options *o)
 			}
 		}
 	}
+	if (parallel_checkout_status() == PC_ACCEPTING_ENTRIES)
+		errs |= run_parallel_checkout(&state, pc_workers, pc_threshold);
 	stop_progress(&progress);
 	errs |= finish_delayed_checkout(&state, NULL);
 	if (o->update)
@@ -930,6 +938,14 @@ static int compare_entry(const struct cache_entry *ce, const struct traverse_inf
 	if (cmp)
 		return cmp;
 
+	/*
+	 * A sparse directory entry of a sparse index is the directory
+	 * itself, followed by the trailing slash.
+	 */
+	if (S_ISSPARSEDIR(ce->ce_mode) && S_ISDIR(n->mode) &&
+	    ce_namelen(ce) == traverse_path_len(info, tree_entry_len(n)) + 1)
+		return 0;
+
 	/*
 	 * Even if the beginning compared identically, the ce should
 	 * compare as bigger than a directory leading up to it!
@@ -956,21 +972,28 @@ static struct cache_entry *create_ce_entry(const struct traverse_info *info,
 	const struct name_entry *n,
 	int stage,
 	struct index_state *istate,
-	int is_transient)
+	int is_transient,
+	int is_sparse_directory)
 {
 	size_t len = traverse_path_len(info, tree_entry_len(n));
+	size_t alloc_len = is_sparse_directory ? len + 1 : len;
 	struct cache_entry *ce =
 		is_transient ?
-		make_empty_transient_cache_entry(len) :
-		make_empty_cache_entry(istate, len);
+		make_empty_transient_cache_entry(alloc_len) :
+		make_empty_cache_entry(istate, alloc_len);
 
-	ce->ce_mode = create_ce_mode(n->mode);
+	ce->ce_mode = is_sparse_directory ? S_IFDIR : create_ce_mode(n->mode);
 	ce->ce_flags = create_ce_flags(stage);
-	ce->ce_namelen = len;
+	ce->ce_namelen = alloc_len;
 	oidcpy(&ce->oid, &n->oid);
 	/* len+1 because the cache_entry allocates space for NUL */
 	make_traverse_path(ce->name, len + 1, info, n->path, n->pathlen);
 
+	if (is_sparse_directory) {
+		ce->name[len] = '/';
+		ce->name[len + 1] = '\0';
+	}
+
 	return ce;
 }
 
@@ -988,11 +1011,19 @@ static int unpack_nondirectories(int n, unsigned long mask,
 	int i;
 	struct unpack_trees_options *o = info->data;
 	unsigned long conflicts = info->df_conflicts | dirmask;
+	int sparse_directory = src[0] && S_ISSPARSEDIR(src[0]->ce_mode);
 
 	/* Do we have *only* directories? Nothing to do */
 	if (mask == dirmask && !src[0])
 		return 0;
 
+	/*
+	 * The trees are compared with a sparse directory entry as a
+	 * whole, instead of being descended into.
+	 */
+	if (sparse_directory)
+		conflicts = info->df_conflicts;
+
 	/*
 	 * Ok, we've filled in up to any potential index entry in src[0],
 	 * now do the rest.
@@ -1022,7 +1053,9 @@ static int unpack_nondirectories(int n, unsigned long mask,
 		 * not stored in the index.  otherwise construct the
 		 * cache entry from the index aware logic.
 		 */
-		src[i + o->merge] = create_ce_entry(info, names + i, stage, &o->result, o->merge);
+		src[i + o->merge] = create_ce_entry(info, names + i, stage,
+						    &o->result, o->merge,
+						    sparse_directory && (dirmask & bit));
 	}
 
 	if (o->merge) {
@@ -1106,10 +1139,15 @@ static int find_cache_pos(struct traverse_info *info,
 		cmp = name_compare(p, p_len, ce_name, ce_len);
 		/*
 		 * Exact match; if we have a directory we need to
-		 * delay returning it.
+		 * delay returning it, unless it is a sparse directory
+		 * entry, which stands for the whole directory.
 		 */
-		if (!cmp)
+		if (!cmp) {
+			if (ce_slash && S_ISSPARSEDIR(ce->ce_mode) &&
+			    !ce_slash[1])
+				return pos;
 			return ce_slash ? -2 - pos : pos;
+		}
 		if (0 < cmp)
 			continue; /* keep looking */
 		/*
@@ -1238,6 +1276,10 @@ static int unpack_callback(int n, unsigned long mask, unsigned long dirmask, str
 
 	/* Now handle any directories.. */
 	if (dirmask) {
+		/* a sparse directory entry has been dealt with as a whole */
+		if (src[0] && S_ISSPARSEDIR(src[0]->ce_mode))
+			return mask;
+
 		/* special case: "diff-index --cached" looking at a tree */
 		if (o->diff_index_cached &&
 		    n == 1 && dirmask == 1 && S_ISDIR(names->mode)) {
@@ -1383,6 +1425,17 @@ static int clear_ce_flags_1(struct index_state *istate,
 			continue;
 		}
 
+		/*
+		 * A sparse directory entry ("prefix/" itself) takes the
+		 * decision made for the directory.
+		 */
+		if (S_ISSPARSEDIR(ce->ce_mode) && !*name) {
+			if (defval > 0)
+				ce->ce_flags &= ~clear_mask;
+			cache++;
+			continue;
+		}
+
 		/* Non-directory */
 		dtype = ce_to_dtype(ce);
 		ret = is_excluded_from_list(ce->name, ce_namelen(ce),
@@ -1475,8 +1528,19 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 		free(sparse);
 	}
 
+	/*
+	 * Sparse directory entries can be carried over as a whole by
+	 * merges that compare entire trees, as long as they stay outside
+	 * of the sparse-checkout cone; otherwise, work on a full index.
+	 */
+	if (o->src_index->sparse_index &&
+	    (o->fn == threeway_merge || o->fn == bind_merge ||
+	     !sparse_dirs_outside_cone(o->src_index)))
+		ensure_full_index(o->src_index);
+
 	memset(&o->result, 0, sizeof(o->result));
 	o->result.initialized = 1;
+	o->result.sparse_index = o->src_index->sparse_index;
 	o->result.timestamp.sec = o->src_index->timestamp.sec;
 	o->result.timestamp.nsec = o->src_index->timestamp.nsec;
 	o->result.version = o->src_index->version;
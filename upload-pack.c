@@ -348,7 +348,7 @@ static int got_oid(const char *hex, struct object_id *oid,
 static int ok_to_give_up(const struct object_array *have_obj,
 			 struct object_array *want_obj)
 {
-	uint32_t min_generation = GENERATION_NUMBER_ZERO;
+	timestamp_t min_generation = GENERATION_NUMBER_ZERO;
 
 	if (!have_obj->nr)
 		return 0;
@@ -1133,6 +1133,9 @@ struct upload_pack_data {
 	int deepen_rev_list;
 	int deepen_relative;
 
+	/* URI schemes the client can download cached packs from */
+	struct string_list uri_protocols;
+
 	struct packet_writer writer;
 
 	unsigned stateless_rpc : 1;
@@ -1151,6 +1154,7 @@ static void upload_pack_data_init(struct upload_pack_data *data)
 	struct oid_array haves = OID_ARRAY_INIT;
 	struct object_array shallows = OBJECT_ARRAY_INIT;
 	struct string_list deepen_not = STRING_LIST_INIT_DUP;
+	struct string_list uri_protocols = STRING_LIST_INIT_DUP;
 
 	memset(data, 0, sizeof(*data));
 	data->wants = wants;
@@ -1158,6 +1162,7 @@ static void upload_pack_data_init(struct upload_pack_data *data)
 	data->haves = haves;
 	data->shallows = shallows;
 	data->deepen_not = deepen_not;
+	data->uri_protocols = uri_protocols;
 	packet_writer_init(&data->writer, 1);
 }
 
@@ -1168,6 +1173,7 @@ static void upload_pack_data_clear(struct upload_pack_data *data)
 	oid_array_clear(&data->haves);
 	object_array_clear(&data->shallows);
 	string_list_clear(&data->deepen_not, 0);
+	string_list_clear(&data->uri_protocols, 0);
 }
 
 static int parse_want(struct packet_writer *writer, const char *line,
@@ -1309,6 +1315,11 @@ static void process_args(struct packet_reader *request,
 			continue;
 		}
 
+		if (skip_prefix(arg, "packfile-uris ", &p)) {
+			string_list_split(&data->uri_protocols, p, ',', -1);
+			continue;
+		}
+
 		if ((git_env_bool("GIT_TEST_SIDEBAND_ALL", 0) ||
 		     allow_sideband_all) &&
 		    !strcmp(arg, "sideband-all")) {
@@ -1429,6 +1440,101 @@ static void send_wanted_ref_info(struct upload_pack_data *data)
 	packet_writer_delim(&data->writer);
 }
 
+static int uri_protocol_requested(struct upload_pack_data *data,
+				  const char *uri)
+{
+	const struct string_list_item *item;
+	const char *p;
+
+	for_each_string_list_item(item, &data->uri_protocols)
+		if (skip_prefix(uri, item->string, &p) && starts_with(p, "://"))
+			return 1;
+	return 0;
+}
+
+/*
+ * A cached pack is a pre-generated pack holding every object reachable
+ * from its tips, which clients can download from elsewhere. Each one is
+ * configured as "uploadpack.cachedPack=<pack-hash> <uri> <tip>...".
+ *
+ * When the client has nothing in common with us and wants all tips of
+ * a cached pack, tell it to download that pack, and treat the tips as
+ * objects it has so that pack-objects only sends what is missing.
+ */
+static void send_cached_pack_uris(struct upload_pack_data *data,
+				  struct object_array *have_obj,
+				  const struct object_array *want_obj)
+{
+	const struct string_list *packs;
+	const struct string_list_item *item;
+	struct commit **wants = NULL;
+	int i, nr_wants = 0, alloc_wants = 0, nr_sent = 0;
+
+	if (!data->uri_protocols.nr || have_obj->nr ||
+	    data->depth || data->deepen_rev_list || data->shallows.nr ||
+	    is_repository_shallow(the_repository) || filter_options.choice)
+		return;
+
+	packs = repo_config_get_value_multi(the_repository,
+					    "uploadpack.cachedpack");
+	if (!packs)
+		return;
+
+	for (i = 0; i < want_obj->nr; i++) {
+		struct commit *commit = lookup_commit_reference_gently(
+			the_repository, &want_obj->objects[i].item->oid, 1);
+		if (!commit)
+			continue;
+		ALLOC_GROW(wants, nr_wants + 1, alloc_wants);
+		wants[nr_wants++] = commit;
+	}
+
+	for_each_string_list_item(item, packs) {
+		struct string_list fields = STRING_LIST_INIT_DUP;
+		struct object_array tips = OBJECT_ARRAY_INIT;
+		struct object_id oid;
+
+		string_list_split(&fields, item->string, ' ', -1);
+		if (fields.nr < 3 || get_oid_hex(fields.items[0].string, &oid)) {
+			warning(_("ignoring malformed uploadpack.cachedPack '%s'"),
+				item->string);
+			goto next;
+		}
+		if (!uri_protocol_requested(data, fields.items[1].string))
+			goto next;
+
+		for (i = 2; i < fields.nr; i++) {
+			struct commit *tip;
+
+			if (get_oid_hex(fields.items[i].string, &oid))
+				break;
+			tip = lookup_commit_reference_gently(the_repository,
+							     &oid, 1);
+			if (!tip || !repo_in_merge_bases_many(the_repository, tip,
+							      nr_wants, wants))
+				break;
+			add_object_array(&tip->object, NULL, &tips);
+		}
+		if (i < fields.nr)
+			goto next;
+
+		if (!nr_sent++)
+			packet_writer_write(&data->writer, "packfile-uris\n");
+		packet_writer_write(&data->writer, "%s %s\n",
+				    fields.items[0].string,
+				    fields.items[1].string);
+		for (i = 0; i < tips.nr; i++)
+			add_object_array(tips.objects[i].item, NULL, have_obj);
+next:
+		object_array_clear(&tips);
+		string_list_clear(&fields, 0);
+	}
+
+	if (nr_sent)
+		packet_writer_delim(&data->writer);
+	free(wants);
+}
+
 static void send_shallow_info(struct upload_pack_data *data,
 			      struct object_array *want_obj)
 {
@@ -1507,6 +1613,7 @@ int upload_pack_v2(struct repository *r, struct argv_array *keys,
 		case FETCH_SEND_PACK:
 			send_wanted_ref_info(&data);
 			send_shallow_info(&data, &want_obj);
+			send_cached_pack_uris(&data, &have_obj, &want_obj);
 
 			packet_writer_write(&data.writer, "packfile\n");
 			create_pack_file(&have_obj, &want_obj);
@@ -1551,6 +1658,10 @@ int upload_pack_advertise(struct repository *r,
 					   &allow_sideband_all_value) &&
 		     allow_sideband_all_value))
 			strbuf_addstr(value, " sideband-all");
+
+		if (repo_config_get_value_multi(the_repository,
+						"uploadpack.cachedpack"))
+			strbuf_addstr(value, " packfile-uris");
 	}
 
 	return 1;